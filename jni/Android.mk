@@ -1,8 +1,6 @@
 LOCAL_PATH := $(call my-dir)
 
-include $(CLEAR_VARS)
-
-LOCAL_SRC_FILES:= \
+bluetooth_jni_src_files := \
     com_android_bluetooth_btservice_AdapterService.cpp \
     com_android_bluetooth_btservice_QAdapterService.cpp \
     com_android_bluetooth_hfp.cpp \
@@ -16,8 +14,34 @@ LOCAL_SRC_FILES:= \
     com_android_bluetooth_hdp.cpp \
     com_android_bluetooth_pan.cpp \
     com_android_bluetooth_gatt.cpp \
+    com_android_bluetooth_address_cache.cpp \
+    com_android_bluetooth_adv_parser.cpp \
+    com_android_bluetooth_adv_payload.cpp \
+    com_android_bluetooth_adv_sched.cpp \
+    com_android_bluetooth_apcf.cpp \
+    com_android_bluetooth_attr_store.cpp \
+    com_android_bluetooth_batch_scan.cpp \
+    com_android_bluetooth_discovery.cpp \
+    com_android_bluetooth_gatt_cache.cpp \
+    com_android_bluetooth_notify_batch.cpp \
+    com_android_bluetooth_notify_fanout.cpp \
+    com_android_bluetooth_notify_stream.cpp \
+    com_android_bluetooth_notify_token.cpp \
+    com_android_bluetooth_prep_write.cpp \
+    com_android_bluetooth_record_batch.cpp \
+    com_android_bluetooth_scan_dedup.cpp \
+    com_android_bluetooth_scan_filter.cpp \
+    com_android_bluetooth_scan_ring.cpp \
+    com_android_bluetooth_subscription.cpp \
+    com_android_bluetooth_track_adv.cpp \
+    com_android_bluetooth_upcall_queue.cpp \
+    com_android_bluetooth_write_pipe.cpp \
     android_hardware_wipower.cpp
 
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(bluetooth_jni_src_files)
+
 LOCAL_C_INCLUDES += \
     $(JNI_H_INCLUDE) \
 
@@ -37,3 +61,5 @@ LOCAL_MODULE := libbluetooth_jni
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -0,0 +1,79 @@
+LOCAL_PATH := $(call my-dir)
+
+# Host stand-ins for the service classes libbluetooth_jni registers against.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(call all-java-files-under, java/src)
+
+LOCAL_MODULE := bluetooth-jni-benchmark-stubs
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_DALVIK_JAVA_LIBRARY)
+
+# Replays HAL callbacks through the JNI layer into an embedded VM.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    $(addprefix ../,$(bluetooth_jni_src_files)) \
+    fake_hal.cpp \
+    callback_replay.cpp \
+    host_runtime.cpp \
+    jni_callback_benchmark.cpp
+
+LOCAL_C_INCLUDES += \
+    $(LOCAL_PATH)/include \
+    $(LOCAL_PATH)/.. \
+    $(JNI_H_INCLUDE) \
+
+LOCAL_SHARED_LIBRARIES := \
+    libnativehelper
+
+LOCAL_STATIC_LIBRARIES := \
+    libutils \
+    libcutils \
+    liblog
+
+LOCAL_LDLIBS := -lpthread -lrt -ldl
+
+LOCAL_REQUIRED_MODULES := bluetooth-jni-benchmark-stubs
+
+LOCAL_MODULE := bluetooth_jni_callback_benchmark
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Parses a corpus of advertising payloads with the native AD structure parser.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    ../com_android_bluetooth_adv_parser.cpp \
+    adv_parser_benchmark.cpp
+
+LOCAL_C_INCLUDES += \
+    $(LOCAL_PATH)/..
+
+LOCAL_MODULE := bluetooth_adv_parser_benchmark
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Matches advertisements against a growing set of compiled software scan filters.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    ../com_android_bluetooth_adv_parser.cpp \
+    ../com_android_bluetooth_apcf.cpp \
+    apcf_benchmark.cpp
+
+LOCAL_C_INCLUDES += \
+    $(LOCAL_PATH)/..
+
+LOCAL_STATIC_LIBRARIES := \
+    liblog
+
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE := bluetooth_apcf_benchmark
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
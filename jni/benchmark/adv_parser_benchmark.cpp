@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measures com_android_bluetooth_adv_parser against a corpus of advertising
+ * payloads in the formats commonly seen in the field, laid out the way
+ * btgattc_scan_result_cb receives them: advertising data, then the scan
+ * response, zero padded to 62 bytes.
+ *
+ *   bluetooth_adv_parser_benchmark [--iterations <n>]
+ */
+
+#define LOG_TAG "BtAdvParserBenchmark"
+
+#include "com_android_bluetooth_adv_parser.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+using namespace android;
+
+typedef struct {
+    const char *name;
+    const char *adv;            // hex
+    const char *scan_response;  // hex
+} adv_sample_t;
+
+static const adv_sample_t sCorpus[] = {
+    {"ibeacon",
+     "0201061aff4c000215f7826da64fa24e988024bc5b71e0893e27101a0bc5", ""},
+    {"eddystone_uid",
+     "0201060303aafe1716aafe00eb8b0c0e6a1f4d3c9b2a10e5d2c4b7a69f830000", ""},
+    {"eddystone_url",
+     "0201060303aafe1016aafe10eb03676f6f676c6507", ""},
+    {"apple_nearby",
+     "02011a0aff4c0010050b1c5e2a9b", ""},
+    {"heart_rate",
+     "0201060502 0d180a18", "0d09506f6c6172204837203132 33 020a00"},
+    {"fast_pair",
+     "0201060303 2cfe06162cfe00004502 0aec", ""},
+    {"microsoft_cdp",
+     "1eff060001092002a1b2c3d4e5f60718293a4b5c6d7e8f90a1b2c3d4e5f607", ""},
+    {"tile",
+     "0201060303edfe0d16edfe0201a7c4e2f9138b0d6c", ""},
+    {"uuid128_fitness",
+     "0201061107ba5689a6fabfa2bd01467d6e00fbabad", "0a0943686172676520330c"},
+    {"samsung_tag",
+     "0201061bff75004204018066a1b2c3d4e5f6070809101112131415161718", ""},
+    {"exposure_notification",
+     "0303 6ffd17166ffd8f3a9c2b7d4e5f60718293a4b5c6d7e8f1a2b3c4", ""},
+    {"mi_band_service_data",
+     "0201061316 95fe3020b701a4b2c3d4e5f60718091a2b3c", "0809 4d692042616e64"},
+    {"flags_only",
+     "020106", ""},
+    {"overrun",
+     "02010640ff4c000215f7826da64fa24e", ""},
+};
+
+#define CORPUS_SIZE ((int)(sizeof(sCorpus) / sizeof(sCorpus[0])))
+
+static uint8_t sPayloads[CORPUS_SIZE][ADV_DATA_MAX_LEN];
+
+static int from_hex(const char *hex, uint8_t *out, int max) {
+    int len = 0;
+    for (const char *p = hex; *p && len < max; ) {
+        if (*p == ' ') {
+            p++;
+            continue;
+        }
+        unsigned int value;
+        if (sscanf(p, "%2x", &value) != 1) break;
+        out[len++] = (uint8_t) value;
+        p += 2;
+    }
+    return len;
+}
+
+static void load_corpus() {
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        memset(sPayloads[i], 0, ADV_DATA_MAX_LEN);
+        // The stack reports advertising data and scan response back to back
+        int len = from_hex(sCorpus[i].adv, sPayloads[i], 31);
+        from_hex(sCorpus[i].scan_response, sPayloads[i] + len, ADV_DATA_MAX_LEN - len);
+    }
+}
+
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *name, uint64_t elapsed_ns, long count, int checksum) {
+    printf("%-24s %11ld %9.1f %12.0f %9d\n", name, count, (double) elapsed_ns / count,
+           count * 1e9 / (double) elapsed_ns, checksum);
+}
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"iterations", required_argument, NULL, 'i'},
+        {NULL, 0, NULL, 0},
+    };
+
+    long iterations = 200000;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "i:", options, NULL)) != -1) {
+        switch (opt) {
+            case 'i': iterations = atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [--iterations <n>]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    load_corpus();
+
+#if defined(ADV_PARSER_NEON)
+    printf("vector path: NEON\n");
+#elif defined(ADV_PARSER_SSE2)
+    printf("vector path: SSE2\n");
+#else
+    printf("vector path: none\n");
+#endif
+    printf("%-24s %11s %9s %12s %9s\n", "payload", "count", "ns/op", "ops/s", "check");
+
+    // Heart Rate, masked to match only its 16 bit value
+    bt_uuid_t wanted, mask;
+    memset(mask.uu, 0, sizeof(mask.uu));
+    mask.uu[12] = mask.uu[13] = 0xFF;
+    memset(wanted.uu, 0, sizeof(wanted.uu));
+    wanted.uu[12] = 0x0D;
+    wanted.uu[13] = 0x18;
+
+    adv_record_t rec;
+    uint64_t total_ns = 0;
+    long total = 0;
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        int checksum = 0;
+        uint64_t start = now_ns();
+        for (long n = 0; n < iterations; n++) {
+            adv_parse(sPayloads[i], ADV_DATA_MAX_LEN, &rec);
+            checksum += rec.num_uuids + rec.num_service_data + rec.num_manufacturer_data +
+                        (adv_find_uuid(&rec, &wanted, &mask) >= 0);
+        }
+        uint64_t elapsed = now_ns() - start;
+        report(sCorpus[i].name, elapsed, iterations, checksum / (int) iterations);
+        total_ns += elapsed;
+        total += iterations;
+    }
+    report("all", total_ns, total, 0);
+    return 0;
+}
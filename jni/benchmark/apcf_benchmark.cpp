@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measures the compiled software scan filters of com_android_bluetooth_apcf
+ * as the number of conditions grows, with the asset tag mix they were built
+ * for: mostly device addresses, then manufacturer data prefixes with masks
+ * and a few service UUIDs. Advertisements are drawn from a fixed pool of
+ * which roughly a quarter match a registered condition.
+ *
+ *   bluetooth_apcf_benchmark [--filters <n>] [--iterations <n>]
+ */
+
+#define LOG_TAG "BtApcfBenchmark"
+
+#include "com_android_bluetooth_apcf.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+using namespace android;
+
+#define ADV_DATA_LEN        62
+#define ADV_POOL_SIZE       256
+#define ADDRESS_FILTER      3
+#define MANUFACTURER_FILTER 4
+#define UUID_FILTER         5
+
+// Every condition of a feature is ORed, as an asset tag list needs
+#define LIST_LOGIC_OR       0x0000000
+
+typedef struct {
+    bt_bdaddr_t bda;
+    uint8_t adv[ADV_DATA_LEN];
+} adv_sample_t;
+
+static adv_sample_t sPool[ADV_POOL_SIZE];
+static uint32_t sSeed = 1;
+
+static uint32_t next_random() {
+    sSeed = sSeed * 1103515245 + 12345;
+    return sSeed >> 8;
+}
+
+static void make_address(int n, bt_bdaddr_t *bda) {
+    uint32_t h = n * 2654435761u;
+    bda->address[0] = 0xC0;
+    bda->address[1] = 0x11;
+    bda->address[2] = h >> 24;
+    bda->address[3] = h >> 16;
+    bda->address[4] = h >> 8;
+    bda->address[5] = h;
+}
+
+static void make_tag_data(int n, uint8_t *data) {
+    data[0] = 0x02;
+    data[1] = 0x15;
+    data[2] = n >> 8;
+    data[3] = n;
+    data[4] = (n * 7) >> 8;
+    data[5] = n * 7;
+}
+
+static void add_filter_params(int filt_index, int feature) {
+    apcf_params_t params;
+    memset(&params, 0, sizeof(params));
+    params.feature_selection = 1 << feature;
+    params.list_logic_type = LIST_LOGIC_OR;
+    params.filter_logic_type = 0;
+    params.rssi_high_threshold = -128;
+    params.delivery_mode = APCF_DELIVERY_IMMEDIATE;
+    apcf_set_params(filt_index, &params);
+}
+
+// Condition n of the mix: 70% addresses, 25% manufacturer data, 5% UUIDs
+static void add_condition(int n) {
+    apcf_cond_t cond;
+    memset(&cond, 0, sizeof(cond));
+    int kind = n % 20;
+    if (kind < 14) {
+        cond.type = APCF_TYPE_ADDRESS;
+        make_address(n, &cond.address);
+        apcf_add_cond(ADDRESS_FILTER, &cond);
+    } else if (kind < 19) {
+        cond.type = APCF_TYPE_MANUFACTURER_DATA;
+        cond.company = 0x004C;
+        cond.company_mask = 0xFFFF;
+        cond.data_len = 6;
+        make_tag_data(n, cond.data);
+        memset(cond.mask, 0xFF, cond.data_len);
+        // Some tags only fix the upper nibble of their last byte
+        if (n & 1) cond.mask[5] = 0xF0;
+        apcf_add_cond(MANUFACTURER_FILTER, &cond);
+    } else {
+        cond.type = APCF_TYPE_SERVICE_UUID;
+        static const uint8_t base[16] = {
+            0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80,
+            0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+        };
+        memcpy(cond.uuid.uu, base, 16);
+        cond.uuid.uu[12] = n;
+        cond.uuid.uu[13] = n >> 8;
+        memset(cond.uuid_mask.uu, 0xFF, 16);
+        apcf_add_cond(UUID_FILTER, &cond);
+    }
+}
+
+// Samples are built from conditions up to max_filters, so the pool hits at every size
+static void make_pool(int max_filters) {
+    for (int i = 0; i < ADV_POOL_SIZE; i++) {
+        adv_sample_t *s = &sPool[i];
+        memset(s->adv, 0, ADV_DATA_LEN);
+        bool hit = (next_random() & 3) == 0;
+        int n = hit ? next_random() % max_filters : max_filters + next_random() % 100000;
+        make_address(hit && n % 20 < 14 ? n : n + 1000000, &s->bda);
+
+        uint8_t *p = s->adv;
+        *p++ = 0x02; *p++ = 0x01; *p++ = 0x06;
+        *p++ = 0x03; *p++ = 0x03; *p++ = (uint8_t) n; *p++ = (uint8_t) (n >> 8);
+        *p++ = 0x1A; *p++ = 0xFF; *p++ = 0x4C; *p++ = 0x00;
+        make_tag_data(n, p);
+        for (int j = 6; j < 0x1A - 3; j++) p[j] = next_random();
+    }
+}
+
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"filters", required_argument, NULL, 'f'},
+        {"iterations", required_argument, NULL, 'i'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int max_filters = 10000;
+    long iterations = 1000000;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:i:", options, NULL)) != -1) {
+        switch (opt) {
+            case 'f': max_filters = atoi(optarg); break;
+            case 'i': iterations = atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [--filters <n>] [--iterations <n>]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (max_filters < 1) max_filters = 1;
+
+    make_pool(max_filters);
+    printf("%-10s %11s %9s %12s %9s\n", "filters", "count", "ns/op", "ops/s", "matched");
+
+    apcf_enable(true);
+    add_filter_params(ADDRESS_FILTER, APCF_TYPE_ADDRESS);
+    add_filter_params(MANUFACTURER_FILTER, APCF_TYPE_MANUFACTURER_DATA);
+    add_filter_params(UUID_FILTER, APCF_TYPE_SERVICE_UUID);
+
+    int added = 0;
+    for (int size = 10; ; size *= 10) {
+        if (size > max_filters) size = max_filters;
+        while (added < size) add_condition(added++);
+
+        long matched = 0;
+        uint32_t tracked;
+        uint64_t start = now_ns();
+        for (long n = 0; n < iterations; n++) {
+            const adv_sample_t *s = &sPool[n & (ADV_POOL_SIZE - 1)];
+            matched += apcf_match(&s->bda, -60, s->adv, ADV_DATA_LEN, &tracked);
+        }
+        uint64_t elapsed = now_ns() - start;
+        printf("%-10d %11ld %9.1f %12.0f %9ld\n", size, iterations,
+               (double) elapsed / iterations, iterations * 1e9 / (double) elapsed, matched);
+
+        if (size == max_filters) break;
+    }
+
+    apcf_reset();
+    return 0;
+}
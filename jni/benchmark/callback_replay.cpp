@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BtJniBenchmarkReplay"
+
+#include "callback_replay.h"
+#include "fake_hal.h"
+#include "com_android_bluetooth_notify_token.h"
+#include "utils/Log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+namespace android {
+namespace benchmark {
+
+#define NS_PER_SEC 1000000000ULL
+#define ADV_DATA_LEN 62
+#define BATCH_SCAN_RECORDS 10
+#define BATCH_SCAN_TRUNCATED_RECORD_LEN 11
+#define BATCH_SCAN_FULL_ADV_LEN 31
+#define BATCH_SCAN_FULL_RECORD_LEN (BATCH_SCAN_TRUNCATED_RECORD_LEN + 2 + BATCH_SCAN_FULL_ADV_LEN)
+#define ATTR_VALUE_LEN 20
+#define NOTIFY_COMPACT_CONN_ID 2
+
+typedef enum {
+    REPLAY_ADAPTER,
+    REPLAY_GATT,
+    REPLAY_AVRCP,
+    REPLAY_HFP,
+} replay_profile_t;
+
+typedef void (*replay_fire_t)(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda, int iteration);
+
+typedef struct {
+    const char *name;
+    replay_profile_t profile;
+    replay_fire_t fire;
+} replay_scenario_t;
+
+static uint8_t sAdvData[ADV_DATA_LEN];
+static uint8_t sBatchScanReport[BATCH_SCAN_RECORDS * BATCH_SCAN_TRUNCATED_RECORD_LEN];
+static uint8_t sBatchScanFullReport[BATCH_SCAN_RECORDS * BATCH_SCAN_FULL_RECORD_LEN];
+static uint8_t sAttrValue[ATTR_VALUE_LEN];
+static btgatt_notify_params_t sNotifyParams;
+static char sDeviceName[] = "Benchmark Device";
+static uint32_t sDeviceClass = 0x5a020c;
+static bt_device_type_t sDeviceType = BT_DEVICE_DEVICE_TYPE_BLE;
+static bool sPrepared = false;
+
+static void set_uuid16(bt_uuid_t *uuid, uint16_t uuid16) {
+    static const uint8_t base[16] = {
+        0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80,
+        0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+    memcpy(uuid->uu, base, sizeof(base));
+    uuid->uu[12] = uuid16 & 0xFF;
+    uuid->uu[13] = (uuid16 >> 8) & 0xFF;
+}
+
+static void replay_prepare() {
+    if (sPrepared) return;
+
+    // Flags, complete local name and a heart rate service UUID, padded with
+    // manufacturer data up to the 62 bytes the stack always reports.
+    static const uint8_t adv[] = {
+        0x02, 0x01, 0x06,
+        0x0A, 0x09, 'B', 'e', 'n', 'c', 'h', 'm', 'a', 'r', 'k',
+        0x03, 0x03, 0x0D, 0x18,
+        0x0B, 0xFF, 0x0A, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+    };
+    memset(sAdvData, 0, sizeof(sAdvData));
+    memcpy(sAdvData, adv, sizeof(adv));
+
+    for (int i = 0; i < BATCH_SCAN_RECORDS; i++) {
+        uint8_t *rec = sBatchScanReport + i * BATCH_SCAN_TRUNCATED_RECORD_LEN;
+        memset(rec, 0, BATCH_SCAN_TRUNCATED_RECORD_LEN);
+        rec[0] = i;                 // address, LSB first
+        rec[6] = 0x00;              // address type
+        rec[7] = 0x00;              // tx power
+        rec[8] = (uint8_t)(-60);    // rssi
+        rec[9] = (i * 20) & 0xFF;   // timestamp in 50ms units, LSB first
+
+        // Same header followed by the advertising data and an empty scan response
+        uint8_t *full = sBatchScanFullReport + i * BATCH_SCAN_FULL_RECORD_LEN;
+        memcpy(full, rec, BATCH_SCAN_TRUNCATED_RECORD_LEN);
+        full[BATCH_SCAN_TRUNCATED_RECORD_LEN] = BATCH_SCAN_FULL_ADV_LEN;
+        memcpy(full + BATCH_SCAN_TRUNCATED_RECORD_LEN + 1, sAdvData, BATCH_SCAN_FULL_ADV_LEN);
+        full[BATCH_SCAN_FULL_RECORD_LEN - 1] = 0;
+    }
+
+    for (int i = 0; i < ATTR_VALUE_LEN; i++) sAttrValue[i] = i;
+
+    memset(&sNotifyParams, 0, sizeof(sNotifyParams));
+    sNotifyParams.srvc_id.is_primary = 1;
+    set_uuid16(&sNotifyParams.srvc_id.id.uuid, 0x180D);
+    set_uuid16(&sNotifyParams.char_id.uuid, 0x2A37);
+    memcpy(sNotifyParams.value, sAttrValue, ATTR_VALUE_LEN);
+    sNotifyParams.len = ATTR_VALUE_LEN;
+    sNotifyParams.is_notify = 1;
+
+    sPrepared = true;
+}
+
+/**
+ * Scenarios
+ */
+
+static void fire_adapter_state(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda, int iteration) {
+    cb->bt->adapter_state_changed_cb((iteration & 1) ? BT_STATE_OFF : BT_STATE_ON);
+}
+
+static void fire_device_found(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda, int iteration) {
+    bt_property_t props[4];
+    props[0].type = BT_PROPERTY_BDADDR;
+    props[0].len = sizeof(bt_bdaddr_t);
+    props[0].val = bda;
+    props[1].type = BT_PROPERTY_BDNAME;
+    props[1].len = strlen(sDeviceName);
+    props[1].val = sDeviceName;
+    props[2].type = BT_PROPERTY_CLASS_OF_DEVICE;
+    props[2].len = sizeof(sDeviceClass);
+    props[2].val = &sDeviceClass;
+    props[3].type = BT_PROPERTY_TYPE_OF_DEVICE;
+    props[3].len = sizeof(sDeviceType);
+    props[3].val = &sDeviceType;
+    cb->bt->device_found_cb(4, props);
+}
+
+static void fire_acl_state(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda, int iteration) {
+    cb->bt->acl_state_changed_cb(BT_STATUS_SUCCESS, bda,
+        (iteration & 1) ? BT_ACL_STATE_DISCONNECTED : BT_ACL_STATE_CONNECTED);
+}
+
+static void fire_gatt_scan_result(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda, int iteration) {
+    cb->gatt->client->scan_result_cb(bda, -40 - (iteration % 50), sAdvData);
+}
+
+static void fire_gatt_notify(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda, int iteration) {
+    memcpy(&sNotifyParams.bda, bda, sizeof(bt_bdaddr_t));
+    cb->gatt->client->notify_cb(1, &sNotifyParams);
+}
+
+static void fire_gatt_notify_compact(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda,
+                                     int iteration) {
+    if (iteration == 0) {
+        notify_token_add(NOTIFY_COMPACT_CONN_ID, &sNotifyParams.srvc_id, &sNotifyParams.char_id, 0);
+    }
+    memcpy(&sNotifyParams.bda, bda, sizeof(bt_bdaddr_t));
+    cb->gatt->client->notify_cb(NOTIFY_COMPACT_CONN_ID, &sNotifyParams);
+}
+
+static void fire_gatt_congestion(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda, int iteration) {
+    cb->gatt->client->congestion_cb(1, iteration & 1);
+}
+
+static void fire_gatt_batchscan_reports(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda,
+                                        int iteration) {
+    cb->gatt->client->batchscan_reports_cb(1, 0, 1, BATCH_SCAN_RECORDS,
+                                           sizeof(sBatchScanReport), sBatchScanReport);
+}
+
+static void fire_gatt_batchscan_full(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda,
+                                     int iteration) {
+    cb->gatt->client->batchscan_reports_cb(1, 0, 2, BATCH_SCAN_RECORDS,
+                                           sizeof(sBatchScanFullReport), sBatchScanFullReport);
+}
+
+static void fire_gatt_server_read(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda, int iteration) {
+    cb->gatt->server->request_read_cb(1, iteration, bda, 0x002A, 0, false);
+}
+
+static void fire_gatt_server_write(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda,
+                                   int iteration) {
+    cb->gatt->server->request_write_cb(1, iteration, bda, 0x002A, 0, ATTR_VALUE_LEN,
+                                       true, false, sAttrValue);
+}
+
+static void fire_avrcp_passthrough(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda,
+                                   int iteration) {
+    cb->rc->passthrough_cmd_cb(0x44, iteration & 1);
+}
+
+static void fire_avrcp_volume(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda, int iteration) {
+    cb->rc->volume_change_cb(iteration & 0x7F, 0x0D);
+}
+
+static void fire_hfp_volume(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda, int iteration) {
+    cb->hf->volume_cmd_cb(BTHF_VOLUME_TYPE_SPK, iteration % 16, bda);
+}
+
+static void fire_hfp_connection(const fake_hal_callbacks_t *cb, bt_bdaddr_t *bda, int iteration) {
+    cb->hf->connection_state_cb((iteration & 1) ? BTHF_CONNECTION_STATE_DISCONNECTED
+                                                : BTHF_CONNECTION_STATE_CONNECTED, bda);
+}
+
+static const replay_scenario_t sScenarios[] = {
+    {"adapter_state",          REPLAY_ADAPTER, fire_adapter_state},
+    {"device_found",           REPLAY_ADAPTER, fire_device_found},
+    {"acl_state",              REPLAY_ADAPTER, fire_acl_state},
+    {"gatt_scan_result",       REPLAY_GATT,    fire_gatt_scan_result},
+    {"gatt_notify",            REPLAY_GATT,    fire_gatt_notify},
+    {"gatt_notify_compact",    REPLAY_GATT,    fire_gatt_notify_compact},
+    {"gatt_congestion",        REPLAY_GATT,    fire_gatt_congestion},
+    {"gatt_batchscan_reports", REPLAY_GATT,    fire_gatt_batchscan_reports},
+    {"gatt_batchscan_full",    REPLAY_GATT,    fire_gatt_batchscan_full},
+    {"gatt_server_read",       REPLAY_GATT,    fire_gatt_server_read},
+    {"gatt_server_write",      REPLAY_GATT,    fire_gatt_server_write},
+    {"avrcp_passthrough",      REPLAY_AVRCP,   fire_avrcp_passthrough},
+    {"avrcp_volume",           REPLAY_AVRCP,   fire_avrcp_volume},
+    {"hfp_volume",             REPLAY_HFP,     fire_hfp_volume},
+    {"hfp_connection",         REPLAY_HFP,     fire_hfp_connection},
+};
+
+#define NUM_SCENARIOS ((int)(sizeof(sScenarios) / sizeof(sScenarios[0])))
+
+int replay_scenario_count() {
+    return NUM_SCENARIOS;
+}
+
+const char* replay_scenario_name(int index) {
+    if (index < 0 || index >= NUM_SCENARIOS) return NULL;
+    return sScenarios[index].name;
+}
+
+/**
+ * Replay loop
+ */
+
+typedef struct {
+    const replay_scenario_t *scenario;
+    const replay_config_t *config;
+    uint64_t *samples;
+    uint64_t elapsed_ns;
+} replay_job_t;
+
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static void sleep_until_ns(uint64_t deadline) {
+    struct timespec ts;
+    ts.tv_sec = deadline / NS_PER_SEC;
+    ts.tv_nsec = deadline % NS_PER_SEC;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {}
+}
+
+static void fill_address(bt_bdaddr_t *bda, int device) {
+    bda->address[0] = 0x00;
+    bda->address[1] = 0x1A;
+    bda->address[2] = 0x7D;
+    bda->address[3] = (device >> 16) & 0xFF;
+    bda->address[4] = (device >> 8) & 0xFF;
+    bda->address[5] = device & 0xFF;
+}
+
+static void replay_job(void *data) {
+    replay_job_t *job = (replay_job_t *)data;
+    const fake_hal_callbacks_t *cb = fake_hal_get_callbacks();
+    const replay_config_t *config = job->config;
+    int num_devices = config->num_devices > 0 ? config->num_devices : 1;
+    uint64_t period = config->rate > 0 ? NS_PER_SEC / config->rate : 0;
+    bt_bdaddr_t bda;
+
+    for (int i = 0; i < config->warmup; i++) {
+        fill_address(&bda, i % num_devices);
+        job->scenario->fire(cb, &bda, i);
+    }
+
+    uint64_t start = now_ns();
+    uint64_t deadline = start;
+    for (int i = 0; i < config->count; i++) {
+        if (period) {
+            sleep_until_ns(deadline);
+            deadline += period;
+        }
+        fill_address(&bda, i % num_devices);
+
+        uint64_t t0 = now_ns();
+        job->scenario->fire(cb, &bda, i);
+        job->samples[i] = now_ns() - t0;
+    }
+    job->elapsed_ns = now_ns() - start;
+}
+
+static bool profile_ready(replay_profile_t profile) {
+    const fake_hal_callbacks_t *cb = fake_hal_get_callbacks();
+    switch (profile) {
+        case REPLAY_ADAPTER: return cb->bt != NULL;
+        case REPLAY_GATT:    return cb->gatt != NULL;
+        case REPLAY_AVRCP:   return cb->rc != NULL;
+        case REPLAY_HFP:     return cb->hf != NULL;
+    }
+    return false;
+}
+
+static int compare_samples(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+bool replay_run(int index, const replay_config_t *config, replay_result_t *result) {
+    if (index < 0 || index >= NUM_SCENARIOS || config->count <= 0) return false;
+
+    const replay_scenario_t *scenario = &sScenarios[index];
+    if (!profile_ready(scenario->profile)) {
+        ALOGE("%s: profile for %s is not initialized", __FUNCTION__, scenario->name);
+        return false;
+    }
+
+    replay_prepare();
+
+    replay_job_t job;
+    job.scenario = scenario;
+    job.config = config;
+    job.samples = (uint64_t *)calloc(config->count, sizeof(uint64_t));
+    job.elapsed_ns = 0;
+    if (!job.samples) return false;
+
+    if (!fake_hal_run_on_callback_thread(replay_job, &job)) {
+        free(job.samples);
+        return false;
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < config->count; i++) total += job.samples[i];
+    qsort(job.samples, config->count, sizeof(uint64_t), compare_samples);
+
+    int last = config->count - 1;
+    result->count = config->count;
+    result->min_ns = job.samples[0];
+    result->p50_ns = job.samples[last * 50 / 100];
+    result->p90_ns = job.samples[last * 90 / 100];
+    result->p99_ns = job.samples[last * 99 / 100];
+    result->max_ns = job.samples[last];
+    result->mean_ns = total / config->count;
+    result->elapsed_ns = job.elapsed_ns;
+
+    free(job.samples);
+    return true;
+}
+
+} // namespace benchmark
+} // namespace android
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BLUETOOTH_JNI_BENCHMARK_CALLBACK_REPLAY_H
+#define BLUETOOTH_JNI_BENCHMARK_CALLBACK_REPLAY_H
+
+#include <stdint.h>
+
+namespace android {
+namespace benchmark {
+
+typedef struct {
+    int count;          // measured invocations
+    int warmup;         // unmeasured invocations run first
+    int rate;           // invocations per second, 0 for back to back
+    int num_devices;    // distinct remote addresses cycled through
+} replay_config_t;
+
+typedef struct {
+    int count;
+    uint64_t min_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+    uint64_t mean_ns;
+    uint64_t elapsed_ns;  // wall time of the measured phase, pacing included
+} replay_result_t;
+
+int replay_scenario_count();
+
+const char* replay_scenario_name(int index);
+
+/*
+ * Fires the callback for scenario index from the fake stack callback
+ * thread and times each upcall. Returns false if the profile the scenario
+ * needs has not been initialized.
+ */
+bool replay_run(int index, const replay_config_t *config, replay_result_t *result);
+
+} // namespace benchmark
+} // namespace android
+
+#endif /* BLUETOOTH_JNI_BENCHMARK_CALLBACK_REPLAY_H */
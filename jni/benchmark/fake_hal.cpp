@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BtJniBenchmarkHal"
+
+#include "fake_hal.h"
+#include "hardware/hardware.h"
+#include "utils/Log.h"
+
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+
+namespace android {
+namespace benchmark {
+
+static fake_hal_callbacks_t sCallbacks;
+
+static pthread_mutex_t sThreadLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sThreadCond = PTHREAD_COND_INITIALIZER;
+static pthread_t sCallbackThread;
+static bool sThreadRunning = false;
+static bool sThreadQuit = false;
+static fake_hal_job_t sPendingJob = NULL;
+static void *sPendingJobData = NULL;
+static unsigned int sJobsPosted = 0;
+static unsigned int sJobsDone = 0;
+
+static void *callback_thread_main(void *arg) {
+    sCallbacks.bt->thread_evt_cb(ASSOCIATE_JVM);
+
+    pthread_mutex_lock(&sThreadLock);
+    for (;;) {
+        while (!sPendingJob && !sThreadQuit) {
+            pthread_cond_wait(&sThreadCond, &sThreadLock);
+        }
+        if (sThreadQuit) break;
+
+        fake_hal_job_t job = sPendingJob;
+        void *data = sPendingJobData;
+        sPendingJob = NULL;
+        sPendingJobData = NULL;
+        pthread_mutex_unlock(&sThreadLock);
+        job(data);
+        pthread_mutex_lock(&sThreadLock);
+
+        sJobsDone++;
+        pthread_cond_broadcast(&sThreadCond);
+    }
+    pthread_mutex_unlock(&sThreadLock);
+
+    sCallbacks.bt->thread_evt_cb(DISASSOCIATE_JVM);
+    return NULL;
+}
+
+bool fake_hal_run_on_callback_thread(fake_hal_job_t job, void *data) {
+    pthread_mutex_lock(&sThreadLock);
+    if (!sThreadRunning) {
+        pthread_mutex_unlock(&sThreadLock);
+        return false;
+    }
+    while (sPendingJob) {
+        pthread_cond_wait(&sThreadCond, &sThreadLock);
+    }
+    sPendingJob = job;
+    sPendingJobData = data;
+    unsigned int ticket = ++sJobsPosted;
+    pthread_cond_broadcast(&sThreadCond);
+    while (sJobsDone < ticket) {
+        pthread_cond_wait(&sThreadCond, &sThreadLock);
+    }
+    pthread_mutex_unlock(&sThreadLock);
+    return true;
+}
+
+const fake_hal_callbacks_t* fake_hal_get_callbacks() {
+    return &sCallbacks;
+}
+
+/**
+ * GATT
+ */
+
+static btgatt_client_interface_t sFakeGattClientInterface;
+static btgatt_server_interface_t sFakeGattServerInterface;
+static btgatt_interface_t sFakeGattInterface;
+
+static bt_status_t fake_gatt_init(const btgatt_callbacks_t *callbacks) {
+    sCallbacks.gatt = callbacks;
+    return BT_STATUS_SUCCESS;
+}
+
+static void fake_gatt_cleanup() {
+    sCallbacks.gatt = NULL;
+}
+
+/**
+ * AVRCP target
+ */
+
+static btrc_interface_t sFakeAvrcpInterface;
+
+static bt_status_t fake_avrcp_init(btrc_callbacks_t *callbacks) {
+    sCallbacks.rc = callbacks;
+    return BT_STATUS_SUCCESS;
+}
+
+static void fake_avrcp_cleanup() {
+    sCallbacks.rc = NULL;
+}
+
+/**
+ * Handsfree
+ */
+
+static bthf_interface_t sFakeHfpInterface;
+
+static bt_status_t fake_hfp_init(bthf_callbacks_t *callbacks, int max_hf_clients) {
+    sCallbacks.hf = callbacks;
+    return BT_STATUS_SUCCESS;
+}
+
+static void fake_hfp_cleanup() {
+    sCallbacks.hf = NULL;
+}
+
+/**
+ * MAP client
+ */
+
+static btmce_interface_t sFakeMceInterface;
+
+static bt_status_t fake_mce_init(btmce_callbacks_t *callbacks) {
+    sCallbacks.mce = callbacks;
+    return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t fake_mce_get_remote_mas_instances(bt_bdaddr_t *bd_addr) {
+    return BT_STATUS_UNSUPPORTED;
+}
+
+/**
+ * Adapter
+ */
+
+static bt_interface_t sFakeBluetoothInterface;
+
+static int fake_bt_init(bt_callbacks_t *callbacks) {
+    pthread_mutex_lock(&sThreadLock);
+    if (sThreadRunning) {
+        pthread_mutex_unlock(&sThreadLock);
+        return BT_STATUS_DONE;
+    }
+    sCallbacks.bt = callbacks;
+    sThreadQuit = false;
+    if (pthread_create(&sCallbackThread, NULL, callback_thread_main, NULL) != 0) {
+        ALOGE("%s: unable to start callback thread", __FUNCTION__);
+        sCallbacks.bt = NULL;
+        pthread_mutex_unlock(&sThreadLock);
+        return BT_STATUS_FAIL;
+    }
+    sThreadRunning = true;
+    pthread_mutex_unlock(&sThreadLock);
+    return BT_STATUS_SUCCESS;
+}
+
+static void fake_bt_cleanup(void) {
+    pthread_mutex_lock(&sThreadLock);
+    if (!sThreadRunning) {
+        pthread_mutex_unlock(&sThreadLock);
+        return;
+    }
+    sThreadQuit = true;
+    pthread_cond_broadcast(&sThreadCond);
+    pthread_mutex_unlock(&sThreadLock);
+
+    pthread_join(sCallbackThread, NULL);
+
+    pthread_mutex_lock(&sThreadLock);
+    sThreadRunning = false;
+    sCallbacks.bt = NULL;
+    pthread_mutex_unlock(&sThreadLock);
+}
+
+static int fake_bt_set_os_callouts(bt_os_callouts_t *callouts) {
+    return BT_STATUS_SUCCESS;
+}
+
+static const void* fake_bt_get_profile_interface(const char *profile_id) {
+    if (!strcmp(profile_id, BT_PROFILE_GATT_ID)) return &sFakeGattInterface;
+    if (!strcmp(profile_id, BT_PROFILE_AV_RC_ID)) return &sFakeAvrcpInterface;
+    if (!strcmp(profile_id, BT_PROFILE_HANDSFREE_ID)) return &sFakeHfpInterface;
+    if (!strcmp(profile_id, BT_PROFILE_MAP_CLIENT_ID)) return &sFakeMceInterface;
+
+    // Sockets and the remaining profiles are not faked; the JNI layer already
+    // copes with a NULL interface for each of them.
+    ALOGW("%s: no fake interface for %s", __FUNCTION__, profile_id);
+    return NULL;
+}
+
+static const bt_interface_t* fake_get_bluetooth_interface() {
+    return &sFakeBluetoothInterface;
+}
+
+static void fake_hal_setup_interfaces() {
+    memset(&sFakeBluetoothInterface, 0, sizeof(sFakeBluetoothInterface));
+    sFakeBluetoothInterface.size = sizeof(sFakeBluetoothInterface);
+    sFakeBluetoothInterface.init = fake_bt_init;
+    sFakeBluetoothInterface.cleanup = fake_bt_cleanup;
+    sFakeBluetoothInterface.get_profile_interface = fake_bt_get_profile_interface;
+    sFakeBluetoothInterface.set_os_callouts = fake_bt_set_os_callouts;
+
+    // Client and server calls are left NULL: the benchmark only drives
+    // upcalls and never issues GATT requests through the JNI natives.
+    memset(&sFakeGattClientInterface, 0, sizeof(sFakeGattClientInterface));
+    memset(&sFakeGattServerInterface, 0, sizeof(sFakeGattServerInterface));
+    memset(&sFakeGattInterface, 0, sizeof(sFakeGattInterface));
+    sFakeGattInterface.size = sizeof(sFakeGattInterface);
+    sFakeGattInterface.init = fake_gatt_init;
+    sFakeGattInterface.cleanup = fake_gatt_cleanup;
+    sFakeGattInterface.client = &sFakeGattClientInterface;
+    sFakeGattInterface.server = &sFakeGattServerInterface;
+
+    memset(&sFakeAvrcpInterface, 0, sizeof(sFakeAvrcpInterface));
+    sFakeAvrcpInterface.size = sizeof(sFakeAvrcpInterface);
+    sFakeAvrcpInterface.init = fake_avrcp_init;
+    sFakeAvrcpInterface.cleanup = fake_avrcp_cleanup;
+
+    memset(&sFakeHfpInterface, 0, sizeof(sFakeHfpInterface));
+    sFakeHfpInterface.size = sizeof(sFakeHfpInterface);
+    sFakeHfpInterface.init = fake_hfp_init;
+    sFakeHfpInterface.cleanup = fake_hfp_cleanup;
+
+    memset(&sFakeMceInterface, 0, sizeof(sFakeMceInterface));
+    sFakeMceInterface.size = sizeof(sFakeMceInterface);
+    sFakeMceInterface.init = fake_mce_init;
+    sFakeMceInterface.get_remote_mas_instances = fake_mce_get_remote_mas_instances;
+}
+
+/**
+ * Module
+ */
+
+static bluetooth_module_t sFakeBluetoothDevice;
+
+static int fake_module_open(const hw_module_t *module, const char *id,
+                            hw_device_t **device) {
+    memset(&sFakeBluetoothDevice, 0, sizeof(sFakeBluetoothDevice));
+    sFakeBluetoothDevice.common.tag = HARDWARE_DEVICE_TAG;
+    sFakeBluetoothDevice.common.version = 0;
+    sFakeBluetoothDevice.common.module = (hw_module_t *)module;
+    sFakeBluetoothDevice.get_bluetooth_interface = fake_get_bluetooth_interface;
+    fake_hal_setup_interfaces();
+
+    *device = (hw_device_t *)&sFakeBluetoothDevice;
+    return 0;
+}
+
+static hw_module_methods_t sFakeModuleMethods = {
+    fake_module_open,
+};
+
+static hw_module_t sFakeModule = {
+    HARDWARE_MODULE_TAG,
+    1,
+    0,
+    BT_HARDWARE_MODULE_ID,
+    "Bluetooth JNI benchmark fake stack",
+    "The Android Open Source Project",
+    &sFakeModuleMethods,
+};
+
+} // namespace benchmark
+} // namespace android
+
+/*
+ * Stands in for libhardware so that classInitNative() in the adapter JNI
+ * loads the fake stack instead of bluetooth.default.so.
+ */
+extern "C" int hw_get_module(const char *id, const struct hw_module_t **module) {
+    if (strcmp(id, BT_STACK_MODULE_ID) && strcmp(id, BT_STACK_TEST_MODULE_ID)) {
+        return -ENOENT;
+    }
+    *module = &android::benchmark::sFakeModule;
+    return 0;
+}
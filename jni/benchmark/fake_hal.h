@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BLUETOOTH_JNI_BENCHMARK_FAKE_HAL_H
+#define BLUETOOTH_JNI_BENCHMARK_FAKE_HAL_H
+
+#include "hardware/bluetooth.h"
+#include "hardware/bt_gatt.h"
+#include "hardware/bt_rc.h"
+#include "hardware/bt_hf.h"
+#include "hardware/bt_mce.h"
+
+namespace android {
+namespace benchmark {
+
+/*
+ * Callback tables handed to the fake HAL by libbluetooth_jni. A member is
+ * NULL until the matching profile has called init() on its interface.
+ */
+typedef struct {
+    bt_callbacks_t *bt;
+    const btgatt_callbacks_t *gatt;
+    btrc_callbacks_t *rc;
+    bthf_callbacks_t *hf;
+    btmce_callbacks_t *mce;
+} fake_hal_callbacks_t;
+
+typedef void (*fake_hal_job_t)(void *data);
+
+const fake_hal_callbacks_t* fake_hal_get_callbacks();
+
+/*
+ * Runs job on the fake stack callback thread and blocks until it returns.
+ * The thread is attached to the VM through thread_evt_cb(ASSOCIATE_JVM)
+ * exactly as the real stack does, so callbacks fired from the job pass the
+ * checkCallbackThread() test in the JNI layer. Returns false if the
+ * adapter interface has not been initialized.
+ */
+bool fake_hal_run_on_callback_thread(fake_hal_job_t job, void *data);
+
+} // namespace benchmark
+} // namespace android
+
+#endif /* BLUETOOTH_JNI_BENCHMARK_FAKE_HAL_H */
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+package com.android.bluetooth.avrcp;
+
+/**
+ * Host stand-in for the real Avrcp, used by the JNI callback benchmark.
+ * It declares the same native methods and upcalls as the real class so
+ * libbluetooth_jni registers against it unchanged; upcalls do nothing.
+ */
+public final class Avrcp {
+    static {
+        classInitNative();
+    }
+
+    void getRcFeatures(byte[] address, int features) {}
+    void getPlayStatus() {}
+    void onListPlayerAttributeRequest() {}
+    void onListPlayerAttributeValues(byte attr) {}
+    void getElementAttr(byte numAttr, int[] attrs) {}
+    void setPlayerAppSetting(byte num , byte [] attr_id , byte [] attr_val) {}
+    void getplayerattribute_text(byte attr , byte [] attrIds) {}
+    void getplayervalue_text(byte attr_id , byte num_value , byte [] value) {}
+    void registerNotification(int eventId, int param) {}
+    void onGetPlayerAttributeValues(byte attr ,int[] arr) {}
+    void volumeChangeCallback(int volume, int ctype) {}
+    void handlePassthroughCmd(int id, int keyState) {}
+    void setAddressedPlayer(int playerId) {}
+    void getFolderItems(byte scope, long start, long end, int attrCnt, int numAttr, int[] attrs) {}
+    void setBrowsedPlayer(int playerId) {}
+    void changePath(byte direction, long uid) {}
+    void playItem(byte scope, long uid) {}
+    void getItemAttr(byte scope, long uid, byte numAttr, int[] attrs) {}
+
+    private native static void classInitNative();
+    private native void initNative();
+    private native void cleanupNative();
+    private native boolean getPlayStatusRspNative(int playStatus, int songLen, int songPos);
+    private native boolean getElementAttrRspNative(byte numAttr, int[] attrIds, String[] textArray);
+    private native boolean getListPlayerappAttrRspNative(byte attr, byte[] attrIds);
+    private native boolean getPlayerAppValueRspNative(byte numberattr, byte[]values);
+    private native boolean registerNotificationRspPlayStatusNative(int type, int playStatus);
+    private native boolean SendCurrentPlayerValueRspNative(byte numberattr, byte[]attr);
+    private native boolean registerNotificationPlayerAppRspNative(int type, byte numberattr,
+            byte[]attr);
+    private native boolean registerNotificationRspTrackChangeNative(int type, byte[] track);
+    private native boolean SendSetPlayerAppRspNative(int attr_status);
+    private native boolean sendSettingsTextRspNative(int num_attr, byte[] attr, int length,
+            String[]text);
+    private native boolean sendValueTextRspNative(int num_attr, byte[] attr, int length,
+            String[]text);
+    private native boolean registerNotificationRspPlayPosNative(int type, int playPos);
+    private native boolean setVolumeNative(int volume);
+    private native boolean setAdressedPlayerRspNative(byte statusCode);
+    private native boolean getMediaPlayerListRspNative(byte statusCode, int uidCounter,
+            int itemCount, byte[] folderItems, int[] folderItemLengths);
+    private native boolean registerNotificationRspAddressedPlayerChangedNative(int type,
+            int playerId);
+    private native boolean registerNotificationRspAvailablePlayersChangedNative(int type);
+    private native boolean registerNotificationRspNowPlayingContentChangedNative(int type);
+    private native boolean setBrowsedPlayerRspNative(byte statusCode, int uidCounter, int itemCount,
+            int folderDepth, int charId, String[] folderItems);
+    private native boolean changePathRspNative(int status, long itemCount);
+    private native boolean playItemRspNative(int status);
+    private native boolean getItemAttrRspNative(byte numAttr, int[] attrIds, String[] textArray);
+    private native boolean getFolderItemsRspNative(byte statusCode, long numItems, int[] itemType,
+            long[] uid, int[] type, byte[] playable, String[] displayName, byte[] numAtt,
+            String[] attValues, int[] attIds);
+}
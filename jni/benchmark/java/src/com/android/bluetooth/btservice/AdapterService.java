@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+package com.android.bluetooth.btservice;
+
+/**
+ * Host stand-in for the real AdapterService, used by the JNI callback benchmark.
+ * It declares the same native methods and upcalls as the real class so
+ * libbluetooth_jni registers against it unchanged; upcalls do nothing.
+ */
+public class AdapterService {
+    static {
+        classInitNative();
+    }
+
+    private final JniCallbacks mJniCallbacks = new JniCallbacks();
+
+    boolean setWakeAlarm(long delayMillis, boolean shouldWake) { return false; }
+    boolean acquireWakeLock(String lockName) { return false; }
+    boolean releaseWakeLock(String lockName) { return false; }
+    void energyInfoCallback(int status, int ctrl_state, long tx_time, long rx_time, long idle_time,
+            long energy_used) {}
+
+    private native static void classInitNative();
+    private native boolean initNative();
+    private native void cleanupNative();
+    private native void ssrcleanupNative(boolean cleanup);
+    private native boolean enableNative();
+    private native boolean disableNative();
+    private native boolean setAdapterPropertyNative(int type, byte[] val);
+    private native boolean getAdapterPropertiesNative();
+    private native boolean getAdapterPropertyNative(int type);
+    private native boolean getDevicePropertyNative(byte[] address, int type);
+    private native boolean setDevicePropertyNative(byte[] address, int type, byte[] val);
+    private native boolean startDiscoveryNative();
+    private native boolean cancelDiscoveryNative();
+    private native boolean createBondNative(byte[] address, int transport);
+    private native boolean removeBondNative(byte[] address);
+    private native boolean cancelBondNative(byte[] address);
+    private native int getConnectionStateNative(byte[] address);
+    private native boolean pinReplyNative(byte[] address, boolean accept, int len, byte[] pin);
+    private native boolean sspReplyNative(byte[] address, int type, boolean accept, int passkey);
+    private native boolean getRemoteServicesNative(byte[] address);
+    private native boolean getRemoteMasInstancesNative(byte[] address);
+    private native int connectSocketNative(byte[] address, int type, byte[] uuid, int port,
+            int flag);
+    private native int createSocketChannelNative(int type, String serviceName, byte[] uuid, int port,
+            int flag);
+    private native boolean configHciSnoopLogNative(boolean enable);
+    private native void alarmFiredNative();
+    private native int readEnergyInfo();
+    private native int getSocketOptNative(int fd, int type, int optionName, byte [] optionVal);
+    private native int setSocketOptNative(int fd, int type, int optionName, byte [] optionVal,
+            int optionLen);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+package com.android.bluetooth.btservice;
+
+/**
+ * Host stand-in for the real JniCallbacks, used by the JNI callback benchmark.
+ * It declares the same native methods and upcalls as the real class so
+ * libbluetooth_jni registers against it unchanged; upcalls do nothing.
+ */
+final class JniCallbacks {
+    void stateChangeCallback(int status) {}
+    void adapterPropertyChangedCallback(int[] types, byte[][] val) {}
+    void discoveryStateChangeCallback(int state) {}
+    void devicePropertyChangedCallback(byte[] address, int[] types, byte[][] val) {}
+    void deviceFoundCallback(byte[] address) {}
+    void pinRequestCallback(byte[] address, byte[] name, int cod, boolean secure) {}
+    void sspRequestCallback(byte[] address, byte[] name, int cod, int pairingVariant,
+            int passkey) {}
+    void bondStateChangeCallback(int status, byte[] address, int newState) {}
+    void aclStateChangeCallback(int status, byte[] address, int newState) {}
+    void deviceMasInstancesFoundCallback(int status, byte[] address, String[] name, int[] scn,
+            int[] id, int[] msgtype) {}
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+package com.android.bluetooth.gatt;
+
+/**
+ * Host stand-in for the real AdvertiseManager, used by the JNI callback benchmark.
+ * It declares the same native methods and upcalls as the real class so
+ * libbluetooth_jni registers against it unchanged; upcalls do nothing.
+ */
+class AdvertiseManager {
+    private class AdvertiseNative {
+        private native void gattClientEnableAdvNative(int client_if, int min_interval,
+                int max_interval, int adv_type, int chnl_map, int tx_power, int timeout_s);
+        private native void gattClientUpdateAdvNative(int client_if, int min_interval,
+                int max_interval, int adv_type, int chnl_map, int tx_power, int timeout_s);
+        private native void gattClientSetAdvDataNative(int client_if, boolean set_scan_rsp,
+                boolean incl_name, boolean incl_txpower, int appearance, byte[] manufacturer_data,
+                byte[] service_data, byte[] service_uuid);
+        private native void gattClientDisableAdvNative(int client_if);
+        private native boolean gattClientUpdateAdvDataNative(int client_if, boolean set_scan_rsp,
+                byte[] manufacturer_data, byte[] service_data, byte[] service_uuid);
+        private native void gattSetAdvDataNative(int serverIf, boolean setScanRsp, boolean inclName,
+                boolean inclTxPower, int minSlaveConnectionInterval, int maxSlaveConnectionInterval,
+                int appearance, byte[] manufacturerData, byte[] serviceData, byte[] serviceUuid);
+        private native void gattAdvertiseNative(int client_if, boolean start);
+        private native void gattClientSetAdvSchedulerNative(int instances, int slice_ms);
+        private native boolean gattClientSetVirtualAdvDataNative(int client_if,
+                boolean set_scan_rsp, boolean incl_name, boolean incl_txpower, int appearance,
+                byte[] manufacturer_data, byte[] service_data, byte[] service_uuid);
+        private native boolean gattClientStartVirtualAdvNative(int client_if, int weight,
+                int min_interval, int max_interval, int adv_type, int chnl_map, int tx_power,
+                int timeout_s);
+        private native boolean gattClientStopVirtualAdvNative(int client_if);
+    }
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+package com.android.bluetooth.gatt;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Host stand-in for the real GattService, used by the JNI callback benchmark.
+ * It declares the same native methods and upcalls as the real class so
+ * libbluetooth_jni registers against it unchanged; upcalls do nothing.
+ */
+public class GattService {
+    static {
+        classInitNative();
+    }
+
+    void onClientRegistered(int status, int clientIf, long uuidLsb, long uuidMsb) {}
+    void onScanResult(String address, int rssi, byte[] adv_data, long clientMask) {}
+    void onScanResults(byte[] packed, int count) {}
+    void onConnected(int clientIf, int connId, int status, String address) {}
+    void onDisconnected(int clientIf, int connId, int status, String address) {}
+    void onReadCharacteristic(int connId, int status, int srvcType, int srvcInstId, long srvcUuidLsb,
+            long srvcUuidMsb, int charInstId, long charUuidLsb, long charUuidMsb, int charType,
+            byte[] data) {}
+    void onWriteCharacteristic(int connId, int status, int srvcType, int srvcInstId,
+            long srvcUuidLsb, long srvcUuidMsb, int charInstId, long charUuidLsb,
+            long charUuidMsb) {}
+    void onExecuteCompleted(int connId, int status) {}
+    void onSearchCompleted(int connId, int status) {}
+    void onSearchResult(int connId, int srvcType, int srvcInstId, long srvcUuidLsb,
+            long srvcUuidMsb) {}
+    void onReadDescriptor(int connId, int status, int srvcType, int srvcInstId, long srvcUuidLsb,
+            long srvcUuidMsb, int charInstId, long charUuidLsb, long charUuidMsb, int descrInstId,
+            long descrUuidLsb, long descrUuidMsb, int charType, byte[] data) {}
+    void onWriteDescriptor(int connId, int status, int srvcType, int srvcInstId, long srvcUuidLsb,
+            long srvcUuidMsb, int charInstId, long charUuidLsb, long charUuidMsb, int descrInstId,
+            long descrUuidLsb, long descrUuidMsb) {}
+    void onNotify(int connId, String address, int srvcType, int srvcInstId, long srvcUuidLsb,
+            long srvcUuidMsb, int charInstId, long charUuidLsb, long charUuidMsb, boolean isNotify,
+            byte[] data) {}
+    void onNotifyCompact(int token, byte[] data) {}
+    void onNotifyBatch(int connId, int[] tokens, long[] timestampsNanos, byte[] values) {}
+    void onGetCharacteristic(int connId, int status, int srvcType, int srvcInstId, long srvcUuidLsb,
+            long srvcUuidMsb, int charInstId, long charUuidLsb, long charUuidMsb, int charProp) {}
+    void onGetDescriptor(int connId, int status, int srvcType, int srvcInstId, long srvcUuidLsb,
+            long srvcUuidMsb, int charInstId, long charUuidLsb, long charUuidMsb, int descrInstId,
+            long descrUuidLsb, long descrUuidMsb) {}
+    void onGetIncludedService(int connId, int status, int srvcType, int srvcInstId, long srvcUuidLsb,
+            long srvcUuidMsb, int inclSrvcType, int inclSrvcInstId, long inclSrvcUuidLsb,
+            long inclSrvcUuidMsb) {}
+    void onDiscoveryTable(int connId, int status, byte[] table) {}
+    void onRegisterForNotifications(int connId, int status, int registered, int srvcType,
+            int srvcInstId, long srvcUuidLsb, long srvcUuidMsb, int charInstId, long charUuidLsb,
+            long charUuidMsb) {}
+    void onReadRemoteRssi(int clientIf, String address, int rssi, int status) {}
+    void onConfigureMTU(int connId, int status, int mtu) {}
+    void onAdvertiseCallback(int status, int clientIf) {}
+    void onScanFilterConfig(int action, int status, int clientIf, int filterType,
+            int availableSpace) {}
+    void onScanFilterParamsConfigured(int action, int status, int clientIf, int availableSpace) {}
+    void onScanFilterEnableDisabled(int action, int status, int clientIf) {}
+    void onAdvertiseInstanceEnabled(int status, int clientIf) {}
+    void onAdvertiseDataUpdated(int status, int client_if) {}
+    void onAdvertiseDataSet(int status, int clientIf) {}
+    void onAdvertiseInstanceDisabled(int status, int clientIf) {}
+    void onClientCongestion(int connId, boolean congested) {}
+    void onBatchScanStorageConfigured(int status, int clientIf) {}
+    void onBatchScanStartStopped(int startStopAction, int status, int clientIf) {}
+    void onBatchScanReports(int status, int clientIf, int reportType, long[] addresses,
+            byte[] txPower, byte[] rssi, int[] timestampDeltaMillis, int[] payloadOffsets,
+            byte[] payloads) {}
+    void onBatchScanThresholdCrossed(int clientIf) {}
+    void onTrackAdvFoundLost(int filterIndex, int addrType, String address, int advState,
+            int clientIf) {}
+    void onServerRegistered(int status, int serverIf, long uuidLsb, long uuidMsb) {}
+    void onClientConnected(String address, boolean connected, int connId, int serverIf) {}
+    void onServiceAdded(int status, int serverIf, int srvcType, int srvcInstId, long srvcUuidLsb,
+            long srvcUuidMsb, int srvcHandle) {}
+    void onIncludedServiceAdded(int status, int serverIf, int srvcHandle, int includedSrvcHandle) {}
+    void onCharacteristicAdded(int status, int serverIf, long charUuidLsb, long charUuidMsb,
+            int srvcHandle, int charHandle) {}
+    void onDescriptorAdded(int status, int serverIf, long descrUuidLsb, long descrUuidMsb,
+            int srvcHandle, int descrHandle) {}
+    void onServiceStarted(int status, int serverIf, int srvcHandle) {}
+    void onServiceStopped(int status, int serverIf, int srvcHandle) {}
+    void onServiceDeleted(int status, int serverIf, int srvcHandle) {}
+    void onResponseSendCompleted(int status, int attrHandle) {}
+    void onAttributeRead(String address, int connId, int transId, int attrHandle, int offset,
+            boolean isLong) {}
+    void onAttributeWrite(String address, int connId, int transId, int attrHandle, int offset,
+            int length, boolean needRsp, boolean isPrep, byte[] data) {}
+    void onExecuteWrite(String address, int connId, int transId, int execWrite) {}
+    void onNotificationSent(int connId, int status) {}
+    void onServerCongestion(int connId, boolean congested) {}
+    void onNotificationFanoutDone(int serverIf, int attrHandle, int sent, int failed) {}
+    void onNotificationStreamProgress(int connId, int attrHandle, int status, int sent,
+            int total) {}
+    void onMtuChanged(int connId, int mtu) {}
+
+    private native static void classInitNative();
+    private native void initializeNative(boolean useUpcallQueue, int scanResultRingSize);
+    private native void cleanupNative();
+    private native int gattClientGetDeviceTypeNative(String address);
+    private native void gattClientRegisterAppNative(long app_uuid_lsb, long app_uuid_msb);
+    private native void gattClientUnregisterAppNative(int clientIf);
+    private native void gattClientConnectNative(int clientIf, String address, boolean isDirect,
+            int transport);
+    private native void gattClientDisconnectNative(int clientIf, String address, int conn_id);
+    private native void gattClientRefreshNative(int clientIf, String address);
+    private native void gattClientSearchServiceNative(int conn_id, boolean search_all,
+            long service_uuid_lsb, long service_uuid_msb);
+    private native void gattClientDiscoverServicesNative(int conn_id);
+    private native void gattClientGetCharacteristicNative(int conn_id, int service_type,
+            int service_id_inst_id, long service_id_uuid_lsb, long service_id_uuid_msb,
+            int char_id_inst_id, long char_id_uuid_lsb, long char_id_uuid_msb);
+    private native void gattClientGetDescriptorNative(int conn_id, int service_type,
+            int service_id_inst_id, long service_id_uuid_lsb, long service_id_uuid_msb,
+            int char_id_inst_id, long char_id_uuid_lsb, long char_id_uuid_msb, int descr_id_inst_id,
+            long descr_id_uuid_lsb, long descr_id_uuid_msb);
+    private native void gattClientGetIncludedServiceNative(int conn_id, int service_type,
+            int service_id_inst_id, long service_id_uuid_lsb, long service_id_uuid_msb,
+            int incl_service_id_inst_id, int incl_service_type, long incl_service_id_uuid_lsb,
+            long incl_service_id_uuid_msb);
+    private native void gattClientReadCharacteristicNative(int conn_id, int service_type,
+            int service_id_inst_id, long service_id_uuid_lsb, long service_id_uuid_msb,
+            int char_id_inst_id, long char_id_uuid_lsb, long char_id_uuid_msb, int authReq);
+    private native void gattClientReadDescriptorNative(int conn_id, int service_type,
+            int service_id_inst_id, long service_id_uuid_lsb, long service_id_uuid_msb,
+            int char_id_inst_id, long char_id_uuid_lsb, long char_id_uuid_msb, int descr_id_inst_id,
+            long descr_id_uuid_lsb, long descr_id_uuid_msb, int authReq);
+    private native void gattClientWriteCharacteristicNative(int conn_id, int service_type,
+            int service_id_inst_id, long service_id_uuid_lsb, long service_id_uuid_msb,
+            int char_id_inst_id, long char_id_uuid_lsb, long char_id_uuid_msb, int write_type,
+            int auth_req, byte[] value);
+    private native void gattClientWriteDescriptorNative(int conn_id, int service_type,
+            int service_id_inst_id, long service_id_uuid_lsb, long service_id_uuid_msb,
+            int char_id_inst_id, long char_id_uuid_lsb, long char_id_uuid_msb, int descr_id_inst_id,
+            long descr_id_uuid_lsb, long descr_id_uuid_msb, int write_type, int auth_req,
+            byte[] value);
+    private native boolean gattClientWriteCharacteristicWindowedNative(int conn_id,
+            int service_type, int service_id_inst_id, long service_id_uuid_lsb,
+            long service_id_uuid_msb, int char_id_inst_id, long char_id_uuid_lsb,
+            long char_id_uuid_msb, int write_type, int auth_req, byte[] value, int window);
+    private native void gattClientExecuteWriteNative(int conn_id, boolean execute);
+    private native void gattClientRegisterForNotificationsNative(int clientIf, String address,
+            int service_type, int service_id_inst_id, long service_id_uuid_lsb,
+            long service_id_uuid_msb, int char_id_inst_id, long char_id_uuid_lsb,
+            long char_id_uuid_msb, boolean enable);
+    private native void gattClientReadRemoteRssiNative(int clientIf, String address);
+    private native void gattClientSetNotifyTokenNative(int connId, int srvcType, int srvcInstId,
+            long srvcUuidLsb, long srvcUuidMsb, int charInstId, long charUuidLsb,
+            long charUuidMsb, int token);
+    private native void gattClientSetNotifyBatchingNative(int connId, int windowMillis,
+            int maxBytes);
+    private native void gattClientSetAttributeCacheDirNative(String dir);
+    private native void gattClientConfigureMTUNative(int conn_id, int mtu);
+    private native void gattConnectionParameterUpdateNative(int client_if, String address,
+            int minInterval, int maxInterval, int latency, int timeout);
+    private native void gattServerRegisterAppNative(long app_uuid_lsb, long app_uuid_msb);
+    private native void gattServerUnregisterAppNative(int serverIf);
+    private native void gattServerConnectNative(int server_if, String address, boolean is_direct,
+            int transport);
+    private native void gattServerDisconnectNative(int serverIf, String address, int conn_id);
+    private native void gattServerAddServiceNative(int server_if, int service_type,
+            int service_id_inst_id, long service_id_uuid_lsb, long service_id_uuid_msb,
+            int num_handles);
+    private native void gattServerAddIncludedServiceNative(int server_if, int svc_handle,
+            int included_svc_handle);
+    private native void gattServerAddCharacteristicNative(int server_if, int svc_handle,
+            long char_uuid_lsb, long char_uuid_msb, int properties, int permissions);
+    private native void gattServerAddDescriptorNative(int server_if, int svc_handle,
+            long desc_uuid_lsb, long desc_uuid_msb, int permissions);
+    private native void gattServerStartServiceNative(int server_if, int svc_handle, int transport);
+    private native void gattServerStopServiceNative(int server_if, int svc_handle);
+    private native void gattServerDeleteServiceNative(int server_if, int svc_handle);
+    private native void gattServerSendIndicationNative(int server_if, int attr_handle, int conn_id,
+            byte[] val);
+    private native void gattServerSendNotificationNative(int server_if, int attr_handle, int conn_id,
+            byte[] val);
+    private native boolean gattServerSendNotificationMultiNative(int server_if, int attr_handle,
+            int[] conn_ids, byte[] val);
+    private native boolean gattServerSendNotificationStreamNative(int server_if, int attr_handle,
+            int conn_id, byte[] val);
+    private native void gattServerSendResponseNative(int server_if, int conn_id, int trans_id,
+            int status, int handle, int offset, byte[] val, int auth_req);
+    private native void gattServerSetPrepWriteLimitNative(int maxBytes);
+    private native void gattServerSetSubscriptionFilterNative(boolean filter);
+    private native void gattServerSetAttributeValueNative(int handle, byte[] value);
+    private native void gattTestNative(int command, long uuid1_lsb, long uuid1_msb, String bda1,
+            int p1, int p2, int p3, int p4, int p5);
+
+    private native int[] gattGetUpcallQueueStatsNative();
+    private native ByteBuffer gattGetScanResultRingNative();
+    private native long gattWaitScanResultRingNative(int consumed, int timeoutMillis);
+    private native void gattStopScanResultRingNative();
+}
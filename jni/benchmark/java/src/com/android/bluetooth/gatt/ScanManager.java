@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+package com.android.bluetooth.gatt;
+
+/**
+ * Host stand-in for the real ScanManager, used by the JNI callback benchmark.
+ * It declares the same native methods and upcalls as the real class so
+ * libbluetooth_jni registers against it unchanged; upcalls do nothing.
+ */
+public class ScanManager {
+    private class ScanNative {
+        private native void gattClientScanNative(boolean start);
+        private native void gattClientConfigBatchScanStorageNative(int client_if,
+                int max_full_reports_percent, int max_truncated_reports_percent,
+                int notify_threshold_percent);
+        private native void gattClientStartBatchScanNative(int client_if, int scan_mode,
+                int scan_interval_unit, int scan_window_unit, int address_type, int discard_rule);
+        private native void gattClientStopBatchScanNative(int client_if);
+        private native void gattClientReadScanReportsNative(int client_if, int scan_type);
+        private native void gattClientScanFilterParamAddNative(int client_if, int filt_index,
+                int feat_seln, int list_logic_type, int filt_logic_type, int rssi_high_thres,
+                int rssi_low_thres, int dely_mode, int found_timeout, int lost_timeout,
+                int found_timeout_cnt);
+        private native void gattClientScanFilterParamDeleteNative(int client_if, int filt_index);
+        private native void gattClientScanFilterParamClearAllNative(int client_if);
+        private native void gattClientScanFilterAddNative(int client_if, int filter_type,
+                int filter_index, int company_id, int company_id_mask, long uuid_lsb, long uuid_msb,
+                long uuid_mask_lsb, long uuid_mask_msb, String name, String address, byte addr_type,
+                byte[] data, byte[] mask);
+        private native void gattClientScanFilterDeleteNative(int client_if, int filter_type,
+                int filter_index, int company_id, int company_id_mask, long uuid_lsb, long uuid_msb,
+                long uuid_mask_lsb, long uuid_mask_msb, String name, String address, byte addr_type,
+                byte[] data, byte[] mask);
+        private native void gattClientScanFilterClearNative(int client_if, int filter_index);
+        private native void gattClientScanFilterEnableNative(int client_if, boolean enable);
+        private native void gattSetScanParametersNative(int scan_interval, int scan_window);
+        private native void gattSetScanResultBatchingNative(int flush_window_ms, int max_records);
+        private native void gattSetScanDedupNative(int window_ms, int rssi_delta);
+        private native void gattSetScanDedupExemptNative(int slot, boolean exempt);
+        private native void gattSetScanFilterEmulationNative(boolean enable);
+        private native int gattSoftScanFilterRegisterNative(int client_if);
+        private native void gattSoftScanFilterUnregisterNative(int slot);
+        private native void gattSoftScanFilterAddNative(int slot, int filter_index,
+                int filter_type, int company_id, long uuid_lsb, long uuid_msb,
+                long uuid_mask_lsb, long uuid_mask_msb, String name, String address,
+                byte[] data, byte[] mask);
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+package com.android.bluetooth.hfp;
+
+/**
+ * Host stand-in for the real HeadsetStateMachine, used by the JNI callback benchmark.
+ * It declares the same native methods and upcalls as the real class so
+ * libbluetooth_jni registers against it unchanged; upcalls do nothing.
+ */
+final class HeadsetStateMachine {
+    static {
+        classInitNative();
+    }
+
+    void onConnectionStateChanged(int state, byte[] address) {}
+    void onAudioStateChanged(int state, byte[] address) {}
+    void onVrStateChanged(int state, byte[] address) {}
+    void onAnswerCall(byte[] address) {}
+    void onHangupCall(byte[] address) {}
+    void onVolumeChanged(int type, int volume, byte[] address) {}
+    void onDialCall(String number, byte[] address) {}
+    void onSendDtmf(int dtmf, byte[] address) {}
+    void onNoiceReductionEnable(boolean enable, byte[] address) {}
+    void onWBS(int codec, byte[] address) {}
+    void onAtChld(int chld, byte[] address) {}
+    void onAtCnum(byte[] address) {}
+    void onAtCind(byte[] address) {}
+    void onAtCops(byte[] address) {}
+    void onAtClcc(byte[] address) {}
+    void onUnknownAt(String atString, byte[] address) {}
+    void onKeyPressed(byte[] address) {}
+
+    private native static void classInitNative();
+    private native void initializeNative(int max_hf_clients);
+    private native void initializeFeaturesNative(int feature_bitmask);
+    private native void cleanupNative();
+    private native boolean connectHfpNative(byte[] address);
+    private native boolean disconnectHfpNative(byte[] address);
+    private native boolean connectAudioNative(byte[] address);
+    private native boolean disconnectAudioNative(byte[] address);
+    private native boolean startVoiceRecognitionNative(byte[] address);
+    private native boolean stopVoiceRecognitionNative(byte[] address);
+    private native boolean setVolumeNative(int volumeType, int volume, byte[] address);
+    private native boolean notifyDeviceStatusNative(int networkState, int serviceType, int signal,
+            int batteryCharge);
+    private native boolean copsResponseNative(String operatorName, byte[] address);
+    private native boolean cindResponseNative(int service, int numActive, int numHeld, int callState,
+            int signal, int roam, int batteryCharge, byte[] address);
+    private native boolean atResponseStringNative(String responseString, byte[] address);
+    private native boolean atResponseCodeNative(int responseCode, int errorCode, byte[] address);
+    private native boolean clccResponseNative(int index, int dir, int status, int mode, boolean mpty,
+            String number, int type, byte[] address);
+    private native boolean phoneStateChangeNative(int numActive, int numHeld, int callState,
+            String number, int type);
+    private native boolean configureWBSNative(byte[] address,int condec_config);
+    private native int getRemoteFeaturesNative(byte[] address);
+}
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Replays HAL callbacks through libbluetooth_jni into an embedded VM and
+ * reports the cost of each upcall. Runs on a plain Linux host: the stack is
+ * replaced by the fake HAL in fake_hal.cpp and the service classes by the
+ * stubs under java/.
+ *
+ *   bluetooth_jni_callback_benchmark [--classpath <jar>] [--scenario <name>]
+ *       [--count <n>] [--warmup <n>] [--rate <per second>] [--devices <n>]
+ *       [--upcall-queue] [--list]
+ *
+ * With --upcall-queue the GATT module posts its hot callbacks to the upcall
+ * queue, so the reported latency is the HAL-side enqueue cost.
+ */
+
+#define LOG_TAG "BtJniBenchmark"
+
+#include "com_android_bluetooth.h"
+#include "callback_replay.h"
+#include "com_android_bluetooth_scan_filter.h"
+#include "JniInvocation.h"
+#include "android_runtime/AndroidRuntime.h"
+#include "utils/Log.h"
+
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+int register_com_android_bluetooth_btservice_AdapterService(JNIEnv* env);
+}
+
+using namespace android;
+using namespace android::benchmark;
+
+#define DEFAULT_STUBS_JAR "framework/bluetooth-jni-benchmark-stubs.jar"
+#define BENCHMARK_SCAN_CLIENT_IF 1
+
+typedef struct {
+    const char *class_name;
+    const char *init_method;
+    const char *init_signature;
+    const char *cleanup_method;
+    const char *cleanup_signature;
+    jobject object;
+} service_t;
+
+// Created in order: the adapter has to be up before the profiles look up
+// their interfaces through getBluetoothInterface().
+static service_t sServices[] = {
+    {"com/android/bluetooth/btservice/AdapterService", "initNative", "()Z",
+        "cleanupNative", "()V", NULL},
+    {"com/android/bluetooth/gatt/GattService", "initializeNative", "(ZI)V",
+        "cleanupNative", "()V", NULL},
+    {"com/android/bluetooth/avrcp/Avrcp", "initNative", "()V",
+        "cleanupNative", "()V", NULL},
+    {"com/android/bluetooth/hfp/HeadsetStateMachine", "initializeNative", "(I)V",
+        "cleanupNative", "()V", NULL},
+};
+
+#define NUM_SERVICES ((int)(sizeof(sServices) / sizeof(sServices[0])))
+
+static bool sUseUpcallQueue = false;
+
+static bool register_natives(JNIEnv* env) {
+    return register_com_android_bluetooth_btservice_AdapterService(env) >= 0 &&
+           register_com_android_bluetooth_gatt(env) >= 0 &&
+           register_com_android_bluetooth_avrcp(env) >= 0 &&
+           register_com_android_bluetooth_hfp(env) >= 0;
+}
+
+static bool start_services(JNIEnv* env) {
+    for (int i = 0; i < NUM_SERVICES; i++) {
+        service_t *service = &sServices[i];
+        jclass clazz = env->FindClass(service->class_name);
+        if (clazz == NULL) {
+            fprintf(stderr, "Unable to find %s\n", service->class_name);
+            return false;
+        }
+
+        jmethodID ctor = env->GetMethodID(clazz, "<init>", "()V");
+        jmethodID init = env->GetMethodID(clazz, service->init_method, service->init_signature);
+        if (ctor == NULL || init == NULL) {
+            fprintf(stderr, "Unable to resolve %s.%s\n", service->class_name,
+                    service->init_method);
+            return false;
+        }
+
+        jobject object = env->NewObject(clazz, ctor);
+        if (object == NULL || env->ExceptionCheck()) {
+            env->ExceptionDescribe();
+            return false;
+        }
+        service->object = env->NewGlobalRef(object);
+        env->DeleteLocalRef(object);
+        env->DeleteLocalRef(clazz);
+
+        // Natives are registered against the stub classes, so calling them
+        // through JNI runs the real initialization code in libbluetooth_jni.
+        if (!strcmp(service->init_signature, "()Z")) {
+            if (!env->CallBooleanMethod(service->object, init)) {
+                fprintf(stderr, "%s.%s failed\n", service->class_name, service->init_method);
+                return false;
+            }
+        } else if (!strcmp(service->init_signature, "(ZI)V")) {
+            // GATT: optional upcall queue, no shared scan result ring
+            env->CallVoidMethod(service->object, init, (jboolean) sUseUpcallQueue, 0);
+        } else if (!strcmp(service->init_signature, "(I)V")) {
+            env->CallVoidMethod(service->object, init, 1);
+        } else {
+            env->CallVoidMethod(service->object, init);
+        }
+        if (env->ExceptionCheck()) {
+            env->ExceptionDescribe();
+            return false;
+        }
+    }
+    return true;
+}
+
+static void stop_services(JNIEnv* env) {
+    for (int i = NUM_SERVICES - 1; i >= 0; i--) {
+        service_t *service = &sServices[i];
+        if (service->object == NULL) continue;
+
+        jclass clazz = env->GetObjectClass(service->object);
+        jmethodID cleanup = env->GetMethodID(clazz, service->cleanup_method,
+                                             service->cleanup_signature);
+        if (cleanup != NULL) env->CallVoidMethod(service->object, cleanup);
+        env->ExceptionClear();
+        env->DeleteLocalRef(clazz);
+        env->DeleteGlobalRef(service->object);
+        service->object = NULL;
+    }
+}
+
+static void print_result(const char *name, const replay_result_t *r) {
+    double rate = r->elapsed_ns ? (double)r->count * 1e9 / (double)r->elapsed_ns : 0;
+    printf("%-24s %9d %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %11.0f\n", name, r->count,
+           r->mean_ns / 1000.0, r->min_ns / 1000.0, r->p50_ns / 1000.0, r->p90_ns / 1000.0,
+           r->p99_ns / 1000.0, r->max_ns / 1000.0, rate);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--classpath <jar>] [--scenario <name>] [--count <n>]\n"
+            "          [--warmup <n>] [--rate <per second>] [--devices <n>] [--upcall-queue]\n"
+            "          [--list]\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"classpath", required_argument, NULL, 'c'},
+        {"scenario",  required_argument, NULL, 's'},
+        {"count",     required_argument, NULL, 'n'},
+        {"warmup",    required_argument, NULL, 'w'},
+        {"rate",      required_argument, NULL, 'r'},
+        {"devices",   required_argument, NULL, 'd'},
+        {"upcall-queue", no_argument,    NULL, 'q'},
+        {"list",      no_argument,       NULL, 'l'},
+        {NULL, 0, NULL, 0},
+    };
+
+    replay_config_t config;
+    config.count = 10000;
+    config.warmup = 1000;
+    config.rate = 0;
+    config.num_devices = 64;
+    const char *classpath = NULL;
+    const char *scenario = NULL;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "c:s:n:w:r:d:ql", options, NULL)) != -1) {
+        switch (opt) {
+            case 'c': classpath = optarg; break;
+            case 's': scenario = optarg; break;
+            case 'n': config.count = atoi(optarg); break;
+            case 'w': config.warmup = atoi(optarg); break;
+            case 'r': config.rate = atoi(optarg); break;
+            case 'd': config.num_devices = atoi(optarg); break;
+            case 'q': sUseUpcallQueue = true; break;
+            case 'l':
+                for (int i = 0; i < replay_scenario_count(); i++) {
+                    printf("%s\n", replay_scenario_name(i));
+                }
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    char default_classpath[PATH_MAX];
+    if (classpath == NULL) {
+        const char *host_out = getenv("ANDROID_HOST_OUT");
+        snprintf(default_classpath, sizeof(default_classpath), "%s/%s",
+                 host_out ? host_out : ".", DEFAULT_STUBS_JAR);
+        classpath = default_classpath;
+    }
+
+    char classpath_option[PATH_MAX + 32];
+    snprintf(classpath_option, sizeof(classpath_option), "-Djava.class.path=%s", classpath);
+
+    JniInvocation jni_invocation;
+    if (!jni_invocation.Init(NULL)) {
+        fprintf(stderr, "Unable to load a VM library\n");
+        return 1;
+    }
+
+    JavaVMOption vm_options[1];
+    vm_options[0].optionString = classpath_option;
+    vm_options[0].extraInfo = NULL;
+
+    JavaVMInitArgs vm_args;
+    vm_args.version = JNI_VERSION_1_6;
+    vm_args.nOptions = 1;
+    vm_args.options = vm_options;
+    vm_args.ignoreUnrecognized = JNI_FALSE;
+
+    JavaVM *vm;
+    JNIEnv *env;
+    if (JNI_CreateJavaVM(&vm, &env, &vm_args) != JNI_OK) {
+        fprintf(stderr, "Unable to create the VM\n");
+        return 1;
+    }
+    AndroidRuntime::setJavaVM(vm);
+
+    int ret = 0;
+    if (!register_natives(env) || !start_services(env)) {
+        fprintf(stderr, "Unable to start libbluetooth_jni against %s\n", classpath);
+        ret = 1;
+    } else {
+        // Stands in for a regular scan client without filters, so scan results are
+        // not dropped before reaching the upcall being measured.
+        int scan_filter_slot = scan_filter_register(BENCHMARK_SCAN_CLIENT_IF);
+
+        printf("%-24s %9s %9s %9s %9s %9s %9s %9s %11s\n", "callback", "count", "mean(us)",
+               "min(us)", "p50(us)", "p90(us)", "p99(us)", "max(us)", "calls/s");
+        bool found = false;
+        for (int i = 0; i < replay_scenario_count(); i++) {
+            const char *name = replay_scenario_name(i);
+            if (scenario && strcmp(scenario, name)) continue;
+            found = true;
+
+            replay_result_t result;
+            if (!replay_run(i, &config, &result)) {
+                fprintf(stderr, "%s: replay failed\n", name);
+                ret = 1;
+                continue;
+            }
+            print_result(name, &result);
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown scenario %s\n", scenario);
+            ret = 1;
+        }
+        scan_filter_unregister(scan_filter_slot);
+    }
+
+    stop_services(env);
+    vm->DestroyJavaVM();
+    return ret;
+}
@@ -32,6 +32,14 @@ const bt_interface_t* getBluetoothInterface();
 
 JNIEnv* getCallbackEnv();
 
+/*
+ * Returns a local ref to the interned "XX:XX:XX:XX:XX:XX" string for bda.
+ * Release it with DeleteLocalRef, as with a string from NewStringUTF.
+ */
+jstring getAddressString(JNIEnv* env, const bt_bdaddr_t* bda);
+
+void clearAddressStringCache(JNIEnv* env);
+
 int register_com_android_bluetooth_hfp(JNIEnv* env);
 
 int register_com_android_bluetooth_hfpclient(JNIEnv* env);
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothAddressCacheJni"
+
+#include "com_android_bluetooth.h"
+#include "utils/Log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+namespace android {
+
+/*
+ * Interned "XX:XX:XX:XX:XX:XX" strings for the most recently reported
+ * remote addresses. Callbacks for the same few peers arrive over and over
+ * while scanning or connected, so handing Java the same String instance
+ * saves a format and an allocation on every upcall.
+ *
+ * Entries hold global refs and live in a fixed array, chained into hash
+ * buckets by address and into an LRU list; the least recently used entry
+ * is recycled once the array is full.
+ */
+
+#define ADDRESS_CACHE_SIZE      128
+#define ADDRESS_CACHE_BUCKETS   256
+#define ADDRESS_CACHE_NONE      (-1)
+
+typedef struct {
+    uint64_t key;
+    jstring str;
+    int hash_next;
+    int lru_prev;
+    int lru_next;
+} address_cache_entry_t;
+
+static pthread_mutex_t sAddressCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static address_cache_entry_t sAddressCache[ADDRESS_CACHE_SIZE];
+static int sAddressCacheBuckets[ADDRESS_CACHE_BUCKETS];
+static int sAddressCacheUsed = 0;
+static int sAddressCacheHead = ADDRESS_CACHE_NONE;   // most recently used
+static int sAddressCacheTail = ADDRESS_CACHE_NONE;   // least recently used
+static bool sAddressCacheReady = false;
+
+static inline uint64_t address_key(const bt_bdaddr_t *bda) {
+    uint64_t key = 0;
+    for (int i = 0; i < 6; i++) {
+        key = (key << 8) | bda->address[i];
+    }
+    return key;
+}
+
+static inline int address_bucket(uint64_t key) {
+    // The low bytes carry the device specific part of the address
+    key ^= key >> 24;
+    key *= 0x9E3779B97F4A7C15ULL;
+    return (int)(key >> 56) & (ADDRESS_CACHE_BUCKETS - 1);
+}
+
+static void address_cache_reset() {
+    for (int i = 0; i < ADDRESS_CACHE_BUCKETS; i++) {
+        sAddressCacheBuckets[i] = ADDRESS_CACHE_NONE;
+    }
+    sAddressCacheUsed = 0;
+    sAddressCacheHead = ADDRESS_CACHE_NONE;
+    sAddressCacheTail = ADDRESS_CACHE_NONE;
+    sAddressCacheReady = true;
+}
+
+static void lru_unlink(int idx) {
+    address_cache_entry_t *e = &sAddressCache[idx];
+    if (e->lru_prev != ADDRESS_CACHE_NONE) {
+        sAddressCache[e->lru_prev].lru_next = e->lru_next;
+    } else {
+        sAddressCacheHead = e->lru_next;
+    }
+    if (e->lru_next != ADDRESS_CACHE_NONE) {
+        sAddressCache[e->lru_next].lru_prev = e->lru_prev;
+    } else {
+        sAddressCacheTail = e->lru_prev;
+    }
+}
+
+static void lru_push_front(int idx) {
+    address_cache_entry_t *e = &sAddressCache[idx];
+    e->lru_prev = ADDRESS_CACHE_NONE;
+    e->lru_next = sAddressCacheHead;
+    if (sAddressCacheHead != ADDRESS_CACHE_NONE) {
+        sAddressCache[sAddressCacheHead].lru_prev = idx;
+    }
+    sAddressCacheHead = idx;
+    if (sAddressCacheTail == ADDRESS_CACHE_NONE) sAddressCacheTail = idx;
+}
+
+static void hash_unlink(int idx) {
+    int *link = &sAddressCacheBuckets[address_bucket(sAddressCache[idx].key)];
+    while (*link != ADDRESS_CACHE_NONE) {
+        if (*link == idx) {
+            *link = sAddressCache[idx].hash_next;
+            return;
+        }
+        link = &sAddressCache[*link].hash_next;
+    }
+}
+
+jstring getAddressString(JNIEnv *env, const bt_bdaddr_t *bda) {
+    uint64_t key = address_key(bda);
+
+    pthread_mutex_lock(&sAddressCacheLock);
+    if (!sAddressCacheReady) address_cache_reset();
+
+    int bucket = address_bucket(key);
+    for (int idx = sAddressCacheBuckets[bucket]; idx != ADDRESS_CACHE_NONE;
+         idx = sAddressCache[idx].hash_next) {
+        if (sAddressCache[idx].key == key) {
+            if (idx != sAddressCacheHead) {
+                lru_unlink(idx);
+                lru_push_front(idx);
+            }
+            jstring str = (jstring) env->NewLocalRef(sAddressCache[idx].str);
+            pthread_mutex_unlock(&sAddressCacheLock);
+            return str;
+        }
+    }
+
+    char c_address[32];
+    snprintf(c_address, sizeof(c_address), "%02X:%02X:%02X:%02X:%02X:%02X",
+        bda->address[0], bda->address[1], bda->address[2],
+        bda->address[3], bda->address[4], bda->address[5]);
+    jstring str = env->NewStringUTF(c_address);
+    if (str == NULL) {
+        pthread_mutex_unlock(&sAddressCacheLock);
+        return NULL;
+    }
+
+    jstring global = (jstring) env->NewGlobalRef(str);
+    if (global == NULL) {
+        pthread_mutex_unlock(&sAddressCacheLock);
+        return str;
+    }
+
+    int idx;
+    if (sAddressCacheUsed < ADDRESS_CACHE_SIZE) {
+        idx = sAddressCacheUsed++;
+    } else {
+        idx = sAddressCacheTail;
+        lru_unlink(idx);
+        hash_unlink(idx);
+        env->DeleteGlobalRef(sAddressCache[idx].str);
+    }
+
+    address_cache_entry_t *e = &sAddressCache[idx];
+    e->key = key;
+    e->str = global;
+    e->hash_next = sAddressCacheBuckets[bucket];
+    sAddressCacheBuckets[bucket] = idx;
+    lru_push_front(idx);
+
+    pthread_mutex_unlock(&sAddressCacheLock);
+    return str;
+}
+
+void clearAddressStringCache(JNIEnv *env) {
+    pthread_mutex_lock(&sAddressCacheLock);
+    for (int i = 0; i < sAddressCacheUsed; i++) {
+        env->DeleteGlobalRef(sAddressCache[i].str);
+        sAddressCache[i].str = NULL;
+    }
+    address_cache_reset();
+    pthread_mutex_unlock(&sAddressCacheLock);
+}
+
+}
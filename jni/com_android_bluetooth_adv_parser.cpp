@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothAdvParserJni"
+
+#include "com_android_bluetooth_adv_parser.h"
+
+namespace android {
+
+#define AD_TYPE_FLAGS               0x01
+#define AD_TYPE_UUID16_PARTIAL      0x02
+#define AD_TYPE_UUID16_COMPLETE     0x03
+#define AD_TYPE_UUID32_PARTIAL      0x04
+#define AD_TYPE_UUID32_COMPLETE     0x05
+#define AD_TYPE_UUID128_PARTIAL     0x06
+#define AD_TYPE_UUID128_COMPLETE    0x07
+#define AD_TYPE_NAME_SHORT          0x08
+#define AD_TYPE_NAME_COMPLETE       0x09
+#define AD_TYPE_TX_POWER            0x0A
+#define AD_TYPE_SOLICIT_UUID16      0x14
+#define AD_TYPE_SOLICIT_UUID128     0x15
+#define AD_TYPE_SERVICE_DATA_16     0x16
+#define AD_TYPE_SOLICIT_UUID32      0x1F
+#define AD_TYPE_SERVICE_DATA_32     0x20
+#define AD_TYPE_SERVICE_DATA_128    0x21
+#define AD_TYPE_MANUFACTURER_DATA   0xFF
+
+// 00000000-0000-1000-8000-00805F9B34FB in bt_uuid_t byte order
+static const uint8_t BASE_UUID[16] = {
+    0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80,
+    0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+/*
+ * Expands count UUIDs of width bytes each into out. The base UUID stays in
+ * a vector register and only the short value is inserted per UUID, so each
+ * expansion is one 16 byte store.
+ */
+static void expand_uuids(bt_uuid_t *out, const uint8_t *data, int count, int width) {
+#if defined(ADV_PARSER_NEON)
+    if (width == 16) {
+        for (int i = 0; i < count; i++, data += 16) vst1q_u8(out[i].uu, vld1q_u8(data));
+        return;
+    }
+
+    uint16x8_t base = vreinterpretq_u16_u8(vld1q_u8(BASE_UUID));
+    for (int i = 0; i < count; i++, data += width) {
+        uint16x8_t v = vsetq_lane_u16((uint16_t) (data[0] | (data[1] << 8)), base, 6);
+        if (width == 4) v = vsetq_lane_u16((uint16_t) (data[2] | (data[3] << 8)), v, 7);
+        vst1q_u8(out[i].uu, vreinterpretq_u8_u16(v));
+    }
+#elif defined(ADV_PARSER_SSE2)
+    if (width == 16) {
+        for (int i = 0; i < count; i++, data += 16) {
+            _mm_storeu_si128((__m128i *) out[i].uu, _mm_loadu_si128((const __m128i *) data));
+        }
+        return;
+    }
+
+    __m128i base = _mm_loadu_si128((const __m128i *) BASE_UUID);
+    for (int i = 0; i < count; i++, data += width) {
+        __m128i v = _mm_insert_epi16(base, data[0] | (data[1] << 8), 6);
+        if (width == 4) v = _mm_insert_epi16(v, data[2] | (data[3] << 8), 7);
+        _mm_storeu_si128((__m128i *) out[i].uu, v);
+    }
+#else
+    if (width == 16) {
+        memcpy(out, data, count * 16);
+        return;
+    }
+
+    for (int i = 0; i < count; i++, data += width) {
+        memcpy(out[i].uu, BASE_UUID, 16);
+        memcpy(&out[i].uu[12], data, width);
+    }
+#endif
+}
+
+static void add_uuid_list(bt_uuid_t *uuids, uint8_t *num_uuids, int max_uuids,
+                          const uint8_t *data, int len, int width) {
+    int count = len / width;
+    if (count > max_uuids - *num_uuids) count = max_uuids - *num_uuids;
+    expand_uuids(&uuids[*num_uuids], data, count, width);
+    *num_uuids += count;
+}
+
+static int find_uuid(const bt_uuid_t *uuids, int num_uuids, const bt_uuid_t *uuid,
+                     const bt_uuid_t *mask) {
+    for (int i = 0; i < num_uuids; i++) {
+        if (adv_uuid_match(&uuids[i], uuid, mask)) return i;
+    }
+    return -1;
+}
+
+static void add_service_data(adv_record_t *rec, const uint8_t *base, const uint8_t *data,
+                             int len, int width) {
+    if (len < width || rec->num_service_data >= ADV_MAX_FIELDS) return;
+
+    adv_service_data_t *entry = &rec->service_data[rec->num_service_data++];
+    expand_uuids(&entry->uuid, data, 1, width);
+    entry->uuid_len = width;
+    entry->data.offset = (uint8_t) (data + width - base);
+    entry->data.len = (uint8_t) (len - width);
+}
+
+bool adv_parse(const uint8_t *data, size_t size, adv_record_t *rec) {
+    rec->present = 0;
+    rec->len = 0;
+    rec->num_uuids = 0;
+    rec->num_manufacturer_data = 0;
+    rec->num_service_data = 0;
+    rec->num_solicit_uuids = 0;
+    if (size > 255) size = 255;     // spans hold 8 bit offsets
+
+    size_t pos = 0;
+    while (pos < size) {
+        int len = data[pos];
+        if (len == 0) break;
+        pos++;
+        if (pos + len > size) {
+            rec->present = ADV_MALFORMED;
+            rec->num_uuids = 0;
+            rec->num_manufacturer_data = 0;
+            rec->num_service_data = 0;
+            rec->num_solicit_uuids = 0;
+            return false;
+        }
+
+        int type = data[pos];
+        const uint8_t *value = &data[pos + 1];
+        int value_len = len - 1;
+        pos += len;
+
+        switch (type) {
+            case AD_TYPE_FLAGS:
+                if (value_len < 1) break;
+                rec->flags = value[0];
+                rec->present |= ADV_HAS_FLAGS;
+                break;
+
+            case AD_TYPE_UUID16_PARTIAL:
+            case AD_TYPE_UUID16_COMPLETE:
+                add_uuid_list(rec->uuids, &rec->num_uuids, ADV_MAX_UUIDS, value, value_len, 2);
+                break;
+
+            case AD_TYPE_UUID32_PARTIAL:
+            case AD_TYPE_UUID32_COMPLETE:
+                add_uuid_list(rec->uuids, &rec->num_uuids, ADV_MAX_UUIDS, value, value_len, 4);
+                break;
+
+            case AD_TYPE_UUID128_PARTIAL:
+            case AD_TYPE_UUID128_COMPLETE:
+                add_uuid_list(rec->uuids, &rec->num_uuids, ADV_MAX_UUIDS, value, value_len, 16);
+                break;
+
+            case AD_TYPE_NAME_SHORT:
+            case AD_TYPE_NAME_COMPLETE:
+                rec->name.offset = (uint8_t) (value - data);
+                rec->name.len = (uint8_t) value_len;
+                rec->present |= ADV_HAS_NAME;
+                if (type == AD_TYPE_NAME_COMPLETE) rec->present |= ADV_NAME_COMPLETE;
+                else rec->present &= ~ADV_NAME_COMPLETE;
+                break;
+
+            case AD_TYPE_TX_POWER:
+                if (value_len < 1) break;
+                rec->tx_power = (int8_t) value[0];
+                rec->present |= ADV_HAS_TX_POWER;
+                break;
+
+            case AD_TYPE_SOLICIT_UUID16:
+                add_uuid_list(rec->solicit_uuids, &rec->num_solicit_uuids, ADV_MAX_SOLICIT_UUIDS,
+                              value, value_len, 2);
+                break;
+
+            case AD_TYPE_SOLICIT_UUID32:
+                add_uuid_list(rec->solicit_uuids, &rec->num_solicit_uuids, ADV_MAX_SOLICIT_UUIDS,
+                              value, value_len, 4);
+                break;
+
+            case AD_TYPE_SOLICIT_UUID128:
+                add_uuid_list(rec->solicit_uuids, &rec->num_solicit_uuids, ADV_MAX_SOLICIT_UUIDS,
+                              value, value_len, 16);
+                break;
+
+            case AD_TYPE_SERVICE_DATA_16:
+                add_service_data(rec, data, value, value_len, 2);
+                break;
+
+            case AD_TYPE_SERVICE_DATA_32:
+                add_service_data(rec, data, value, value_len, 4);
+                break;
+
+            case AD_TYPE_SERVICE_DATA_128:
+                add_service_data(rec, data, value, value_len, 16);
+                break;
+
+            case AD_TYPE_MANUFACTURER_DATA:
+                if (value_len < 2 || rec->num_manufacturer_data >= ADV_MAX_FIELDS) break;
+                {
+                    adv_manufacturer_data_t *entry =
+                            &rec->manufacturer_data[rec->num_manufacturer_data++];
+                    entry->company = (uint16_t) (value[0] | (value[1] << 8));
+                    entry->data.offset = (uint8_t) (value + 2 - data);
+                    entry->data.len = (uint8_t) (value_len - 2);
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+    rec->len = (uint8_t) pos;
+    return true;
+}
+
+int adv_find_uuid(const adv_record_t *rec, const bt_uuid_t *uuid, const bt_uuid_t *mask) {
+    return find_uuid(rec->uuids, rec->num_uuids, uuid, mask);
+}
+
+int adv_find_solicit_uuid(const adv_record_t *rec, const bt_uuid_t *uuid,
+                          const bt_uuid_t *mask) {
+    return find_uuid(rec->solicit_uuids, rec->num_solicit_uuids, uuid, mask);
+}
+
+const adv_manufacturer_data_t* adv_find_manufacturer_data(const adv_record_t *rec,
+                                                          uint16_t company) {
+    for (int i = rec->num_manufacturer_data - 1; i >= 0; i--) {
+        if (rec->manufacturer_data[i].company == company) return &rec->manufacturer_data[i];
+    }
+    return NULL;
+}
+
+const adv_service_data_t* adv_find_service_data(const adv_record_t *rec,
+                                                const bt_uuid_t *uuid) {
+    for (int i = rec->num_service_data - 1; i >= 0; i--) {
+        if (!memcmp(rec->service_data[i].uuid.uu, uuid->uu, 16)) return &rec->service_data[i];
+    }
+    return NULL;
+}
+
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_ADV_PARSER_H
+#define COM_ANDROID_BLUETOOTH_ADV_PARSER_H
+
+#include "hardware/bluetooth.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ADV_PARSER_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define ADV_PARSER_SSE2
+#endif
+
+namespace android {
+
+/*
+ * Advertising data parser.
+ *
+ * Walks the length/type/value structures of an advertisement (advertising
+ * data followed by the scan response, as reported by the stack) into a
+ * fixed layout record. Variable length values are not copied: spans refer
+ * back into the parsed buffer. UUIDs of every width are expanded to 128
+ * bits in bt_uuid_t byte order, so lookups compare 16 bytes at a time.
+ * Vector instructions only serve that expansion and the masked UUID
+ * comparison; the length walk is serial.
+ *
+ * Like ScanRecord.parseFromBytes(), parsing stops at the first zero length
+ * and a structure that overruns the buffer invalidates the whole record.
+ * The record serves the native scan filters and batch scan reports; scan
+ * results still reach Java as raw bytes, which GattService parses again.
+ */
+
+#define ADV_DATA_MAX_LEN        62
+#define ADV_MAX_UUIDS           31
+#define ADV_MAX_FIELDS          8
+#define ADV_MAX_SOLICIT_UUIDS   8
+
+// adv_record_t.present bits
+#define ADV_HAS_FLAGS           0x01
+#define ADV_HAS_TX_POWER        0x02
+#define ADV_HAS_NAME            0x04
+#define ADV_NAME_COMPLETE       0x08
+#define ADV_MALFORMED           0x80
+
+typedef struct {
+    uint8_t offset;
+    uint8_t len;
+} adv_span_t;
+
+typedef struct {
+    uint16_t company;
+    adv_span_t data;        // after the company identifier
+} adv_manufacturer_data_t;
+
+typedef struct {
+    bt_uuid_t uuid;
+    uint8_t uuid_len;       // 2, 4 or 16, as carried in the advertisement
+    adv_span_t data;        // after the UUID
+} adv_service_data_t;
+
+typedef struct {
+    uint8_t present;
+    uint8_t len;            // bytes before the first zero length, i.e. without padding
+    uint8_t flags;
+    int8_t tx_power;
+    uint8_t num_uuids;
+    uint8_t num_manufacturer_data;
+    uint8_t num_service_data;
+    uint8_t num_solicit_uuids;
+    adv_span_t name;
+    adv_manufacturer_data_t manufacturer_data[ADV_MAX_FIELDS];
+    adv_service_data_t service_data[ADV_MAX_FIELDS];
+    bt_uuid_t uuids[ADV_MAX_UUIDS];
+    bt_uuid_t solicit_uuids[ADV_MAX_SOLICIT_UUIDS];
+} adv_record_t;
+
+/*
+ * Parses len bytes of advertising data into rec. Returns false, with rec
+ * left empty apart from ADV_MALFORMED, if a structure overruns the data.
+ */
+bool adv_parse(const uint8_t *data, size_t len, adv_record_t *rec);
+
+/*
+ * Returns the index of the first UUID equal to uuid under mask, or -1.
+ */
+int adv_find_uuid(const adv_record_t *rec, const bt_uuid_t *uuid, const bt_uuid_t *mask);
+
+/*
+ * Same as adv_find_uuid() for the service solicitation UUIDs.
+ */
+int adv_find_solicit_uuid(const adv_record_t *rec, const bt_uuid_t *uuid,
+                          const bt_uuid_t *mask);
+
+/*
+ * Return the last entry for the key, matching what ScanRecord keeps, or
+ * NULL if there is none.
+ */
+const adv_manufacturer_data_t* adv_find_manufacturer_data(const adv_record_t *rec,
+                                                          uint16_t company);
+const adv_service_data_t* adv_find_service_data(const adv_record_t *rec,
+                                                const bt_uuid_t *uuid);
+
+static inline const uint8_t* adv_span_data(const uint8_t *data, adv_span_t span) {
+    return data + span.offset;
+}
+
+/*
+ * True if ((a ^ b) & mask) is zero over all 16 bytes.
+ */
+static inline bool adv_uuid_match(const bt_uuid_t *a, const bt_uuid_t *b,
+                                  const bt_uuid_t *mask) {
+#if defined(ADV_PARSER_NEON)
+    uint8x16_t diff = vandq_u8(veorq_u8(vld1q_u8(a->uu), vld1q_u8(b->uu)), vld1q_u8(mask->uu));
+    uint64x2_t lanes = vreinterpretq_u64_u8(diff);
+    return (vgetq_lane_u64(lanes, 0) | vgetq_lane_u64(lanes, 1)) == 0;
+#elif defined(ADV_PARSER_SSE2)
+    __m128i diff = _mm_and_si128(
+            _mm_xor_si128(_mm_loadu_si128((const __m128i *) a->uu),
+                          _mm_loadu_si128((const __m128i *) b->uu)),
+            _mm_loadu_si128((const __m128i *) mask->uu));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) == 0xFFFF;
+#else
+    uint64_t x[2], y[2], m[2];
+    memcpy(x, a->uu, 16);
+    memcpy(y, b->uu, 16);
+    memcpy(m, mask->uu, 16);
+    return (((x[0] ^ y[0]) & m[0]) | ((x[1] ^ y[1]) & m[1])) == 0;
+#endif
+}
+
+}
+
+#endif
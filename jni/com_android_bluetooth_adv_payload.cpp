@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothAdvPayloadJni"
+
+#include "com_android_bluetooth_adv_payload.h"
+#include "utils/Log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+namespace android {
+
+#define NS_PER_MS       1000000LL
+#define NS_PER_SEC      1000000000LL
+#define NS_PER_UNIT     625000LL        // advertising interval unit
+#define DEADLINE_NEVER  ((int64_t) 0x7fffffffffffffffLL)
+
+typedef struct {
+    bool present;               // set by the caller
+    adv_sched_data_t sent;      // last sent, or being sent
+    adv_sched_data_t want;      // with the updates applied
+} payload_t;
+
+typedef struct {
+    bool in_use;
+    int client_if;
+    int64_t interval_ns;
+    int64_t next_send_ns;       // CLOCK_MONOTONIC time the next send may go out
+    payload_t payloads[2];      // advertising data, scan response
+
+    // The send in flight
+    bool busy;
+    uint32_t op_seq;
+    bool op_scan_rsp;
+    bool op_stale;              // the payload was set again meanwhile
+    int64_t op_deadline_ns;
+    adv_sched_data_t op_data;
+} adv_client_t;
+
+struct adv_payload {
+    adv_payload_handler_t handler;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    adv_client_t clients[ADV_PAYLOAD_MAX_CLIENTS];
+    uint32_t op_seq;
+
+    bool stopping;
+    pthread_t thread;
+    char thread_name[16];
+};
+
+static int64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static adv_client_t* find_client(adv_payload_t *payload, int client_if) {
+    for (int i = 0; i < ADV_PAYLOAD_MAX_CLIENTS; i++) {
+        if (payload->clients[i].in_use && payload->clients[i].client_if == client_if) {
+            return &payload->clients[i];
+        }
+    }
+    return NULL;
+}
+
+// Returns the client of client_if, created if needed; called with the lock held
+static adv_client_t* get_client(adv_payload_t *payload, int client_if) {
+    adv_client_t *client = find_client(payload, client_if);
+    for (int i = 0; i < ADV_PAYLOAD_MAX_CLIENTS && client == NULL; i++) {
+        if (payload->clients[i].in_use) continue;
+        client = &payload->clients[i];
+        memset(client, 0, sizeof(*client));
+        client->in_use = true;
+        client->client_if = client_if;
+        client->interval_ns = ADV_PAYLOAD_DEFAULT_INTERVAL_MS * NS_PER_MS;
+    }
+    return client;
+}
+
+// Copies data with the unused bytes cleared, so payloads compare by memcmp
+static void copy_data(adv_sched_data_t *dst, const adv_sched_data_t *src) {
+    memset(dst, 0, sizeof(*dst));
+    dst->present = true;
+    dst->incl_name = src->incl_name;
+    dst->incl_txpower = src->incl_txpower;
+    dst->appearance = src->appearance;
+    dst->manufacturer_len = src->manufacturer_len;
+    dst->service_data_len = src->service_data_len;
+    dst->service_uuid_len = src->service_uuid_len;
+    memcpy(dst->manufacturer_data, src->manufacturer_data, src->manufacturer_len);
+    memcpy(dst->service_data, src->service_data, src->service_data_len);
+    memcpy(dst->service_uuid, src->service_uuid, src->service_uuid_len);
+}
+
+static bool is_dirty(const payload_t *p) {
+    return p->present && memcmp(&p->sent, &p->want, sizeof(p->want)) != 0;
+}
+
+static void complete_op(adv_client_t *client, int status) {
+    if (status == 0 && !client->op_stale) {
+        client->payloads[client->op_scan_rsp ? 1 : 0].sent = client->op_data;
+    }
+    client->busy = false;
+}
+
+/*
+ * Picks the payload to send next; called with the lock held. Returns the
+ * client, or NULL with the time to look again in wakeup.
+ */
+static adv_client_t* next_send(adv_payload_t *payload, int64_t now, int64_t *wakeup) {
+    *wakeup = DEADLINE_NEVER;
+    for (int i = 0; i < ADV_PAYLOAD_MAX_CLIENTS; i++) {
+        adv_client_t *client = &payload->clients[i];
+        if (!client->in_use) continue;
+
+        if (client->busy) {
+            if (now < client->op_deadline_ns) {
+                if (client->op_deadline_ns < *wakeup) *wakeup = client->op_deadline_ns;
+                continue;
+            }
+            ALOGW("%s: send for client %d timed out", __FUNCTION__, client->client_if);
+            complete_op(client, -1);
+        }
+
+        for (int r = 0; r < 2; r++) {
+            if (!is_dirty(&client->payloads[r])) continue;
+            if (now >= client->next_send_ns) {
+                client->op_scan_rsp = r == 1;
+                return client;
+            }
+            if (client->next_send_ns < *wakeup) *wakeup = client->next_send_ns;
+        }
+    }
+    return NULL;
+}
+
+static void *adv_payload_thread_main(void *arg) {
+    adv_payload_t *payload = (adv_payload_t *) arg;
+
+    pthread_mutex_lock(&payload->lock);
+    while (!payload->stopping) {
+        int64_t now = monotonic_ns();
+        int64_t wakeup;
+        adv_client_t *client = next_send(payload, now, &wakeup);
+        if (client != NULL) {
+            int client_if = client->client_if;
+            bool scan_rsp = client->op_scan_rsp;
+            uint32_t seq = ++payload->op_seq;
+            client->busy = true;
+            client->op_seq = seq;
+            client->op_stale = false;
+            client->op_deadline_ns = now + ADV_PAYLOAD_OP_TIMEOUT_MS * NS_PER_MS;
+            client->op_data = client->payloads[scan_rsp ? 1 : 0].want;
+            client->next_send_ns = now + client->interval_ns;
+
+            adv_sched_data_t data = client->op_data;
+            pthread_mutex_unlock(&payload->lock);
+
+            int result = payload->handler(client_if, scan_rsp, &data);
+
+            pthread_mutex_lock(&payload->lock);
+            // The client may have been removed, or its send completed, meanwhile
+            if (client->in_use && client->busy && client->op_seq == seq) {
+                if (result == ADV_PAYLOAD_ISSUE_APPLIED) {
+                    complete_op(client, 0);
+                } else if (result == ADV_PAYLOAD_ISSUE_FAILED) {
+                    complete_op(client, -1);
+                }
+            }
+            continue;
+        }
+
+        if (wakeup == DEADLINE_NEVER) {
+            pthread_cond_wait(&payload->cond, &payload->lock);
+        } else {
+            struct timespec ts;
+            ts.tv_sec = wakeup / NS_PER_SEC;
+            ts.tv_nsec = wakeup % NS_PER_SEC;
+            pthread_cond_timedwait(&payload->cond, &payload->lock, &ts);
+        }
+    }
+    pthread_mutex_unlock(&payload->lock);
+    return NULL;
+}
+
+adv_payload_t* adv_payload_create(const char *thread_name, adv_payload_handler_t handler) {
+    adv_payload_t *payload = (adv_payload_t *) calloc(1, sizeof(adv_payload_t));
+    if (payload == NULL) return NULL;
+
+    payload->handler = handler;
+    snprintf(payload->thread_name, sizeof(payload->thread_name), "%s", thread_name);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&payload->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&payload->lock, NULL);
+
+    if (pthread_create(&payload->thread, NULL, adv_payload_thread_main, payload) != 0) {
+        ALOGE("%s: unable to start %s", __FUNCTION__, thread_name);
+        pthread_cond_destroy(&payload->cond);
+        pthread_mutex_destroy(&payload->lock);
+        free(payload);
+        return NULL;
+    }
+    pthread_setname_np(payload->thread, payload->thread_name);
+    return payload;
+}
+
+void adv_payload_destroy(adv_payload_t *payload) {
+    if (payload == NULL) return;
+
+    pthread_mutex_lock(&payload->lock);
+    payload->stopping = true;
+    pthread_cond_broadcast(&payload->cond);
+    pthread_mutex_unlock(&payload->lock);
+    pthread_join(payload->thread, NULL);
+
+    pthread_cond_destroy(&payload->cond);
+    pthread_mutex_destroy(&payload->lock);
+    free(payload);
+}
+
+void adv_payload_set_interval(adv_payload_t *payload, int client_if, int interval_units) {
+    pthread_mutex_lock(&payload->lock);
+    adv_client_t *client = get_client(payload, client_if);
+    if (client != NULL && interval_units > 0) {
+        client->interval_ns = interval_units * NS_PER_UNIT;
+    }
+    pthread_mutex_unlock(&payload->lock);
+}
+
+void adv_payload_set(adv_payload_t *payload, int client_if, bool scan_rsp,
+                     const adv_sched_data_t *data) {
+    pthread_mutex_lock(&payload->lock);
+    adv_client_t *client = get_client(payload, client_if);
+    if (client == NULL) {
+        ALOGW("%s: no room for client %d", __FUNCTION__, client_if);
+    } else {
+        payload_t *p = &client->payloads[scan_rsp ? 1 : 0];
+        if (client->busy && client->op_scan_rsp == scan_rsp) client->op_stale = true;
+        p->present = true;
+        copy_data(&p->sent, data);
+        p->want = p->sent;
+        client->next_send_ns = monotonic_ns() + client->interval_ns;
+    }
+    pthread_mutex_unlock(&payload->lock);
+}
+
+int adv_payload_update(adv_payload_t *payload, int client_if, bool scan_rsp,
+                       const adv_payload_diff_t *diffs, int count) {
+    for (int i = 0; i < count; i++) {
+        if (diffs[i].len < 0 || diffs[i].len > ADV_SCHED_MAX_FIELD) return ADV_PAYLOAD_INVALID;
+        if (diffs[i].field < ADV_PAYLOAD_FIELD_MANUFACTURER_DATA
+                || diffs[i].field > ADV_PAYLOAD_FIELD_SERVICE_UUID) {
+            return ADV_PAYLOAD_INVALID;
+        }
+    }
+
+    pthread_mutex_lock(&payload->lock);
+    adv_client_t *client = find_client(payload, client_if);
+    payload_t *p = client ? &client->payloads[scan_rsp ? 1 : 0] : NULL;
+    if (p == NULL || !p->present) {
+        pthread_mutex_unlock(&payload->lock);
+        return ADV_PAYLOAD_UNKNOWN;
+    }
+
+    adv_sched_data_t want = p->want;
+    for (int i = 0; i < count; i++) {
+        uint8_t *dst;
+        int *len;
+        switch (diffs[i].field) {
+        case ADV_PAYLOAD_FIELD_MANUFACTURER_DATA:
+            dst = want.manufacturer_data;
+            len = &want.manufacturer_len;
+            break;
+        case ADV_PAYLOAD_FIELD_SERVICE_DATA:
+            dst = want.service_data;
+            len = &want.service_data_len;
+            break;
+        default:
+            dst = want.service_uuid;
+            len = &want.service_uuid_len;
+            break;
+        }
+        memset(dst, 0, ADV_SCHED_MAX_FIELD);
+        memcpy(dst, diffs[i].value, diffs[i].len);
+        *len = diffs[i].len;
+    }
+
+    int result = ADV_PAYLOAD_UNCHANGED;
+    if (memcmp(&want, &p->want, sizeof(want)) != 0) {
+        p->want = want;
+        // A send is only due if the payload differs from what is on air
+        if (is_dirty(p)) {
+            result = ADV_PAYLOAD_QUEUED;
+            pthread_cond_signal(&payload->cond);
+        }
+    }
+    pthread_mutex_unlock(&payload->lock);
+    return result;
+}
+
+bool adv_payload_done(adv_payload_t *payload, int client_if, int status) {
+    pthread_mutex_lock(&payload->lock);
+    adv_client_t *client = find_client(payload, client_if);
+    bool consumed = client != NULL && client->busy;
+    if (consumed) {
+        if (status != 0) {
+            ALOGW("%s: send for client %d failed, status=%d", __FUNCTION__, client_if, status);
+        }
+        complete_op(client, status);
+        pthread_cond_signal(&payload->cond);
+    }
+    pthread_mutex_unlock(&payload->lock);
+    return consumed;
+}
+
+void adv_payload_remove(adv_payload_t *payload, int client_if) {
+    pthread_mutex_lock(&payload->lock);
+    adv_client_t *client = find_client(payload, client_if);
+    if (client != NULL) client->in_use = false;
+    pthread_mutex_unlock(&payload->lock);
+}
+
+void adv_payload_clear(adv_payload_t *payload) {
+    pthread_mutex_lock(&payload->lock);
+    for (int i = 0; i < ADV_PAYLOAD_MAX_CLIENTS; i++) payload->clients[i].in_use = false;
+    pthread_mutex_unlock(&payload->lock);
+}
+
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_ADV_PAYLOAD_H
+#define COM_ANDROID_BLUETOOTH_ADV_PAYLOAD_H
+
+#include "com_android_bluetooth_adv_sched.h"
+
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Advertising payloads kept per client_if, so a started advertiser can
+ * be updated field by field.
+ *
+ * The caller records the advertising data and scan response it hands to
+ * the stack with adv_payload_set(). Updates are applied to a copy that
+ * is only sent when its bytes differ from what was last sent, so
+ * re-sending the same values costs nothing and a change undone before it
+ * went out is dropped. Sends of one client_if are at least its
+ * advertising interval apart and one at a time; updates arriving faster
+ * are coalesced into the next send, which carries the latest payload.
+ *
+ * Sends are made from the module's own thread through the handler, which
+ * is not attached to the VM.
+ */
+
+#define ADV_PAYLOAD_MAX_CLIENTS         32
+#define ADV_PAYLOAD_DEFAULT_INTERVAL_MS 100
+#define ADV_PAYLOAD_OP_TIMEOUT_MS       1000
+
+// Fields an update can replace
+#define ADV_PAYLOAD_FIELD_MANUFACTURER_DATA 0
+#define ADV_PAYLOAD_FIELD_SERVICE_DATA      1
+#define ADV_PAYLOAD_FIELD_SERVICE_UUID      2
+
+// Results of adv_payload_update()
+#define ADV_PAYLOAD_UNCHANGED   0
+#define ADV_PAYLOAD_QUEUED      1
+#define ADV_PAYLOAD_UNKNOWN     (-1)    // no payload was set
+#define ADV_PAYLOAD_INVALID     (-2)    // bad field or too long
+
+// Results of the handler
+#define ADV_PAYLOAD_ISSUE_PENDING   0   // completes through adv_payload_done()
+#define ADV_PAYLOAD_ISSUE_APPLIED   1   // taken without a completion
+#define ADV_PAYLOAD_ISSUE_FAILED    2
+
+typedef struct {
+    int field;
+    const uint8_t *value;
+    int len;
+} adv_payload_diff_t;
+
+/*
+ * Sends data as the advertising data, or the scan response if scan_rsp is
+ * set, of client_if.
+ */
+typedef int (*adv_payload_handler_t)(int client_if, bool scan_rsp, const adv_sched_data_t *data);
+
+typedef struct adv_payload adv_payload_t;
+
+/*
+ * Creates the payload store and starts its thread. Returns NULL on
+ * failure.
+ */
+adv_payload_t* adv_payload_create(const char *thread_name, adv_payload_handler_t handler);
+
+/*
+ * Stops the thread and frees the store. Updates not sent yet are dropped.
+ */
+void adv_payload_destroy(adv_payload_t *payload);
+
+/*
+ * Sets the advertising interval of client_if, in units of 0.625 ms.
+ */
+void adv_payload_set_interval(adv_payload_t *payload, int client_if, int interval_units);
+
+/*
+ * Records data as sent by the caller as the advertising data, or the scan
+ * response if scan_rsp is set, of client_if. Updates still pending for it
+ * are dropped.
+ */
+void adv_payload_set(adv_payload_t *payload, int client_if, bool scan_rsp,
+                     const adv_sched_data_t *data);
+
+/*
+ * Replaces the given fields of the advertising data, or the scan response
+ * if scan_rsp is set, of client_if. Either all diffs are applied or none.
+ */
+int adv_payload_update(adv_payload_t *payload, int client_if, bool scan_rsp,
+                       const adv_payload_diff_t *diffs, int count);
+
+/*
+ * Accounts the completion of a send. Returns true if it was issued by the
+ * store and must not be passed on.
+ */
+bool adv_payload_done(adv_payload_t *payload, int client_if, int status);
+
+/*
+ * Forgets the payloads of client_if.
+ */
+void adv_payload_remove(adv_payload_t *payload, int client_if);
+
+/*
+ * Forgets the payloads of every client_if.
+ */
+void adv_payload_clear(adv_payload_t *payload);
+
+}
+
+#endif
@@ -0,0 +1,589 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothAdvSchedJni"
+
+#include "com_android_bluetooth.h"
+#include "com_android_bluetooth_adv_sched.h"
+#include "android_runtime/AndroidRuntime.h"
+#include "utils/Log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+namespace android {
+
+#define NS_PER_MS       1000000LL
+#define NS_PER_SEC      1000000000LL
+#define DEADLINE_NEVER  ((int64_t) 0x7fffffffffffffffLL)
+
+#define STRIDE          (1 << 16)
+#define MAX_WEIGHT      16
+#define STATUS_FAILED   (-1)
+#define MAX_STALE_OPS   8
+
+typedef struct {
+    bool in_use;
+    int client_if;
+    int weight;
+    int64_t deadline_ns;        // CLOCK_MONOTONIC time the set times out, 0 for never
+    adv_sched_params_t params;
+    adv_sched_data_t adv_data;
+    adv_sched_data_t scan_rsp;
+
+    bool started;               // scheduled, otherwise only data was set
+    bool enabled;               // holds an instance
+    bool adv_data_pending;      // to be set while enabled
+    bool scan_rsp_pending;
+    bool want;                  // picked for the current slice
+    bool removed;
+    bool failed;                // could not be enabled, reported disabled with a failure
+    bool in_doubt;              // an enable or disable timed out, counted on air until it completes
+    int enable_failures;        // in a row
+    int64_t pass;
+} adv_set_t;
+
+// An operation that timed out; its completion is dropped when it comes late
+typedef struct {
+    uint32_t seq;
+    int client_if;
+    int op_type;
+} adv_stale_op_t;
+
+struct adv_sched {
+    adv_sched_handler_t handler;
+    int instances;
+    int64_t slice_ns;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    adv_set_t sets[ADV_SCHED_MAX_SETS];
+    bool replan;
+    int64_t next_slice_ns;
+
+    // The operation in flight
+    bool busy;
+    uint32_t op_seq;
+    int op_client_if;
+    int op_type;
+    bool op_report;             // passed on to the caller when done
+    int64_t op_deadline_ns;
+
+    // Timed out operations, oldest first
+    adv_stale_op_t stale[MAX_STALE_OPS];
+    int num_stale;
+
+    bool stopping;
+    pthread_t thread;
+    char thread_name[32];
+};
+
+static int64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static adv_set_t* find_set(adv_sched_t *sched, int client_if) {
+    for (int i = 0; i < ADV_SCHED_MAX_SETS; i++) {
+        if (sched->sets[i].in_use && sched->sets[i].client_if == client_if) {
+            return &sched->sets[i];
+        }
+    }
+    return NULL;
+}
+
+static bool is_active(const adv_set_t *set) {
+    return set->in_use && set->started && !set->removed;
+}
+
+static int active_sets(const adv_sched_t *sched) {
+    int count = 0;
+    for (int i = 0; i < ADV_SCHED_MAX_SETS; i++) {
+        if (is_active(&sched->sets[i])) count++;
+    }
+    return count;
+}
+
+/*
+ * Picks the sets for the slice: all of them if they fit, otherwise the
+ * ones with the lowest pass, preferring sets on air on ties. Picked sets
+ * are charged for the slice if charge is set.
+ */
+static void pick_sets(adv_sched_t *sched, bool charge) {
+    bool all = active_sets(sched) <= sched->instances;
+    for (int i = 0; i < ADV_SCHED_MAX_SETS; i++) {
+        adv_set_t *set = &sched->sets[i];
+        set->want = all && is_active(set);
+    }
+    if (all) return;
+
+    for (int n = 0; n < sched->instances; n++) {
+        adv_set_t *best = NULL;
+        for (int i = 0; i < ADV_SCHED_MAX_SETS; i++) {
+            adv_set_t *set = &sched->sets[i];
+            if (!is_active(set) || set->want) continue;
+            if (best == NULL || set->pass < best->pass
+                    || (set->pass == best->pass && set->enabled && !best->enabled)) {
+                best = set;
+            }
+        }
+        if (best == NULL) break;
+        best->want = true;
+        if (charge) best->pass += STRIDE / best->weight;
+    }
+}
+
+static void free_set(adv_set_t *set) {
+    memset(set, 0, sizeof(*set));
+}
+
+/*
+ * Returns the set the next operation is for, with op filled in, or NULL
+ * if there is nothing to do. Sets come off the air before others go on.
+ */
+static adv_set_t* next_op(adv_sched_t *sched, adv_sched_op_t *op) {
+    int on_air = 0;
+    adv_set_t *leaving = NULL;
+    adv_set_t *coming = NULL;
+
+    for (int i = 0; i < ADV_SCHED_MAX_SETS; i++) {
+        adv_set_t *set = &sched->sets[i];
+        if (!set->in_use) continue;
+
+        // Nothing more is issued for a set until the stack answers for it
+        if (set->in_doubt) {
+            on_air++;
+            continue;
+        }
+        if (set->removed && !set->enabled) {
+            op->type = ADV_SCHED_OP_REPORT_DISABLED;
+            op->client_if = set->client_if;
+            op->status = set->failed ? STATUS_FAILED : 0;
+            return set;
+        }
+        if (set->enabled) {
+            on_air++;
+            if (!set->want && leaving == NULL) leaving = set;
+        }
+        if (set->want && coming == NULL && (!set->enabled || set->adv_data_pending
+                                            || set->scan_rsp_pending)) {
+            coming = set;
+        }
+    }
+
+    if (leaving != NULL) {
+        op->type = ADV_SCHED_OP_DISABLE;
+        op->client_if = leaving->client_if;
+        return leaving;
+    }
+    if (coming == NULL) return NULL;
+
+    op->client_if = coming->client_if;
+    if (!coming->enabled) {
+        if (on_air >= sched->instances) return NULL;
+        op->type = ADV_SCHED_OP_ENABLE;
+        op->params = &coming->params;
+    } else if (coming->adv_data_pending) {
+        op->type = ADV_SCHED_OP_SET_DATA;
+        op->data = &coming->adv_data;
+    } else {
+        op->type = ADV_SCHED_OP_SET_SCAN_RSP;
+        op->data = &coming->scan_rsp;
+    }
+    return coming;
+}
+
+static void complete_op(adv_sched_t *sched, int status) {
+    sched->busy = false;
+    adv_set_t *set = find_set(sched, sched->op_client_if);
+    if (set == NULL) return;
+
+    switch (sched->op_type) {
+    case ADV_SCHED_OP_ENABLE:
+        if (status == 0) {
+            set->enabled = true;
+            set->enable_failures = 0;
+            set->adv_data_pending = set->adv_data.present;
+            set->scan_rsp_pending = set->scan_rsp.present;
+        } else if (++set->enable_failures < ADV_SCHED_ENABLE_RETRIES) {
+            // Still wanted, so the next operation tries again
+            ALOGW("%s: client_if %d not enabled (%d)", __FUNCTION__, set->client_if, status);
+        } else {
+            // The caller was told it started; it learns here that it stopped
+            ALOGE("%s: client_if %d not enabled (%d), giving up", __FUNCTION__,
+                  set->client_if, status);
+            set->removed = true;
+            set->failed = true;
+            set->want = false;
+            sched->replan = true;
+        }
+        break;
+    case ADV_SCHED_OP_SET_DATA:
+        set->adv_data_pending = false;
+        break;
+    case ADV_SCHED_OP_SET_SCAN_RSP:
+        set->scan_rsp_pending = false;
+        break;
+    case ADV_SCHED_OP_DISABLE:
+        set->enabled = false;
+        // Removed sets are reported by the disable, unless it never completed
+        if (set->removed && status != STATUS_FAILED) free_set(set);
+        break;
+    }
+}
+
+/*
+ * Gives up waiting for the operation in flight. Its completion may still
+ * come, so it is remembered to be dropped then; until then a set being
+ * enabled or disabled may hold an instance.
+ */
+static void time_out_op(adv_sched_t *sched) {
+    sched->busy = false;
+    if (sched->num_stale == MAX_STALE_OPS) {
+        ALOGW("%s: too many operations timed out, forgetting seq %u", __FUNCTION__,
+              sched->stale[0].seq);
+        memmove(&sched->stale[0], &sched->stale[1],
+                (MAX_STALE_OPS - 1) * sizeof(sched->stale[0]));
+        sched->num_stale--;
+    }
+    adv_stale_op_t *stale = &sched->stale[sched->num_stale++];
+    stale->seq = sched->op_seq;
+    stale->client_if = sched->op_client_if;
+    stale->op_type = sched->op_type;
+
+    adv_set_t *set = find_set(sched, sched->op_client_if);
+    if (set == NULL) return;
+
+    switch (sched->op_type) {
+    case ADV_SCHED_OP_ENABLE:
+    case ADV_SCHED_OP_DISABLE:
+        set->in_doubt = true;
+        break;
+    case ADV_SCHED_OP_SET_DATA:
+        set->adv_data_pending = true;
+        break;
+    case ADV_SCHED_OP_SET_SCAN_RSP:
+        set->scan_rsp_pending = true;
+        break;
+    }
+}
+
+static bool same_callback(int op_type, int issued_type) {
+    // Advertising data and scan responses complete through the same callback
+    return op_type == issued_type
+            || (op_type == ADV_SCHED_OP_SET_DATA && issued_type == ADV_SCHED_OP_SET_SCAN_RSP);
+}
+
+/*
+ * Takes a completion of client_if that belongs to an operation that timed
+ * out. The stack completes the operations of an advertiser in the order
+ * they were issued, so it is the oldest matching one, which was issued
+ * before anything in flight now. Returns false if there is none.
+ */
+static bool complete_stale_op(adv_sched_t *sched, int client_if, int op_type, int status) {
+    int i = 0;
+    while (i < sched->num_stale && (sched->stale[i].client_if != client_if
+                                    || !same_callback(op_type, sched->stale[i].op_type))) {
+        i++;
+    }
+    if (i == sched->num_stale) return false;
+
+    adv_stale_op_t stale = sched->stale[i];
+    memmove(&sched->stale[i], &sched->stale[i + 1],
+            (sched->num_stale - i - 1) * sizeof(sched->stale[0]));
+    sched->num_stale--;
+    ALOGW("%s: late completion of seq %u for client_if %d (%d)", __FUNCTION__, stale.seq,
+          client_if, status);
+
+    adv_set_t *set = find_set(sched, client_if);
+    if (set == NULL || !set->in_doubt) return true;
+    for (int j = 0; j < sched->num_stale; j++) {
+        if (sched->stale[j].client_if == client_if) return true;
+    }
+
+    // The last word of the stack on this set decides whether it is on air
+    set->in_doubt = false;
+    if (stale.op_type == ADV_SCHED_OP_ENABLE && status == 0) {
+        set->enabled = true;
+        set->adv_data_pending = set->adv_data.present;
+        set->scan_rsp_pending = set->scan_rsp.present;
+    } else if (stale.op_type == ADV_SCHED_OP_DISABLE) {
+        set->enabled = false;
+    }
+    sched->replan = true;
+    return true;
+}
+
+static int64_t next_wakeup(adv_sched_t *sched) {
+    if (sched->busy) return sched->op_deadline_ns;
+
+    int64_t wakeup = DEADLINE_NEVER;
+    if (active_sets(sched) > sched->instances) wakeup = sched->next_slice_ns;
+    for (int i = 0; i < ADV_SCHED_MAX_SETS; i++) {
+        adv_set_t *set = &sched->sets[i];
+        if (is_active(set) && set->deadline_ns != 0 && set->deadline_ns < wakeup) {
+            wakeup = set->deadline_ns;
+        }
+    }
+    return wakeup;
+}
+
+static void *adv_sched_thread_main(void *arg) {
+    adv_sched_t *sched = (adv_sched_t *) arg;
+    JavaVM *vm = AndroidRuntime::getJavaVM();
+    JNIEnv *env = NULL;
+
+    JavaVMAttachArgs args;
+    args.version = JNI_VERSION_1_6;
+    args.name = sched->thread_name;
+    args.group = NULL;
+    if (vm->AttachCurrentThread(&env, &args) != JNI_OK) {
+        ALOGE("%s: unable to attach %s to VM", __FUNCTION__, sched->thread_name);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&sched->lock);
+    while (!sched->stopping) {
+        int64_t now = monotonic_ns();
+
+        if (sched->busy && now >= sched->op_deadline_ns) {
+            ALOGW("%s: operation %d of client_if %d timed out", __FUNCTION__,
+                  sched->op_type, sched->op_client_if);
+            time_out_op(sched);
+        }
+
+        if (!sched->busy) {
+            for (int i = 0; i < ADV_SCHED_MAX_SETS; i++) {
+                adv_set_t *set = &sched->sets[i];
+                if (is_active(set) && set->deadline_ns != 0 && now >= set->deadline_ns) {
+                    set->removed = true;
+                    sched->replan = true;
+                }
+            }
+            if (active_sets(sched) > sched->instances && now >= sched->next_slice_ns) {
+                pick_sets(sched, true);
+                sched->next_slice_ns = now + sched->slice_ns;
+            } else if (sched->replan) {
+                pick_sets(sched, false);
+            }
+            sched->replan = false;
+
+            adv_sched_op_t op;
+            memset(&op, 0, sizeof(op));
+            adv_set_t *set = next_op(sched, &op);
+            if (set != NULL) {
+                uint32_t seq = ++sched->op_seq;
+                bool report = op.type == ADV_SCHED_OP_REPORT_DISABLED;
+                if (!report) {
+                    sched->busy = true;
+                    sched->op_client_if = op.client_if;
+                    sched->op_type = op.type;
+                    sched->op_report = set->removed;
+                    sched->op_deadline_ns = now + ADV_SCHED_OP_TIMEOUT_MS * NS_PER_MS;
+                }
+                pthread_mutex_unlock(&sched->lock);
+
+                bool issued = sched->handler(env, &op);
+                checkAndClearExceptionFromCallback(env, __FUNCTION__);
+
+                pthread_mutex_lock(&sched->lock);
+                if (report) {
+                    free_set(set);
+                } else if (!issued && sched->busy && sched->op_seq == seq) {
+                    complete_op(sched, STATUS_FAILED);
+                }
+                continue;
+            }
+        }
+
+        int64_t wakeup = next_wakeup(sched);
+        if (wakeup == DEADLINE_NEVER) {
+            pthread_cond_wait(&sched->cond, &sched->lock);
+        } else {
+            struct timespec ts;
+            ts.tv_sec = wakeup / NS_PER_SEC;
+            ts.tv_nsec = wakeup % NS_PER_SEC;
+            pthread_cond_timedwait(&sched->cond, &sched->lock, &ts);
+        }
+    }
+    pthread_mutex_unlock(&sched->lock);
+
+    vm->DetachCurrentThread();
+    return NULL;
+}
+
+adv_sched_t* adv_sched_create(const char *thread_name, adv_sched_handler_t handler,
+                              int instances, int slice_ms) {
+    if (instances <= 0 || slice_ms <= 0) return NULL;
+
+    adv_sched_t *sched = (adv_sched_t *) calloc(1, sizeof(adv_sched_t));
+    if (sched == NULL) return NULL;
+
+    sched->handler = handler;
+    sched->instances = instances;
+    sched->slice_ns = slice_ms * NS_PER_MS;
+    snprintf(sched->thread_name, sizeof(sched->thread_name), "%s", thread_name);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sched->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&sched->lock, NULL);
+
+    if (pthread_create(&sched->thread, NULL, adv_sched_thread_main, sched) != 0) {
+        ALOGE("%s: unable to start %s", __FUNCTION__, thread_name);
+        pthread_cond_destroy(&sched->cond);
+        pthread_mutex_destroy(&sched->lock);
+        free(sched);
+        return NULL;
+    }
+    return sched;
+}
+
+void adv_sched_destroy(adv_sched_t *sched) {
+    if (sched == NULL) return;
+
+    pthread_mutex_lock(&sched->lock);
+    sched->stopping = true;
+    pthread_cond_broadcast(&sched->cond);
+    pthread_mutex_unlock(&sched->lock);
+    pthread_join(sched->thread, NULL);
+
+    pthread_cond_destroy(&sched->cond);
+    pthread_mutex_destroy(&sched->lock);
+    free(sched);
+}
+
+// Returns the set of client_if, created if needed; called with the lock held
+static adv_set_t* get_set(adv_sched_t *sched, int client_if) {
+    adv_set_t *set = find_set(sched, client_if);
+    for (int i = 0; i < ADV_SCHED_MAX_SETS && set == NULL; i++) {
+        if (sched->sets[i].in_use) continue;
+        set = &sched->sets[i];
+        memset(set, 0, sizeof(*set));
+        set->in_use = true;
+        set->client_if = client_if;
+    }
+    return set;
+}
+
+bool adv_sched_set_data(adv_sched_t *sched, int client_if, bool scan_rsp,
+                        const adv_sched_data_t *data) {
+    pthread_mutex_lock(&sched->lock);
+    adv_set_t *set = get_set(sched, client_if);
+    if (set != NULL) {
+        if (scan_rsp) {
+            set->scan_rsp = *data;
+            set->scan_rsp.present = true;
+            set->scan_rsp_pending = set->enabled;
+        } else {
+            set->adv_data = *data;
+            set->adv_data.present = true;
+            set->adv_data_pending = set->enabled;
+        }
+        pthread_cond_broadcast(&sched->cond);
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return set != NULL;
+}
+
+bool adv_sched_start(adv_sched_t *sched, int client_if, int weight, int timeout_s,
+                     const adv_sched_params_t *params) {
+    if (weight < 1) weight = 1;
+    if (weight > MAX_WEIGHT) weight = MAX_WEIGHT;
+
+    pthread_mutex_lock(&sched->lock);
+    adv_set_t *set = get_set(sched, client_if);
+    if (set == NULL || set->started || set->removed) {
+        pthread_mutex_unlock(&sched->lock);
+        return false;
+    }
+
+    // New sets start level with the least served one
+    int64_t pass = 0;
+    bool first = true;
+    for (int i = 0; i < ADV_SCHED_MAX_SETS; i++) {
+        adv_set_t *other = &sched->sets[i];
+        if (!is_active(other)) continue;
+        if (first || other->pass < pass) pass = other->pass;
+        first = false;
+    }
+
+    set->started = true;
+    set->weight = weight;
+    set->deadline_ns = timeout_s > 0 ? monotonic_ns() + timeout_s * NS_PER_SEC : 0;
+    set->params = *params;
+    set->pass = pass;
+
+    sched->replan = true;
+    pthread_cond_broadcast(&sched->cond);
+    pthread_mutex_unlock(&sched->lock);
+    return true;
+}
+
+bool adv_sched_remove(adv_sched_t *sched, int client_if) {
+    pthread_mutex_lock(&sched->lock);
+    adv_set_t *set = find_set(sched, client_if);
+    bool found = set != NULL && !set->removed;
+    if (found && !set->started) {
+        free_set(set);
+    } else if (found) {
+        set->removed = true;
+        set->want = false;
+        sched->replan = true;
+        pthread_cond_broadcast(&sched->cond);
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return found;
+}
+
+bool adv_sched_done(adv_sched_t *sched, int client_if, int op_type, int status) {
+    bool consumed = false;
+
+    pthread_mutex_lock(&sched->lock);
+    if (complete_stale_op(sched, client_if, op_type, status)) {
+        consumed = true;
+        pthread_cond_broadcast(&sched->cond);
+    } else if (sched->busy && sched->op_client_if == client_if
+            && same_callback(op_type, sched->op_type)) {
+        consumed = !sched->op_report;
+        complete_op(sched, status);
+        pthread_cond_broadcast(&sched->cond);
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return consumed;
+}
+
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_ADV_SCHED_H
+#define COM_ANDROID_BLUETOOTH_ADV_SCHED_H
+
+#include "jni.h"
+
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Time sliced advertising of more sets than the controller has
+ * advertising instances.
+ *
+ * Sets are handed over once: their advertising data and scan response
+ * first, then their parameters when they start. Data set again later is
+ * sent on when the set is on air, or when it goes on air next. While
+ * there are no more sets than instances every set
+ * keeps one. Otherwise the sets on air are picked again every slice by
+ * stride scheduling, so each set is on air for a share of the slices in
+ * proportion to its weight; sets that stay on air are left alone.
+ *
+ * One thread attached to the VM issues the operations that move sets on
+ * and off the air, one at a time, and learns of their completion through
+ * adv_sched_done(). Sets off the air are taken off before others are put
+ * on, so no more than the given number of instances are ever in use.
+ * When a set is removed or times out while on air, its disable is passed
+ * on as if the caller had asked for it; otherwise the handler is asked to
+ * report it disabled.
+ *
+ * A set that fails to be enabled is tried again, up to
+ * ADV_SCHED_ENABLE_RETRIES times in a row, and then reported disabled
+ * with a failure. An enable or disable that times out leaves its set
+ * counted as on air, with nothing more issued for it, until the stack
+ * completes it; such late completions are not passed on.
+ */
+
+#define ADV_SCHED_MAX_SETS          32
+#define ADV_SCHED_MAX_FIELD         64
+#define ADV_SCHED_OP_TIMEOUT_MS     1000
+#define ADV_SCHED_ENABLE_RETRIES    3
+
+// Operations for the handler
+#define ADV_SCHED_OP_ENABLE         0
+#define ADV_SCHED_OP_SET_DATA       1
+#define ADV_SCHED_OP_SET_SCAN_RSP   2
+#define ADV_SCHED_OP_DISABLE        3
+#define ADV_SCHED_OP_REPORT_DISABLED 4  // no stack call, the set stopped off the air
+
+typedef struct {
+    int min_interval;
+    int max_interval;
+    int adv_type;
+    int chnl_map;
+    int tx_power;
+} adv_sched_params_t;
+
+typedef struct {
+    bool present;
+    bool incl_name;
+    bool incl_txpower;
+    int appearance;
+    int manufacturer_len;
+    int service_data_len;
+    int service_uuid_len;
+    uint8_t manufacturer_data[ADV_SCHED_MAX_FIELD];
+    uint8_t service_data[ADV_SCHED_MAX_FIELD];
+    uint8_t service_uuid[ADV_SCHED_MAX_FIELD];
+} adv_sched_data_t;
+
+typedef struct {
+    int type;
+    int client_if;
+    int status;                         // for ADV_SCHED_OP_REPORT_DISABLED
+    const adv_sched_params_t *params;   // for ADV_SCHED_OP_ENABLE
+    const adv_sched_data_t *data;       // for ADV_SCHED_OP_SET_DATA and SET_SCAN_RSP
+} adv_sched_op_t;
+
+/*
+ * Issues op. Operations other than ADV_SCHED_OP_REPORT_DISABLED complete
+ * through adv_sched_done(), unless the handler returns false.
+ */
+typedef bool (*adv_sched_handler_t)(JNIEnv *env, const adv_sched_op_t *op);
+
+typedef struct adv_sched adv_sched_t;
+
+/*
+ * Creates a scheduler for the given number of instances and slice length
+ * and starts its thread. Returns NULL on failure.
+ */
+adv_sched_t* adv_sched_create(const char *thread_name, adv_sched_handler_t handler,
+                              int instances, int slice_ms);
+
+/*
+ * Stops the thread and frees the scheduler. Sets are dropped without
+ * being taken off the air.
+ */
+void adv_sched_destroy(adv_sched_t *sched);
+
+/*
+ * Sets the advertising data, or the scan response if scan_rsp is set, of
+ * the set of client_if, which is created if needed but only scheduled
+ * once started. Returns false if there is no room.
+ */
+bool adv_sched_set_data(adv_sched_t *sched, int client_if, bool scan_rsp,
+                        const adv_sched_data_t *data);
+
+/*
+ * Schedules the set of client_if with the given weight, timeout in
+ * seconds (0 for none) and parameters. Returns false if it was started
+ * already or there is no room.
+ */
+bool adv_sched_start(adv_sched_t *sched, int client_if, int weight, int timeout_s,
+                     const adv_sched_params_t *params);
+
+/*
+ * Removes the set of client_if; a set that was not started is dropped
+ * without a report. Returns false if there is none.
+ */
+bool adv_sched_remove(adv_sched_t *sched, int client_if);
+
+/*
+ * Accounts the completion of an operation. Returns true if it was issued
+ * by the scheduler and must not be passed on.
+ */
+bool adv_sched_done(adv_sched_t *sched, int client_if, int op_type, int status);
+
+}
+
+#endif
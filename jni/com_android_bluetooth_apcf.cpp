@@ -0,0 +1,782 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothApcfJni"
+
+#include "com_android_bluetooth_apcf.h"
+#include "com_android_bluetooth_adv_parser.h"
+#include "utils/Log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+namespace android {
+
+// Features combined with the filter logic type; the others are always ANDed
+#define APCF_LOGIC_FEATURES ((1 << APCF_TYPE_LOCAL_NAME) | (1 << APCF_TYPE_MANUFACTURER_DATA) | \
+                             (1 << APCF_TYPE_SERVICE_DATA))
+
+#define APCF_NONE               0xFFFFFFFFu
+#define APCF_TRIE_MAX_MASKS     4       // distinct byte masks below one trie node
+#define APCF_MIN_CAPACITY       16
+
+// A condition reference: filter index in the upper half, condition in the lower
+#define APCF_REF(filter, cond)  (((uint32_t) (filter) << 16) | (uint32_t) (cond))
+#define APCF_REF_FILTER(ref)    ((ref) >> 16)
+#define APCF_REF_COND(ref)      ((ref) & 0xFFFF)
+
+typedef struct {
+    apcf_cond_t cond;
+    uint32_t hit_generation;    // last match that counted this condition
+} apcf_entry_t;
+
+typedef struct {
+    bool configured;
+    apcf_params_t params;
+    apcf_entry_t *entries;
+    int num_conds;
+    int capacity;
+    int totals[APCF_NUM_TYPES];
+} apcf_filter_t;
+
+// Open addressing multimap from 64 bit keys to 32 bit values
+typedef struct {
+    uint64_t *keys;
+    uint32_t *values;           // APCF_NONE marks a free slot
+    uint32_t capacity;
+    uint32_t count;
+} apcf_hash_t;
+
+typedef struct {
+    int32_t terms;              // first apcf_term_t ending here, or -1
+    uint8_t num_masks;
+    uint8_t masks[APCF_TRIE_MAX_MASKS];
+} apcf_node_t;
+
+typedef struct {
+    uint32_t ref;
+    int32_t next;
+} apcf_term_t;
+
+/*
+ * Byte trie with masked edges. An edge is keyed by its parent, the byte
+ * mask and the masked value, so a node can fan out to any number of
+ * children while a walk looks up one edge per distinct mask.
+ */
+typedef struct {
+    apcf_node_t *nodes;
+    int num_nodes;
+    int node_capacity;
+    apcf_term_t *terms;
+    int num_terms;
+    int term_capacity;
+    apcf_hash_t edges;
+} apcf_trie_t;
+
+// Service data an address advertised last, for service data change conditions
+typedef struct {
+    bool in_use;
+    bt_bdaddr_t bda;
+    uint64_t hash;
+    uint32_t generation;        // match that last saw the address
+} apcf_history_t;
+
+typedef struct {
+    bool dirty;                 // conditions moved; recompile before matching
+    bool failed;                // out of memory; let everything through
+    apcf_hash_t addresses;
+    apcf_hash_t uuids;          // full mask service and solicitation UUIDs
+    apcf_hash_t names;
+    apcf_trie_t manufacturer_data;
+    apcf_trie_t service_data;
+    uint32_t *linear;           // conditions checked one by one
+    int num_linear;
+    int linear_capacity;
+} apcf_index_t;
+
+static pthread_mutex_t sApcfLock = PTHREAD_MUTEX_INITIALIZER;
+static bool sApcfEnabled = false;
+static apcf_filter_t sFilters[APCF_MAX_FILTERS];
+static apcf_index_t sIndex;
+static uint32_t sGeneration = 0;
+static uint16_t sHits[APCF_MAX_FILTERS][APCF_NUM_TYPES];
+static apcf_history_t sHistory[APCF_HISTORY_SIZE];
+
+static bool grow(void **array, int *capacity, int needed, size_t size) {
+    if (needed <= *capacity) return true;
+    int capacity_new = *capacity ? *capacity * 2 : APCF_MIN_CAPACITY;
+    while (capacity_new < needed) capacity_new *= 2;
+    void *array_new = realloc(*array, capacity_new * size);
+    if (array_new == NULL) return false;
+    *array = array_new;
+    *capacity = capacity_new;
+    return true;
+}
+
+static inline uint32_t hash_key(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (uint32_t) key;
+}
+
+static uint64_t hash_bytes(const uint8_t *data, int len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < len; i++) h = (h ^ data[i]) * 1099511628211ULL;
+    return h;
+}
+
+static void hash_clear(apcf_hash_t *h) {
+    if (h->values) memset(h->values, 0xFF, h->capacity * sizeof(uint32_t));
+    h->count = 0;
+}
+
+static void hash_free(apcf_hash_t *h) {
+    free(h->keys);
+    free(h->values);
+    memset(h, 0, sizeof(*h));
+}
+
+static bool hash_put(apcf_hash_t *h, uint64_t key, uint32_t value) {
+    if ((h->count + 1) * 2 > h->capacity) {
+        uint32_t capacity = h->capacity ? h->capacity * 2 : APCF_MIN_CAPACITY;
+        uint64_t *keys = (uint64_t *) malloc(capacity * sizeof(uint64_t));
+        uint32_t *values = (uint32_t *) malloc(capacity * sizeof(uint32_t));
+        if (keys == NULL || values == NULL) {
+            free(keys);
+            free(values);
+            return false;
+        }
+        memset(values, 0xFF, capacity * sizeof(uint32_t));
+        for (uint32_t i = 0; i < h->capacity; i++) {
+            if (h->values[i] == APCF_NONE) continue;
+            uint32_t pos = hash_key(h->keys[i]) & (capacity - 1);
+            while (values[pos] != APCF_NONE) pos = (pos + 1) & (capacity - 1);
+            keys[pos] = h->keys[i];
+            values[pos] = h->values[i];
+        }
+        free(h->keys);
+        free(h->values);
+        h->keys = keys;
+        h->values = values;
+        h->capacity = capacity;
+    }
+
+    uint32_t pos = hash_key(key) & (h->capacity - 1);
+    while (h->values[pos] != APCF_NONE) pos = (pos + 1) & (h->capacity - 1);
+    h->keys[pos] = key;
+    h->values[pos] = value;
+    h->count++;
+    return true;
+}
+
+/*
+ * Returns the next value stored under key, or APCF_NONE. *pos must start
+ * out as APCF_NONE.
+ */
+static uint32_t hash_next(const apcf_hash_t *h, uint64_t key, uint32_t *pos) {
+    if (h->count == 0) return APCF_NONE;
+    uint32_t mask = h->capacity - 1;
+    uint32_t i = *pos == APCF_NONE ? hash_key(key) & mask : *pos;
+    while (h->values[i] != APCF_NONE) {
+        uint32_t next = (i + 1) & mask;
+        if (h->keys[i] == key) {
+            *pos = next;
+            return h->values[i];
+        }
+        i = next;
+    }
+    *pos = i;
+    return APCF_NONE;
+}
+
+static uint32_t hash_get(const apcf_hash_t *h, uint64_t key) {
+    uint32_t pos = APCF_NONE;
+    return hash_next(h, key, &pos);
+}
+
+static void trie_clear(apcf_trie_t *trie) {
+    trie->num_nodes = 0;
+    trie->num_terms = 0;
+    hash_clear(&trie->edges);
+}
+
+static void trie_free(apcf_trie_t *trie) {
+    free(trie->nodes);
+    free(trie->terms);
+    hash_free(&trie->edges);
+    memset(trie, 0, sizeof(*trie));
+}
+
+static int trie_new_node(apcf_trie_t *trie) {
+    if (!grow((void **) &trie->nodes, &trie->node_capacity, trie->num_nodes + 1,
+              sizeof(apcf_node_t))) {
+        return -1;
+    }
+    apcf_node_t *node = &trie->nodes[trie->num_nodes];
+    node->terms = -1;
+    node->num_masks = 0;
+    return trie->num_nodes++;
+}
+
+static inline uint64_t edge_key(int node, uint8_t mask, uint8_t value) {
+    return ((uint64_t) node << 16) | (mask << 8) | (value & mask);
+}
+
+/*
+ * Adds ref under the masked key. Returns false if the key needs more
+ * distinct masks below a node than the trie keeps, or on allocation
+ * failure; *full tells the two apart.
+ */
+static bool trie_insert(apcf_trie_t *trie, const uint8_t *key, const uint8_t *mask, int len,
+                        uint32_t ref, bool *full) {
+    *full = false;
+    if (trie->num_nodes == 0 && trie_new_node(trie) < 0) return false;
+
+    int node = 0;
+    for (int i = 0; i < len; i++) {
+        uint32_t child = hash_get(&trie->edges, edge_key(node, mask[i], key[i]));
+        if (child != APCF_NONE) {
+            node = child;
+            continue;
+        }
+
+        apcf_node_t *n = &trie->nodes[node];
+        int m = 0;
+        while (m < n->num_masks && n->masks[m] != mask[i]) m++;
+        if (m == APCF_TRIE_MAX_MASKS) {
+            *full = true;
+            return false;
+        }
+
+        int created = trie_new_node(trie);
+        if (created < 0 || !hash_put(&trie->edges, edge_key(node, mask[i], key[i]), created)) {
+            return false;
+        }
+        n = &trie->nodes[node];
+        if (m == n->num_masks) n->masks[n->num_masks++] = mask[i];
+        node = created;
+    }
+
+    if (!grow((void **) &trie->terms, &trie->term_capacity, trie->num_terms + 1,
+              sizeof(apcf_term_t))) {
+        return false;
+    }
+    trie->terms[trie->num_terms].ref = ref;
+    trie->terms[trie->num_terms].next = trie->nodes[node].terms;
+    trie->nodes[node].terms = trie->num_terms++;
+    return true;
+}
+
+static void count_hit(uint32_t ref);
+
+/*
+ * Counts every key that is a masked prefix of data, following all edges
+ * whose mask and value fit the next byte.
+ */
+static void trie_walk(const apcf_trie_t *trie, int node, const uint8_t *data, int len) {
+    const apcf_node_t *n = &trie->nodes[node];
+    for (int t = n->terms; t >= 0; t = trie->terms[t].next) count_hit(trie->terms[t].ref);
+    if (len == 0) return;
+
+    for (int m = 0; m < n->num_masks; m++) {
+        uint32_t child = hash_get(&trie->edges, edge_key(node, n->masks[m], data[0]));
+        if (child != APCF_NONE) trie_walk(trie, child, data + 1, len - 1);
+    }
+}
+
+static bool match_masked(const uint8_t *want, const uint8_t *mask, int len,
+                         const uint8_t *have, int have_len) {
+    if (len > have_len) return false;
+    for (int i = 0; i < len; i++) {
+        if ((want[i] ^ have[i]) & mask[i]) return false;
+    }
+    return true;
+}
+
+// Set once per match by count_matches(), as the history must only move once
+static bool sMatchServiceDataChanged;
+
+static bool match_cond(const apcf_cond_t *cond, const bt_bdaddr_t *bda,
+                       const uint8_t *adv_data, const adv_record_t *rec) {
+    switch (cond->type) {
+        case APCF_TYPE_ADDRESS:
+            return !memcmp(&cond->address, bda, sizeof(*bda));
+
+        case APCF_TYPE_SERVICE_DATA_CHANGE:
+            return sMatchServiceDataChanged;
+
+        case APCF_TYPE_SERVICE_UUID:
+            return adv_find_uuid(rec, &cond->uuid, &cond->uuid_mask) >= 0;
+
+        case APCF_TYPE_SOLICIT_UUID:
+            return adv_find_solicit_uuid(rec, &cond->uuid, &cond->uuid_mask) >= 0;
+
+        case APCF_TYPE_LOCAL_NAME:
+            return (rec->present & ADV_HAS_NAME) && rec->name.len == cond->data_len &&
+                    !memcmp(adv_span_data(adv_data, rec->name), cond->data, cond->data_len);
+
+        case APCF_TYPE_MANUFACTURER_DATA:
+            for (int i = 0; i < rec->num_manufacturer_data; i++) {
+                const adv_manufacturer_data_t *m = &rec->manufacturer_data[i];
+                if ((m->company ^ cond->company) & cond->company_mask) continue;
+                if (match_masked(cond->data, cond->mask, cond->data_len,
+                                 adv_span_data(adv_data, m->data), m->data.len)) {
+                    return true;
+                }
+            }
+            return false;
+
+        case APCF_TYPE_SERVICE_DATA:
+            // The pattern starts with the 16 bit service UUID, as in the AD structure
+            for (int i = 0; i < rec->num_service_data; i++) {
+                const adv_service_data_t *s = &rec->service_data[i];
+                if (s->uuid_len != 2) continue;
+                const uint8_t *data = adv_span_data(adv_data, s->data);
+                if (match_masked(cond->data, cond->mask, cond->data_len, data - 2,
+                                 s->data.len + 2)) {
+                    return true;
+                }
+            }
+            return false;
+
+        default:
+            return false;
+    }
+}
+
+static inline uint64_t address_key(const bt_bdaddr_t *bda) {
+    uint64_t key = 0;
+    for (int i = 0; i < 6; i++) key = (key << 8) | bda->address[i];
+    return key;
+}
+
+static bool is_full_mask(const bt_uuid_t *mask) {
+    for (int i = 0; i < 16; i++) {
+        if (mask->uu[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+static bool index_add_linear(uint32_t ref) {
+    if (!grow((void **) &sIndex.linear, &sIndex.linear_capacity, sIndex.num_linear + 1,
+              sizeof(uint32_t))) {
+        return false;
+    }
+    sIndex.linear[sIndex.num_linear++] = ref;
+    return true;
+}
+
+static bool index_add(const apcf_cond_t *cond, uint32_t ref) {
+    bool full = false;
+    bool added;
+    switch (cond->type) {
+        case APCF_TYPE_ADDRESS:
+            return hash_put(&sIndex.addresses, address_key(&cond->address), ref);
+
+        case APCF_TYPE_SERVICE_UUID:
+        case APCF_TYPE_SOLICIT_UUID:
+            if (!is_full_mask(&cond->uuid_mask)) return index_add_linear(ref);
+            return hash_put(&sIndex.uuids, hash_bytes(cond->uuid.uu, 16), ref);
+
+        case APCF_TYPE_LOCAL_NAME:
+            return hash_put(&sIndex.names, hash_bytes(cond->data, cond->data_len), ref);
+
+        case APCF_TYPE_MANUFACTURER_DATA:
+        {
+            // Key on the company identifier as it appears in the AD structure
+            uint8_t key[APCF_MAX_DATA_LEN + 2];
+            uint8_t mask[APCF_MAX_DATA_LEN + 2];
+            key[0] = (uint8_t) cond->company;
+            key[1] = (uint8_t) (cond->company >> 8);
+            mask[0] = (uint8_t) cond->company_mask;
+            mask[1] = (uint8_t) (cond->company_mask >> 8);
+            memcpy(key + 2, cond->data, cond->data_len);
+            memcpy(mask + 2, cond->mask, cond->data_len);
+            added = trie_insert(&sIndex.manufacturer_data, key, mask, cond->data_len + 2, ref,
+                                &full);
+            break;
+        }
+
+        case APCF_TYPE_SERVICE_DATA:
+            added = trie_insert(&sIndex.service_data, cond->data, cond->mask, cond->data_len,
+                                ref, &full);
+            break;
+
+        default:
+            return index_add_linear(ref);
+    }
+    if (!added && full) return index_add_linear(ref);
+    return added;
+}
+
+static void index_clear() {
+    hash_clear(&sIndex.addresses);
+    hash_clear(&sIndex.uuids);
+    hash_clear(&sIndex.names);
+    trie_clear(&sIndex.manufacturer_data);
+    trie_clear(&sIndex.service_data);
+    sIndex.num_linear = 0;
+    sIndex.dirty = false;
+    sIndex.failed = false;
+}
+
+static void index_free() {
+    hash_free(&sIndex.addresses);
+    hash_free(&sIndex.uuids);
+    hash_free(&sIndex.names);
+    trie_free(&sIndex.manufacturer_data);
+    trie_free(&sIndex.service_data);
+    free(sIndex.linear);
+    memset(&sIndex, 0, sizeof(sIndex));
+}
+
+static void index_rebuild() {
+    index_clear();
+    for (int f = 0; f < APCF_MAX_FILTERS; f++) {
+        for (int c = 0; c < sFilters[f].num_conds; c++) {
+            if (!index_add(&sFilters[f].entries[c].cond, APCF_REF(f, c))) {
+                ALOGE("%s: out of memory, scan results are not filtered", __FUNCTION__);
+                sIndex.failed = true;
+                return;
+            }
+        }
+    }
+}
+
+// State of the match in progress, for count_hit()
+static const bt_bdaddr_t *sMatchBda;
+static const uint8_t *sMatchAdvData;
+static const adv_record_t *sMatchRecord;
+
+static bool has_service_data_change_conds() {
+    for (int f = 0; f < APCF_MAX_FILTERS; f++) {
+        if (sFilters[f].totals[APCF_TYPE_SERVICE_DATA_CHANGE] > 0) return true;
+    }
+    return false;
+}
+
+/*
+ * Records the service data of the advertisement and returns true if it
+ * differs from what the address advertised last. Called once per match,
+ * after sGeneration moved.
+ */
+static bool service_data_changed(const bt_bdaddr_t *bda, const uint8_t *adv_data,
+                                 const adv_record_t *rec) {
+    if (rec->num_service_data == 0) return false;
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < rec->num_service_data; i++) {
+        const adv_service_data_t *s = &rec->service_data[i];
+        const uint8_t *value = adv_span_data(adv_data, s->data) - s->uuid_len;
+        hash = (hash ^ hash_bytes(value, s->data.len + s->uuid_len)) * 1099511628211ULL;
+    }
+
+    // Probe a few neighbouring entries, replacing the least recently seen if none matches
+    uint32_t bucket = hash_key(address_key(bda));
+    apcf_history_t *victim = NULL;
+    for (int i = 0; i < APCF_HISTORY_MAX_PROBES; i++) {
+        apcf_history_t *h = &sHistory[(bucket + i) & (APCF_HISTORY_SIZE - 1)];
+        if (h->in_use && !memcmp(&h->bda, bda, sizeof(*bda))) {
+            bool changed = h->hash != hash;
+            h->hash = hash;
+            h->generation = sGeneration;
+            return changed;
+        }
+        if (victim == NULL || !h->in_use ||
+                (victim->in_use && h->generation < victim->generation)) {
+            victim = h;
+        }
+    }
+
+    victim->in_use = true;
+    victim->bda = *bda;
+    victim->hash = hash;
+    victim->generation = sGeneration;
+    return true;
+}
+
+static void count_hit(uint32_t ref) {
+    apcf_entry_t *entry = &sFilters[APCF_REF_FILTER(ref)].entries[APCF_REF_COND(ref)];
+    if (entry->hit_generation == sGeneration) return;
+    entry->hit_generation = sGeneration;
+    sHits[APCF_REF_FILTER(ref)][entry->cond.type]++;
+}
+
+// For hash lookups keyed by a hash rather than the value itself
+static void count_hit_checked(uint32_t ref) {
+    const apcf_cond_t *cond = &sFilters[APCF_REF_FILTER(ref)].entries[APCF_REF_COND(ref)].cond;
+    if (match_cond(cond, sMatchBda, sMatchAdvData, sMatchRecord)) count_hit(ref);
+}
+
+static void count_all(const apcf_hash_t *h, uint64_t key, bool checked) {
+    uint32_t pos = APCF_NONE;
+    uint32_t ref;
+    while ((ref = hash_next(h, key, &pos)) != APCF_NONE) {
+        if (checked) count_hit_checked(ref);
+        else count_hit(ref);
+    }
+}
+
+static void count_matches(const bt_bdaddr_t *bda, const uint8_t *adv_data,
+                          const adv_record_t *rec) {
+    sMatchBda = bda;
+    sMatchAdvData = adv_data;
+    sMatchRecord = rec;
+    if (++sGeneration == 0) {
+        // Wrapped around: forget every stamp so none looks current
+        for (int f = 0; f < APCF_MAX_FILTERS; f++) {
+            for (int c = 0; c < sFilters[f].num_conds; c++) {
+                sFilters[f].entries[c].hit_generation = 0;
+            }
+        }
+        for (int i = 0; i < APCF_HISTORY_SIZE; i++) sHistory[i].generation = 0;
+        sGeneration = 1;
+    }
+    memset(sHits, 0, sizeof(sHits));
+    sMatchServiceDataChanged = has_service_data_change_conds() &&
+            service_data_changed(bda, adv_data, rec);
+
+    count_all(&sIndex.addresses, address_key(bda), false);
+
+    if (sIndex.uuids.count > 0) {
+        for (int i = 0; i < rec->num_uuids; i++) {
+            count_all(&sIndex.uuids, hash_bytes(rec->uuids[i].uu, 16), true);
+        }
+        for (int i = 0; i < rec->num_solicit_uuids; i++) {
+            count_all(&sIndex.uuids, hash_bytes(rec->solicit_uuids[i].uu, 16), true);
+        }
+    }
+
+    if (sIndex.names.count > 0 && (rec->present & ADV_HAS_NAME)) {
+        count_all(&sIndex.names,
+                  hash_bytes(adv_span_data(adv_data, rec->name), rec->name.len), true);
+    }
+
+    // Both tries walk the AD value from its first byte: company or service UUID
+    if (sIndex.manufacturer_data.num_nodes > 0) {
+        for (int i = 0; i < rec->num_manufacturer_data; i++) {
+            const adv_manufacturer_data_t *m = &rec->manufacturer_data[i];
+            trie_walk(&sIndex.manufacturer_data, 0, adv_span_data(adv_data, m->data) - 2,
+                      m->data.len + 2);
+        }
+    }
+    if (sIndex.service_data.num_nodes > 0) {
+        for (int i = 0; i < rec->num_service_data; i++) {
+            const adv_service_data_t *s = &rec->service_data[i];
+            if (s->uuid_len != 2) continue;
+            trie_walk(&sIndex.service_data, 0, adv_span_data(adv_data, s->data) - 2,
+                      s->data.len + 2);
+        }
+    }
+
+    for (int i = 0; i < sIndex.num_linear; i++) count_hit_checked(sIndex.linear[i]);
+}
+
+static bool match_filter(const apcf_filter_t *filter, const uint16_t *hits, int rssi) {
+    const apcf_params_t *params = &filter->params;
+    if (rssi < params->rssi_high_threshold) return false;
+
+    int selection = params->feature_selection & ((1 << APCF_NUM_TYPES) - 1);
+    if (selection == 0) return true;
+
+    bool logic_and = params->filter_logic_type != 0;
+    bool any_logic = false;
+    bool logic_match = logic_and;
+    for (int type = 0; type < APCF_NUM_TYPES; type++) {
+        if (!(selection & (1 << type))) continue;
+
+        // A selected feature without conditions never matches
+        bool all = (params->list_logic_type >> (4 * type)) & 0x1;
+        int total = filter->totals[type];
+        bool match = total > 0 && (all ? hits[type] == total : hits[type] > 0);
+
+        if (!(APCF_LOGIC_FEATURES & (1 << type))) {
+            if (!match) return false;
+            continue;
+        }
+        any_logic = true;
+        logic_match = logic_and ? (logic_match && match) : (logic_match || match);
+    }
+    return !any_logic || logic_match;
+}
+
+static int count_free_filters() {
+    int count = 0;
+    for (int i = 0; i < APCF_MAX_FILTERS; i++) {
+        if (!sFilters[i].configured) count++;
+    }
+    return count;
+}
+
+static void clear_conds(apcf_filter_t *filter) {
+    if (filter->num_conds > 0) sIndex.dirty = true;
+    filter->num_conds = 0;
+    memset(filter->totals, 0, sizeof(filter->totals));
+}
+
+void apcf_enable(bool enable) {
+    pthread_mutex_lock(&sApcfLock);
+    sApcfEnabled = enable;
+    pthread_mutex_unlock(&sApcfLock);
+}
+
+int apcf_add_cond(int filt_index, const apcf_cond_t *cond) {
+    if (filt_index < 0 || filt_index >= APCF_MAX_FILTERS) return -1;
+    if (cond->type < 0 || cond->type >= APCF_NUM_TYPES) return -1;
+
+    pthread_mutex_lock(&sApcfLock);
+    apcf_filter_t *filter = &sFilters[filt_index];
+    if (filter->num_conds == APCF_MAX_CONDS ||
+            !grow((void **) &filter->entries, &filter->capacity, filter->num_conds + 1,
+                  sizeof(apcf_entry_t))) {
+        pthread_mutex_unlock(&sApcfLock);
+        return -1;
+    }
+
+    int c = filter->num_conds;
+    filter->entries[c].cond = *cond;
+    filter->entries[c].hit_generation = 0;
+    if (!sIndex.dirty && !index_add(cond, APCF_REF(filt_index, c))) {
+        pthread_mutex_unlock(&sApcfLock);
+        return -1;
+    }
+    filter->num_conds++;
+    filter->totals[cond->type]++;
+    int avbl_space = APCF_MAX_CONDS - filter->num_conds;
+    pthread_mutex_unlock(&sApcfLock);
+    return avbl_space;
+}
+
+int apcf_remove_cond(int filt_index, const apcf_cond_t *cond) {
+    if (filt_index < 0 || filt_index >= APCF_MAX_FILTERS) return -1;
+
+    pthread_mutex_lock(&sApcfLock);
+    apcf_filter_t *filter = &sFilters[filt_index];
+    for (int i = 0; i < filter->num_conds; i++) {
+        if (!memcmp(&filter->entries[i].cond, cond, sizeof(*cond))) {
+            filter->totals[cond->type]--;
+            filter->entries[i] = filter->entries[--filter->num_conds];
+            sIndex.dirty = true;
+            break;
+        }
+    }
+    int avbl_space = APCF_MAX_CONDS - filter->num_conds;
+    pthread_mutex_unlock(&sApcfLock);
+    return avbl_space;
+}
+
+int apcf_clear_conds(int filt_index) {
+    if (filt_index < 0 || filt_index >= APCF_MAX_FILTERS) return -1;
+
+    pthread_mutex_lock(&sApcfLock);
+    clear_conds(&sFilters[filt_index]);
+    int avbl_space = APCF_MAX_CONDS - sFilters[filt_index].num_conds;
+    pthread_mutex_unlock(&sApcfLock);
+    return avbl_space;
+}
+
+int apcf_set_params(int filt_index, const apcf_params_t *params) {
+    if (filt_index < 0 || filt_index >= APCF_MAX_FILTERS) return -1;
+
+    pthread_mutex_lock(&sApcfLock);
+    sFilters[filt_index].params = *params;
+    sFilters[filt_index].configured = true;
+    int avbl_space = count_free_filters();
+    pthread_mutex_unlock(&sApcfLock);
+    return avbl_space;
+}
+
+int apcf_delete_params(int filt_index) {
+    if (filt_index < 0 || filt_index >= APCF_MAX_FILTERS) return -1;
+
+    // The controller drops the conditions along with the filter
+    pthread_mutex_lock(&sApcfLock);
+    sFilters[filt_index].configured = false;
+    clear_conds(&sFilters[filt_index]);
+    int avbl_space = count_free_filters();
+    pthread_mutex_unlock(&sApcfLock);
+    return avbl_space;
+}
+
+int apcf_clear_params() {
+    pthread_mutex_lock(&sApcfLock);
+    for (int i = 0; i < APCF_MAX_FILTERS; i++) {
+        sFilters[i].configured = false;
+        clear_conds(&sFilters[i]);
+    }
+    pthread_mutex_unlock(&sApcfLock);
+    return APCF_MAX_FILTERS;
+}
+
+void apcf_reset() {
+    pthread_mutex_lock(&sApcfLock);
+    sApcfEnabled = false;
+    for (int i = 0; i < APCF_MAX_FILTERS; i++) free(sFilters[i].entries);
+    memset(sFilters, 0, sizeof(sFilters));
+    memset(sHistory, 0, sizeof(sHistory));
+    index_free();
+    pthread_mutex_unlock(&sApcfLock);
+}
+
+bool apcf_match(const bt_bdaddr_t *bda, int rssi, const uint8_t *adv_data, size_t len,
+                uint32_t *tracked) {
+    *tracked = 0;
+    // Read without the lock: a stale value only lets a few results through
+    if (!sApcfEnabled) return true;
+
+    adv_record_t rec;
+    adv_parse(adv_data, len, &rec);
+
+    pthread_mutex_lock(&sApcfLock);
+    if (sIndex.dirty) index_rebuild();
+    if (!sApcfEnabled || sIndex.failed) {
+        pthread_mutex_unlock(&sApcfLock);
+        return true;
+    }
+
+    count_matches(bda, adv_data, &rec);
+    bool match = false;
+    for (int i = 0; i < APCF_MAX_FILTERS; i++) {
+        const apcf_filter_t *filter = &sFilters[i];
+        if (!filter->configured) continue;
+
+        int mode = filter->params.delivery_mode;
+        if (mode == APCF_DELIVERY_IMMEDIATE) {
+            if (!match) match = match_filter(filter, sHits[i], rssi);
+        } else if (mode == APCF_DELIVERY_ON_FOUND_LOST) {
+            if (match_filter(filter, sHits[i], rssi)) *tracked |= 1u << i;
+        }
+    }
+    pthread_mutex_unlock(&sApcfLock);
+    return match;
+}
+
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_APCF_H
+#define COM_ANDROID_BLUETOOTH_APCF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hardware/bluetooth.h"
+
+namespace android {
+
+/*
+ * Software emulation of the controller's advertising packet content filter
+ * (APCF), for controllers that have none.
+ *
+ * Filters are addressed by the same filter index the stack hands to the
+ * controller, and are made of conditions of the BTM_BLE_PF_* types plus a
+ * parameter set. Within one feature the conditions are combined as the
+ * list logic type says, four bits per feature (0 OR, 1 AND). Address,
+ * service data change and UUID features are always combined with AND;
+ * local name, manufacturer data and service data patterns use the filter
+ * logic type. A feature selection of 0 lets everything through. A service
+ * data change condition matches when an address advertises service data
+ * that differs from what it advertised last, or the first time it is seen
+ * with service data; the last payload of the most recently seen addresses
+ * is kept for this.
+ *
+ * Only filters with immediate delivery apply to regular scan results. While
+ * filtering is enabled, a result that matches none of them is dropped, as
+ * the controller would. Matches of on-found/on-lost filters are reported
+ * separately, for the advertiser tracker to act on.
+ *
+ * Conditions are compiled into lookup structures as they are added: a hash
+ * set of addresses, hash sets of UUIDs and local names, and masked byte
+ * tries over manufacturer data and service data patterns. Matching an
+ * advertisement only visits the conditions it can satisfy, so its cost does
+ * not grow with the number of conditions. Removing conditions recompiles
+ * on the next match.
+ */
+
+#define APCF_MAX_FILTERS            32
+#define APCF_MAX_CONDS              8192    // per filter index
+#define APCF_MAX_DATA_LEN           62
+#define APCF_HISTORY_SIZE           256     // must be a power of two
+#define APCF_HISTORY_MAX_PROBES     8
+
+// Condition types, as in ScanFilterQueue
+#define APCF_TYPE_ADDRESS               0
+#define APCF_TYPE_SERVICE_DATA_CHANGE   1
+#define APCF_TYPE_SERVICE_UUID          2
+#define APCF_TYPE_SOLICIT_UUID          3
+#define APCF_TYPE_LOCAL_NAME            4
+#define APCF_TYPE_MANUFACTURER_DATA     5
+#define APCF_TYPE_SERVICE_DATA          6
+#define APCF_NUM_TYPES                  7
+
+#define APCF_DELIVERY_IMMEDIATE     0
+#define APCF_DELIVERY_ON_FOUND_LOST 1
+
+typedef struct {
+    int type;
+    bt_bdaddr_t address;
+    bt_uuid_t uuid;
+    bt_uuid_t uuid_mask;
+    int company;
+    int company_mask;
+    uint8_t data[APCF_MAX_DATA_LEN];    // name, manufacturer data or UUID16 + service data
+    uint8_t mask[APCF_MAX_DATA_LEN];
+    int data_len;
+} apcf_cond_t;
+
+typedef struct {
+    int client_if;
+    int feature_selection;
+    int list_logic_type;
+    int filter_logic_type;
+    int rssi_high_threshold;
+    int delivery_mode;
+} apcf_params_t;
+
+/*
+ * Turns filtering on or off. While off every result passes.
+ */
+void apcf_enable(bool enable);
+
+/*
+ * Add or remove a condition of filter filt_index. Return the number of
+ * conditions the filter still has room for, or -1 on failure.
+ */
+int apcf_add_cond(int filt_index, const apcf_cond_t *cond);
+int apcf_remove_cond(int filt_index, const apcf_cond_t *cond);
+
+/*
+ * Removes all conditions of filter filt_index. Returns the number of
+ * conditions the filter has room for, or -1 on failure.
+ */
+int apcf_clear_conds(int filt_index);
+
+/*
+ * Set or delete the parameters of filter filt_index; a filter without
+ * parameters takes no part in matching. Return the number of free filter
+ * indices, or -1 on failure.
+ */
+int apcf_set_params(int filt_index, const apcf_params_t *params);
+int apcf_delete_params(int filt_index);
+int apcf_clear_params();
+
+/*
+ * Drops every filter and turns filtering off.
+ */
+void apcf_reset();
+
+/*
+ * True if the result should be reported. Sets bit i of tracked for each
+ * on-found/on-lost filter i the result matched.
+ */
+bool apcf_match(const bt_bdaddr_t *bda, int rssi, const uint8_t *adv_data, size_t len,
+                uint32_t *tracked);
+
+}
+
+#endif
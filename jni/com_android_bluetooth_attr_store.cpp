@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothAttrStoreJni"
+
+#include "com_android_bluetooth_attr_store.h"
+#include "utils/Log.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+typedef struct {
+    bool in_use;
+    int attr_handle;
+    uint8_t *value;
+    int len;
+} attr_store_entry_t;
+
+static pthread_mutex_t sAttrStoreLock = PTHREAD_MUTEX_INITIALIZER;
+static attr_store_entry_t sEntries[ATTR_STORE_MAX_ATTRS];
+
+static attr_store_entry_t* find_entry(int attr_handle, attr_store_entry_t **unused) {
+    for (int i = 0; i < ATTR_STORE_MAX_ATTRS; i++) {
+        if (!sEntries[i].in_use) {
+            if (unused != NULL && *unused == NULL) *unused = &sEntries[i];
+        } else if (sEntries[i].attr_handle == attr_handle) {
+            return &sEntries[i];
+        }
+    }
+    return NULL;
+}
+
+static void release_entry(attr_store_entry_t *entry) {
+    free(entry->value);
+    memset(entry, 0, sizeof(*entry));
+}
+
+bool attr_store_set(int attr_handle, const uint8_t *value, int len) {
+    if (value != NULL && (len < 0 || len > ATTR_STORE_MAX_LEN)) {
+        ALOGW("%s: value of handle %d too long (%d)", __FUNCTION__, attr_handle, len);
+        return false;
+    }
+
+    // Allocate outside the lock; at least one byte so empty values are stored too
+    uint8_t *copy = NULL;
+    if (value != NULL) {
+        copy = (uint8_t *) malloc(len > 0 ? len : 1);
+        if (copy == NULL) return false;
+        memcpy(copy, value, len);
+    }
+
+    pthread_mutex_lock(&sAttrStoreLock);
+    attr_store_entry_t *unused = NULL;
+    attr_store_entry_t *entry = find_entry(attr_handle, &unused);
+    if (entry != NULL) release_entry(entry);
+
+    bool stored = true;
+    if (copy != NULL) {
+        if (entry == NULL) entry = unused;
+        if (entry != NULL) {
+            entry->in_use = true;
+            entry->attr_handle = attr_handle;
+            entry->value = copy;
+            entry->len = len;
+        } else {
+            ALOGW("%s: store full, handle %d left to the server", __FUNCTION__,
+                  attr_handle);
+            free(copy);
+            stored = false;
+        }
+    }
+    pthread_mutex_unlock(&sAttrStoreLock);
+    return stored;
+}
+
+int attr_store_read(int attr_handle, int offset, uint8_t *buf, size_t buf_len, int *len) {
+    int status = ATTR_STORE_MISSING;
+    *len = 0;
+
+    pthread_mutex_lock(&sAttrStoreLock);
+    attr_store_entry_t *entry = find_entry(attr_handle, NULL);
+    if (entry != NULL) {
+        if (offset < 0 || offset > entry->len) {
+            status = ATTR_STORE_INVALID_OFFSET;
+        } else {
+            size_t count = entry->len - offset;
+            if (count > buf_len) count = buf_len;
+            memcpy(buf, entry->value + offset, count);
+            *len = (int) count;
+            status = ATTR_STORE_OK;
+        }
+    }
+    pthread_mutex_unlock(&sAttrStoreLock);
+    return status;
+}
+
+void attr_store_clear() {
+    pthread_mutex_lock(&sAttrStoreLock);
+    for (int i = 0; i < ATTR_STORE_MAX_ATTRS; i++) {
+        if (sEntries[i].in_use) release_entry(&sEntries[i]);
+    }
+    pthread_mutex_unlock(&sAttrStoreLock);
+}
+
+}
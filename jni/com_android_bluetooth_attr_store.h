@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_ATTR_STORE_H
+#define COM_ANDROID_BLUETOOTH_ATTR_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Values of GATT server attributes, kept in native code.
+ *
+ * A server may hand the value of an attribute over once instead of
+ * answering every read of it. Reads of a stored attribute, long reads
+ * included, are answered from here with the part of the value starting
+ * at the requested offset; reads of any other attribute still go to the
+ * server.
+ */
+
+#define ATTR_STORE_MAX_ATTRS        128
+#define ATTR_STORE_MAX_LEN          512     // longest attribute value in ATT
+
+#define ATTR_STORE_MISSING          (-1)
+#define ATTR_STORE_OK               0
+#define ATTR_STORE_INVALID_OFFSET   0x07    // ATT error code
+
+/*
+ * Stores the value of attr_handle, replacing any earlier one, or forgets
+ * it if value is NULL. Returns false if the value is too long or the
+ * store is full.
+ */
+bool attr_store_set(int attr_handle, const uint8_t *value, int len);
+
+/*
+ * Copies the stored value of attr_handle from offset on into buf, at most
+ * buf_len bytes, and sets *len. Returns ATTR_STORE_MISSING if nothing is
+ * stored, otherwise the status to answer the read with.
+ */
+int attr_store_read(int attr_handle, int offset, uint8_t *buf, size_t buf_len, int *len);
+
+/*
+ * Forgets all stored values.
+ */
+void attr_store_clear();
+
+}
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothBatchScanJni"
+
+#include "com_android_bluetooth_adv_parser.h"
+#include "com_android_bluetooth_batch_scan.h"
+#include "utils/Log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+#define BATCH_SCAN_HEADER_LEN           11
+#define BATCH_SCAN_TIMESTAMP_UNIT_MS    50
+
+static int64_t decode_header(const uint8_t *rec, int8_t *tx_power, int8_t *rssi,
+                             int32_t *timestamp_delta_ms) {
+    // The controller reports the address least significant octet first
+    int64_t address = 0;
+    for (int i = 5; i >= 0; i--) {
+        address = (address << 8) | rec[i];
+    }
+    *tx_power = (int8_t) rec[7];
+    *rssi = (int8_t) rec[8];
+    *timestamp_delta_ms = (rec[9] | (rec[10] << 8)) * BATCH_SCAN_TIMESTAMP_UNIT_MS;
+    return address;
+}
+
+static bool allocate(batch_scan_reports_t *reports, int max_records, int payload_len) {
+    memset(reports, 0, sizeof(*reports));
+    reports->addresses = (int64_t *) malloc((max_records + 1) * sizeof(int64_t));
+    reports->tx_power = (int8_t *) malloc(max_records + 1);
+    reports->rssi = (int8_t *) malloc(max_records + 1);
+    reports->timestamp_delta_ms = (int32_t *) malloc((max_records + 1) * sizeof(int32_t));
+    if (payload_len > 0) {
+        reports->payload_offsets = (int32_t *) malloc((max_records + 1) * sizeof(int32_t));
+        reports->payloads = (uint8_t *) malloc(payload_len);
+        if (reports->payload_offsets == NULL || reports->payloads == NULL) {
+            batch_scan_reports_free(reports);
+            return false;
+        }
+    }
+    if (reports->addresses == NULL || reports->tx_power == NULL || reports->rssi == NULL ||
+        reports->timestamp_delta_ms == NULL) {
+        batch_scan_reports_free(reports);
+        return false;
+    }
+    return true;
+}
+
+static void decode_truncated(const uint8_t *data, int len, batch_scan_reports_t *reports) {
+    int count = len / BATCH_SCAN_HEADER_LEN;
+    for (int i = 0; i < count; i++) {
+        reports->addresses[i] = decode_header(data + i * BATCH_SCAN_HEADER_LEN,
+                                              &reports->tx_power[i], &reports->rssi[i],
+                                              &reports->timestamp_delta_ms[i]);
+    }
+    reports->count = count;
+}
+
+static void decode_full(const uint8_t *data, int len, batch_scan_reports_t *reports) {
+    int pos = 0;
+    int count = 0;
+    int payload_len = 0;
+    while (pos + BATCH_SCAN_HEADER_LEN < len) {
+        const uint8_t *rec = data + pos;
+        int adv_pos = pos + BATCH_SCAN_HEADER_LEN;
+        int adv_len = data[adv_pos];
+        int rsp_pos = adv_pos + 1 + adv_len;
+        if (rsp_pos >= len) break;
+        int rsp_len = data[rsp_pos];
+        int end = rsp_pos + 1 + rsp_len;
+        if (end > len) break;
+
+        reports->addresses[count] = decode_header(rec, &reports->tx_power[count],
+                                                  &reports->rssi[count],
+                                                  &reports->timestamp_delta_ms[count]);
+        // The advertising data comes padded to its full length. Java parses it
+        // and the scan response as one record, which would stop at the padding
+        // and lose the scan response, so only the significant part is kept.
+        adv_record_t adv;
+        if (adv_parse(data + adv_pos + 1, adv_len, &adv)) adv_len = adv.len;
+
+        reports->payload_offsets[count] = payload_len;
+        memcpy(reports->payloads + payload_len, data + adv_pos + 1, adv_len);
+        payload_len += adv_len;
+        memcpy(reports->payloads + payload_len, data + rsp_pos + 1, rsp_len);
+        payload_len += rsp_len;
+        count++;
+        pos = end;
+    }
+    if (pos != len) ALOGW("%s: dropped %d trailing bytes", __FUNCTION__, len - pos);
+
+    reports->payload_offsets[count] = payload_len;
+    reports->payload_len = payload_len;
+    reports->count = count;
+}
+
+bool batch_scan_decode(int format, const uint8_t *data, int len, batch_scan_reports_t *reports) {
+    if (len < 0) len = 0;
+
+    switch (format) {
+        case BATCH_SCAN_FORMAT_TRUNCATED:
+            if (!allocate(reports, len / BATCH_SCAN_HEADER_LEN, 0)) return false;
+            decode_truncated(data, len, reports);
+            return true;
+
+        case BATCH_SCAN_FORMAT_FULL:
+            // Every record carries at least the header and two length bytes
+            if (!allocate(reports, len / (BATCH_SCAN_HEADER_LEN + 2), len + 1)) return false;
+            decode_full(data, len, reports);
+            return true;
+
+        default:
+            ALOGE("%s: unknown report format %d", __FUNCTION__, format);
+            memset(reports, 0, sizeof(*reports));
+            return false;
+    }
+}
+
+void batch_scan_reports_free(batch_scan_reports_t *reports) {
+    free(reports->addresses);
+    free(reports->tx_power);
+    free(reports->rssi);
+    free(reports->timestamp_delta_ms);
+    free(reports->payload_offsets);
+    free(reports->payloads);
+    memset(reports, 0, sizeof(*reports));
+}
+
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_BATCH_SCAN_H
+#define COM_ANDROID_BLUETOOTH_BATCH_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Decoder for the batch scan reports read back from the controller.
+ *
+ * Both report formats are decoded into parallel arrays, one entry per
+ * record, so they can be handed to Java in a single upcall without any
+ * per-record objects.
+ *
+ * Truncated records are 11 bytes: address (LSB first), address type,
+ * TX power, RSSI and a 2 byte timestamp in 50 ms units. Full records have
+ * the same 11 byte header followed by the advertising data and the scan
+ * response, each prefixed with its length; the padding after the
+ * advertising data is dropped so the two parse as one record.
+ */
+
+#define BATCH_SCAN_FORMAT_TRUNCATED     1
+#define BATCH_SCAN_FORMAT_FULL          2
+
+typedef struct {
+    int count;
+    int64_t *addresses;             // first printed octet in bits 47..40
+    int8_t *tx_power;
+    int8_t *rssi;
+    int32_t *timestamp_delta_ms;    // how long before the read the record was seen
+    int32_t *payload_offsets;       // count + 1 entries into payloads, full format only
+    uint8_t *payloads;              // advertising data and scan response, back to back
+    int payload_len;
+} batch_scan_reports_t;
+
+/*
+ * Decodes len bytes of a report in format into reports. Records that do
+ * not fit in the data are dropped. Returns false if memory could not be
+ * allocated or the format is unknown. The arrays are released with
+ * batch_scan_reports_free().
+ */
+bool batch_scan_decode(int format, const uint8_t *data, int len, batch_scan_reports_t *reports);
+
+void batch_scan_reports_free(batch_scan_reports_t *reports);
+
+}
+
+#endif
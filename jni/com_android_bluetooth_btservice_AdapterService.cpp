@@ -18,6 +18,7 @@
 
 #define LOG_TAG "BluetoothServiceJni"
 #include "com_android_bluetooth.h"
+#include "com_android_bluetooth_gatt_cache.h"
 #include "android_hardware_wipower.h"
 #include "hardware/bt_sock.h"
 #include "hardware/bt_mce.h"
@@ -298,6 +299,33 @@ static void device_found_callback(int num_properties, bt_property_t *properties)
     callbackEnv->DeleteLocalRef(addr);
 }
 
+// Devices with a bond in progress, so that a failed pairing is not taken
+// for a removed bond. Only touched on the callback thread.
+#define MAX_BONDING_DEVICES 8
+static bt_bdaddr_t sBondingDevices[MAX_BONDING_DEVICES];
+static int sNumBondingDevices = 0;
+
+/*
+ * Records the new bond state of bd_addr and returns true if it was bonded
+ * before, i.e. its bond is removed now that it reports BT_BOND_STATE_NONE.
+ */
+static bool bond_removed(const bt_bdaddr_t *bd_addr, bt_bond_state_t state) {
+    int i;
+    for (i = 0; i < sNumBondingDevices; i++) {
+        if (!memcmp(&sBondingDevices[i], bd_addr, sizeof(bt_bdaddr_t))) break;
+    }
+    bool was_bonding = i < sNumBondingDevices;
+
+    if (state == BT_BOND_STATE_BONDING) {
+        if (!was_bonding && sNumBondingDevices < MAX_BONDING_DEVICES) {
+            sBondingDevices[sNumBondingDevices++] = *bd_addr;
+        }
+        return false;
+    }
+    if (was_bonding) sBondingDevices[i] = sBondingDevices[--sNumBondingDevices];
+    return state == BT_BOND_STATE_NONE && !was_bonding;
+}
+
 static void bond_state_changed_callback(bt_status_t status, bt_bdaddr_t *bd_addr,
                                         bt_bond_state_t state) {
     jbyteArray addr;
@@ -310,6 +338,10 @@ static void bond_state_changed_callback(bt_status_t status, bt_bdaddr_t *bd_addr
         ALOGE("Address is null in %s", __FUNCTION__);
         return;
     }
+
+    // A cached attribute database may hold attributes of the removed bond
+    if (bond_removed(bd_addr, state)) gatt_cache_invalidate(bd_addr);
+
     addr = callbackEnv->NewByteArray(sizeof(bt_bdaddr_t));
     if (addr == NULL) {
        ALOGE("Address allocation failed in %s", __FUNCTION__);
@@ -115,16 +115,12 @@ static bool checkCallbackThread() {
 
 void le_lpp_write_rssi_thresh_callbacks(bt_bdaddr_t *bda, int status)
 {
-    char c_address[32] = {0};
     if (!checkCallbackThread()) {
        ALOGE("Callback: '%s' is not called on the correct thread", __FUNCTION__);
        return;
     }
 
-    snprintf(c_address, sizeof(c_address),"%02X:%02X:%02X:%02X:%02X:%02X",
-        bda->address[0], bda->address[1], bda->address[2],
-        bda->address[3], bda->address[4], bda->address[5]);
-    jstring address = qccallbackEnv->NewStringUTF(c_address);
+    jstring address = getAddressString(qccallbackEnv, bda);
     qccallbackEnv->CallVoidMethod(qcJniCallbacksObj, method_onLeLppWriteRssiThreshold,
                                   address, status);
     qccallbackEnv->DeleteLocalRef(address);
@@ -134,15 +130,11 @@ void le_lpp_write_rssi_thresh_callbacks(bt_bdaddr_t *bda, int status)
 void le_lpp_read_rssi_thresh_callbacks(bt_bdaddr_t *bda, int low, int upper,
                                 int alert, int status)
 {
-    char c_address[32] = {0};
     if (!checkCallbackThread()) {
        ALOGE("Callback: '%s' is not called on the correct thread", __FUNCTION__);
        return;
     }
-    snprintf(c_address, sizeof(c_address),"%02X:%02X:%02X:%02X:%02X:%02X",
-        bda->address[0], bda->address[1], bda->address[2],
-        bda->address[3], bda->address[4], bda->address[5]);
-    jstring address = qccallbackEnv->NewStringUTF(c_address);
+    jstring address = getAddressString(qccallbackEnv, bda);
     qccallbackEnv->CallVoidMethod(qcJniCallbacksObj, method_onLeLppReadRssiThreshold,
                                   address, low, upper, alert, status);
     qccallbackEnv->DeleteLocalRef(address);
@@ -152,15 +144,11 @@ void le_lpp_read_rssi_thresh_callbacks(bt_bdaddr_t *bda, int low, int upper,
 void le_lpp_enable_rssi_monitor_callbacks(bt_bdaddr_t *bda,
                                     int enable, int status)
 {
-    char c_address[32] = {0};
     if (!checkCallbackThread()) {
        ALOGE("Callback: '%s' is not called on the correct thread", __FUNCTION__);
        return;
     }
-    snprintf(c_address, sizeof(c_address),"%02X:%02X:%02X:%02X:%02X:%02X",
-        bda->address[0], bda->address[1], bda->address[2],
-        bda->address[3], bda->address[4], bda->address[5]);
-    jstring address = qccallbackEnv->NewStringUTF(c_address);
+    jstring address = getAddressString(qccallbackEnv, bda);
     qccallbackEnv->CallVoidMethod(qcJniCallbacksObj, method_onLeLppEnableRssiMonitor,
                                   address, enable, status);
     qccallbackEnv->DeleteLocalRef(address);
@@ -170,15 +158,11 @@ void le_lpp_enable_rssi_monitor_callbacks(bt_bdaddr_t *bda,
 void le_lpp_rssi_threshold_evt_callbacks(bt_bdaddr_t *bda,
                                   int evt_type, int rssi)
 {
-    char c_address[32] = {0};
     if (!checkCallbackThread()) {
        ALOGE("Callback: '%s' is not called on the correct thread", __FUNCTION__);
        return;
     }
-    snprintf(c_address, sizeof(c_address),"%02X:%02X:%02X:%02X:%02X:%02X",
-        bda->address[0], bda->address[1], bda->address[2],
-        bda->address[3], bda->address[4], bda->address[5]);
-    jstring address = qccallbackEnv->NewStringUTF(c_address);
+    jstring address = getAddressString(qccallbackEnv, bda);
     qccallbackEnv->CallVoidMethod(qcJniCallbacksObj, method_onLeLppRssiThresholdEvent,
                                   address, evt_type, rssi);
     qccallbackEnv->DeleteLocalRef(address);
@@ -253,6 +237,7 @@ static bool cleanupNative(JNIEnv *env, jobject obj) {
         env->DeleteGlobalRef(qcJniCallbacksObj);
         qcJniCallbacksObj=NULL;
     }
+    clearAddressStringCache(env);
     return JNI_TRUE;
 }
 
@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothDiscoveryJni"
+
+#include "com_android_bluetooth_discovery.h"
+#include "utils/Log.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+#define INITIAL_CAPACITY    64
+#define MAX_ATTRS           0xFFFF      // one per attribute handle at most
+
+enum {
+    STATE_SEARCHING,
+    STATE_WALKING,
+    STATE_DONE,
+};
+
+typedef struct {
+    bool in_use;
+    int conn_id;
+    int state;
+    int status;
+    gatt_cache_attr_t *attrs;
+    int count;
+    int capacity;
+    int next;                   // service or characteristic being walked
+    int list;                   // type of the list being walked
+} discovery_session_t;
+
+static pthread_mutex_t sDiscoveryLock = PTHREAD_MUTEX_INITIALIZER;
+static discovery_session_t sSessions[DISCOVERY_MAX_SESSIONS];
+
+static discovery_session_t* find_session(int conn_id) {
+    for (int i = 0; i < DISCOVERY_MAX_SESSIONS; i++) {
+        if (sSessions[i].in_use && sSessions[i].conn_id == conn_id) return &sSessions[i];
+    }
+    return NULL;
+}
+
+static void end_session(discovery_session_t *s) {
+    free(s->attrs);
+    memset(s, 0, sizeof(*s));
+}
+
+static bool append_locked(discovery_session_t *s, const gatt_cache_attr_t *attr) {
+    if (s->count == s->capacity) {
+        int capacity = s->capacity ? s->capacity * 2 : INITIAL_CAPACITY;
+        if (capacity > MAX_ATTRS) capacity = MAX_ATTRS;
+        gatt_cache_attr_t *attrs = (gatt_cache_attr_t *) (s->count < MAX_ATTRS
+            ? realloc(s->attrs, capacity * sizeof(gatt_cache_attr_t)) : NULL);
+        if (attrs == NULL) {
+            ALOGE("%s: unable to grow the table of conn_id %d", __FUNCTION__, s->conn_id);
+            return false;
+        }
+        s->attrs = attrs;
+        s->capacity = capacity;
+    }
+    s->attrs[s->count++] = *attr;
+    return true;
+}
+
+/*
+ * Starts the next list of the walk, or finishes it.
+ */
+static int advance_locked(discovery_session_t *s, gatt_cache_attr_t *query, bool *has_start) {
+    for (; s->next < s->count; s->next++) {
+        const gatt_cache_attr_t *attr = &s->attrs[s->next];
+        if (attr->type == GATT_CACHE_SERVICE) {
+            s->list = GATT_CACHE_CHARACTERISTIC;
+        } else if (attr->type == GATT_CACHE_CHARACTERISTIC) {
+            s->list = GATT_CACHE_DESCRIPTOR;
+        } else {
+            continue;
+        }
+
+        memset(query, 0, sizeof(*query));
+        query->type = s->list;
+        query->srvc_id = attr->srvc_id;
+        query->char_id = attr->char_id;
+        *has_start = false;
+        return DISCOVERY_QUERY;
+    }
+
+    s->state = STATE_DONE;
+    return DISCOVERY_DONE;
+}
+
+bool discovery_start(int conn_id) {
+    pthread_mutex_lock(&sDiscoveryLock);
+    discovery_session_t *s = find_session(conn_id);
+    if (s == NULL) {
+        for (int i = 0; i < DISCOVERY_MAX_SESSIONS; i++) {
+            if (!sSessions[i].in_use) {
+                s = &sSessions[i];
+                break;
+            }
+        }
+    }
+    if (s != NULL) {
+        end_session(s);
+        s->in_use = true;
+        s->conn_id = conn_id;
+        s->state = STATE_SEARCHING;
+    }
+    pthread_mutex_unlock(&sDiscoveryLock);
+    return s != NULL;
+}
+
+void discovery_stop(int conn_id) {
+    pthread_mutex_lock(&sDiscoveryLock);
+    discovery_session_t *s = find_session(conn_id);
+    if (s != NULL) end_session(s);
+    pthread_mutex_unlock(&sDiscoveryLock);
+}
+
+bool discovery_service_found(int conn_id, const btgatt_srvc_id_t *srvc_id) {
+    pthread_mutex_lock(&sDiscoveryLock);
+    discovery_session_t *s = find_session(conn_id);
+    bool driven = s != NULL && s->state == STATE_SEARCHING;
+    if (driven) {
+        gatt_cache_attr_t attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = GATT_CACHE_SERVICE;
+        attr.srvc_id = *srvc_id;
+        append_locked(s, &attr);
+    }
+    pthread_mutex_unlock(&sDiscoveryLock);
+    return driven;
+}
+
+int discovery_search_complete(int conn_id, int status, gatt_cache_attr_t *query,
+                              bool *has_start) {
+    int action = DISCOVERY_NONE;
+    pthread_mutex_lock(&sDiscoveryLock);
+    discovery_session_t *s = find_session(conn_id);
+    if (s != NULL && s->state == STATE_SEARCHING) {
+        s->status = status;
+        if (status == 0) {
+            s->state = STATE_WALKING;
+            s->next = 0;
+            action = advance_locked(s, query, has_start);
+        } else {
+            s->state = STATE_DONE;
+            action = DISCOVERY_DONE;
+        }
+    }
+    pthread_mutex_unlock(&sDiscoveryLock);
+    return action;
+}
+
+int discovery_result(int conn_id, int status, const gatt_cache_attr_t *attr,
+                     gatt_cache_attr_t *query, bool *has_start) {
+    int action = DISCOVERY_NONE;
+    pthread_mutex_lock(&sDiscoveryLock);
+    discovery_session_t *s = find_session(conn_id);
+    if (s == NULL || s->state != STATE_WALKING || attr->type != s->list) {
+        pthread_mutex_unlock(&sDiscoveryLock);
+        return action;
+    }
+
+    if (status == 0 && append_locked(s, attr)) {
+        // Ask for the next attribute of the same list
+        *query = *attr;
+        *has_start = true;
+        action = DISCOVERY_QUERY;
+    } else if (s->list == GATT_CACHE_CHARACTERISTIC) {
+        // Included services of the same service come next
+        memset(query, 0, sizeof(*query));
+        query->type = GATT_CACHE_INCLUDED_SERVICE;
+        query->srvc_id = attr->srvc_id;
+        *has_start = false;
+        s->list = GATT_CACHE_INCLUDED_SERVICE;
+        action = DISCOVERY_QUERY;
+    } else {
+        s->next++;
+        action = advance_locked(s, query, has_start);
+    }
+    pthread_mutex_unlock(&sDiscoveryLock);
+    return action;
+}
+
+static void put_uuid(uint8_t *p, const bt_uuid_t *uuid) {
+    // bt_uuid_t is little endian already
+    memcpy(p, uuid->uu, 16);
+}
+
+static void pack(uint8_t *p, const gatt_cache_attr_t *attr) {
+    memset(p, 0, DISCOVERY_RECORD_SIZE);
+    p[0] = (uint8_t) attr->type;
+    p[1] = attr->srvc_id.is_primary ? BTGATT_SERVICE_TYPE_PRIMARY
+                                    : BTGATT_SERVICE_TYPE_SECONDARY;
+    p[2] = attr->srvc_id.id.inst_id;
+    put_uuid(p + 8, &attr->srvc_id.id.uuid);
+
+    switch (attr->type) {
+    case GATT_CACHE_DESCRIPTOR:
+        p[5] = attr->descr_id.inst_id;
+        put_uuid(p + 40, &attr->descr_id.uuid);
+        // fall through
+    case GATT_CACHE_CHARACTERISTIC:
+        p[3] = attr->char_id.inst_id;
+        p[6] = (uint8_t) attr->char_prop;
+        put_uuid(p + 24, &attr->char_id.uuid);
+        break;
+    case GATT_CACHE_INCLUDED_SERVICE:
+        p[3] = attr->incl_srvc_id.id.inst_id;
+        p[4] = attr->incl_srvc_id.is_primary ? BTGATT_SERVICE_TYPE_PRIMARY
+                                             : BTGATT_SERVICE_TYPE_SECONDARY;
+        put_uuid(p + 24, &attr->incl_srvc_id.id.uuid);
+        break;
+    }
+}
+
+uint8_t* discovery_take(int conn_id, int *status, int *len) {
+    uint8_t *table = NULL;
+    pthread_mutex_lock(&sDiscoveryLock);
+    discovery_session_t *s = find_session(conn_id);
+    if (s != NULL && s->state == STATE_DONE) {
+        *status = s->status;
+        *len = s->count * DISCOVERY_RECORD_SIZE;
+        table = (uint8_t *) malloc(*len + 1);
+        if (table != NULL) {
+            for (int i = 0; i < s->count; i++) {
+                pack(table + i * DISCOVERY_RECORD_SIZE, &s->attrs[i]);
+            }
+        }
+        end_session(s);
+    }
+    pthread_mutex_unlock(&sDiscoveryLock);
+    return table;
+}
+
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_DISCOVERY_H
+#define COM_ANDROID_BLUETOOTH_DISCOVERY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hardware/bt_gatt.h"
+#include "com_android_bluetooth_gatt_cache.h"
+
+namespace android {
+
+/*
+ * Native service discovery driver.
+ *
+ * Walks the attribute database of a connection in the order GattService
+ * walks it through SearchQueue: the services of the search, then the
+ * characteristics and included services of each service, then the
+ * descriptors of each characteristic. The caller makes the calls the
+ * driver asks for and feeds it their results. Once the walk is done the
+ * whole table is handed over in one packed array of
+ * DISCOVERY_RECORD_SIZE byte records, in the order the attributes were
+ * found:
+ *
+ *   0   type, a GATT_CACHE_ value
+ *   1   service type, BTGATT_SERVICE_TYPE_
+ *   2   service instance id
+ *   3   characteristic or included service instance id
+ *   4   included service type
+ *   5   descriptor instance id
+ *   6   characteristic properties
+ *   7   unused
+ *   8   service UUID, least then most significant 64 bits
+ *   24  characteristic or included service UUID
+ *   40  descriptor UUID
+ *
+ * Integers are little endian. IDs that do not apply to a type are 0.
+ */
+
+#define DISCOVERY_MAX_SESSIONS      16
+#define DISCOVERY_RECORD_SIZE       56
+
+#define DISCOVERY_NONE              0   // the connection is not driven
+#define DISCOVERY_QUERY             1   // make the call in query
+#define DISCOVERY_DONE              2   // take the table
+
+/*
+ * Drives the next full service search of conn_id. Returns false if no
+ * session is free.
+ */
+bool discovery_start(int conn_id);
+
+/*
+ * Forgets conn_id.
+ */
+void discovery_stop(int conn_id);
+
+/*
+ * Feed the driver the results of the service search and of the calls it
+ * asked for. They return DISCOVERY_NONE, or false, if conn_id is not
+ * driven, in which case the caller handles the result itself.
+ */
+bool discovery_service_found(int conn_id, const btgatt_srvc_id_t *srvc_id);
+int discovery_search_complete(int conn_id, int status, gatt_cache_attr_t *query,
+                              bool *has_start);
+int discovery_result(int conn_id, int status, const gatt_cache_attr_t *attr,
+                     gatt_cache_attr_t *query, bool *has_start);
+
+/*
+ * Returns the packed table of a finished walk and ends the session, or
+ * NULL if allocation fails. The caller frees the table.
+ */
+uint8_t* discovery_take(int conn_id, int *status, int *len);
+
+}
+
+#endif
@@ -26,10 +26,34 @@
    }
 
 #include "com_android_bluetooth.h"
+#include "com_android_bluetooth_adv_payload.h"
+#include "com_android_bluetooth_adv_sched.h"
+#include "com_android_bluetooth_apcf.h"
+#include "com_android_bluetooth_attr_store.h"
+#include "com_android_bluetooth_batch_scan.h"
+#include "com_android_bluetooth_discovery.h"
+#include "com_android_bluetooth_gatt_cache.h"
+#include "com_android_bluetooth_notify_batch.h"
+#include "com_android_bluetooth_notify_fanout.h"
+#include "com_android_bluetooth_notify_stream.h"
+#include "com_android_bluetooth_notify_token.h"
+#include "com_android_bluetooth_prep_write.h"
+#include "com_android_bluetooth_record_batch.h"
+#include "com_android_bluetooth_scan_dedup.h"
+#include "com_android_bluetooth_scan_filter.h"
+#include "com_android_bluetooth_scan_ring.h"
+#include "com_android_bluetooth_subscription.h"
+#include "com_android_bluetooth_track_adv.h"
+#include "com_android_bluetooth_upcall_queue.h"
+#include "com_android_bluetooth_write_pipe.h"
 #include "hardware/bt_gatt.h"
 #include "utils/Log.h"
 #include "android_runtime/AndroidRuntime.h"
 
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <cutils/log.h>
@@ -41,6 +65,11 @@
 
 #define BD_ADDR_LEN 6
 
+#define SCAN_RESULT_ADV_DATA_LEN 62
+#define SCAN_RESULT_RECORD_LEN (6 + 1 + SCAN_RESULT_ADV_DATA_LEN + 8)
+
+#define GATT_UPCALL_QUEUE_SIZE 256
+
 #define UUID_PARAMS(uuid_ptr) \
     uuid_lsb(uuid_ptr),  uuid_msb(uuid_ptr)
 
@@ -142,6 +171,7 @@ namespace android {
 
 static jmethodID method_onClientRegistered;
 static jmethodID method_onScanResult;
+static jmethodID method_onScanResults;
 static jmethodID method_onConnected;
 static jmethodID method_onDisconnected;
 static jmethodID method_onReadCharacteristic;
@@ -149,9 +179,12 @@ static jmethodID method_onWriteCharacteristic;
 static jmethodID method_onExecuteCompleted;
 static jmethodID method_onSearchCompleted;
 static jmethodID method_onSearchResult;
+static jmethodID method_onDiscoveryTable;
 static jmethodID method_onReadDescriptor;
 static jmethodID method_onWriteDescriptor;
 static jmethodID method_onNotify;
+static jmethodID method_onNotifyCompact;
+static jmethodID method_onNotifyBatch;
 static jmethodID method_onGetCharacteristic;
 static jmethodID method_onGetDescriptor;
 static jmethodID method_onGetIncludedService;
@@ -191,6 +224,8 @@ static jmethodID method_onAttributeWrite;
 static jmethodID method_onExecuteWrite;
 static jmethodID method_onNotificationSent;
 static jmethodID method_onServerCongestion;
+static jmethodID method_onNotificationFanoutDone;
+static jmethodID method_onNotificationStreamProgress;
 static jmethodID method_onServerMtuChanged;
 
 /**
@@ -200,6 +235,17 @@ static jmethodID method_onServerMtuChanged;
 static const btgatt_interface_t *sGattIf = NULL;
 static jobject mCallbacksObj = NULL;
 static JNIEnv *sCallbackEnv = NULL;
+static upcall_queue_t *sUpcallQueue = NULL;
+static bool sQueueUpcalls = false;
+static record_batch_t *sScanResultBatch = NULL;
+static scan_ring_t *sScanResultRing = NULL;
+static bool sApcfEmulated = false;
+static track_adv_t *sTrackAdv = NULL;
+static notify_batch_t *sNotifyBatch = NULL;
+static adv_sched_t *sAdvSched = NULL;
+static adv_payload_t *sAdvPayload = NULL;
+// Held while sAdvSched is used, since a binder thread may swap it
+static pthread_mutex_t sAdvSchedLock = PTHREAD_MUTEX_INITIALIZER;
 
 static bool checkCallbackThread() {
     sCallbackEnv = getCallbackEnv();
@@ -209,359 +255,1005 @@ static bool checkCallbackThread() {
     return true;
 }
 
+/**
+ * Upcall dispatch
+ *
+ * Callbacks marshal their arguments into a struct and hand it to a
+ * handler. When the upcall queue is enabled the struct lives in a queue
+ * slot, with variable length data copied right behind it, and the handler
+ * runs on the queue's drain thread. Otherwise the struct stays on the
+ * caller's stack and the handler runs inline after the usual thread check,
+ * unless upcalls are still queued: the struct then goes to the queue too,
+ * so that it does not overtake them. The stack thread never waits for
+ * Java; an upcall the queue has no room for is dropped.
+ *
+ * The queue exists either way: upcalls that originate in a native method
+ * rather than a stack callback are always posted to it with postUpcall(),
+ * so they neither re-enter Java on the caller's thread nor overtake
+ * callbacks delivered before them.
+ */
+
+static void* beginUpcall(upcall_handler_t handler, void *local, size_t len, size_t data_len,
+                         bool lossy)
+{
+    if (sUpcallQueue && (sQueueUpcalls || !upcall_queue_idle(sUpcallQueue))) {
+        void *slot = upcall_queue_reserve(sUpcallQueue, handler, len + data_len, lossy);
+        if (slot == NULL) warn("upcall dropped, the queue is full");
+        return slot;
+    }
+    if (!checkCallbackThread()) {
+        error("Callback is not called on the correct thread");
+        return NULL;
+    }
+    return local;
+}
+
+static const uint8_t* copyUpcallData(void *payload, void *local, size_t len,
+                                     const uint8_t *data, size_t data_len)
+{
+    if (payload == local) return data;
+
+    uint8_t *copy = (uint8_t *) payload + len;
+    memcpy(copy, data, data_len);
+    return copy;
+}
+
+static void endUpcall(upcall_handler_t handler, void *payload, void *local)
+{
+    if (payload != local) {
+        upcall_queue_commit(sUpcallQueue, payload);
+        return;
+    }
+    handler(sCallbackEnv, payload);
+}
+
+// Returns false if the upcall was dropped
+static bool postUpcall(JNIEnv *env, upcall_handler_t handler, const void *payload, size_t len)
+{
+    if (sUpcallQueue == NULL) {
+        handler(env, payload);
+        return true;
+    }
+    void *slot = upcall_queue_reserve(sUpcallQueue, handler, len, false);
+    if (slot == NULL) {
+        warn("upcall dropped, the queue is full");
+        return false;
+    }
+    memcpy(slot, payload, len);
+    upcall_queue_commit(sUpcallQueue, slot);
+    return true;
+}
+
+/*
+ * Callbacks without a handler of their own describe their Java call to
+ * callJava() with one letter per argument: I for an int, J for a long, Z
+ * for a boolean, A for a bt_bdaddr_t * passed up as an address string and
+ * B for a byte array given as a pointer and a length. The call then goes
+ * through beginUpcall() like any other.
+ */
+#define CALL_JAVA_MAX_ARGS 14
+
+typedef struct {
+    jmethodID method;
+    char format[CALL_JAVA_MAX_ARGS + 1];
+    jvalue args[CALL_JAVA_MAX_ARGS];
+    bt_bdaddr_t bda;
+    int value_len;
+    const uint8_t *value;
+    bool value_owned;   // value is a malloc'ed copy too long for a queue slot
+} call_java_upcall_t;
+
+#define UUID_ARGS       "JJ"
+#define GATT_ID_ARGS    "I" UUID_ARGS
+#define SRVC_ID_ARGS    "I" GATT_ID_ARGS
+
+static void call_java_upcall(JNIEnv *env, const void *payload)
+{
+    const call_java_upcall_t *p = (const call_java_upcall_t *) payload;
+    jvalue args[CALL_JAVA_MAX_ARGS];
+    jobject address = NULL;
+    jobject value = NULL;
+
+    for (int i = 0; p->format[i]; i++) {
+        switch (p->format[i]) {
+        case 'A':
+            if (address == NULL) address = getAddressString(env, &p->bda);
+            args[i].l = address;
+            break;
+        case 'B':
+            if (value == NULL) {
+                value = env->NewByteArray(p->value_len);
+                if (value == NULL) goto out;
+                env->SetByteArrayRegion((jbyteArray) value, 0, p->value_len,
+                                        (const jbyte *) p->value);
+            }
+            args[i].l = value;
+            break;
+        default:
+            args[i] = p->args[i];
+            break;
+        }
+    }
+    env->CallVoidMethodA(mCallbacksObj, p->method, args);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+
+out:
+    if (address) env->DeleteLocalRef(address);
+    if (value) env->DeleteLocalRef(value);
+    if (p->value_owned) free((void *) p->value);
+}
+
+static void callJava(jmethodID method, const char *format, ...)
+{
+    call_java_upcall_t local;
+    memset(&local, 0, sizeof(local));
+    local.method = method;
+    snprintf(local.format, sizeof(local.format), "%s", format);
+
+    va_list ap;
+    va_start(ap, format);
+    for (int i = 0; local.format[i]; i++) {
+        switch (local.format[i]) {
+        case 'I': local.args[i].i = va_arg(ap, jint); break;
+        case 'J': local.args[i].j = va_arg(ap, jlong); break;
+        case 'Z': local.args[i].z = va_arg(ap, int) ? JNI_TRUE : JNI_FALSE; break;
+        case 'A': local.bda = *va_arg(ap, bt_bdaddr_t *); break;
+        case 'B':
+            local.value = va_arg(ap, const uint8_t *);
+            local.value_len = va_arg(ap, int);
+            break;
+        }
+    }
+    va_end(ap);
+
+    size_t data_len = local.value_len;
+    if (data_len > UPCALL_QUEUE_MAX_PAYLOAD - sizeof(local)) {
+        uint8_t *copy = (uint8_t *) malloc(data_len);
+        if (copy == NULL) {
+            error("%s: unable to allocate %zu bytes", __FUNCTION__, data_len);
+            return;
+        }
+        memcpy(copy, local.value, data_len);
+        local.value = copy;
+        local.value_owned = true;
+        data_len = 0;
+    }
+
+    call_java_upcall_t *p = (call_java_upcall_t *)
+        beginUpcall(call_java_upcall, &local, sizeof(local), data_len, false);
+    if (p == NULL) {
+        if (local.value_owned) free((void *) local.value);
+        return;
+    }
+    if (p != &local) *p = local;
+    if (!local.value_owned) {
+        p->value = copyUpcallData(p, &local, sizeof(local), local.value, data_len);
+    }
+    endUpcall(call_java_upcall, p, &local);
+}
+
 /**
  * BTA client callbacks
  */
 
 void btgattc_register_app_cb(int status, int clientIf, bt_uuid_t *app_uuid)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onClientRegistered, status,
-        clientIf, UUID_PARAMS(app_uuid));
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onClientRegistered, "II" UUID_ARGS, status, clientIf,
+             UUID_PARAMS(app_uuid));
+}
+
+typedef struct {
+    bt_bdaddr_t bda;
+    int rssi;
+    uint64_t clients;
+    const uint8_t *adv_data;
+} scan_result_upcall_t;
+
+static void scan_result_upcall(JNIEnv *env, const void *payload)
+{
+    const scan_result_upcall_t *p = (const scan_result_upcall_t *) payload;
+
+    jstring address = getAddressString(env, &p->bda);
+    jbyteArray jb = env->NewByteArray(SCAN_RESULT_ADV_DATA_LEN);
+    env->SetByteArrayRegion(jb, 0, SCAN_RESULT_ADV_DATA_LEN, (jbyte *) p->adv_data);
+
+    env->CallVoidMethod(mCallbacksObj, method_onScanResult
+        , address, p->rssi, jb, (jlong) p->clients);
+
+    env->DeleteLocalRef(address);
+    env->DeleteLocalRef(jb);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+}
+
+/*
+ * Batched scan results are packed as SCAN_RESULT_RECORD_LEN byte records:
+ * the 6 address bytes, the RSSI as a signed byte, the advertising data, then
+ * the scan filter slots the result matched in native byte order.
+ */
+static void scan_results_upcall(JNIEnv *env, const uint8_t *records, int count)
+{
+    jsize len = count * SCAN_RESULT_RECORD_LEN;
+    jbyteArray packed = env->NewByteArray(len);
+    if (packed == NULL) return;
+    env->SetByteArrayRegion(packed, 0, len, (const jbyte *) records);
+
+    env->CallVoidMethod(mCallbacksObj, method_onScanResults, packed, count);
+
+    env->DeleteLocalRef(packed);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
 
 void btgattc_scan_result_cb(bt_bdaddr_t* bda, int rssi, uint8_t* adv_data)
 {
-    CHECK_CALLBACK_ENV
+    // Stand in for the controller's filters when it has none. Devices tracked
+    // for found/lost only get through when they are found.
+    uint32_t tracked;
+    bool match = apcf_match(bda, rssi, adv_data, SCAN_RESULT_ADV_DATA_LEN, &tracked);
+    if (tracked && sTrackAdv && track_adv_sighting(sTrackAdv, bda, tracked)) match = true;
+    if (!match) return;
+
+    // Nothing to do in Java for results no scan client is interested in
+    uint64_t clients = scan_filter_match(bda, adv_data, SCAN_RESULT_ADV_DATA_LEN);
+    if (clients == 0) return;
 
-    char c_address[32];
-    snprintf(c_address, sizeof(c_address),"%02X:%02X:%02X:%02X:%02X:%02X",
-        bda->address[0], bda->address[1], bda->address[2],
-        bda->address[3], bda->address[4], bda->address[5]);
+    // Beacons repeat the same payload every few hundred ms; drop the repeats here
+    clients = scan_dedup_filter(bda, rssi, adv_data, SCAN_RESULT_ADV_DATA_LEN, clients);
+    if (clients == 0) return;
 
-    jstring address = sCallbackEnv->NewStringUTF(c_address);
-    jbyteArray jb = sCallbackEnv->NewByteArray(62);
-    sCallbackEnv->SetByteArrayRegion(jb, 0, 62, (jbyte *) adv_data);
+    // GattService reads the ring on its own thread; no upcall is made here
+    if (sScanResultRing) {
+        scan_ring_put(sScanResultRing, bda, rssi, adv_data, clients);
+        return;
+    }
+
+    if (sScanResultBatch) {
+        uint8_t record[SCAN_RESULT_RECORD_LEN];
+        memcpy(record, bda->address, sizeof(bda->address));
+        record[6] = (uint8_t) rssi;
+        memcpy(record + 7, adv_data, SCAN_RESULT_ADV_DATA_LEN);
+        memcpy(record + 7 + SCAN_RESULT_ADV_DATA_LEN, &clients, sizeof(clients));
+        if (record_batch_add(sScanResultBatch, record)) return;
+    }
 
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onScanResult
-        , address, rssi, jb);
+    scan_result_upcall_t local;
+    scan_result_upcall_t *p = (scan_result_upcall_t *)
+        beginUpcall(scan_result_upcall, &local, sizeof(local), SCAN_RESULT_ADV_DATA_LEN, true);
+    if (p == NULL) return;
 
-    sCallbackEnv->DeleteLocalRef(address);
-    sCallbackEnv->DeleteLocalRef(jb);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    p->bda = *bda;
+    p->rssi = rssi;
+    p->clients = clients;
+    p->adv_data = copyUpcallData(p, &local, sizeof(local), adv_data,
+                                 SCAN_RESULT_ADV_DATA_LEN);
+    endUpcall(scan_result_upcall, p, &local);
 }
 
 void btgattc_open_cb(int conn_id, int status, int clientIf, bt_bdaddr_t* bda)
 {
-    CHECK_CALLBACK_ENV
-
-    char c_address[32];
-    snprintf(c_address, sizeof(c_address),"%02X:%02X:%02X:%02X:%02X:%02X",
-        bda->address[0], bda->address[1], bda->address[2],
-        bda->address[3], bda->address[4], bda->address[5]);
+    if (status == 0) gatt_cache_open(conn_id, bda);
 
-    jstring address = sCallbackEnv->NewStringUTF(c_address);
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onConnected,
-        clientIf, conn_id, status, address);
-    sCallbackEnv->DeleteLocalRef(address);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onConnected, "IIIA", clientIf, conn_id, status, bda);
 }
 
 void btgattc_close_cb(int conn_id, int status, int clientIf, bt_bdaddr_t* bda)
 {
-    CHECK_CALLBACK_ENV
-    char c_address[32];
-    snprintf(c_address, sizeof(c_address),"%02X:%02X:%02X:%02X:%02X:%02X",
-        bda->address[0], bda->address[1], bda->address[2],
-        bda->address[3], bda->address[4], bda->address[5]);
+    // conn_id may be reused by the next connection
+    if (sNotifyBatch) notify_batch_configure(sNotifyBatch, conn_id, 0, 0);
+    notify_token_remove_conn(conn_id);
+    gatt_cache_close(conn_id);
+    discovery_stop(conn_id);
+    write_pipe_close(conn_id);
+
+    callJava(method_onDisconnected, "IIIA", clientIf, conn_id, status, bda);
+}
+
+typedef struct {
+    int conn_id;
+    int status;
+    gatt_cache_attr_t attr;
+} gatt_cache_answer_upcall_t;
+
+static void gatt_cache_answer_upcall(JNIEnv *env, const void *payload)
+{
+    const gatt_cache_answer_upcall_t *p = (const gatt_cache_answer_upcall_t *) payload;
+    gatt_cache_attr_t copy = p->attr;
+    gatt_cache_attr_t *attr = &copy;
+
+    switch (attr->type) {
+    case GATT_CACHE_CHARACTERISTIC:
+        env->CallVoidMethod(mCallbacksObj, method_onGetCharacteristic
+            , p->conn_id, p->status, SRVC_ID_PARAMS((&attr->srvc_id))
+            , GATT_ID_PARAMS((&attr->char_id)), attr->char_prop);
+        break;
+    case GATT_CACHE_DESCRIPTOR:
+        env->CallVoidMethod(mCallbacksObj, method_onGetDescriptor
+            , p->conn_id, p->status, SRVC_ID_PARAMS((&attr->srvc_id))
+            , GATT_ID_PARAMS((&attr->char_id)), GATT_ID_PARAMS((&attr->descr_id)));
+        break;
+    case GATT_CACHE_INCLUDED_SERVICE:
+        env->CallVoidMethod(mCallbacksObj, method_onGetIncludedService
+            , p->conn_id, p->status, SRVC_ID_PARAMS((&attr->srvc_id))
+            , SRVC_ID_PARAMS((&attr->incl_srvc_id)));
+        break;
+    }
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+}
+
+/*
+ * Answers a discovery call from com_android_bluetooth_gatt_cache.h. The
+ * call comes from a binder thread or from the previous answer, so the
+ * answer is posted like a stack callback rather than delivered here.
+ */
+static void gatt_cache_answer(JNIEnv *env, int conn_id, int status,
+                              gatt_cache_attr_t *attr)
+{
+    gatt_cache_answer_upcall_t upcall;
+    upcall.conn_id = conn_id;
+    upcall.status = status;
+    upcall.attr = *attr;
+    postUpcall(env, gatt_cache_answer_upcall, &upcall, sizeof(upcall));
+}
+
+// Service Changed characteristic, 0x2A05
+static bool is_service_changed(const btgatt_gatt_id_t *char_id)
+{
+    static const uint8_t uuid[16] = {
+        0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80,
+        0x00, 0x10, 0x00, 0x00, 0x05, 0x2A, 0x00, 0x00,
+    };
+    return memcmp(char_id->uuid.uu, uuid, sizeof(uuid)) == 0;
+}
+
+/*
+ * Asks for the characteristics, descriptors or included services of
+ * query, starting after the one in it if has_start is set. The attribute
+ * cache answers through handler if it can, the stack through the
+ * get_*_cb callbacks otherwise.
+ */
+static void discovery_query(JNIEnv *env, int conn_id, gatt_cache_attr_t *query,
+                            bool has_start, gatt_cache_handler_t handler)
+{
+    if (gatt_cache_replay(env, conn_id, query, has_start, handler)) return;
+
+    switch (query->type) {
+    case GATT_CACHE_CHARACTERISTIC:
+        sGattIf->client->get_characteristic(conn_id, &query->srvc_id,
+            has_start ? &query->char_id : 0);
+        break;
+    case GATT_CACHE_DESCRIPTOR:
+        sGattIf->client->get_descriptor(conn_id, &query->srvc_id, &query->char_id,
+            has_start ? &query->descr_id : 0);
+        break;
+    case GATT_CACHE_INCLUDED_SERVICE:
+        sGattIf->client->get_included_service(conn_id, &query->srvc_id,
+            has_start ? &query->incl_srvc_id : 0);
+        break;
+    }
+}
+
+typedef struct {
+    int conn_id;
+    int status;
+    uint8_t *table;
+    int len;
+} discovery_upcall_t;
+
+static void discovery_table_upcall(JNIEnv *env, const void *payload)
+{
+    const discovery_upcall_t *p = (const discovery_upcall_t *) payload;
+    int status = p->status;
+    jbyteArray jtable = env->NewByteArray(p->table != NULL ? p->len : 0);
+    if (jtable == NULL) {
+        error("%s: unable to allocate %d bytes", __FUNCTION__, p->len);
+        free(p->table);
+        return;
+    }
+    if (p->table != NULL) {
+        env->SetByteArrayRegion(jtable, 0, p->len, (const jbyte *) p->table);
+        free(p->table);
+    } else {
+        status = BT_STATUS_NOMEM;
+    }
 
-    jstring address = sCallbackEnv->NewStringUTF(c_address);
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onDisconnected,
-        clientIf, conn_id, status, address);
-    sCallbackEnv->DeleteLocalRef(address);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    env->CallVoidMethod(mCallbacksObj, method_onDiscoveryTable, p->conn_id, status, jtable);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+    env->DeleteLocalRef(jtable);
+}
+
+/*
+ * Delivers the attribute table of a walk of
+ * com_android_bluetooth_discovery.h. The walk ends on the stack thread or
+ * on a binder thread, so the table is posted either way.
+ */
+static void discovery_upcall(JNIEnv *env, int conn_id)
+{
+    discovery_upcall_t upcall;
+    upcall.conn_id = conn_id;
+    upcall.status = 0;
+    upcall.len = 0;
+    upcall.table = discovery_take(conn_id, &upcall.status, &upcall.len);
+    if (!postUpcall(env, discovery_table_upcall, &upcall, sizeof(upcall))) free(upcall.table);
+}
+
+static void discovery_answer(JNIEnv *env, int conn_id, int status, gatt_cache_attr_t *attr);
+
+static void discovery_step(JNIEnv *env, int conn_id, int action,
+                           gatt_cache_attr_t *query, bool has_start)
+{
+    if (action == DISCOVERY_QUERY) {
+        discovery_query(env, conn_id, query, has_start, discovery_answer);
+    } else if (action == DISCOVERY_DONE) {
+        discovery_upcall(env, conn_id);
+    }
+}
+
+static void discovery_answer(JNIEnv *env, int conn_id, int status, gatt_cache_attr_t *attr)
+{
+    gatt_cache_attr_t query;
+    bool has_start = false;
+    int action = discovery_result(conn_id, status, attr, &query, &has_start);
+    discovery_step(env, conn_id, action, &query, has_start);
+}
+
+/*
+ * Hands a stack result to the discovery driver. Returns false if conn_id
+ * is not driven and GattService walks it.
+ */
+static bool discovery_feed(int conn_id, int status, gatt_cache_attr_t *attr)
+{
+    gatt_cache_attr_t query;
+    bool has_start = false;
+    int action = discovery_result(conn_id, status, attr, &query, &has_start);
+    if (action == DISCOVERY_NONE) return false;
+    discovery_step(sCallbackEnv, conn_id, action, &query, has_start);
+    return true;
 }
 
 void btgattc_search_complete_cb(int conn_id, int status)
 {
+    gatt_cache_search_complete(conn_id, status);
+
     CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onSearchCompleted,
-                                 conn_id, status);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    gatt_cache_attr_t query;
+    bool has_start = false;
+    int action = discovery_search_complete(conn_id, status, &query, &has_start);
+    if (action != DISCOVERY_NONE) {
+        discovery_step(sCallbackEnv, conn_id, action, &query, has_start);
+        return;
+    }
+
+    callJava(method_onSearchCompleted, "II", conn_id, status);
 }
 
 void btgattc_search_result_cb(int conn_id, btgatt_srvc_id_t *srvc_id)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onSearchResult, conn_id,
-        SRVC_ID_PARAMS(srvc_id));
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    gatt_cache_service_found(conn_id, srvc_id);
+    if (discovery_service_found(conn_id, srvc_id)) return;
+
+    callJava(method_onSearchResult, "I" SRVC_ID_ARGS, conn_id, SRVC_ID_PARAMS(srvc_id));
 }
 
 void btgattc_get_characteristic_cb(int conn_id, int status,
                 btgatt_srvc_id_t *srvc_id, btgatt_gatt_id_t *char_id,
                 int char_prop)
 {
+    gatt_cache_attr_t attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = GATT_CACHE_CHARACTERISTIC;
+    attr.srvc_id = *srvc_id;
+    attr.char_id = *char_id;
+    attr.char_prop = char_prop;
+    gatt_cache_record(conn_id, status, &attr);
+
     CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onGetCharacteristic
+    if (discovery_feed(conn_id, status, &attr)) return;
+
+    callJava(method_onGetCharacteristic, "II" SRVC_ID_ARGS GATT_ID_ARGS "I"
         , conn_id, status, SRVC_ID_PARAMS(srvc_id), GATT_ID_PARAMS(char_id)
         , char_prop);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
 }
 
 void btgattc_get_descriptor_cb(int conn_id, int status,
                 btgatt_srvc_id_t *srvc_id, btgatt_gatt_id_t *char_id,
                 btgatt_gatt_id_t *descr_id)
 {
+    gatt_cache_attr_t attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = GATT_CACHE_DESCRIPTOR;
+    attr.srvc_id = *srvc_id;
+    attr.char_id = *char_id;
+    attr.descr_id = *descr_id;
+    gatt_cache_record(conn_id, status, &attr);
+
     CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onGetDescriptor
+    if (discovery_feed(conn_id, status, &attr)) return;
+
+    callJava(method_onGetDescriptor, "II" SRVC_ID_ARGS GATT_ID_ARGS GATT_ID_ARGS
         , conn_id, status, SRVC_ID_PARAMS(srvc_id), GATT_ID_PARAMS(char_id)
         , GATT_ID_PARAMS(descr_id));
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
 }
 
 void btgattc_get_included_service_cb(int conn_id, int status,
                 btgatt_srvc_id_t *srvc_id, btgatt_srvc_id_t *incl_srvc_id)
 {
+    gatt_cache_attr_t attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = GATT_CACHE_INCLUDED_SERVICE;
+    attr.srvc_id = *srvc_id;
+    attr.incl_srvc_id = *incl_srvc_id;
+    gatt_cache_record(conn_id, status, &attr);
+
     CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onGetIncludedService
+    if (discovery_feed(conn_id, status, &attr)) return;
+
+    callJava(method_onGetIncludedService, "II" SRVC_ID_ARGS SRVC_ID_ARGS
         , conn_id, status, SRVC_ID_PARAMS(srvc_id), SRVC_ID_PARAMS(incl_srvc_id));
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
 }
 
 void btgattc_register_for_notification_cb(int conn_id, int registered, int status,
                                           btgatt_srvc_id_t *srvc_id, btgatt_gatt_id_t *char_id)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onRegisterForNotifications
+    callJava(method_onRegisterForNotifications, "III" SRVC_ID_ARGS GATT_ID_ARGS
         , conn_id, status, registered, SRVC_ID_PARAMS(srvc_id), GATT_ID_PARAMS(char_id));
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+}
+
+typedef struct {
+    int conn_id;
+    bt_bdaddr_t bda;
+    btgatt_srvc_id_t srvc_id;
+    btgatt_gatt_id_t char_id;
+    uint8_t is_notify;
+    uint16_t len;
+    const uint8_t *value;
+} notify_upcall_t;
+
+static void notify_upcall(JNIEnv *env, const void *payload)
+{
+    const notify_upcall_t *p = (const notify_upcall_t *) payload;
+    btgatt_srvc_id_t *srvc_id = (btgatt_srvc_id_t *) &p->srvc_id;
+    btgatt_gatt_id_t *char_id = (btgatt_gatt_id_t *) &p->char_id;
+
+    jstring address = getAddressString(env, &p->bda);
+    jbyteArray jb = env->NewByteArray(p->len);
+    env->SetByteArrayRegion(jb, 0, p->len, (jbyte *) p->value);
+
+    env->CallVoidMethod(mCallbacksObj, method_onNotify
+        , p->conn_id, address, SRVC_ID_PARAMS(srvc_id)
+        , GATT_ID_PARAMS(char_id), p->is_notify, jb);
+
+    env->DeleteLocalRef(address);
+    env->DeleteLocalRef(jb);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+}
+
+typedef struct {
+    int token;
+    uint16_t len;
+    const uint8_t *value;
+} notify_compact_upcall_t;
+
+static void notify_compact_upcall(JNIEnv *env, const void *payload)
+{
+    const notify_compact_upcall_t *p = (const notify_compact_upcall_t *) payload;
+
+    jbyteArray jb = env->NewByteArray(p->len);
+    env->SetByteArrayRegion(jb, 0, p->len, (jbyte *) p->value);
+
+    env->CallVoidMethod(mCallbacksObj, method_onNotifyCompact, p->token, jb);
+
+    env->DeleteLocalRef(jb);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+}
+
+/*
+ * Notifications batched per connection, with the values packed as in
+ * com_android_bluetooth_notify_batch.h.
+ */
+static void notify_batch_upcall(JNIEnv *env, int conn_id, const int32_t *tokens,
+                                const int64_t *timestamps, int count,
+                                const uint8_t *values, int values_len)
+{
+    jintArray jtokens = env->NewIntArray(count);
+    jlongArray jtimestamps = env->NewLongArray(count);
+    jbyteArray jvalues = env->NewByteArray(values_len);
+    if (jtokens == NULL || jtimestamps == NULL || jvalues == NULL) {
+        error("%s: unable to allocate %d notifications", __FUNCTION__, count);
+        if (jtokens) env->DeleteLocalRef(jtokens);
+        if (jtimestamps) env->DeleteLocalRef(jtimestamps);
+        if (jvalues) env->DeleteLocalRef(jvalues);
+        return;
+    }
+    env->SetIntArrayRegion(jtokens, 0, count, (const jint *) tokens);
+    env->SetLongArrayRegion(jtimestamps, 0, count, (const jlong *) timestamps);
+    env->SetByteArrayRegion(jvalues, 0, values_len, (const jbyte *) values);
+
+    env->CallVoidMethod(mCallbacksObj, method_onNotifyBatch, conn_id, jtokens, jtimestamps,
+                        jvalues);
+
+    env->DeleteLocalRef(jtokens);
+    env->DeleteLocalRef(jtimestamps);
+    env->DeleteLocalRef(jvalues);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
 
 void btgattc_notify_cb(int conn_id, btgatt_notify_params_t *p_data)
 {
-    CHECK_CALLBACK_ENV
+    if (is_service_changed(&p_data->char_id)) gatt_cache_invalidate(&p_data->bda);
 
-    char c_address[32];
-    snprintf(c_address, sizeof(c_address), "%02X:%02X:%02X:%02X:%02X:%02X",
-        p_data->bda.address[0], p_data->bda.address[1], p_data->bda.address[2],
-        p_data->bda.address[3], p_data->bda.address[4], p_data->bda.address[5]);
+    // GattService already knows the address and IDs behind a token
+    int token = notify_token_lookup(conn_id, &p_data->srvc_id, &p_data->char_id);
+    if (token != NOTIFY_TOKEN_NONE) {
+        if (sNotifyBatch &&
+                notify_batch_add(sNotifyBatch, conn_id, token, p_data->value, p_data->len)) {
+            return;
+        }
+
+        notify_compact_upcall_t local;
+        notify_compact_upcall_t *p = (notify_compact_upcall_t *)
+            beginUpcall(notify_compact_upcall, &local, sizeof(local), p_data->len, true);
+        if (p == NULL) return;
 
-    jstring address = sCallbackEnv->NewStringUTF(c_address);
-    jbyteArray jb = sCallbackEnv->NewByteArray(p_data->len);
-    sCallbackEnv->SetByteArrayRegion(jb, 0, p_data->len, (jbyte *) p_data->value);
+        p->token = token;
+        p->len = p_data->len;
+        p->value = copyUpcallData(p, &local, sizeof(local), p_data->value, p_data->len);
+        endUpcall(notify_compact_upcall, p, &local);
+        return;
+    }
 
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onNotify
-        , conn_id, address, SRVC_ID_PARAMS((&p_data->srvc_id))
-        , GATT_ID_PARAMS((&p_data->char_id)), p_data->is_notify, jb);
+    notify_upcall_t local;
+    notify_upcall_t *p = (notify_upcall_t *)
+        beginUpcall(notify_upcall, &local, sizeof(local), p_data->len, true);
+    if (p == NULL) return;
 
-    sCallbackEnv->DeleteLocalRef(address);
-    sCallbackEnv->DeleteLocalRef(jb);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    p->conn_id = conn_id;
+    p->bda = p_data->bda;
+    p->srvc_id = p_data->srvc_id;
+    p->char_id = p_data->char_id;
+    p->is_notify = p_data->is_notify;
+    p->len = p_data->len;
+    p->value = copyUpcallData(p, &local, sizeof(local), p_data->value, p_data->len);
+    endUpcall(notify_upcall, p, &local);
 }
 
 void btgattc_read_characteristic_cb(int conn_id, int status, btgatt_read_params_t *p_data)
 {
-    CHECK_CALLBACK_ENV
-
-    jbyteArray jb;
+    static const uint8_t no_value = 0;
+    const uint8_t *value = &no_value;
+    int len = 1;
     if ( status == 0 )      //successful
     {
-        jb = sCallbackEnv->NewByteArray(p_data->value.len);
-        sCallbackEnv->SetByteArrayRegion(jb, 0, p_data->value.len,
-            (jbyte *) p_data->value.value);
-    } else {
-        uint8_t value = 0;
-        jb = sCallbackEnv->NewByteArray(1);
-        sCallbackEnv->SetByteArrayRegion(jb, 0, 1, (jbyte *) &value);
+        value = p_data->value.value;
+        len = p_data->value.len;
     }
 
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onReadCharacteristic
+    callJava(method_onReadCharacteristic, "II" SRVC_ID_ARGS GATT_ID_ARGS "IB"
         , conn_id, status, SRVC_ID_PARAMS((&p_data->srvc_id))
-        , GATT_ID_PARAMS((&p_data->char_id)), p_data->value_type, jb);
-    sCallbackEnv->DeleteLocalRef(jb);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+        , GATT_ID_PARAMS((&p_data->char_id)), p_data->value_type, value, len);
+}
+
+static void write_pipe_done(int conn_id, write_pipe_chunk_t *done)
+{
+    callJava(method_onWriteCharacteristic, "II" SRVC_ID_ARGS GATT_ID_ARGS
+        , conn_id, done->status, SRVC_ID_PARAMS((&done->srvc_id))
+        , GATT_ID_PARAMS((&done->char_id)));
+}
+
+typedef struct {
+    int conn_id;
+    int status;
+    btgatt_srvc_id_t srvc_id;
+    btgatt_gatt_id_t char_id;
+} write_pipe_failed_upcall_t;
+
+static void write_pipe_failed_upcall(JNIEnv *env, const void *payload)
+{
+    const write_pipe_failed_upcall_t *p = (const write_pipe_failed_upcall_t *) payload;
+    btgatt_srvc_id_t srvc_id = p->srvc_id;
+    btgatt_gatt_id_t char_id = p->char_id;
+    env->CallVoidMethod(mCallbacksObj, method_onWriteCharacteristic
+        , p->conn_id, p->status, SRVC_ID_PARAMS((&srvc_id))
+        , GATT_ID_PARAMS((&char_id)));
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+}
+
+/*
+ * Starts as many chunks of the value conn_id is writing as
+ * com_android_bluetooth_write_pipe.h allows. The lock keeps chunks handed
+ * out on different threads in order. The pump also runs on binder
+ * threads, so a value that fails to start is reported through the upcall
+ * queue.
+ */
+static void write_pipe_pump(JNIEnv *env, int conn_id)
+{
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    write_pipe_chunk_t chunk;
+    bool done = false;
+
+    pthread_mutex_lock(&lock);
+    while (!done && write_pipe_next(conn_id, &chunk)) {
+        bt_status_t ret = sGattIf->client->write_characteristic(conn_id, &chunk.srvc_id,
+            &chunk.char_id, chunk.write_type, chunk.len, chunk.auth_req, (char *) chunk.value);
+        // No callback follows a write that was not started
+        done = ret != BT_STATUS_SUCCESS && write_pipe_written(conn_id, &chunk.srvc_id,
+            &chunk.char_id, ret, &chunk) == WRITE_PIPE_DONE;
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (done) {
+        write_pipe_failed_upcall_t upcall;
+        upcall.conn_id = conn_id;
+        upcall.status = chunk.status;
+        upcall.srvc_id = chunk.srvc_id;
+        upcall.char_id = chunk.char_id;
+        postUpcall(env, write_pipe_failed_upcall, &upcall, sizeof(upcall));
+    }
 }
 
 void btgattc_write_characteristic_cb(int conn_id, int status, btgatt_write_params_t *p_data)
 {
     CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onWriteCharacteristic
+
+    write_pipe_chunk_t done;
+    switch (write_pipe_written(conn_id, &p_data->srvc_id, &p_data->char_id, status, &done)) {
+    case WRITE_PIPE_MORE:
+        write_pipe_pump(sCallbackEnv, conn_id);
+        return;
+    case WRITE_PIPE_DONE:
+        write_pipe_done(conn_id, &done);
+        return;
+    }
+
+    callJava(method_onWriteCharacteristic, "II" SRVC_ID_ARGS GATT_ID_ARGS
         , conn_id, status, SRVC_ID_PARAMS((&p_data->srvc_id))
         , GATT_ID_PARAMS((&p_data->char_id)));
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
 }
 
 void btgattc_execute_write_cb(int conn_id, int status)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onExecuteCompleted
-        , conn_id, status);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onExecuteCompleted, "II", conn_id, status);
 }
 
 void btgattc_read_descriptor_cb(int conn_id, int status, btgatt_read_params_t *p_data)
 {
-    CHECK_CALLBACK_ENV
-
-    jbyteArray jb;
+    static const uint8_t no_value = 0;
+    const uint8_t *value = &no_value;
+    int len = 1;
     if ( p_data->value.len != 0 )
     {
-        jb = sCallbackEnv->NewByteArray(p_data->value.len);
-        sCallbackEnv->SetByteArrayRegion(jb, 0, p_data->value.len,
-                                (jbyte *) p_data->value.value);
-    } else {
-        jb = sCallbackEnv->NewByteArray(1);
+        value = p_data->value.value;
+        len = p_data->value.len;
     }
 
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onReadDescriptor
+    callJava(method_onReadDescriptor, "II" SRVC_ID_ARGS GATT_ID_ARGS GATT_ID_ARGS "IB"
         , conn_id, status, SRVC_ID_PARAMS((&p_data->srvc_id))
         , GATT_ID_PARAMS((&p_data->char_id)), GATT_ID_PARAMS((&p_data->descr_id))
-        , p_data->value_type, jb);
-
-    sCallbackEnv->DeleteLocalRef(jb);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+        , p_data->value_type, value, len);
 }
 
 void btgattc_write_descriptor_cb(int conn_id, int status, btgatt_write_params_t *p_data)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onWriteDescriptor
+    callJava(method_onWriteDescriptor, "II" SRVC_ID_ARGS GATT_ID_ARGS GATT_ID_ARGS
         , conn_id, status, SRVC_ID_PARAMS((&p_data->srvc_id))
         , GATT_ID_PARAMS((&p_data->char_id))
         , GATT_ID_PARAMS((&p_data->descr_id)));
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
 }
 
 void btgattc_remote_rssi_cb(int client_if,bt_bdaddr_t* bda, int rssi, int status)
 {
-    CHECK_CALLBACK_ENV
-
-    char c_address[32];
-    snprintf(c_address, sizeof(c_address),"%02X:%02X:%02X:%02X:%02X:%02X",
-        bda->address[0], bda->address[1], bda->address[2],
-        bda->address[3], bda->address[4], bda->address[5]);
-    jstring address = sCallbackEnv->NewStringUTF(c_address);
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onReadRemoteRssi,
-       client_if, address, rssi, status);
-    sCallbackEnv->DeleteLocalRef(address);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onReadRemoteRssi, "IAII", client_if, bda, rssi, status);
 }
 
 void btgattc_advertise_cb(int status, int client_if)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onAdvertiseCallback, status, client_if);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onAdvertiseCallback, "II", status, client_if);
 }
 
 void btgattc_configure_mtu_cb(int conn_id, int status, int mtu)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onConfigureMTU,
-                                 conn_id, status, mtu);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    if (status == 0) write_pipe_set_mtu(conn_id, mtu);
+
+    callJava(method_onConfigureMTU, "III", conn_id, status, mtu);
 }
 
 void btgattc_scan_filter_cfg_cb(int action, int client_if, int status, int filt_type,
                                 int avbl_space)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onScanFilterConfig,
-                                 action, status, client_if, filt_type, avbl_space);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onScanFilterConfig, "IIIII", action, status, client_if, filt_type,
+             avbl_space);
 }
 
 void btgattc_scan_filter_param_cb(int action, int client_if, int status, int avbl_space)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onScanFilterParamsConfigured,
-            action, status, client_if, avbl_space);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onScanFilterParamsConfigured, "IIII", action, status, client_if,
+             avbl_space);
 }
 
 void btgattc_scan_filter_status_cb(int action, int client_if, int status)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onScanFilterEnableDisabled,
-            action, status, client_if);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onScanFilterEnableDisabled, "III", action, status, client_if);
+}
+
+static bool adv_sched_consume(int client_if, int op_type, int status)
+{
+    pthread_mutex_lock(&sAdvSchedLock);
+    bool consumed = sAdvSched && adv_sched_done(sAdvSched, client_if, op_type, status);
+    pthread_mutex_unlock(&sAdvSchedLock);
+    return consumed;
 }
 
 void btgattc_multiadv_enable_cb(int client_if, int status)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onMultiAdvEnable, status,client_if);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    if (adv_sched_consume(client_if, ADV_SCHED_OP_ENABLE, status)) return;
+
+    callJava(method_onMultiAdvEnable, "II", status, client_if);
 }
 
 void btgattc_multiadv_update_cb(int client_if, int status)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onMultiAdvUpdate, status, client_if);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onMultiAdvUpdate, "II", status, client_if);
 }
 
 void btgattc_multiadv_setadv_data_cb(int client_if, int status)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onMultiAdvSetAdvData, status, client_if);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    if (adv_sched_consume(client_if, ADV_SCHED_OP_SET_DATA, status)) return;
+    if (sAdvPayload && adv_payload_done(sAdvPayload, client_if, status)) return;
+
+    callJava(method_onMultiAdvSetAdvData, "II", status, client_if);
 }
 
 void btgattc_multiadv_disable_cb(int client_if, int status)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onMultiAdvDisable, status, client_if);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    if (adv_sched_consume(client_if, ADV_SCHED_OP_DISABLE, status)) return;
+
+    callJava(method_onMultiAdvDisable, "II", status, client_if);
+}
+
+typedef struct {
+    int conn_id;
+    bool congested;
+} congestion_upcall_t;
+
+static void client_congestion_upcall(JNIEnv *env, const void *payload)
+{
+    const congestion_upcall_t *p = (const congestion_upcall_t *) payload;
+    env->CallVoidMethod(mCallbacksObj, method_onClientCongestion, p->conn_id, p->congested);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
 
 void btgattc_congestion_cb(int conn_id, bool congested)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onClientCongestion, conn_id, congested);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    // Let the client see what arrived before the link state changed
+    if (sNotifyBatch) notify_batch_flush(sNotifyBatch, conn_id);
+
+    write_pipe_congested(conn_id, congested);
+    if (!congested && checkCallbackThread()) write_pipe_pump(sCallbackEnv, conn_id);
+
+    congestion_upcall_t local;
+    congestion_upcall_t *p = (congestion_upcall_t *)
+        beginUpcall(client_congestion_upcall, &local, sizeof(local), 0, false);
+    if (p == NULL) return;
+
+    p->conn_id = conn_id;
+    p->congested = congested;
+    endUpcall(client_congestion_upcall, p, &local);
 }
 
 void btgattc_batchscan_cfg_storage_cb(int client_if, int status)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onBatchScanStorageConfigured, status, client_if);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onBatchScanStorageConfigured, "II", status, client_if);
 }
 
 void btgattc_batchscan_startstop_cb(int startstop_action, int client_if, int status)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onBatchScanStartStopped, startstop_action,
-                                 status, client_if);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onBatchScanStartStopped, "III", startstop_action, status, client_if);
+}
+
+typedef struct {
+    int client_if;
+    int status;
+    int report_format;
+    batch_scan_reports_t reports;   // owned by the upcall
+} batchscan_reports_upcall_t;
+
+static void batchscan_reports_upcall(JNIEnv *env, const void *payload)
+{
+    batchscan_reports_upcall_t *p = (batchscan_reports_upcall_t *) payload;
+    batch_scan_reports_t *reports = &p->reports;
+
+    // Each field goes up in its own array so Java never sees the raw report
+    int count = reports->count;
+    jlongArray addresses = env->NewLongArray(count);
+    jbyteArray tx_power = env->NewByteArray(count);
+    jbyteArray rssi = env->NewByteArray(count);
+    jintArray timestamps = env->NewIntArray(count);
+    jintArray offsets = NULL;
+    jbyteArray payloads = NULL;
+    if (reports->payload_offsets != NULL) {
+        offsets = env->NewIntArray(count + 1);
+        payloads = env->NewByteArray(reports->payload_len);
+    }
+    if (addresses == NULL || tx_power == NULL || rssi == NULL || timestamps == NULL ||
+            (reports->payload_offsets != NULL && (offsets == NULL || payloads == NULL))) {
+        ALOGE("%s: out of memory, dropping %d records", __FUNCTION__, count);
+        goto out;
+    }
+
+    env->SetLongArrayRegion(addresses, 0, count, (jlong *) reports->addresses);
+    env->SetByteArrayRegion(tx_power, 0, count, (jbyte *) reports->tx_power);
+    env->SetByteArrayRegion(rssi, 0, count, (jbyte *) reports->rssi);
+    env->SetIntArrayRegion(timestamps, 0, count, (jint *) reports->timestamp_delta_ms);
+    if (offsets != NULL) {
+        env->SetIntArrayRegion(offsets, 0, count + 1, (jint *) reports->payload_offsets);
+        env->SetByteArrayRegion(payloads, 0, reports->payload_len,
+                                (jbyte *) reports->payloads);
+    }
+
+    env->CallVoidMethod(mCallbacksObj, method_onBatchScanReports, p->status, p->client_if,
+                        p->report_format, addresses, tx_power, rssi, timestamps,
+                        offsets, payloads);
+
+out:
+    batch_scan_reports_free(reports);
+    if (addresses != NULL) env->DeleteLocalRef(addresses);
+    if (tx_power != NULL) env->DeleteLocalRef(tx_power);
+    if (rssi != NULL) env->DeleteLocalRef(rssi);
+    if (timestamps != NULL) env->DeleteLocalRef(timestamps);
+    if (offsets != NULL) env->DeleteLocalRef(offsets);
+    if (payloads != NULL) env->DeleteLocalRef(payloads);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
 
 void btgattc_batchscan_reports_cb(int client_if, int status, int report_format,
                         int num_records, int data_len, uint8_t *p_rep_data)
 {
-    CHECK_CALLBACK_ENV
-    jbyteArray jb = sCallbackEnv->NewByteArray(data_len);
-    sCallbackEnv->SetByteArrayRegion(jb, 0, data_len, (jbyte *) p_rep_data);
+    batch_scan_reports_t reports;
+    if (!batch_scan_decode(report_format, p_rep_data, data_len, &reports)) {
+        ALOGE("%s: failed to decode %d records", __FUNCTION__, num_records);
+    } else if (reports.count != num_records) {
+        ALOGW("%s: decoded %d of %d records", __FUNCTION__, reports.count, num_records);
+    }
+
+    batchscan_reports_upcall_t local;
+    batchscan_reports_upcall_t *p = (batchscan_reports_upcall_t *)
+        beginUpcall(batchscan_reports_upcall, &local, sizeof(local), 0, false);
+    if (p == NULL) {
+        batch_scan_reports_free(&reports);
+        return;
+    }
 
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onBatchScanReports, status, client_if,
-                                report_format, num_records, jb);
-    sCallbackEnv->DeleteLocalRef(jb);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    p->client_if = client_if;
+    p->status = status;
+    p->report_format = report_format;
+    p->reports = reports;
+    endUpcall(batchscan_reports_upcall, p, &local);
 }
 
 void btgattc_batchscan_threshold_cb(int client_if)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onBatchScanThresholdCrossed, client_if);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onBatchScanThresholdCrossed, "I", client_if);
+}
+
+/*
+ * Found/lost events of the software advertiser tracker. The address type is
+ * not part of scan results and is reported as public.
+ */
+static void track_adv_upcall(JNIEnv *env, const track_adv_event_t *events, int count)
+{
+    for (int i = 0; i < count; i++) {
+        const track_adv_event_t *ev = &events[i];
+        jstring address = getAddressString(env, &ev->bda);
+        env->CallVoidMethod(mCallbacksObj, method_onTrackAdvFoundLost, ev->filt_index, 0,
+                            address, ev->adv_state, ev->client_if);
+        env->DeleteLocalRef(address);
+        checkAndClearExceptionFromCallback(env, __FUNCTION__);
+    }
 }
 
 void btgattc_track_adv_event_cb(int client_if, int filt_index, int addr_type,
                                         bt_bdaddr_t* bda, int adv_state)
 {
-    CHECK_CALLBACK_ENV
-    char c_address[32];
-    snprintf(c_address, sizeof(c_address),"%02X:%02X:%02X:%02X:%02X:%02X",
-        bda->address[0], bda->address[1], bda->address[2],
-        bda->address[3], bda->address[4], bda->address[5]);
-    jstring address = sCallbackEnv->NewStringUTF(c_address);
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onTrackAdvFoundLost,
-                                    filt_index, addr_type, address, adv_state, client_if);
-    sCallbackEnv->DeleteLocalRef(address);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onTrackAdvFoundLost, "IIAII", filt_index, addr_type, bda, adv_state,
+             client_if);
 }
 
 static const btgatt_client_callbacks_t sGattClientCallbacks = {
@@ -606,109 +1298,164 @@ static const btgatt_client_callbacks_t sGattClientCallbacks = {
 
 void btgatts_register_app_cb(int status, int server_if, bt_uuid_t *uuid)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onServerRegistered
-        , status, server_if, UUID_PARAMS(uuid));
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onServerRegistered, "II" UUID_ARGS, status, server_if, UUID_PARAMS(uuid));
 }
 
+static void notify_close(int conn_id);
+
 void btgatts_connection_cb(int conn_id, int server_if, int connected, bt_bdaddr_t *bda)
 {
-    CHECK_CALLBACK_ENV
-
-    char c_address[32];
-    sprintf(c_address, "%02X:%02X:%02X:%02X:%02X:%02X",
-            bda->address[0], bda->address[1], bda->address[2],
-            bda->address[3], bda->address[4], bda->address[5]);
+    if (!connected)
+    {
+        prep_write_clear(conn_id);
+        subscription_clear(conn_id);
+        notify_close(conn_id);
+    }
 
-    jstring address = sCallbackEnv->NewStringUTF(c_address);
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onClientConnected,
-                                 address, connected, conn_id, server_if);
-    sCallbackEnv->DeleteLocalRef(address);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onClientConnected, "AZII", bda, connected, conn_id, server_if);
 }
 
 void btgatts_service_added_cb(int status, int server_if,
                               btgatt_srvc_id_t *srvc_id, int srvc_handle)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onServiceAdded, status,
-                                 server_if, SRVC_ID_PARAMS(srvc_id),
-                                 srvc_handle);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onServiceAdded, "II" SRVC_ID_ARGS "I", status, server_if,
+             SRVC_ID_PARAMS(srvc_id), srvc_handle);
 }
 
 void btgatts_included_service_added_cb(int status, int server_if,
                                    int srvc_handle,
                                    int incl_srvc_handle)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onIncludedServiceAdded,
-                                 status, server_if, srvc_handle, incl_srvc_handle);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onIncludedServiceAdded, "IIII", status, server_if, srvc_handle,
+             incl_srvc_handle);
 }
 
 void btgatts_characteristic_added_cb(int status, int server_if, bt_uuid_t *char_id,
                                      int srvc_handle, int char_handle)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onCharacteristicAdded,
-                                 status, server_if, UUID_PARAMS(char_id),
-                                 srvc_handle, char_handle);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    if (status == 0) subscription_characteristic_added(srvc_handle, char_handle);
+
+    callJava(method_onCharacteristicAdded, "II" UUID_ARGS "II", status, server_if,
+             UUID_PARAMS(char_id), srvc_handle, char_handle);
+}
+
+// Client Characteristic Configuration descriptor, 0x2902
+static bool is_cccd(const bt_uuid_t *descr_id)
+{
+    static const uint8_t uuid[16] = {
+        0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80,
+        0x00, 0x10, 0x00, 0x00, 0x02, 0x29, 0x00, 0x00,
+    };
+    return memcmp(descr_id->uu, uuid, sizeof(uuid)) == 0;
 }
 
 void btgatts_descriptor_added_cb(int status, int server_if,
                                  bt_uuid_t *descr_id, int srvc_handle,
                                  int descr_handle)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onDescriptorAdded,
-                                 status, server_if, UUID_PARAMS(descr_id),
-                                 srvc_handle, descr_handle);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    if (status == 0) subscription_descriptor_added(srvc_handle, descr_handle, is_cccd(descr_id));
+
+    callJava(method_onDescriptorAdded, "II" UUID_ARGS "II", status, server_if,
+             UUID_PARAMS(descr_id), srvc_handle, descr_handle);
 }
 
 void btgatts_service_started_cb(int status, int server_if, int srvc_handle)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onServiceStarted, status,
-                                 server_if, srvc_handle);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onServiceStarted, "III", status, server_if, srvc_handle);
 }
 
 void btgatts_service_stopped_cb(int status, int server_if, int srvc_handle)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onServiceStopped, status,
-                                 server_if, srvc_handle);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onServiceStopped, "III", status, server_if, srvc_handle);
 }
 
 void btgatts_service_deleted_cb(int status, int server_if, int srvc_handle)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onServiceDeleted, status,
-                                 server_if, srvc_handle);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    if (status == 0) subscription_service_deleted(srvc_handle);
+
+    callJava(method_onServiceDeleted, "III", status, server_if, srvc_handle);
+}
+
+typedef struct {
+    int conn_id;
+    int trans_id;
+    bt_bdaddr_t bda;
+    int attr_handle;
+    int offset;
+    bool is_long;
+} request_read_upcall_t;
+
+static void request_read_upcall(JNIEnv *env, const void *payload)
+{
+    const request_read_upcall_t *p = (const request_read_upcall_t *) payload;
+
+    jstring address = getAddressString(env, &p->bda);
+    env->CallVoidMethod(mCallbacksObj, method_onAttributeRead,
+                        address, p->conn_id, p->trans_id, p->attr_handle,
+                        p->offset, p->is_long);
+    env->DeleteLocalRef(address);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
 
 void btgatts_request_read_cb(int conn_id, int trans_id, bt_bdaddr_t *bda,
                              int attr_handle, int offset, bool is_long)
 {
-    CHECK_CALLBACK_ENV
+    // Answer reads of stored values right away, the stack trims to the MTU
+    btgatt_response_t response;
+    int len;
+    int status = attr_store_read(attr_handle, offset, response.attr_value.value,
+                                 sizeof(response.attr_value.value), &len);
+    if (status != ATTR_STORE_MISSING)
+    {
+        if (!sGattIf) return;
+        response.attr_value.handle = attr_handle;
+        response.attr_value.offset = offset;
+        response.attr_value.len = (uint16_t) len;
+        response.attr_value.auth_req = 0;
+        sGattIf->server->send_response(conn_id, trans_id, status, &response);
+        return;
+    }
+
+    request_read_upcall_t local;
+    request_read_upcall_t *p = (request_read_upcall_t *)
+        beginUpcall(request_read_upcall, &local, sizeof(local), 0, false);
+    if (p == NULL) return;
+
+    p->conn_id = conn_id;
+    p->trans_id = trans_id;
+    p->bda = *bda;
+    p->attr_handle = attr_handle;
+    p->offset = offset;
+    p->is_long = is_long;
+    endUpcall(request_read_upcall, p, &local);
+}
 
-    char c_address[32];
-    sprintf(c_address, "%02X:%02X:%02X:%02X:%02X:%02X",
-            bda->address[0], bda->address[1], bda->address[2],
-            bda->address[3], bda->address[4], bda->address[5]);
+typedef struct {
+    int conn_id;
+    int trans_id;
+    bt_bdaddr_t bda;
+    int attr_handle;
+    int offset;
+    int length;
+    bool need_rsp;
+    bool is_prep;
+    const uint8_t *value;
+} request_write_upcall_t;
+
+static void request_write_upcall(JNIEnv *env, const void *payload)
+{
+    const request_write_upcall_t *p = (const request_write_upcall_t *) payload;
 
-    jstring address = sCallbackEnv->NewStringUTF(c_address);
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onAttributeRead,
-                                 address, conn_id, trans_id, attr_handle,
-                                 offset, is_long);
-    sCallbackEnv->DeleteLocalRef(address);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    jstring address = getAddressString(env, &p->bda);
+
+    jbyteArray val = env->NewByteArray(p->length);
+    if (val) env->SetByteArrayRegion(val, 0, p->length, (jbyte*)p->value);
+    env->CallVoidMethod(mCallbacksObj, method_onAttributeWrite,
+                        address, p->conn_id, p->trans_id, p->attr_handle,
+                        p->offset, p->length, p->need_rsp, p->is_prep, val);
+    env->DeleteLocalRef(address);
+    env->DeleteLocalRef(val);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
 
 void btgatts_request_write_cb(int conn_id, int trans_id,
@@ -716,70 +1463,274 @@ void btgatts_request_write_cb(int conn_id, int trans_id,
                               int offset, int length,
                               bool need_rsp, bool is_prep, uint8_t* value)
 {
-    CHECK_CALLBACK_ENV
+    if (!is_prep && offset == 0)
+        subscription_write(conn_id, trans_id, attr_handle, value, length, need_rsp);
+
+    // Queued fragments are acknowledged here and reach Java on execute
+    if (is_prep) {
+        int status = prep_write_add(conn_id, attr_handle, offset, value, length);
+        // Descriptor writes count once executed, however they are queued
+        if (status != PREP_WRITE_QUEUE_FULL) {
+            subscription_prepare_write(conn_id, attr_handle, offset, value, length);
+        }
+        if (status != PREP_WRITE_DISABLED) {
+            if (!sGattIf) return;
+            btgatt_response_t response;
+            response.attr_value.handle = attr_handle;
+            response.attr_value.auth_req = 0;
+            response.attr_value.offset = offset;
+            response.attr_value.len = length;
+            memcpy(response.attr_value.value, value, length);
+            sGattIf->server->send_response(conn_id, trans_id, status, &response);
+            return;
+        }
+    }
 
-    char c_address[32];
-    sprintf(c_address, "%02X:%02X:%02X:%02X:%02X:%02X",
-            bda->address[0], bda->address[1], bda->address[2],
-            bda->address[3], bda->address[4], bda->address[5]);
+    request_write_upcall_t local;
+    request_write_upcall_t *p = (request_write_upcall_t *)
+        beginUpcall(request_write_upcall, &local, sizeof(local), length, false);
+    if (p == NULL) return;
+
+    p->conn_id = conn_id;
+    p->trans_id = trans_id;
+    p->bda = *bda;
+    p->attr_handle = attr_handle;
+    p->offset = offset;
+    p->length = length;
+    p->need_rsp = need_rsp;
+    p->is_prep = is_prep;
+    p->value = copyUpcallData(p, &local, sizeof(local), value, length);
+    endUpcall(request_write_upcall, p, &local);
+}
+
+typedef struct {
+    bt_bdaddr_t *bda;
+    int conn_id;
+    int trans_id;
+} prep_write_context_t;
 
-    jstring address = sCallbackEnv->NewStringUTF(c_address);
+/*
+ * Delivers a reassembled prepared write as a plain write.
+ */
+static void prep_write_deliver(void *context, int attr_handle, int offset,
+                               const uint8_t *value, int len)
+{
+    const prep_write_context_t *c = (const prep_write_context_t *) context;
 
-    jbyteArray val = sCallbackEnv->NewByteArray(length);
-    if (val) sCallbackEnv->SetByteArrayRegion(val, 0, length, (jbyte*)value);
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onAttributeWrite,
-                                 address, conn_id, trans_id, attr_handle,
-                                 offset, length, need_rsp, is_prep, val);
-    sCallbackEnv->DeleteLocalRef(address);
-    sCallbackEnv->DeleteLocalRef(val);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onAttributeWrite, "AIIIIIZZB", c->bda, c->conn_id, c->trans_id,
+             attr_handle, offset, len, false, false, value, len);
 }
 
 void btgatts_request_exec_write_cb(int conn_id, int trans_id,
                                    bt_bdaddr_t *bda, int exec_write)
 {
-    CHECK_CALLBACK_ENV
-
-    char c_address[32];
-    sprintf(c_address, "%02X:%02X:%02X:%02X:%02X:%02X",
-            bda->address[0], bda->address[1], bda->address[2],
-            bda->address[3], bda->address[4], bda->address[5]);
+    prep_write_context_t context;
+    context.bda = bda;
+    context.conn_id = conn_id;
+    context.trans_id = trans_id;
+    prep_write_execute(conn_id, exec_write != 0, prep_write_deliver, &context);
+    subscription_execute_write(conn_id, trans_id, exec_write != 0);
 
-    jstring address = sCallbackEnv->NewStringUTF(c_address);
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onExecuteWrite,
-                                 address, conn_id, trans_id, exec_write);
-    sCallbackEnv->DeleteLocalRef(address);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onExecuteWrite, "AIII", bda, conn_id, trans_id, exec_write);
 }
 
 void btgatts_response_confirmation_cb(int status, int handle)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onResponseSendCompleted,
-                                 status, handle);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    callJava(method_onResponseSendCompleted, "II", status, handle);
+}
+
+/**
+ * Notifications of one value to many connections, see
+ * com_android_bluetooth_notify_fanout.h. Sends of single notifications
+ * take the same lock so that the stack reports them in the order they
+ * were recorded.
+ */
+static pthread_mutex_t sNotifySendLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void notify_fanout_pump(int conn_id)
+{
+    notify_fanout_send_t send;
+
+    pthread_mutex_lock(&sNotifySendLock);
+    while (notify_fanout_next(conn_id, &send))
+    {
+        bt_status_t ret = sGattIf->server->send_indication(send.server_if, send.attr_handle,
+            conn_id, send.len, /*confirm*/ 0, (char *) send.value);
+        // No report follows a notification that was not started
+        if (ret != BT_STATUS_SUCCESS) notify_fanout_unsent(conn_id);
+    }
+    pthread_mutex_unlock(&sNotifySendLock);
+}
+
+static void notify_fanout_done_upcall(JNIEnv *env, const void *payload)
+{
+    const notify_fanout_done_t *p = (const notify_fanout_done_t *) payload;
+    env->CallVoidMethod(mCallbacksObj, method_onNotificationFanoutDone,
+                        p->server_if, p->attr_handle, p->sent, p->failed);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+}
+
+static void notify_fanout_report()
+{
+    notify_fanout_done_t done;
+
+    while (notify_fanout_take_done(&done))
+    {
+        notify_fanout_done_t local;
+        notify_fanout_done_t *p = (notify_fanout_done_t *)
+            beginUpcall(notify_fanout_done_upcall, &local, sizeof(local), 0, false);
+        if (p == NULL) return;
+
+        *p = done;
+        endUpcall(notify_fanout_done_upcall, p, &local);
+    }
+}
+
+/**
+ * Values streamed to one connection in MTU sized chunks, see
+ * com_android_bluetooth_notify_stream.h. Chunks are recorded with the
+ * fan-outs so that their reports are told apart.
+ */
+static int notify_stream_pump(int conn_id, notify_stream_progress_t *progress)
+{
+    notify_stream_chunk_t chunk;
+    int result = NOTIFY_STREAM_NONE;
+
+    pthread_mutex_lock(&sNotifySendLock);
+    while (result == NOTIFY_STREAM_NONE && notify_stream_next(conn_id, &chunk))
+    {
+        bool recorded = notify_fanout_stream(conn_id);
+        if (recorded && sGattIf->server->send_indication(chunk.server_if, chunk.attr_handle,
+                conn_id, chunk.len, /*confirm*/ 0, (char *) chunk.value) == BT_STATUS_SUCCESS)
+            continue;
+
+        if (recorded) notify_fanout_unsent(conn_id);
+        result = notify_stream_unsent(conn_id, progress);
+    }
+    pthread_mutex_unlock(&sNotifySendLock);
+    return result;
+}
+
+typedef struct {
+    int conn_id;
+    notify_stream_progress_t progress;
+} notify_stream_upcall_t;
+
+static void notify_stream_upcall(JNIEnv *env, const void *payload)
+{
+    const notify_stream_upcall_t *p = (const notify_stream_upcall_t *) payload;
+    env->CallVoidMethod(mCallbacksObj, method_onNotificationStreamProgress, p->conn_id,
+                        p->progress.attr_handle, p->progress.status,
+                        (jint) p->progress.sent, (jint) p->progress.total);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+}
+
+static void notify_stream_report(int conn_id, const notify_stream_progress_t *progress)
+{
+    notify_stream_upcall_t local;
+    notify_stream_upcall_t *p = (notify_stream_upcall_t *)
+        beginUpcall(notify_stream_upcall, &local, sizeof(local), 0, false);
+    if (p == NULL) return;
+
+    p->conn_id = conn_id;
+    p->progress = *progress;
+    endUpcall(notify_stream_upcall, p, &local);
+}
+
+static void notify_stream_resume(int conn_id)
+{
+    notify_stream_progress_t progress;
+    if (notify_stream_pump(conn_id, &progress) != NOTIFY_STREAM_NONE)
+        notify_stream_report(conn_id, &progress);
+}
+
+// Values in flight are dropped under the send lock, which their senders hold
+static void notify_close(int conn_id)
+{
+    notify_stream_progress_t progress;
+
+    pthread_mutex_lock(&sNotifySendLock);
+    notify_fanout_close(conn_id);
+    bool cut = notify_stream_close(conn_id, &progress);
+    pthread_mutex_unlock(&sNotifySendLock);
+
+    notify_fanout_report();
+    if (cut) notify_stream_report(conn_id, &progress);
+}
+
+typedef struct {
+    int conn_id;
+    int status;
+} indication_sent_upcall_t;
+
+static void indication_sent_upcall(JNIEnv *env, const void *payload)
+{
+    const indication_sent_upcall_t *p = (const indication_sent_upcall_t *) payload;
+    env->CallVoidMethod(mCallbacksObj, method_onNotificationSent,
+                        p->conn_id, p->status);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
 
 void btgatts_indication_sent_cb(int conn_id, int status)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onNotificationSent,
-                                 conn_id, status);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    switch (notify_fanout_sent(conn_id, status))
+    {
+    case NOTIFY_FANOUT_JOB:
+        notify_fanout_pump(conn_id);
+        notify_fanout_report();
+        return;
+    case NOTIFY_FANOUT_STREAM:
+    {
+        notify_stream_progress_t progress;
+        if (notify_stream_sent(conn_id, status, &progress) != NOTIFY_STREAM_NONE)
+            notify_stream_report(conn_id, &progress);
+        notify_stream_resume(conn_id);
+        return;
+    }
+    }
+
+    indication_sent_upcall_t local;
+    indication_sent_upcall_t *p = (indication_sent_upcall_t *)
+        beginUpcall(indication_sent_upcall, &local, sizeof(local), 0, false);
+    if (p == NULL) return;
+
+    p->conn_id = conn_id;
+    p->status = status;
+    endUpcall(indication_sent_upcall, p, &local);
+}
+
+static void server_congestion_upcall(JNIEnv *env, const void *payload)
+{
+    const congestion_upcall_t *p = (const congestion_upcall_t *) payload;
+    env->CallVoidMethod(mCallbacksObj, method_onServerCongestion, p->conn_id, p->congested);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
 
 void btgatts_congestion_cb(int conn_id, bool congested)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onServerCongestion, conn_id, congested);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    notify_fanout_congested(conn_id, congested);
+    notify_stream_congested(conn_id, congested);
+    if (!congested)
+    {
+        notify_fanout_pump(conn_id);
+        notify_stream_resume(conn_id);
+    }
+
+    congestion_upcall_t local;
+    congestion_upcall_t *p = (congestion_upcall_t *)
+        beginUpcall(server_congestion_upcall, &local, sizeof(local), 0, false);
+    if (p == NULL) return;
+
+    p->conn_id = conn_id;
+    p->congested = congested;
+    endUpcall(server_congestion_upcall, p, &local);
 }
 
 void btgatts_mtu_changed_cb(int conn_id, int mtu)
 {
-    CHECK_CALLBACK_ENV
-    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onServerMtuChanged, conn_id, mtu);
-    checkAndClearExceptionFromCallback(sCallbackEnv, __FUNCTION__);
+    notify_stream_set_mtu(conn_id, mtu);
+
+    callJava(method_onServerMtuChanged, "II", conn_id, mtu);
 }
 
 static const btgatt_server_callbacks_t sGattServerCallbacks = {
@@ -819,7 +1770,8 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
     // Client callbacks
 
     method_onClientRegistered = env->GetMethodID(clazz, "onClientRegistered", "(IIJJ)V");
-    method_onScanResult = env->GetMethodID(clazz, "onScanResult", "(Ljava/lang/String;I[B)V");
+    method_onScanResult = env->GetMethodID(clazz, "onScanResult", "(Ljava/lang/String;I[BJ)V");
+    method_onScanResults = env->GetMethodID(clazz, "onScanResults", "([BI)V");
     method_onConnected   = env->GetMethodID(clazz, "onConnected", "(IIILjava/lang/String;)V");
     method_onDisconnected = env->GetMethodID(clazz, "onDisconnected", "(IIILjava/lang/String;)V");
     method_onReadCharacteristic = env->GetMethodID(clazz, "onReadCharacteristic", "(IIIIJJIJJI[B)V");
@@ -827,9 +1779,12 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
     method_onExecuteCompleted = env->GetMethodID(clazz, "onExecuteCompleted",  "(II)V");
     method_onSearchCompleted = env->GetMethodID(clazz, "onSearchCompleted",  "(II)V");
     method_onSearchResult = env->GetMethodID(clazz, "onSearchResult", "(IIIJJ)V");
+    method_onDiscoveryTable = env->GetMethodID(clazz, "onDiscoveryTable", "(II[B)V");
     method_onReadDescriptor = env->GetMethodID(clazz, "onReadDescriptor", "(IIIIJJIJJIJJI[B)V");
     method_onWriteDescriptor = env->GetMethodID(clazz, "onWriteDescriptor", "(IIIIJJIJJIJJ)V");
     method_onNotify = env->GetMethodID(clazz, "onNotify", "(ILjava/lang/String;IIJJIJJZ[B)V");
+    method_onNotifyCompact = env->GetMethodID(clazz, "onNotifyCompact", "(I[B)V");
+    method_onNotifyBatch = env->GetMethodID(clazz, "onNotifyBatch", "(I[I[J[B)V");
     method_onGetCharacteristic = env->GetMethodID(clazz, "onGetCharacteristic", "(IIIIJJIJJI)V");
     method_onGetDescriptor = env->GetMethodID(clazz, "onGetDescriptor", "(IIIIJJIJJIJJ)V");
     method_onGetIncludedService = env->GetMethodID(clazz, "onGetIncludedService", "(IIIIJJIIJJ)V");
@@ -847,7 +1802,8 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
     method_onClientCongestion = env->GetMethodID(clazz, "onClientCongestion", "(IZ)V");
     method_onBatchScanStorageConfigured = env->GetMethodID(clazz, "onBatchScanStorageConfigured", "(II)V");
     method_onBatchScanStartStopped = env->GetMethodID(clazz, "onBatchScanStartStopped", "(III)V");
-    method_onBatchScanReports = env->GetMethodID(clazz, "onBatchScanReports", "(IIII[B)V");
+    method_onBatchScanReports = env->GetMethodID(clazz, "onBatchScanReports",
+                                                "(III[J[B[B[I[I[B)V");
     method_onBatchScanThresholdCrossed = env->GetMethodID(clazz, "onBatchScanThresholdCrossed", "(I)V");
     method_onTrackAdvFoundLost = env->GetMethodID(clazz, "onTrackAdvFoundLost", "(IILjava/lang/String;II)V");
 
@@ -868,6 +1824,11 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
     method_onExecuteWrite= env->GetMethodID(clazz, "onExecuteWrite", "(Ljava/lang/String;III)V");
     method_onNotificationSent = env->GetMethodID(clazz, "onNotificationSent", "(II)V");
     method_onServerCongestion = env->GetMethodID(clazz, "onServerCongestion", "(IZ)V");
+    method_onNotificationFanoutDone = env->GetMethodID(clazz, "onNotificationFanoutDone",
+                                                       "(IIII)V");
+    method_onNotificationStreamProgress = env->GetMethodID(clazz,
+                                                           "onNotificationStreamProgress",
+                                                           "(IIIII)V");
     method_onServerMtuChanged = env->GetMethodID(clazz, "onMtuChanged", "(II)V");
 
     info("classInitNative: Success!");
@@ -875,7 +1836,10 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
 
 static const bt_interface_t* btIf;
 
-static void initializeNative(JNIEnv *env, jobject object) {
+static int adv_payload_issue(int client_if, bool scan_rsp, const adv_sched_data_t *data);
+
+static void initializeNative(JNIEnv *env, jobject object, jboolean useUpcallQueue,
+                             jint scanResultRingSize) {
     if(btIf)
         return;
 
@@ -910,6 +1874,27 @@ static void initializeNative(JNIEnv *env, jobject object) {
     }
 
     mCallbacksObj = env->NewGlobalRef(object);
+
+    sUpcallQueue = upcall_queue_create("BT GATT Upcall Thread", GATT_UPCALL_QUEUE_SIZE);
+    if (sUpcallQueue == NULL) warn("Unable to create upcall queue, delivering directly");
+    sQueueUpcalls = useUpcallQueue;
+
+    sScanResultBatch = record_batch_create("BT GATT Scan Batch Thread", SCAN_RESULT_RECORD_LEN,
+                                           scan_results_upcall);
+    if (sScanResultBatch == NULL) warn("Unable to create scan result batch");
+
+    // Created up front: btgattc_notify_cb reads it without a lock
+    sNotifyBatch = notify_batch_create("BT GATT Notify Batch Thread", notify_batch_upcall);
+    if (sNotifyBatch == NULL) warn("Unable to create notification batch");
+
+    // Created up front like the batch: the stack callbacks read it without a lock
+    sAdvPayload = adv_payload_create("BT GATT Adv Data", adv_payload_issue);
+    if (sAdvPayload == NULL) warn("Unable to create advertising payload store");
+
+    if (scanResultRingSize > 0) {
+        sScanResultRing = scan_ring_create(scanResultRingSize);
+        if (sScanResultRing == NULL) warn("Unable to create scan result ring");
+    }
 }
 
 static void cleanupNative(JNIEnv *env, jobject object) {
@@ -921,10 +1906,63 @@ static void cleanupNative(JNIEnv *env, jobject object) {
         sGattIf = NULL;
     }
 
+    if (sScanResultBatch != NULL) {
+        record_batch_destroy(sScanResultBatch);
+        sScanResultBatch = NULL;
+    }
+
+    if (sScanResultRing != NULL) {
+        scan_ring_stop(sScanResultRing);
+        scan_ring_destroy(sScanResultRing);
+        sScanResultRing = NULL;
+    }
+
+    if (sTrackAdv != NULL) {
+        track_adv_destroy(sTrackAdv);
+        sTrackAdv = NULL;
+    }
+
+    if (sNotifyBatch != NULL) {
+        notify_batch_destroy(sNotifyBatch);
+        sNotifyBatch = NULL;
+    }
+
+    // Payload updates may go through the scheduler, so stop them first
+    if (sAdvPayload != NULL) {
+        adv_payload_destroy(sAdvPayload);
+        sAdvPayload = NULL;
+    }
+
+    pthread_mutex_lock(&sAdvSchedLock);
+    if (sAdvSched != NULL) {
+        adv_sched_destroy(sAdvSched);
+        sAdvSched = NULL;
+    }
+    pthread_mutex_unlock(&sAdvSchedLock);
+
+    scan_filter_reset();
+    scan_dedup_reset();
+    gatt_cache_set_dir(NULL);
+    prep_write_set_limit(0);
+    attr_store_clear();
+    subscription_reset();
+    notify_fanout_reset();
+    notify_stream_reset();
+
+    if (sUpcallQueue != NULL) {
+        upcall_queue_destroy(sUpcallQueue);
+        sUpcallQueue = NULL;
+    }
+    sQueueUpcalls = false;
+
     if (mCallbacksObj != NULL) {
         env->DeleteGlobalRef(mCallbacksObj);
         mCallbacksObj = NULL;
     }
+    sApcfEmulated = false;
+    apcf_reset();
+    notify_token_remove_conn(-1);
+    clearAddressStringCache(env);
     btIf = NULL;
 }
 
@@ -960,6 +1998,9 @@ static void gattClientScanNative(JNIEnv* env, jobject object, jboolean start)
 {
     if (!sGattIf) return;
     sGattIf->client->scan(start);
+
+    // Hand over whatever is still batched instead of waiting out the window
+    if (!start && sScanResultBatch) record_batch_flush(sScanResultBatch);
 }
 
 static void gattClientConnectNative(JNIEnv* env, jobject object, jint clientif,
@@ -988,6 +2029,7 @@ static void gattClientRefreshNative(JNIEnv* env, jobject object, jint clientIf,
 
     bt_bdaddr_t bda;
     jstr2bdaddr(env, &bda, address);
+    gatt_cache_invalidate(&bda);
     sGattIf->client->refresh(clientIf, &bda);
 }
 
@@ -998,9 +2040,20 @@ static void gattClientSearchServiceNative(JNIEnv* env, jobject object, jint conn
 
     bt_uuid_t uuid;
     set_uuid(uuid.uu, service_uuid_msb, service_uuid_lsb);
+    gatt_cache_search_started(conn_id, search_all);
     sGattIf->client->search_service(conn_id, search_all ? 0 : &uuid);
 }
 
+static void gattClientDiscoverServicesNative(JNIEnv* env, jobject object, jint conn_id)
+{
+    if (!sGattIf) return;
+
+    // Without a session GattService gets the usual per attribute upcalls
+    if (!discovery_start(conn_id)) warn("No discovery session for conn_id %d", conn_id);
+    gatt_cache_search_started(conn_id, true);
+    sGattIf->client->search_service(conn_id, 0);
+}
+
 static void gattClientGetCharacteristicNative(JNIEnv* env, jobject object,
     jint conn_id,
     jint  service_type, jint  service_id_inst_id,
@@ -1020,12 +2073,12 @@ static void gattClientGetCharacteristicNative(JNIEnv* env, jobject object,
     char_id.inst_id = (uint8_t) char_id_inst_id;
     set_uuid(char_id.uuid.uu, char_id_uuid_msb, char_id_uuid_lsb);
 
-    if (char_id_uuid_lsb == 0)
-    {
-        sGattIf->client->get_characteristic(conn_id, &srvc_id, 0);
-    } else {
-        sGattIf->client->get_characteristic(conn_id, &srvc_id, &char_id);
-    }
+    gatt_cache_attr_t query;
+    memset(&query, 0, sizeof(query));
+    query.type = GATT_CACHE_CHARACTERISTIC;
+    query.srvc_id = srvc_id;
+    query.char_id = char_id;
+    discovery_query(env, conn_id, &query, char_id_uuid_lsb != 0, gatt_cache_answer);
 }
 
 static void gattClientGetDescriptorNative(JNIEnv* env, jobject object,
@@ -1052,12 +2105,13 @@ static void gattClientGetDescriptorNative(JNIEnv* env, jobject object,
     descr_id.inst_id = (uint8_t) descr_id_inst_id;
     set_uuid(descr_id.uuid.uu, descr_id_uuid_msb, descr_id_uuid_lsb);
 
-    if (descr_id_uuid_lsb == 0)
-    {
-        sGattIf->client->get_descriptor(conn_id, &srvc_id, &char_id, 0);
-    } else {
-        sGattIf->client->get_descriptor(conn_id, &srvc_id, &char_id, &descr_id);
-    }
+    gatt_cache_attr_t query;
+    memset(&query, 0, sizeof(query));
+    query.type = GATT_CACHE_DESCRIPTOR;
+    query.srvc_id = srvc_id;
+    query.char_id = char_id;
+    query.descr_id = descr_id;
+    discovery_query(env, conn_id, &query, descr_id_uuid_lsb != 0, gatt_cache_answer);
 }
 
 static void gattClientGetIncludedServiceNative(JNIEnv* env, jobject object,
@@ -1078,12 +2132,12 @@ static void gattClientGetIncludedServiceNative(JNIEnv* env, jobject object,
     incl_srvc_id.is_primary = (incl_service_type == BTGATT_SERVICE_TYPE_PRIMARY ? 1 : 0);
     set_uuid(incl_srvc_id.id.uuid.uu, incl_service_id_uuid_msb, incl_service_id_uuid_lsb);
 
-    if (incl_service_id_uuid_lsb == 0)
-    {
-        sGattIf->client->get_included_service(conn_id, &srvc_id, 0);
-    } else {
-        sGattIf->client->get_included_service(conn_id, &srvc_id, &incl_srvc_id);
-    }
+    gatt_cache_attr_t query;
+    memset(&query, 0, sizeof(query));
+    query.type = GATT_CACHE_INCLUDED_SERVICE;
+    query.srvc_id = srvc_id;
+    query.incl_srvc_id = incl_srvc_id;
+    discovery_query(env, conn_id, &query, incl_service_id_uuid_lsb != 0, gatt_cache_answer);
 }
 
 static void gattClientReadCharacteristicNative(JNIEnv* env, jobject object,
@@ -1161,6 +2215,37 @@ static void gattClientWriteCharacteristicNative(JNIEnv* env, jobject object,
     env->ReleaseByteArrayElements(value, p_value, 0);
 }
 
+static jboolean gattClientWriteCharacteristicWindowedNative(JNIEnv* env, jobject object,
+    jint conn_id, jint  service_type, jint  service_id_inst_id,
+    jlong service_id_uuid_lsb, jlong service_id_uuid_msb,
+    jint  char_id_inst_id,
+    jlong char_id_uuid_lsb, jlong char_id_uuid_msb,
+    jint write_type, jint auth_req, jbyteArray value, jint window)
+{
+    if (!sGattIf) return JNI_FALSE;
+
+    btgatt_srvc_id_t srvc_id;
+    srvc_id.id.inst_id = (uint8_t) service_id_inst_id;
+    srvc_id.is_primary = (service_type == BTGATT_SERVICE_TYPE_PRIMARY ? 1 : 0);
+    set_uuid(srvc_id.id.uuid.uu, service_id_uuid_msb, service_id_uuid_lsb);
+
+    btgatt_gatt_id_t char_id;
+    char_id.inst_id = (uint8_t) char_id_inst_id;
+    set_uuid(char_id.uuid.uu, char_id_uuid_msb, char_id_uuid_lsb);
+
+    jsize len = env->GetArrayLength(value);
+    jbyte *p_value = env->GetByteArrayElements(value, NULL);
+    if (p_value == NULL) return JNI_FALSE;
+
+    bool started = write_pipe_start(conn_id, &srvc_id, &char_id, write_type, auth_req,
+                                    (const uint8_t *) p_value, len, window);
+    env->ReleaseByteArrayElements(value, p_value, JNI_ABORT);
+    if (!started) return JNI_FALSE;
+
+    write_pipe_pump(env, conn_id);
+    return JNI_TRUE;
+}
+
 static void gattClientExecuteWriteNative(JNIEnv* env, jobject object,
     jint conn_id, jboolean execute)
 {
@@ -1235,6 +2320,49 @@ static void gattClientRegisterForNotificationsNative(JNIEnv* env, jobject object
         sGattIf->client->deregister_for_notification(clientIf, &bd_addr, &srvc_id, &char_id);
 }
 
+static void gattClientSetNotifyTokenNative(JNIEnv* env, jobject object, jint conn_id,
+    jint service_type, jint service_id_inst_id,
+    jlong service_id_uuid_lsb, jlong service_id_uuid_msb,
+    jint char_id_inst_id,
+    jlong char_id_uuid_lsb, jlong char_id_uuid_msb,
+    jint token)
+{
+    btgatt_srvc_id_t srvc_id;
+    srvc_id.id.inst_id = (uint8_t) service_id_inst_id;
+    srvc_id.is_primary = (service_type == BTGATT_SERVICE_TYPE_PRIMARY ? 1 : 0);
+    set_uuid(srvc_id.id.uuid.uu, service_id_uuid_msb, service_id_uuid_lsb);
+
+    btgatt_gatt_id_t char_id;
+    char_id.inst_id = (uint8_t) char_id_inst_id;
+    set_uuid(char_id.uuid.uu, char_id_uuid_msb, char_id_uuid_lsb);
+
+    if (token == NOTIFY_TOKEN_NONE) {
+        notify_token_remove(conn_id, &srvc_id, &char_id);
+    } else {
+        notify_token_add(conn_id, &srvc_id, &char_id, token);
+    }
+}
+
+static void gattClientSetNotifyBatchingNative(JNIEnv* env, jobject object, jint conn_id,
+    jint window_ms, jint max_bytes)
+{
+    if (!sGattIf || !sNotifyBatch) return;
+    notify_batch_configure(sNotifyBatch, conn_id, window_ms, max_bytes);
+}
+
+static void gattClientSetAttributeCacheDirNative(JNIEnv* env, jobject object, jstring dir)
+{
+    if (!sGattIf) return;
+
+    if (dir == NULL) {
+        gatt_cache_set_dir(NULL);
+        return;
+    }
+    const char *c_dir = env->GetStringUTFChars(dir, NULL);
+    gatt_cache_set_dir(c_dir);
+    env->ReleaseStringUTFChars(dir, c_dir);
+}
+
 static void gattClientReadRemoteRssiNative(JNIEnv* env, jobject object, jint clientif,
                                  jstring address)
 {
@@ -1285,6 +2413,167 @@ static void gattSetScanParametersNative(JNIEnv* env, jobject object,
     sGattIf->client->set_scan_parameters(scan_interval_unit, scan_window_unit);
 }
 
+static jint gattSoftScanFilterRegisterNative(JNIEnv* env, jobject object, jint client_if)
+{
+    int slot = scan_filter_register(client_if);
+    scan_dedup_forget_slot(slot);
+    return slot;
+}
+
+static void gattSoftScanFilterUnregisterNative(JNIEnv* env, jobject object, jint slot)
+{
+    scan_filter_unregister(slot);
+}
+
+static void gattSoftScanFilterAddNative(JNIEnv* env, jobject object, jint slot,
+        jint filter_index, jint filter_type, jint company_id, jlong uuid_lsb, jlong uuid_msb,
+        jlong uuid_mask_lsb, jlong uuid_mask_msb, jstring name, jstring address,
+        jbyteArray data, jbyteArray mask)
+{
+    scan_filter_cond_t cond;
+    memset(&cond, 0, sizeof(cond));
+    cond.type = filter_type;
+    cond.filter_index = filter_index;
+    cond.company = company_id;
+    set_uuid(cond.uuid.uu, uuid_msb, uuid_lsb);
+    set_uuid(cond.uuid_mask.uu, uuid_mask_msb, uuid_mask_lsb);
+    if (address != NULL) jstr2bdaddr(env, &cond.address, address);
+
+    if (name != NULL) {
+        const char *c_name = env->GetStringUTFChars(name, NULL);
+        if (c_name != NULL) {
+            // A name longer than an advertisement can carry never matches
+            size_t len = strlen(c_name);
+            if (len <= SCAN_FILTER_MAX_DATA_LEN) {
+                memcpy(cond.data, c_name, len);
+                cond.data_len = len;
+            } else {
+                cond.data_len = -1;
+            }
+            env->ReleaseStringUTFChars(name, c_name);
+        }
+    }
+
+    if (data != NULL) {
+        jsize len = env->GetArrayLength(data);
+        if (len > SCAN_FILTER_MAX_DATA_LEN || (mask && env->GetArrayLength(mask) != len)) {
+            error("Invalid scan filter data length %d", len);
+            return;
+        }
+        cond.data_len = len;
+        env->GetByteArrayRegion(data, 0, len, (jbyte *) cond.data);
+        if (mask) env->GetByteArrayRegion(mask, 0, len, (jbyte *) cond.mask);
+        else memset(cond.mask, 0xFF, len);
+    }
+
+    if (!scan_filter_add(slot, &cond)) error("Unable to add scan filter for slot %d", slot);
+}
+
+static void gattSetScanResultBatchingNative(JNIEnv* env, jobject object,
+                                            jint flush_window_ms, jint max_records)
+{
+    if (!sScanResultBatch) return;
+    record_batch_configure(sScanResultBatch, flush_window_ms, max_records);
+}
+
+static void gattSetScanDedupNative(JNIEnv* env, jobject object, jint window_ms,
+                                   jint rssi_delta)
+{
+    scan_dedup_configure(window_ms, rssi_delta);
+}
+
+static void gattSetScanDedupExemptNative(JNIEnv* env, jobject object, jint slot,
+                                         jboolean exempt)
+{
+    scan_dedup_set_exempt(slot, exempt);
+}
+
+/*
+ * The emulated filters answer synchronously. GattService is called back on
+ * the calling thread, which ScanManager handles like a controller event.
+ */
+static void apcfParamsConfigured(JNIEnv* env, int action, int client_if, int avbl_space)
+{
+    env->CallVoidMethod(mCallbacksObj, method_onScanFilterParamsConfigured, action,
+                        avbl_space < 0 ? BT_STATUS_FAIL : BT_STATUS_SUCCESS, client_if,
+                        avbl_space < 0 ? 0 : avbl_space);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+}
+
+static void apcfAddRemove(JNIEnv* env, jint client_if, jint action, jint filt_type,
+        jint filt_index, jint company_id, jint company_id_mask, jlong uuid_lsb, jlong uuid_msb,
+        jlong uuid_mask_lsb, jlong uuid_mask_msb, jstring name, jstring address,
+        jbyteArray data, jbyteArray mask)
+{
+    apcf_cond_t cond;
+    memset(&cond, 0, sizeof(cond));
+    cond.type = filt_type;
+    cond.company = company_id;
+    cond.company_mask = company_id_mask;
+
+    switch (filt_type)
+    {
+        case APCF_TYPE_ADDRESS:
+            jstr2bdaddr(env, &cond.address, address);
+            break;
+
+        case APCF_TYPE_SERVICE_UUID:
+        case APCF_TYPE_SOLICIT_UUID:
+            // Same rule as for the controller: a partial mask counts as no mask
+            set_uuid(cond.uuid.uu, uuid_msb, uuid_lsb);
+            if (uuid_mask_lsb != 0 && uuid_mask_msb != 0) {
+                set_uuid(cond.uuid_mask.uu, uuid_mask_msb, uuid_mask_lsb);
+            } else {
+                memset(cond.uuid_mask.uu, 0xFF, sizeof(cond.uuid_mask.uu));
+            }
+            break;
+
+        case APCF_TYPE_LOCAL_NAME:
+        {
+            const char* c_name = env->GetStringUTFChars(name, NULL);
+            if (c_name != NULL) {
+                size_t len = strlen(c_name);
+                cond.data_len = len < APCF_MAX_DATA_LEN ? len : APCF_MAX_DATA_LEN;
+                memcpy(cond.data, c_name, cond.data_len);
+                env->ReleaseStringUTFChars(name, c_name);
+            }
+            break;
+        }
+
+        case APCF_TYPE_SERVICE_DATA_CHANGE:
+            break;
+
+        case APCF_TYPE_MANUFACTURER_DATA:
+        case APCF_TYPE_SERVICE_DATA:
+        {
+            jsize len = data != NULL ? env->GetArrayLength(data) : 0;
+            if (len > APCF_MAX_DATA_LEN) len = APCF_MAX_DATA_LEN;
+            cond.data_len = len;
+            env->GetByteArrayRegion(data, 0, len, (jbyte *) cond.data);
+            if (mask != NULL && env->GetArrayLength(mask) >= len) {
+                env->GetByteArrayRegion(mask, 0, len, (jbyte *) cond.mask);
+            } else {
+                memset(cond.mask, 0xFF, len);
+            }
+            break;
+        }
+
+        default:
+            error("Unsupported scan filter type %d", filt_type);
+            env->CallVoidMethod(mCallbacksObj, method_onScanFilterConfig, action,
+                                BT_STATUS_UNSUPPORTED, client_if, filt_type, 0);
+            checkAndClearExceptionFromCallback(env, __FUNCTION__);
+            return;
+    }
+
+    int avbl_space = action == 0 ? apcf_add_cond(filt_index, &cond)
+                                 : apcf_remove_cond(filt_index, &cond);
+    env->CallVoidMethod(mCallbacksObj, method_onScanFilterConfig, action,
+                        avbl_space < 0 ? BT_STATUS_FAIL : BT_STATUS_SUCCESS, client_if,
+                        filt_type, avbl_space < 0 ? 0 : avbl_space);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+}
+
 static void gattClientScanFilterParamAddNative(JNIEnv* env, jobject object,
         jint client_if, jint filt_index,
         jint feat_seln, jint list_logic_type, jint filt_logic_type,
@@ -1293,6 +2582,24 @@ static void gattClientScanFilterParamAddNative(JNIEnv* env, jobject object,
 {
     if (!sGattIf) return;
     const int add_scan_filter_params_action = 0;
+    if (sApcfEmulated) {
+        apcf_params_t params;
+        params.client_if = client_if;
+        params.feature_selection = feat_seln;
+        params.list_logic_type = list_logic_type;
+        params.filter_logic_type = filt_logic_type;
+        params.rssi_high_threshold = rssi_high_thres;
+        params.delivery_mode = dely_mode;
+        if (sTrackAdv && dely_mode == APCF_DELIVERY_ON_FOUND_LOST) {
+            track_adv_set_filter(sTrackAdv, filt_index, client_if, found_timeout, lost_timeout,
+                                 found_timeout_cnt);
+        } else if (sTrackAdv) {
+            track_adv_clear_filter(sTrackAdv, filt_index);
+        }
+        apcfParamsConfigured(env, add_scan_filter_params_action, client_if,
+                             apcf_set_params(filt_index, &params));
+        return;
+    }
     sGattIf->client->scan_filter_param_setup(client_if, add_scan_filter_params_action, filt_index,
             feat_seln, list_logic_type, filt_logic_type,
             rssi_high_thres, rssi_low_thres,
@@ -1304,6 +2611,12 @@ static void gattClientScanFilterParamDeleteNative(JNIEnv* env, jobject object,
 {
     if (!sGattIf) return;
     const int delete_scan_filter_params_action = 1;
+    if (sApcfEmulated) {
+        if (sTrackAdv) track_adv_clear_filter(sTrackAdv, filt_index);
+        apcfParamsConfigured(env, delete_scan_filter_params_action, client_if,
+                             apcf_delete_params(filt_index));
+        return;
+    }
     sGattIf->client->scan_filter_param_setup(client_if, delete_scan_filter_params_action,
             filt_index, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 }
@@ -1312,6 +2625,12 @@ static void gattClientScanFilterParamClearAllNative(JNIEnv* env, jobject object,
 {
     if (!sGattIf) return;
     const int clear_scan_filter_params_action = 2;
+    if (sApcfEmulated) {
+        if (sTrackAdv) track_adv_clear_filter(sTrackAdv, -1);
+        apcfParamsConfigured(env, clear_scan_filter_params_action, client_if,
+                             apcf_clear_params());
+        return;
+    }
     sGattIf->client->scan_filter_param_setup(client_if, clear_scan_filter_params_action,
             0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 }
@@ -1322,6 +2641,13 @@ static void gattClientScanFilterAddRemoveNative(JNIEnv* env, jobject object,
         jlong uuid_mask_msb, jstring name, jstring address, jbyte addr_type,
         jbyteArray data, jbyteArray mask)
 {
+    if (sApcfEmulated) {
+        apcfAddRemove(env, client_if, action, filt_type, filt_index, company_id,
+                      company_id_mask, uuid_lsb, uuid_msb, uuid_mask_lsb, uuid_mask_msb,
+                      name, address, data, mask);
+        return;
+    }
+
     switch(filt_type)
     {
         case 0: // BTM_BLE_PF_ADDR_FILTER
@@ -1423,6 +2749,15 @@ static void gattClientScanFilterClearNative(JNIEnv* env, jobject object, jint cl
                         jint filt_index)
 {
     if (!sGattIf) return;
+    if (sApcfEmulated) {
+        const int clear_scan_filter_action = 2;
+        int avbl_space = apcf_clear_conds(filt_index);
+        env->CallVoidMethod(mCallbacksObj, method_onScanFilterConfig, clear_scan_filter_action,
+                            avbl_space < 0 ? BT_STATUS_FAIL : BT_STATUS_SUCCESS, client_if, 0,
+                            avbl_space < 0 ? 0 : avbl_space);
+        checkAndClearExceptionFromCallback(env, __FUNCTION__);
+        return;
+    }
     sGattIf->client->scan_filter_clear(client_if, filt_index);
 }
 
@@ -1430,9 +2765,28 @@ static void gattClientScanFilterEnableNative (JNIEnv* env, jobject object, jint
                           jboolean enable)
 {
     if (!sGattIf) return;
+    if (sApcfEmulated) {
+        apcf_enable(enable);
+        env->CallVoidMethod(mCallbacksObj, method_onScanFilterEnableDisabled, enable ? 1 : 0,
+                            0, client_if);
+        checkAndClearExceptionFromCallback(env, __FUNCTION__);
+        return;
+    }
     sGattIf->client->scan_filter_enable(client_if, enable);
 }
 
+static void gattSetScanFilterEmulationNative(JNIEnv* env, jobject object, jboolean enable)
+{
+    if (!sGattIf) return;
+    if (sApcfEmulated && !enable) apcf_reset();
+    if (sTrackAdv) track_adv_clear_filter(sTrackAdv, -1);
+    if (enable && sTrackAdv == NULL) {
+        sTrackAdv = track_adv_create("BT GATT Track Adv Thread", track_adv_upcall);
+        if (sTrackAdv == NULL) warn("Unable to create advertiser tracker");
+    }
+    sApcfEmulated = enable;
+}
+
 static void gattClientConfigureMTUNative(JNIEnv *env, jobject object,
         jint conn_id, jint mtu)
 {
@@ -1449,12 +2803,59 @@ static void gattConnectionParameterUpdateNative(JNIEnv *env, jobject object, jin
     sGattIf->client->conn_parameter_update(&bda, min_interval, max_interval, latency, timeout);
 }
 
+/**
+ * Advertising payloads kept per client_if for field level updates, see
+ * com_android_bluetooth_adv_payload.h.
+ */
+static int adv_payload_issue(int client_if, bool scan_rsp, const adv_sched_data_t *data)
+{
+    // Virtual advertisers take the data through the scheduler, which sends it while on air
+    pthread_mutex_lock(&sAdvSchedLock);
+    int result = -1;
+    if (sAdvSched) {
+        result = adv_sched_set_data(sAdvSched, client_if, scan_rsp, data)
+            ? ADV_PAYLOAD_ISSUE_APPLIED : ADV_PAYLOAD_ISSUE_FAILED;
+    }
+    pthread_mutex_unlock(&sAdvSchedLock);
+    if (result >= 0) return result;
+    if (!sGattIf) return ADV_PAYLOAD_ISSUE_FAILED;
+
+    bt_status_t ret = sGattIf->client->multi_adv_set_inst_data(client_if, scan_rsp,
+        data->incl_name, data->incl_txpower, data->appearance, data->manufacturer_len,
+        (char *) data->manufacturer_data, data->service_data_len, (char *) data->service_data,
+        data->service_uuid_len, (char *) data->service_uuid);
+    return ret == BT_STATUS_SUCCESS ? ADV_PAYLOAD_ISSUE_PENDING : ADV_PAYLOAD_ISSUE_FAILED;
+}
+
+static bool copy_adv_field(JNIEnv* env, jbyteArray field, uint8_t *dst, int *len)
+{
+    *len = env->GetArrayLength(field);
+    if (*len > ADV_SCHED_MAX_FIELD) return false;
+    env->GetByteArrayRegion(field, 0, *len, (jbyte *) dst);
+    return true;
+}
+
+static bool copy_adv_data(JNIEnv* env, jboolean incl_name, jboolean incl_txpower,
+        jint appearance, jbyteArray manufacturer_data, jbyteArray service_data,
+        jbyteArray service_uuid, adv_sched_data_t *data)
+{
+    memset(data, 0, sizeof(*data));
+    data->incl_name = incl_name;
+    data->incl_txpower = incl_txpower;
+    data->appearance = appearance;
+    return copy_adv_field(env, manufacturer_data, data->manufacturer_data,
+                          &data->manufacturer_len)
+        && copy_adv_field(env, service_data, data->service_data, &data->service_data_len)
+        && copy_adv_field(env, service_uuid, data->service_uuid, &data->service_uuid_len);
+}
+
 static void gattClientEnableAdvNative(JNIEnv* env, jobject object, jint client_if,
        jint min_interval, jint max_interval, jint adv_type, jint chnl_map, jint tx_power,
        jint timeout_s)
 {
     if (!sGattIf) return;
 
+    if (sAdvPayload) adv_payload_set_interval(sAdvPayload, client_if, min_interval);
     sGattIf->client->multi_adv_enable(client_if, min_interval, max_interval, adv_type, chnl_map,
         tx_power, timeout_s);
 }
@@ -1483,7 +2884,8 @@ static void gattClientSetAdvDataNative(JNIEnv* env, jobject object , jint client
     jbyte* serv_uuid = env->GetByteArrayElements(service_uuid, NULL);
     uint16_t serv_uuid_len = (uint16_t) env->GetArrayLength(service_uuid);
 
-    sGattIf->client->multi_adv_set_inst_data(client_if, set_scan_rsp, incl_name,incl_txpower,
+    bt_status_t ret = sGattIf->client->multi_adv_set_inst_data(client_if, set_scan_rsp,
+                                             incl_name, incl_txpower,
                                              appearance, manu_len, (char*)manu_data,
                                              serv_data_len, (char*)serv_data, serv_uuid_len,
                                              (char*)serv_uuid);
@@ -1491,14 +2893,160 @@ static void gattClientSetAdvDataNative(JNIEnv* env, jobject object , jint client
     env->ReleaseByteArrayElements(manufacturer_data, manu_data, JNI_ABORT);
     env->ReleaseByteArrayElements(service_data, serv_data, JNI_ABORT);
     env->ReleaseByteArrayElements(service_uuid, serv_uuid, JNI_ABORT);
+
+    // Keep what was sent for later updates of single fields
+    adv_sched_data_t data;
+    if (ret == BT_STATUS_SUCCESS && sAdvPayload
+            && copy_adv_data(env, incl_name, incl_txpower, appearance, manufacturer_data,
+                             service_data, service_uuid, &data)) {
+        adv_payload_set(sAdvPayload, client_if, set_scan_rsp, &data);
+    }
 }
 
 static void gattClientDisableAdvNative(JNIEnv* env, jobject object, jint client_if)
 {
     if (!sGattIf) return;
+    if (sAdvPayload) adv_payload_remove(sAdvPayload, client_if);
     sGattIf->client->multi_adv_disable(client_if);
 }
 
+static jboolean gattClientUpdateAdvDataNative(JNIEnv* env, jobject object, jint client_if,
+        jboolean set_scan_rsp, jbyteArray manufacturer_data, jbyteArray service_data,
+        jbyteArray service_uuid)
+{
+    if (!sGattIf || !sAdvPayload) return JNI_FALSE;
+
+    // Fields passed as null are left as they are
+    jbyteArray fields[] = { manufacturer_data, service_data, service_uuid };
+    uint8_t values[3][ADV_SCHED_MAX_FIELD];
+    adv_payload_diff_t diffs[3];
+    int count = 0;
+    for (int i = 0; i < 3; i++) {
+        if (fields[i] == NULL) continue;
+        diffs[count].field = ADV_PAYLOAD_FIELD_MANUFACTURER_DATA + i;
+        diffs[count].value = values[i];
+        if (!copy_adv_field(env, fields[i], values[i], &diffs[count].len)) return JNI_FALSE;
+        count++;
+    }
+
+    int result = adv_payload_update(sAdvPayload, client_if, set_scan_rsp, diffs, count);
+    return result >= 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Virtual advertising sets, time sliced onto the advertising instances by
+ * com_android_bluetooth_adv_sched.h.
+ */
+static bool adv_sched_issue(JNIEnv *env, const adv_sched_op_t *op)
+{
+    if (op->type == ADV_SCHED_OP_REPORT_DISABLED)
+    {
+        env->CallVoidMethod(mCallbacksObj, method_onMultiAdvDisable, op->status, op->client_if);
+        checkAndClearExceptionFromCallback(env, __FUNCTION__);
+        return true;
+    }
+    if (!sGattIf) return false;
+
+    bt_status_t ret = BT_STATUS_FAIL;
+    switch (op->type)
+    {
+    case ADV_SCHED_OP_ENABLE:
+        // Timeouts are kept by the scheduler
+        ret = sGattIf->client->multi_adv_enable(op->client_if, op->params->min_interval,
+            op->params->max_interval, op->params->adv_type, op->params->chnl_map,
+            op->params->tx_power, 0);
+        break;
+    case ADV_SCHED_OP_SET_DATA:
+    case ADV_SCHED_OP_SET_SCAN_RSP:
+    {
+        const adv_sched_data_t *data = op->data;
+        ret = sGattIf->client->multi_adv_set_inst_data(op->client_if,
+            op->type == ADV_SCHED_OP_SET_SCAN_RSP, data->incl_name, data->incl_txpower,
+            data->appearance, data->manufacturer_len, (char *) data->manufacturer_data,
+            data->service_data_len, (char *) data->service_data, data->service_uuid_len,
+            (char *) data->service_uuid);
+        break;
+    }
+    case ADV_SCHED_OP_DISABLE:
+        ret = sGattIf->client->multi_adv_disable(op->client_if);
+        break;
+    }
+    return ret == BT_STATUS_SUCCESS;
+}
+
+static void gattClientSetAdvSchedulerNative(JNIEnv* env, jobject object, jint instances,
+                                            jint slice_ms)
+{
+    if (!sGattIf) return;
+
+    // Payloads belong to the advertisers of the previous mode
+    if (sAdvPayload) adv_payload_clear(sAdvPayload);
+
+    pthread_mutex_lock(&sAdvSchedLock);
+    if (sAdvSched != NULL) {
+        adv_sched_destroy(sAdvSched);
+        sAdvSched = NULL;
+    }
+    if (slice_ms > 0) {
+        sAdvSched = adv_sched_create("BT GATT Adv Scheduler Thread", adv_sched_issue,
+                                     instances, slice_ms);
+        if (sAdvSched == NULL) warn("Unable to create advertising scheduler");
+    }
+    pthread_mutex_unlock(&sAdvSchedLock);
+}
+
+static jboolean gattClientSetVirtualAdvDataNative(JNIEnv* env, jobject object,
+        jint client_if, jboolean set_scan_rsp, jboolean incl_name, jboolean incl_txpower,
+        jint appearance, jbyteArray manufacturer_data, jbyteArray service_data,
+        jbyteArray service_uuid)
+{
+    if (!sGattIf) return JNI_FALSE;
+
+    adv_sched_data_t data;
+    if (!copy_adv_data(env, incl_name, incl_txpower, appearance, manufacturer_data,
+                       service_data, service_uuid, &data))
+        return JNI_FALSE;
+
+    pthread_mutex_lock(&sAdvSchedLock);
+    bool set = sAdvSched && adv_sched_set_data(sAdvSched, client_if, set_scan_rsp, &data);
+    pthread_mutex_unlock(&sAdvSchedLock);
+    if (!set) return JNI_FALSE;
+    if (sAdvPayload) adv_payload_set(sAdvPayload, client_if, set_scan_rsp, &data);
+    return JNI_TRUE;
+}
+
+static jboolean gattClientStartVirtualAdvNative(JNIEnv* env, jobject object, jint client_if,
+       jint weight, jint min_interval, jint max_interval, jint adv_type, jint chnl_map,
+       jint tx_power, jint timeout_s)
+{
+    if (!sGattIf) return JNI_FALSE;
+
+    adv_sched_params_t params;
+    params.min_interval = min_interval;
+    params.max_interval = max_interval;
+    params.adv_type = adv_type;
+    params.chnl_map = chnl_map;
+    params.tx_power = tx_power;
+    if (sAdvPayload) adv_payload_set_interval(sAdvPayload, client_if, min_interval);
+
+    pthread_mutex_lock(&sAdvSchedLock);
+    bool started = sAdvSched && adv_sched_start(sAdvSched, client_if, weight, timeout_s,
+                                                &params);
+    pthread_mutex_unlock(&sAdvSchedLock);
+    return started ? JNI_TRUE : JNI_FALSE;
+}
+
+static jboolean gattClientStopVirtualAdvNative(JNIEnv* env, jobject object, jint client_if)
+{
+    if (!sGattIf) return JNI_FALSE;
+    if (sAdvPayload) adv_payload_remove(sAdvPayload, client_if);
+
+    pthread_mutex_lock(&sAdvSchedLock);
+    bool removed = sAdvSched && adv_sched_remove(sAdvSched, client_if);
+    pthread_mutex_unlock(&sAdvSchedLock);
+    return removed ? JNI_TRUE : JNI_FALSE;
+}
+
 static void gattClientConfigBatchScanStorageNative(JNIEnv* env, jobject object, jint client_if,
             jint max_full_reports_percent, jint max_trunc_reports_percent,
             jint notify_threshold_level_percent)
@@ -1640,16 +3188,36 @@ static void gattServerDeleteServiceNative (JNIEnv *env, jobject object,
     sGattIf->server->delete_service(server_if, svc_handle);
 }
 
+// The client did not subscribe; report the value as sent all the same, in
+// order with the reports of values that went out
+static void notify_unsubscribed(JNIEnv *env, int conn_id)
+{
+    indication_sent_upcall_t upcall;
+    upcall.conn_id = conn_id;
+    upcall.status = 0;
+    postUpcall(env, indication_sent_upcall, &upcall, sizeof(upcall));
+}
+
 static void gattServerSendIndicationNative (JNIEnv *env, jobject object,
         jint server_if, jint attr_handle, jint conn_id, jbyteArray val)
 {
     if (!sGattIf) return;
 
+    if (!subscription_allowed(conn_id, attr_handle, /*indicate*/ true))
+    {
+        notify_unsubscribed(env, conn_id);
+        return;
+    }
+
     jbyte* array = env->GetByteArrayElements(val, 0);
     int val_len = env->GetArrayLength(val);
 
-    sGattIf->server->send_indication(server_if, attr_handle, conn_id, val_len,
-                                     /*confirm*/ 1, (char*)array);
+    pthread_mutex_lock(&sNotifySendLock);
+    notify_fanout_single(conn_id);
+    if (sGattIf->server->send_indication(server_if, attr_handle, conn_id, val_len,
+                                         /*confirm*/ 1, (char*)array) != BT_STATUS_SUCCESS)
+        notify_fanout_unsent(conn_id);
+    pthread_mutex_unlock(&sNotifySendLock);
     env->ReleaseByteArrayElements(val, array, JNI_ABORT);
 }
 
@@ -1658,12 +3226,94 @@ static void gattServerSendNotificationNative (JNIEnv *env, jobject object,
 {
     if (!sGattIf) return;
 
+    if (!subscription_allowed(conn_id, attr_handle, /*indicate*/ false))
+    {
+        notify_unsubscribed(env, conn_id);
+        return;
+    }
+
     jbyte* array = env->GetByteArrayElements(val, 0);
     int val_len = env->GetArrayLength(val);
 
-    sGattIf->server->send_indication(server_if, attr_handle, conn_id, val_len,
-                                     /*confirm*/ 0, (char*)array);
+    pthread_mutex_lock(&sNotifySendLock);
+    notify_fanout_single(conn_id);
+    if (sGattIf->server->send_indication(server_if, attr_handle, conn_id, val_len,
+                                         /*confirm*/ 0, (char*)array) != BT_STATUS_SUCCESS)
+        notify_fanout_unsent(conn_id);
+    pthread_mutex_unlock(&sNotifySendLock);
+    env->ReleaseByteArrayElements(val, array, JNI_ABORT);
+}
+
+static jboolean gattServerSendNotificationMultiNative (JNIEnv *env, jobject object,
+        jint server_if, jint attr_handle, jintArray conn_ids, jbyteArray val)
+{
+    if (!sGattIf) return JNI_FALSE;
+
+    jsize count = env->GetArrayLength(conn_ids);
+    int *ids = (int *) malloc(count > 0 ? count * sizeof(int) : sizeof(int));
+    if (ids == NULL) return JNI_FALSE;
+
+    // Only subscribed connections are kept; the others count as failed
+    jint* array_ids = env->GetIntArrayElements(conn_ids, 0);
+    int kept = 0;
+    for (jsize i = 0; i < count; i++)
+    {
+        if (subscription_allowed(array_ids[i], attr_handle, /*indicate*/ false))
+            ids[kept++] = array_ids[i];
+    }
+    env->ReleaseIntArrayElements(conn_ids, array_ids, JNI_ABORT);
+
+    jsize val_len = env->GetArrayLength(val);
+    jbyte* array = env->GetByteArrayElements(val, 0);
+    bool started = notify_fanout_start(server_if, attr_handle, ids, kept, count - kept,
+                                       (const uint8_t *) array, val_len);
+    env->ReleaseByteArrayElements(val, array, JNI_ABORT);
+
+    if (started)
+    {
+        for (int i = 0; i < kept; i++) notify_fanout_pump(ids[i]);
+
+        // Fan-outs that failed on every connection are done already
+        notify_fanout_done_t done;
+        while (notify_fanout_take_done(&done))
+            postUpcall(env, notify_fanout_done_upcall, &done, sizeof(done));
+    }
+    free(ids);
+    return started ? JNI_TRUE : JNI_FALSE;
+}
+
+static jboolean gattServerSendNotificationStreamNative (JNIEnv *env, jobject object,
+        jint server_if, jint attr_handle, jint conn_id, jbyteArray val)
+{
+    if (!sGattIf) return JNI_FALSE;
+
+    notify_stream_progress_t progress;
+    progress.attr_handle = attr_handle;
+    progress.status = 0;
+    progress.sent = progress.total = env->GetArrayLength(val);
+
+    if (!subscription_allowed(conn_id, attr_handle, /*indicate*/ false))
+    {
+        // The client did not subscribe; nothing of the value goes out
+        progress.status = NOTIFY_STREAM_FAILURE;
+        progress.sent = 0;
+        notify_stream_upcall_t done = { conn_id, progress };
+        postUpcall(env, notify_stream_upcall, &done, sizeof(done));
+        return JNI_TRUE;
+    }
+
+    jbyte* array = env->GetByteArrayElements(val, 0);
+    bool started = notify_stream_start(conn_id, server_if, attr_handle,
+                                       (const uint8_t *) array, progress.total);
     env->ReleaseByteArrayElements(val, array, JNI_ABORT);
+    if (!started) return JNI_FALSE;
+
+    if (notify_stream_pump(conn_id, &progress) != NOTIFY_STREAM_NONE)
+    {
+        notify_stream_upcall_t done = { conn_id, progress };
+        postUpcall(env, notify_stream_upcall, &done, sizeof(done));
+    }
+    return JNI_TRUE;
 }
 
 static void gattServerSendResponseNative (JNIEnv *env, jobject object,
@@ -1689,9 +3339,40 @@ static void gattServerSendResponseNative (JNIEnv *env, jobject object,
         env->ReleaseByteArrayElements(val, array, JNI_ABORT);
     }
 
+    subscription_respond(conn_id, trans_id, status == 0);
     sGattIf->server->send_response(conn_id, trans_id, status, &response);
 }
 
+static void gattServerSetSubscriptionFilterNative(JNIEnv *env, jobject object,
+                                                 jboolean filter)
+{
+    if (!sGattIf) return;
+    subscription_set_filter(filter);
+}
+
+static void gattServerSetPrepWriteLimitNative(JNIEnv *env, jobject object, jint max_bytes)
+{
+    if (!sGattIf) return;
+    prep_write_set_limit(max_bytes > 0 ? max_bytes : 0);
+}
+
+static void gattServerSetAttributeValueNative(JNIEnv *env, jobject object,
+        jint handle, jbyteArray val)
+{
+    if (!sGattIf) return;
+
+    if (val == NULL)
+    {
+        attr_store_set(handle, NULL, 0);
+        return;
+    }
+
+    jsize val_len = env->GetArrayLength(val);
+    jbyte* array = env->GetByteArrayElements(val, 0);
+    attr_store_set(handle, (const uint8_t *) array, val_len);
+    env->ReleaseByteArrayElements(val, array, JNI_ABORT);
+}
+
 static void gattTestNative(JNIEnv *env, jobject object, jint command,
                            jlong uuid1_lsb, jlong uuid1_msb, jstring bda1,
                            jint p1, jint p2, jint p3, jint p4, jint p5 )
@@ -1715,6 +3396,41 @@ static void gattTestNative(JNIEnv *env, jobject object, jint command,
     sGattIf->client->test_command(command, &params);
 }
 
+static jintArray gattGetUpcallQueueStatsNative(JNIEnv *env, jobject object)
+{
+    if (!sUpcallQueue) return NULL;
+
+    upcall_queue_stats_t stats;
+    upcall_queue_get_stats(sUpcallQueue, &stats);
+
+    jint values[] = { stats.capacity, stats.depth, stats.high_water, stats.dropped };
+    jintArray result = env->NewIntArray(4);
+    if (result) env->SetIntArrayRegion(result, 0, 4, values);
+    return result;
+}
+
+static jobject gattGetScanResultRingNative(JNIEnv *env, jobject object)
+{
+    if (!sScanResultRing) return NULL;
+
+    size_t size;
+    void *buffer = scan_ring_get_buffer(sScanResultRing, &size);
+    return env->NewDirectByteBuffer(buffer, (jlong) size);
+}
+
+static jlong gattWaitScanResultRingNative(JNIEnv *env, jobject object, jint consumed,
+                                          jint timeout_ms)
+{
+    if (!sScanResultRing) return -1;
+    return scan_ring_wait(sScanResultRing, consumed, timeout_ms);
+}
+
+static void gattStopScanResultRingNative(JNIEnv *env, jobject object)
+{
+    if (!sScanResultRing) return;
+    scan_ring_stop(sScanResultRing);
+}
+
 /**
  * JNI function definitinos
  */
@@ -1725,6 +3441,11 @@ static JNINativeMethod sAdvertiseMethods[] = {
     {"gattClientUpdateAdvNative", "(IIIIIII)V", (void *) gattClientUpdateAdvNative},
     {"gattClientSetAdvDataNative", "(IZZZI[B[B[B)V", (void *) gattClientSetAdvDataNative},
     {"gattClientDisableAdvNative", "(I)V", (void *) gattClientDisableAdvNative},
+    {"gattClientUpdateAdvDataNative", "(IZ[B[B[B)Z", (void *) gattClientUpdateAdvDataNative},
+    {"gattClientSetAdvSchedulerNative", "(II)V", (void *) gattClientSetAdvSchedulerNative},
+    {"gattClientSetVirtualAdvDataNative", "(IZZZI[B[B[B)Z", (void *) gattClientSetVirtualAdvDataNative},
+    {"gattClientStartVirtualAdvNative", "(IIIIIIII)Z", (void *) gattClientStartVirtualAdvNative},
+    {"gattClientStopVirtualAdvNative", "(I)Z", (void *) gattClientStopVirtualAdvNative},
     {"gattSetAdvDataNative", "(IZZZIII[B[B[B)V", (void *) gattSetAdvDataNative},
     {"gattAdvertiseNative", "(IZ)V", (void *) gattAdvertiseNative},
 };
@@ -1746,12 +3467,20 @@ static JNINativeMethod sScanMethods[] = {
     {"gattClientScanFilterClearNative", "(II)V", (void *) gattClientScanFilterClearNative},
     {"gattClientScanFilterEnableNative", "(IZ)V", (void *) gattClientScanFilterEnableNative},
     {"gattSetScanParametersNative", "(II)V", (void *) gattSetScanParametersNative},
+    {"gattSetScanResultBatchingNative", "(II)V", (void *) gattSetScanResultBatchingNative},
+    {"gattSetScanDedupNative", "(II)V", (void *) gattSetScanDedupNative},
+    {"gattSetScanFilterEmulationNative", "(Z)V", (void *) gattSetScanFilterEmulationNative},
+    {"gattSetScanDedupExemptNative", "(IZ)V", (void *) gattSetScanDedupExemptNative},
+    // Software scan filter JNI functions.
+    {"gattSoftScanFilterRegisterNative", "(I)I", (void *) gattSoftScanFilterRegisterNative},
+    {"gattSoftScanFilterUnregisterNative", "(I)V", (void *) gattSoftScanFilterUnregisterNative},
+    {"gattSoftScanFilterAddNative", "(IIIIJJJJLjava/lang/String;Ljava/lang/String;[B[B)V", (void *) gattSoftScanFilterAddNative},
 };
 
 // JNI functions defined in GattService class.
 static JNINativeMethod sMethods[] = {
     {"classInitNative", "()V", (void *) classInitNative},
-    {"initializeNative", "()V", (void *) initializeNative},
+    {"initializeNative", "(ZI)V", (void *) initializeNative},
     {"cleanupNative", "()V", (void *) cleanupNative},
     {"gattClientGetDeviceTypeNative", "(Ljava/lang/String;)I", (void *) gattClientGetDeviceTypeNative},
     {"gattClientRegisterAppNative", "(JJ)V", (void *) gattClientRegisterAppNative},
@@ -1760,6 +3489,7 @@ static JNINativeMethod sMethods[] = {
     {"gattClientDisconnectNative", "(ILjava/lang/String;I)V", (void *) gattClientDisconnectNative},
     {"gattClientRefreshNative", "(ILjava/lang/String;)V", (void *) gattClientRefreshNative},
     {"gattClientSearchServiceNative", "(IZJJ)V", (void *) gattClientSearchServiceNative},
+    {"gattClientDiscoverServicesNative", "(I)V", (void *) gattClientDiscoverServicesNative},
     {"gattClientGetCharacteristicNative", "(IIIJJIJJ)V", (void *) gattClientGetCharacteristicNative},
     {"gattClientGetDescriptorNative", "(IIIJJIJJIJJ)V", (void *) gattClientGetDescriptorNative},
     {"gattClientGetIncludedServiceNative", "(IIIJJIIJJ)V", (void *) gattClientGetIncludedServiceNative},
@@ -1767,8 +3497,12 @@ static JNINativeMethod sMethods[] = {
     {"gattClientReadDescriptorNative", "(IIIJJIJJIJJI)V", (void *) gattClientReadDescriptorNative},
     {"gattClientWriteCharacteristicNative", "(IIIJJIJJII[B)V", (void *) gattClientWriteCharacteristicNative},
     {"gattClientWriteDescriptorNative", "(IIIJJIJJIJJII[B)V", (void *) gattClientWriteDescriptorNative},
+    {"gattClientWriteCharacteristicWindowedNative", "(IIIJJIJJII[BI)Z", (void *) gattClientWriteCharacteristicWindowedNative},
     {"gattClientExecuteWriteNative", "(IZ)V", (void *) gattClientExecuteWriteNative},
     {"gattClientRegisterForNotificationsNative", "(ILjava/lang/String;IIJJIJJZ)V", (void *) gattClientRegisterForNotificationsNative},
+    {"gattClientSetNotifyTokenNative", "(IIIJJIJJI)V", (void *) gattClientSetNotifyTokenNative},
+    {"gattClientSetNotifyBatchingNative", "(III)V", (void *) gattClientSetNotifyBatchingNative},
+    {"gattClientSetAttributeCacheDirNative", "(Ljava/lang/String;)V", (void *) gattClientSetAttributeCacheDirNative},
     {"gattClientReadRemoteRssiNative", "(ILjava/lang/String;)V", (void *) gattClientReadRemoteRssiNative},
     {"gattClientConfigureMTUNative", "(II)V", (void *) gattClientConfigureMTUNative},
     {"gattConnectionParameterUpdateNative", "(ILjava/lang/String;IIII)V", (void *) gattConnectionParameterUpdateNative},
@@ -1785,9 +3519,18 @@ static JNINativeMethod sMethods[] = {
     {"gattServerDeleteServiceNative", "(II)V", (void *) gattServerDeleteServiceNative},
     {"gattServerSendIndicationNative", "(III[B)V", (void *) gattServerSendIndicationNative},
     {"gattServerSendNotificationNative", "(III[B)V", (void *) gattServerSendNotificationNative},
+    {"gattServerSendNotificationMultiNative", "(II[I[B)Z", (void *) gattServerSendNotificationMultiNative},
+    {"gattServerSendNotificationStreamNative", "(III[B)Z", (void *) gattServerSendNotificationStreamNative},
     {"gattServerSendResponseNative", "(IIIIII[BI)V", (void *) gattServerSendResponseNative},
+    {"gattServerSetPrepWriteLimitNative", "(I)V", (void *) gattServerSetPrepWriteLimitNative},
+    {"gattServerSetAttributeValueNative", "(I[B)V", (void *) gattServerSetAttributeValueNative},
+    {"gattServerSetSubscriptionFilterNative", "(Z)V", (void *) gattServerSetSubscriptionFilterNative},
 
     {"gattTestNative", "(IJJLjava/lang/String;IIIII)V", (void *) gattTestNative},
+    {"gattGetUpcallQueueStatsNative", "()[I", (void *) gattGetUpcallQueueStatsNative},
+    {"gattGetScanResultRingNative", "()Ljava/nio/ByteBuffer;", (void *) gattGetScanResultRingNative},
+    {"gattWaitScanResultRingNative", "(II)J", (void *) gattWaitScanResultRingNative},
+    {"gattStopScanResultRingNative", "()V", (void *) gattStopScanResultRingNative},
 };
 
 int register_com_android_bluetooth_gatt(JNIEnv* env)
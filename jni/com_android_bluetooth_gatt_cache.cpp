@@ -0,0 +1,559 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothGattCacheJni"
+
+#include "com_android_bluetooth_gatt_cache.h"
+#include "utils/Log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace android {
+
+#define CACHE_MAGIC         0x43424447  // "GDBC"
+#define CACHE_VERSION       1
+#define CACHE_DIR_LEN       256
+#define CACHE_PATH_LEN      (CACHE_DIR_LEN + 32)
+
+enum {
+    STATE_IDLE,
+    STATE_SEARCHING,    // collecting the services of a search
+    STATE_RECORDING,    // recording the walk answered by the stack
+    STATE_REPLAYING,    // answering the walk from the cache
+};
+
+/*
+ * On disk record. Included services are kept in the char_ fields.
+ */
+typedef struct {
+    uint8_t type;
+    uint8_t srvc_is_primary;
+    uint8_t srvc_inst_id;
+    uint8_t char_inst_id;
+    uint8_t descr_inst_id;
+    uint8_t incl_is_primary;
+    uint8_t char_prop;
+    uint8_t unused;
+    uint8_t srvc_uuid[16];
+    uint8_t char_uuid[16];
+    uint8_t descr_uuid[16];
+} cache_record_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint16_t count;
+    uint8_t end_status;
+    uint8_t unused;
+    uint8_t bda[6];
+    uint8_t unused2[2];
+    uint32_t checksum;          // FNV-1a of the records
+} cache_header_t;
+
+typedef struct {
+    bool in_use;
+    int conn_id;
+    bt_bdaddr_t bda;
+    int state;
+    uint32_t epoch;             // sEpoch when the search started
+
+    cache_record_t *cached;     // loaded from the file, services first
+    int cached_count;
+    int cached_services;
+    int cached_chars;
+    uint8_t cached_end_status;
+
+    cache_record_t *recorded;
+    int recorded_count;
+    int services;
+    int chars;
+    int ends;                   // lists answered so far
+    int end_status;             // -1 until the first list ends
+
+    bool answering;             // a replay loop runs for this session
+    bool has_pending;
+    bool pending_has_start;
+    cache_record_t pending;
+} cache_session_t;
+
+static pthread_mutex_t sCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static char sCacheDir[CACHE_DIR_LEN];
+static cache_session_t sSessions[GATT_CACHE_MAX_SESSIONS];
+static uint32_t sEpoch = 0;     // bumped by every invalidation
+
+static uint32_t checksum(const cache_record_t *records, int count) {
+    const uint8_t *p = (const uint8_t *) records;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < count * sizeof(cache_record_t); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void make_path(char *path, const char *suffix, const bt_bdaddr_t *bda) {
+    const uint8_t *a = bda->address;
+    snprintf(path, CACHE_PATH_LEN, "%s/%02x%02x%02x%02x%02x%02x.gattdb%s", sCacheDir,
+             a[0], a[1], a[2], a[3], a[4], a[5], suffix);
+}
+
+static void to_record(const gatt_cache_attr_t *attr, cache_record_t *r) {
+    memset(r, 0, sizeof(*r));
+    r->type = (uint8_t) attr->type;
+    r->srvc_is_primary = attr->srvc_id.is_primary ? 1 : 0;
+    r->srvc_inst_id = attr->srvc_id.id.inst_id;
+    memcpy(r->srvc_uuid, attr->srvc_id.id.uuid.uu, 16);
+
+    switch (attr->type) {
+    case GATT_CACHE_DESCRIPTOR:
+        r->descr_inst_id = attr->descr_id.inst_id;
+        memcpy(r->descr_uuid, attr->descr_id.uuid.uu, 16);
+        // fall through
+    case GATT_CACHE_CHARACTERISTIC:
+        r->char_inst_id = attr->char_id.inst_id;
+        memcpy(r->char_uuid, attr->char_id.uuid.uu, 16);
+        r->char_prop = (uint8_t) attr->char_prop;
+        break;
+    case GATT_CACHE_INCLUDED_SERVICE:
+        r->incl_is_primary = attr->incl_srvc_id.is_primary ? 1 : 0;
+        r->char_inst_id = attr->incl_srvc_id.id.inst_id;
+        memcpy(r->char_uuid, attr->incl_srvc_id.id.uuid.uu, 16);
+        break;
+    }
+}
+
+static void to_attr(const cache_record_t *r, gatt_cache_attr_t *attr) {
+    memset(attr, 0, sizeof(*attr));
+    attr->type = r->type;
+    attr->srvc_id.is_primary = r->srvc_is_primary;
+    attr->srvc_id.id.inst_id = r->srvc_inst_id;
+    memcpy(attr->srvc_id.id.uuid.uu, r->srvc_uuid, 16);
+
+    switch (r->type) {
+    case GATT_CACHE_DESCRIPTOR:
+        attr->descr_id.inst_id = r->descr_inst_id;
+        memcpy(attr->descr_id.uuid.uu, r->descr_uuid, 16);
+        // fall through
+    case GATT_CACHE_CHARACTERISTIC:
+        attr->char_id.inst_id = r->char_inst_id;
+        memcpy(attr->char_id.uuid.uu, r->char_uuid, 16);
+        attr->char_prop = r->char_prop;
+        break;
+    case GATT_CACHE_INCLUDED_SERVICE:
+        attr->incl_srvc_id.is_primary = r->incl_is_primary;
+        attr->incl_srvc_id.id.inst_id = r->char_inst_id;
+        memcpy(attr->incl_srvc_id.id.uuid.uu, r->char_uuid, 16);
+        break;
+    }
+}
+
+static bool same_srvc(const cache_record_t *a, const cache_record_t *b) {
+    return a->srvc_inst_id == b->srvc_inst_id && a->srvc_is_primary == b->srvc_is_primary
+        && !memcmp(a->srvc_uuid, b->srvc_uuid, 16);
+}
+
+// Characteristic, or included service
+static bool same_char(const cache_record_t *a, const cache_record_t *b) {
+    return a->char_inst_id == b->char_inst_id && a->incl_is_primary == b->incl_is_primary
+        && !memcmp(a->char_uuid, b->char_uuid, 16);
+}
+
+static bool same_descr(const cache_record_t *a, const cache_record_t *b) {
+    return a->descr_inst_id == b->descr_inst_id && !memcmp(a->descr_uuid, b->descr_uuid, 16);
+}
+
+static cache_session_t* find_session(int conn_id) {
+    for (int i = 0; i < GATT_CACHE_MAX_SESSIONS; i++) {
+        if (sSessions[i].in_use && sSessions[i].conn_id == conn_id) return &sSessions[i];
+    }
+    return NULL;
+}
+
+static void reset_session(cache_session_t *s) {
+    free(s->cached);
+    free(s->recorded);
+    s->cached = NULL;
+    s->recorded = NULL;
+    s->cached_count = 0;
+    s->recorded_count = 0;
+    s->state = STATE_IDLE;
+    s->has_pending = false;
+    s->answering = false;
+}
+
+/*
+ * Reads the cache file of the session's device into s->cached.
+ */
+static void load_locked(cache_session_t *s) {
+    char path[CACHE_PATH_LEN];
+    make_path(path, "", &s->bda);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(cache_header_t)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return;
+
+    const cache_header_t *h = (const cache_header_t *) map;
+    const cache_record_t *records = (const cache_record_t *) (h + 1);
+    if (h->magic != CACHE_MAGIC || h->version != CACHE_VERSION
+            || h->record_size != sizeof(cache_record_t) || h->count > GATT_CACHE_MAX_ATTRS
+            || st.st_size != (off_t) (sizeof(*h) + h->count * sizeof(cache_record_t))
+            || memcmp(h->bda, s->bda.address, sizeof(h->bda))
+            || h->checksum != checksum(records, h->count)) {
+        ALOGW("%s: ignoring invalid %s", __FUNCTION__, path);
+        munmap(map, st.st_size);
+        unlink(path);
+        return;
+    }
+
+    s->cached = (cache_record_t *) malloc(h->count * sizeof(cache_record_t) + 1);
+    if (s->cached != NULL) {
+        memcpy(s->cached, records, h->count * sizeof(cache_record_t));
+        s->cached_count = h->count;
+        s->cached_end_status = h->end_status;
+        s->cached_services = 0;
+        s->cached_chars = 0;
+        for (int i = 0; i < s->cached_count; i++) {
+            if (s->cached[i].type == GATT_CACHE_SERVICE) s->cached_services++;
+            else if (s->cached[i].type == GATT_CACHE_CHARACTERISTIC) s->cached_chars++;
+        }
+    }
+    munmap(map, st.st_size);
+}
+
+/*
+ * Writes the session's recording through a temporary file, so a reader
+ * never sees a partial file. Takes ownership of the recording and drops
+ * the lock while writing.
+ */
+static void commit_locked(cache_session_t *s) {
+    char path[CACHE_PATH_LEN];
+    char tmp_path[CACHE_PATH_LEN];
+    make_path(path, "", &s->bda);
+    make_path(tmp_path, ".tmp", &s->bda);
+
+    cache_record_t *records = s->recorded;
+    int count = s->recorded_count;
+    uint32_t epoch = s->epoch;
+    cache_header_t h;
+    memset(&h, 0, sizeof(h));
+    h.magic = CACHE_MAGIC;
+    h.version = CACHE_VERSION;
+    h.record_size = sizeof(cache_record_t);
+    h.count = (uint16_t) count;
+    h.end_status = (uint8_t) s->end_status;
+    memcpy(h.bda, s->bda.address, sizeof(h.bda));
+    h.checksum = checksum(records, count);
+
+    s->recorded = NULL;
+    s->recorded_count = 0;
+    pthread_mutex_unlock(&sCacheLock);
+
+    size_t size = sizeof(h) + count * sizeof(cache_record_t);
+    bool written = false;
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd >= 0) {
+        if (ftruncate(fd, size) == 0) {
+            void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (map != MAP_FAILED) {
+                memcpy(map, &h, sizeof(h));
+                memcpy((cache_header_t *) map + 1, records, count * sizeof(cache_record_t));
+                written = msync(map, size, MS_SYNC) == 0;
+                munmap(map, size);
+            }
+        }
+        close(fd);
+    }
+    free(records);
+
+    pthread_mutex_lock(&sCacheLock);
+    // The device may have been invalidated while the file was written
+    if (!written || epoch != sEpoch || rename(tmp_path, path) != 0) {
+        if (!written) ALOGW("%s: unable to write %s: %s", __FUNCTION__, tmp_path, strerror(errno));
+        unlink(tmp_path);
+    }
+}
+
+bool gatt_cache_set_dir(const char *dir) {
+    struct stat st;
+    if (dir != NULL && (strlen(dir) >= CACHE_DIR_LEN || stat(dir, &st) != 0
+            || !S_ISDIR(st.st_mode))) {
+        ALOGE("%s: unusable cache directory %s", __FUNCTION__, dir);
+        dir = NULL;
+    }
+
+    pthread_mutex_lock(&sCacheLock);
+    if (dir != NULL) {
+        strcpy(sCacheDir, dir);
+    } else {
+        sCacheDir[0] = '\0';
+    }
+    pthread_mutex_unlock(&sCacheLock);
+    return dir != NULL;
+}
+
+void gatt_cache_open(int conn_id, const bt_bdaddr_t *bda) {
+    pthread_mutex_lock(&sCacheLock);
+    cache_session_t *s = find_session(conn_id);
+    if (s == NULL) {
+        for (int i = 0; i < GATT_CACHE_MAX_SESSIONS; i++) {
+            if (!sSessions[i].in_use) {
+                s = &sSessions[i];
+                break;
+            }
+        }
+    }
+    if (s != NULL) {
+        reset_session(s);
+        s->in_use = true;
+        s->conn_id = conn_id;
+        s->bda = *bda;
+    }
+    pthread_mutex_unlock(&sCacheLock);
+}
+
+void gatt_cache_close(int conn_id) {
+    pthread_mutex_lock(&sCacheLock);
+    cache_session_t *s = find_session(conn_id);
+    if (s != NULL) {
+        reset_session(s);
+        s->in_use = false;
+    }
+    pthread_mutex_unlock(&sCacheLock);
+}
+
+void gatt_cache_invalidate(const bt_bdaddr_t *bda) {
+    pthread_mutex_lock(&sCacheLock);
+    sEpoch++;
+    if (sCacheDir[0] != '\0') {
+        char path[CACHE_PATH_LEN];
+        make_path(path, "", bda);
+        unlink(path);
+    }
+    for (int i = 0; i < GATT_CACHE_MAX_SESSIONS; i++) {
+        cache_session_t *s = &sSessions[i];
+        if (s->in_use && s->state != STATE_REPLAYING
+                && !memcmp(&s->bda, bda, sizeof(*bda))) {
+            reset_session(s);
+        }
+    }
+    pthread_mutex_unlock(&sCacheLock);
+}
+
+void gatt_cache_search_started(int conn_id, bool search_all) {
+    pthread_mutex_lock(&sCacheLock);
+    cache_session_t *s = find_session(conn_id);
+    if (s != NULL) {
+        reset_session(s);
+        if (search_all && sCacheDir[0] != '\0') {
+            s->recorded = (cache_record_t *) malloc(
+                GATT_CACHE_MAX_ATTRS * sizeof(cache_record_t));
+            if (s->recorded != NULL) {
+                load_locked(s);
+                s->state = STATE_SEARCHING;
+                s->epoch = sEpoch;
+                s->services = 0;
+                s->chars = 0;
+                s->ends = 0;
+                s->end_status = -1;
+            }
+        }
+    }
+    pthread_mutex_unlock(&sCacheLock);
+}
+
+void gatt_cache_service_found(int conn_id, const btgatt_srvc_id_t *srvc_id) {
+    pthread_mutex_lock(&sCacheLock);
+    cache_session_t *s = find_session(conn_id);
+    if (s != NULL && s->state == STATE_SEARCHING) {
+        if (s->recorded_count < GATT_CACHE_MAX_ATTRS) {
+            gatt_cache_attr_t attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.type = GATT_CACHE_SERVICE;
+            attr.srvc_id = *srvc_id;
+            to_record(&attr, &s->recorded[s->recorded_count++]);
+            s->services++;
+        } else {
+            reset_session(s);
+        }
+    }
+    pthread_mutex_unlock(&sCacheLock);
+}
+
+void gatt_cache_search_complete(int conn_id, int status) {
+    pthread_mutex_lock(&sCacheLock);
+    cache_session_t *s = find_session(conn_id);
+    if (s != NULL && s->state == STATE_SEARCHING) {
+        if (status != 0) {
+            reset_session(s);
+        } else if (s->cached != NULL && s->cached_services == s->services
+                && !memcmp(s->cached, s->recorded, s->services * sizeof(cache_record_t))) {
+            ALOGD("%s: conn_id %d replays %d attributes", __FUNCTION__, conn_id,
+                  s->cached_count);
+            free(s->recorded);
+            s->recorded = NULL;
+            s->recorded_count = 0;
+            s->state = STATE_REPLAYING;
+        } else {
+            free(s->cached);
+            s->cached = NULL;
+            s->cached_count = 0;
+            s->state = STATE_RECORDING;
+        }
+    }
+    pthread_mutex_unlock(&sCacheLock);
+}
+
+void gatt_cache_record(int conn_id, int status, const gatt_cache_attr_t *attr) {
+    pthread_mutex_lock(&sCacheLock);
+    cache_session_t *s = find_session(conn_id);
+    if (s == NULL || s->state != STATE_RECORDING) {
+        pthread_mutex_unlock(&sCacheLock);
+        return;
+    }
+
+    if (status == 0) {
+        if (s->recorded_count < GATT_CACHE_MAX_ATTRS) {
+            to_record(attr, &s->recorded[s->recorded_count++]);
+            if (attr->type == GATT_CACHE_CHARACTERISTIC) s->chars++;
+        } else {
+            ALOGW("%s: more than %d attributes, not caching", __FUNCTION__,
+                  GATT_CACHE_MAX_ATTRS);
+            reset_session(s);
+        }
+    } else if (s->end_status != -1 && s->end_status != status) {
+        // Only lists that simply ran out are worth replaying
+        reset_session(s);
+    } else {
+        s->end_status = status;
+        // Every service ends a characteristic and an included service
+        // list, every characteristic a descriptor list
+        if (++s->ends == 2 * s->services + s->chars) {
+            commit_locked(s);
+            reset_session(s);
+        }
+    }
+    pthread_mutex_unlock(&sCacheLock);
+}
+
+/*
+ * Finds the answer to q in the cache. Returns false for the end of the
+ * list, with answer holding the IDs of the query.
+ */
+static bool answer_locked(cache_session_t *s, const cache_record_t *q, bool has_start,
+                          gatt_cache_attr_t *answer) {
+    bool past_start = !has_start;
+    for (int i = s->cached_services; i < s->cached_count; i++) {
+        const cache_record_t *r = &s->cached[i];
+        if (r->type != q->type || !same_srvc(r, q)) continue;
+        if (r->type == GATT_CACHE_DESCRIPTOR && !same_char(r, q)) continue;
+
+        if (past_start) {
+            to_attr(r, answer);
+            return true;
+        }
+        past_start = (r->type == GATT_CACHE_DESCRIPTOR) ? same_descr(r, q) : same_char(r, q);
+    }
+
+    cache_record_t end = *q;
+    if (q->type == GATT_CACHE_DESCRIPTOR) {
+        end.descr_inst_id = 0;
+        memset(end.descr_uuid, 0, sizeof(end.descr_uuid));
+    } else {
+        end.char_inst_id = 0;
+        end.incl_is_primary = 0;
+        memset(end.char_uuid, 0, sizeof(end.char_uuid));
+    }
+    to_attr(&end, answer);
+    return false;
+}
+
+bool gatt_cache_replay(JNIEnv *env, int conn_id, const gatt_cache_attr_t *query,
+                       bool has_start, gatt_cache_handler_t handler) {
+    pthread_mutex_lock(&sCacheLock);
+    cache_session_t *s = find_session(conn_id);
+    if (s == NULL || s->state != STATE_REPLAYING) {
+        pthread_mutex_unlock(&sCacheLock);
+        return false;
+    }
+
+    to_record(query, &s->pending);
+    s->pending_has_start = has_start;
+    s->has_pending = true;
+    if (s->answering) {
+        // Called from the handler, the loop below answers it
+        pthread_mutex_unlock(&sCacheLock);
+        return true;
+    }
+
+    s->answering = true;
+    while (s->has_pending) {
+        s->has_pending = false;
+        gatt_cache_attr_t answer;
+        int status = 0;
+        if (!answer_locked(s, &s->pending, s->pending_has_start, &answer)) {
+            status = s->cached_end_status;
+            if (++s->ends == 2 * s->cached_services + s->cached_chars) reset_session(s);
+        }
+
+        pthread_mutex_unlock(&sCacheLock);
+        handler(env, conn_id, status, &answer);
+        pthread_mutex_lock(&sCacheLock);
+
+        // Closed or reset meanwhile; the session may already serve another walk
+        if (!s->in_use || s->conn_id != conn_id || !s->answering) {
+            pthread_mutex_unlock(&sCacheLock);
+            return true;
+        }
+        if (s->has_pending && s->state != STATE_REPLAYING) {
+            // Only a confused caller asks past the end of the walk
+            ALOGW("%s: conn_id %d asked past the cached database", __FUNCTION__, conn_id);
+            s->has_pending = false;
+        }
+    }
+    s->answering = false;
+    pthread_mutex_unlock(&sCacheLock);
+    return true;
+}
+
+}
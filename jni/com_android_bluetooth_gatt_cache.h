@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_GATT_CACHE_H
+#define COM_ANDROID_BLUETOOTH_GATT_CACHE_H
+
+#include "jni.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hardware/bt_gatt.h"
+
+namespace android {
+
+/*
+ * Persistent cache of remote GATT attribute databases.
+ *
+ * GattService walks the attribute database of a device with one
+ * get_characteristic, get_descriptor or get_included_service call per
+ * attribute, each answered by its own callback. A full walk that succeeds
+ * is recorded and written to <dir>/<address>.gattdb as a header and an
+ * array of fixed size records, in the order the attributes were found.
+ *
+ * The service search itself still goes to the stack, which needs it to
+ * resolve attribute handles. When it reports the same services that were
+ * recorded, the rest of the walk is answered from the recording without
+ * calling into the stack. Any other outcome starts a new recording.
+ *
+ * The file of a device is removed on Service Changed, on a refresh and
+ * when its bond is removed. Nothing is cached until a directory is set.
+ */
+
+#define GATT_CACHE_MAX_ATTRS        512
+#define GATT_CACHE_MAX_SESSIONS     16
+
+#define GATT_CACHE_SERVICE          0
+#define GATT_CACHE_CHARACTERISTIC   1
+#define GATT_CACHE_DESCRIPTOR       2
+#define GATT_CACHE_INCLUDED_SERVICE 3
+
+/*
+ * One discovered attribute. Only the IDs that apply to type are set.
+ */
+typedef struct {
+    int type;
+    btgatt_srvc_id_t srvc_id;
+    btgatt_gatt_id_t char_id;
+    btgatt_gatt_id_t descr_id;
+    btgatt_srvc_id_t incl_srvc_id;
+    int char_prop;
+} gatt_cache_attr_t;
+
+/*
+ * Delivers an answer of the cache the way the matching stack callback
+ * would, with status != 0 for the end of a list.
+ */
+typedef void (*gatt_cache_handler_t)(JNIEnv *env, int conn_id, int status,
+                                     gatt_cache_attr_t *attr);
+
+/*
+ * Sets the directory of the cache files, or turns caching off if dir is
+ * NULL. Returns false if the directory is unusable.
+ */
+bool gatt_cache_set_dir(const char *dir);
+
+/*
+ * Starts and ends tracking a connection.
+ */
+void gatt_cache_open(int conn_id, const bt_bdaddr_t *bda);
+void gatt_cache_close(int conn_id);
+
+/*
+ * Removes the cache file of a device and drops a recording in progress.
+ * A replay in progress finishes from memory.
+ */
+void gatt_cache_invalidate(const bt_bdaddr_t *bda);
+
+/*
+ * Follow a service search of conn_id. Searches for a single service are
+ * neither recorded nor replayed.
+ */
+void gatt_cache_search_started(int conn_id, bool search_all);
+void gatt_cache_service_found(int conn_id, const btgatt_srvc_id_t *srvc_id);
+void gatt_cache_search_complete(int conn_id, int status);
+
+/*
+ * Records the result of a get_characteristic, get_descriptor or
+ * get_included_service call answered by the stack.
+ */
+void gatt_cache_record(int conn_id, int status, const gatt_cache_attr_t *attr);
+
+/*
+ * Answers a get_characteristic, get_descriptor or get_included_service
+ * call from the cache. query->type selects the call and the ID it starts
+ * after is set unless has_start is false. Returns false if the caller
+ * has to ask the stack.
+ *
+ * The handler runs on the calling thread. Calls made from inside the
+ * handler are queued and answered once it returns, so a walk does not
+ * grow the stack.
+ */
+bool gatt_cache_replay(JNIEnv *env, int conn_id, const gatt_cache_attr_t *query,
+                       bool has_start, gatt_cache_handler_t handler);
+
+}
+
+#endif
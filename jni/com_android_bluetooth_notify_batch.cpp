@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothNotifyBatchJni"
+
+#include "com_android_bluetooth.h"
+#include "com_android_bluetooth_notify_batch.h"
+#include "android_runtime/AndroidRuntime.h"
+#include "utils/Log.h"
+#include "utils/SystemClock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+namespace android {
+
+#define NS_PER_MS       1000000LL
+#define NS_PER_SEC      1000000000LL
+#define DEADLINE_NEVER  ((int64_t) 0x7fffffffffffffffLL)
+
+typedef struct {
+    int count;
+    int len;
+    int32_t tokens[NOTIFY_BATCH_MAX_VALUES];
+    int64_t timestamps[NOTIFY_BATCH_MAX_VALUES];
+    uint8_t values[NOTIFY_BATCH_MAX_BYTES];
+} notify_buffer_t;
+
+typedef struct {
+    int conn_id;
+    bool enabled;           // cleared to drain and free the connection
+    int window_ms;
+    int max_bytes;
+
+    // filling is appended to by the producer; delivering is owned by the
+    // delivery thread while delivering_busy is set
+    notify_buffer_t buffers[2];
+    notify_buffer_t *filling;
+    notify_buffer_t *delivering;
+    bool delivering_busy;
+    bool flush_now;
+    int64_t deadline_ns;    // CLOCK_MONOTONIC time the filling buffer is due
+    int waiters;            // producers waiting for room; keeps the connection alive
+} notify_conn_t;
+
+struct notify_batch {
+    notify_batch_handler_t handler;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    notify_conn_t *conns[NOTIFY_BATCH_MAX_CONNS];
+    bool stopping;
+
+    pthread_t thread;
+    char thread_name[32];
+};
+
+static int64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static int find_conn(const notify_batch_t *batch, int conn_id) {
+    for (int i = 0; i < NOTIFY_BATCH_MAX_CONNS; i++) {
+        if (batch->conns[i] != NULL && batch->conns[i]->conn_id == conn_id) return i;
+    }
+    return -1;
+}
+
+static bool conn_due(const notify_conn_t *c, int64_t now) {
+    return c->flush_now || !c->enabled || now >= c->deadline_ns;
+}
+
+/*
+ * Returns the index of a connection whose buffer should be delivered now,
+ * freeing drained connections on the way, or -1 with *next_deadline set.
+ */
+static int next_due_conn(notify_batch_t *batch, int64_t *next_deadline) {
+    int64_t now = monotonic_ns();
+    *next_deadline = DEADLINE_NEVER;
+    for (int i = 0; i < NOTIFY_BATCH_MAX_CONNS; i++) {
+        notify_conn_t *c = batch->conns[i];
+        if (c == NULL) continue;
+
+        if (c->filling->count == 0) {
+            if (!c->enabled && c->waiters == 0) {
+                batch->conns[i] = NULL;
+                free(c);
+                pthread_cond_broadcast(&batch->cond);
+            }
+            continue;
+        }
+        if (conn_due(c, now)) return i;
+        if (c->deadline_ns < *next_deadline) *next_deadline = c->deadline_ns;
+    }
+    return -1;
+}
+
+static void *notify_batch_thread_main(void *arg) {
+    notify_batch_t *batch = (notify_batch_t *) arg;
+    JavaVM *vm = AndroidRuntime::getJavaVM();
+    JNIEnv *env = NULL;
+
+    JavaVMAttachArgs args;
+    args.version = JNI_VERSION_1_6;
+    args.name = batch->thread_name;
+    args.group = NULL;
+    if (vm->AttachCurrentThread(&env, &args) != JNI_OK) {
+        ALOGE("%s: unable to attach %s to VM", __FUNCTION__, batch->thread_name);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    while (!batch->stopping) {
+        int64_t next_deadline;
+        int i = next_due_conn(batch, &next_deadline);
+        if (i < 0) {
+            if (next_deadline == DEADLINE_NEVER) {
+                pthread_cond_wait(&batch->cond, &batch->lock);
+            } else {
+                struct timespec ts;
+                ts.tv_sec = next_deadline / NS_PER_SEC;
+                ts.tv_nsec = next_deadline % NS_PER_SEC;
+                pthread_cond_timedwait(&batch->cond, &batch->lock, &ts);
+            }
+            continue;
+        }
+
+        notify_conn_t *c = batch->conns[i];
+        notify_buffer_t *ready = c->filling;
+        c->filling = c->delivering;
+        c->delivering = ready;
+        c->delivering_busy = true;
+        c->flush_now = false;
+        pthread_cond_broadcast(&batch->cond);
+        pthread_mutex_unlock(&batch->lock);
+
+        batch->handler(env, c->conn_id, ready->tokens, ready->timestamps, ready->count,
+                       ready->values, ready->len);
+        checkAndClearExceptionFromCallback(env, __FUNCTION__);
+
+        pthread_mutex_lock(&batch->lock);
+        ready->count = 0;
+        ready->len = 0;
+        c->delivering_busy = false;
+        pthread_cond_broadcast(&batch->cond);
+    }
+    pthread_mutex_unlock(&batch->lock);
+
+    vm->DetachCurrentThread();
+    return NULL;
+}
+
+notify_batch_t* notify_batch_create(const char *thread_name, notify_batch_handler_t handler) {
+    notify_batch_t *batch = (notify_batch_t *) calloc(1, sizeof(notify_batch_t));
+    if (batch == NULL) return NULL;
+
+    batch->handler = handler;
+    snprintf(batch->thread_name, sizeof(batch->thread_name), "%s", thread_name);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&batch->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&batch->lock, NULL);
+
+    if (pthread_create(&batch->thread, NULL, notify_batch_thread_main, batch) != 0) {
+        ALOGE("%s: unable to start %s", __FUNCTION__, thread_name);
+        pthread_cond_destroy(&batch->cond);
+        pthread_mutex_destroy(&batch->lock);
+        free(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+void notify_batch_destroy(notify_batch_t *batch) {
+    if (batch == NULL) return;
+
+    pthread_mutex_lock(&batch->lock);
+    batch->stopping = true;
+    pthread_cond_broadcast(&batch->cond);
+    pthread_mutex_unlock(&batch->lock);
+    pthread_join(batch->thread, NULL);
+
+    for (int i = 0; i < NOTIFY_BATCH_MAX_CONNS; i++) free(batch->conns[i]);
+    pthread_cond_destroy(&batch->cond);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch);
+}
+
+bool notify_batch_configure(notify_batch_t *batch, int conn_id, int window_ms, int max_bytes) {
+    if (max_bytes < NOTIFY_BATCH_MIN_BYTES) max_bytes = NOTIFY_BATCH_MIN_BYTES;
+    if (max_bytes > NOTIFY_BATCH_MAX_BYTES) max_bytes = NOTIFY_BATCH_MAX_BYTES;
+
+    pthread_mutex_lock(&batch->lock);
+    int i = find_conn(batch, conn_id);
+    if (window_ms <= 0) {
+        if (i >= 0) {
+            notify_conn_t *c = batch->conns[i];
+            c->enabled = false;
+            pthread_cond_broadcast(&batch->cond);
+            while (batch->conns[i] == c && !batch->stopping) {
+                pthread_cond_wait(&batch->cond, &batch->lock);
+            }
+        }
+        pthread_mutex_unlock(&batch->lock);
+        return true;
+    }
+
+    if (i < 0) {
+        for (i = 0; i < NOTIFY_BATCH_MAX_CONNS && batch->conns[i] != NULL; i++);
+        notify_conn_t *c = i < NOTIFY_BATCH_MAX_CONNS ?
+                (notify_conn_t *) calloc(1, sizeof(notify_conn_t)) : NULL;
+        if (c == NULL) {
+            pthread_mutex_unlock(&batch->lock);
+            ALOGW("%s: unable to batch notifications of conn_id %d", __FUNCTION__, conn_id);
+            return false;
+        }
+        c->conn_id = conn_id;
+        c->filling = &c->buffers[0];
+        c->delivering = &c->buffers[1];
+        batch->conns[i] = c;
+    }
+
+    notify_conn_t *c = batch->conns[i];
+    c->enabled = true;
+    c->window_ms = window_ms;
+    c->max_bytes = max_bytes;
+    pthread_mutex_unlock(&batch->lock);
+    return true;
+}
+
+bool notify_batch_add(notify_batch_t *batch, int conn_id, int token, const uint8_t *value,
+                      size_t len) {
+    int64_t timestamp = elapsedRealtimeNano();
+    int need = (int) len + 2;
+
+    pthread_mutex_lock(&batch->lock);
+    int i = find_conn(batch, conn_id);
+    notify_conn_t *c = i >= 0 ? batch->conns[i] : NULL;
+    if (c == NULL || !c->enabled || need > c->max_bytes) {
+        pthread_mutex_unlock(&batch->lock);
+        return false;
+    }
+
+    c->waiters++;
+    while (c->filling->count == NOTIFY_BATCH_MAX_VALUES ||
+            c->filling->len + need > c->max_bytes) {
+        c->flush_now = true;
+        pthread_cond_broadcast(&batch->cond);
+        pthread_cond_wait(&batch->cond, &batch->lock);
+        if (batch->stopping || !c->enabled) break;
+    }
+    c->waiters--;
+    if (batch->stopping || !c->enabled) {
+        pthread_cond_broadcast(&batch->cond);
+        pthread_mutex_unlock(&batch->lock);
+        return false;
+    }
+
+    notify_buffer_t *b = c->filling;
+    b->tokens[b->count] = token;
+    b->timestamps[b->count] = timestamp;
+    b->values[b->len] = (uint8_t) len;
+    b->values[b->len + 1] = (uint8_t) (len >> 8);
+    memcpy(b->values + b->len + 2, value, len);
+    b->len += need;
+    if (b->count++ == 0) {
+        c->deadline_ns = monotonic_ns() + c->window_ms * NS_PER_MS;
+        pthread_cond_broadcast(&batch->cond);
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return true;
+}
+
+void notify_batch_flush(notify_batch_t *batch, int conn_id) {
+    pthread_mutex_lock(&batch->lock);
+    int i = find_conn(batch, conn_id);
+    if (i >= 0 && batch->conns[i]->filling->count > 0) {
+        batch->conns[i]->flush_now = true;
+        pthread_cond_broadcast(&batch->cond);
+    }
+    pthread_mutex_unlock(&batch->lock);
+}
+
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_NOTIFY_BATCH_H
+#define COM_ANDROID_BLUETOOTH_NOTIFY_BATCH_H
+
+#include "jni.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Per connection batching of notifications.
+ *
+ * Connections opt in one by one. Their notifications are appended to a
+ * buffer of the connection, as the notify token, the arrival time from
+ * elapsedRealtimeNano() and the value with a two byte little endian
+ * length in front. A buffer is delivered in one upcall once it is full,
+ * window_ms after its first value arrived, or when it is flushed, which
+ * happens on congestion changes and before the connection goes away.
+ *
+ * One thread attached to the VM delivers the buffers of every connection,
+ * so values of a connection keep their order. Each connection has two
+ * buffers; the producer only waits when both are full.
+ */
+
+#define NOTIFY_BATCH_MAX_CONNS      16
+#define NOTIFY_BATCH_MAX_VALUES     128
+#define NOTIFY_BATCH_MAX_BYTES      8192
+#define NOTIFY_BATCH_MIN_BYTES      (600 + 2)   // one full length attribute value
+
+typedef void (*notify_batch_handler_t)(JNIEnv *env, int conn_id, const int32_t *tokens,
+                                       const int64_t *timestamps, int count,
+                                       const uint8_t *values, int values_len);
+
+typedef struct notify_batch notify_batch_t;
+
+/*
+ * Creates a batcher without connections and starts its delivery thread.
+ * Returns NULL on failure.
+ */
+notify_batch_t* notify_batch_create(const char *thread_name, notify_batch_handler_t handler);
+
+/*
+ * Stops the delivery thread and frees the batcher. Pending values are
+ * dropped.
+ */
+void notify_batch_destroy(notify_batch_t *batch);
+
+/*
+ * Turns batching on for conn_id with the given window and buffer size, or
+ * off if window_ms is 0. Turning it off delivers pending values and waits
+ * for them to be delivered. Returns false if no connection slot is free.
+ */
+bool notify_batch_configure(notify_batch_t *batch, int conn_id, int window_ms, int max_bytes);
+
+/*
+ * Appends a notification value. Returns false if conn_id does not batch,
+ * in which case the caller delivers the value itself.
+ */
+bool notify_batch_add(notify_batch_t *batch, int conn_id, int token, const uint8_t *value,
+                      size_t len);
+
+/*
+ * Asks the delivery thread to deliver the pending values of conn_id now,
+ * without waiting for it to do so.
+ */
+void notify_batch_flush(notify_batch_t *batch, int conn_id);
+
+}
+
+#endif
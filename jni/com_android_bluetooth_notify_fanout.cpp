@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothNotifyFanoutJni"
+
+#include "com_android_bluetooth_notify_fanout.h"
+#include "utils/Log.h"
+
+#include <pthread.h>
+#include <string.h>
+
+namespace android {
+
+// Fan-out values and streamed chunks are few at a time, single notifications
+// in between them merge
+#define OUTSTANDING_SIZE    32
+#define NO_JOB              (-1)
+#define STREAM_JOB          (-2)
+
+typedef struct {
+    bool in_use;
+    bool done;
+    int server_if;
+    int attr_handle;
+    int remaining;              // connections not accounted yet
+    int sent;
+    int failed;
+    int len;
+    uint8_t value[NOTIFY_FANOUT_MAX_LEN];
+} fanout_job_t;
+
+typedef struct {
+    int8_t job;                 // NO_JOB for notifications sent on their own, STREAM_JOB
+                                // for streamed chunks
+    uint16_t count;
+} fanout_outstanding_t;
+
+typedef struct {
+    bool in_use;
+    bool congested;
+    int conn_id;
+    int in_flight;              // fan-out values among the outstanding ones
+    int8_t pending[NOTIFY_FANOUT_MAX_JOBS];
+    int pending_head;
+    int pending_count;
+    fanout_outstanding_t outstanding[OUTSTANDING_SIZE];
+    int outstanding_head;
+    int outstanding_count;
+} fanout_conn_t;
+
+static pthread_mutex_t sFanoutLock = PTHREAD_MUTEX_INITIALIZER;
+static fanout_job_t sJobs[NOTIFY_FANOUT_MAX_JOBS];
+static fanout_conn_t sConns[NOTIFY_FANOUT_MAX_CONNS];
+
+static fanout_conn_t* find_conn(int conn_id, bool create) {
+    fanout_conn_t *unused = NULL;
+    for (int i = 0; i < NOTIFY_FANOUT_MAX_CONNS; i++) {
+        if (!sConns[i].in_use) {
+            if (unused == NULL) unused = &sConns[i];
+        } else if (sConns[i].conn_id == conn_id) {
+            return &sConns[i];
+        }
+    }
+    if (!create || unused == NULL) return NULL;
+
+    memset(unused, 0, sizeof(*unused));
+    unused->in_use = true;
+    unused->conn_id = conn_id;
+    return unused;
+}
+
+static void account(int job, bool ok) {
+    fanout_job_t *j = &sJobs[job];
+    if (ok) {
+        j->sent++;
+    } else {
+        j->failed++;
+    }
+    if (--j->remaining == 0) j->done = true;
+}
+
+static fanout_outstanding_t* outstanding_at(fanout_conn_t *conn, int i) {
+    return &conn->outstanding[(conn->outstanding_head + i) % OUTSTANDING_SIZE];
+}
+
+static bool push_outstanding(fanout_conn_t *conn, int job) {
+    if (conn->outstanding_count > 0) {
+        fanout_outstanding_t *tail = outstanding_at(conn, conn->outstanding_count - 1);
+        if (job < 0 && tail->job == job) {
+            tail->count++;
+            return true;
+        }
+    }
+    if (conn->outstanding_count == OUTSTANDING_SIZE) return false;
+
+    fanout_outstanding_t *entry = outstanding_at(conn, conn->outstanding_count++);
+    entry->job = job;
+    entry->count = 1;
+    return true;
+}
+
+bool notify_fanout_start(int server_if, int attr_handle, const int *conn_ids, int count,
+                         int skipped, const uint8_t *value, int len) {
+    if (len < 0 || len > NOTIFY_FANOUT_MAX_LEN) return false;
+
+    pthread_mutex_lock(&sFanoutLock);
+    int job = NO_JOB;
+    for (int i = 0; i < NOTIFY_FANOUT_MAX_JOBS && job == NO_JOB; i++) {
+        if (!sJobs[i].in_use) job = i;
+    }
+    if (job == NO_JOB) {
+        pthread_mutex_unlock(&sFanoutLock);
+        return false;
+    }
+
+    fanout_job_t *j = &sJobs[job];
+    memset(j, 0, sizeof(*j));
+    j->in_use = true;
+    j->server_if = server_if;
+    j->attr_handle = attr_handle;
+    j->len = len;
+    j->failed = skipped;
+    memcpy(j->value, value, len);
+
+    for (int i = 0; i < count; i++) {
+        fanout_conn_t *conn = find_conn(conn_ids[i], true);
+        if (conn == NULL) {
+            ALOGW("%s: no room for conn_id %d", __FUNCTION__, conn_ids[i]);
+            j->failed++;
+            continue;
+        }
+        // Values are queued in order, so a duplicate is the last one queued
+        if (conn->pending_count > 0 && conn->pending[(conn->pending_head
+                + conn->pending_count - 1) % NOTIFY_FANOUT_MAX_JOBS] == job) {
+            continue;
+        }
+        conn->pending[(conn->pending_head + conn->pending_count++)
+                      % NOTIFY_FANOUT_MAX_JOBS] = (int8_t) job;
+        j->remaining++;
+    }
+    if (j->remaining == 0) j->done = true;
+    pthread_mutex_unlock(&sFanoutLock);
+    return true;
+}
+
+bool notify_fanout_next(int conn_id, notify_fanout_send_t *send) {
+    bool found = false;
+
+    pthread_mutex_lock(&sFanoutLock);
+    fanout_conn_t *conn = find_conn(conn_id, false);
+    if (conn != NULL && !conn->congested && conn->pending_count > 0
+            && conn->in_flight < NOTIFY_FANOUT_WINDOW) {
+        int job = conn->pending[conn->pending_head];
+        if (push_outstanding(conn, job)) {
+            conn->pending_head = (conn->pending_head + 1) % NOTIFY_FANOUT_MAX_JOBS;
+            conn->pending_count--;
+            conn->in_flight++;
+
+            send->conn_id = conn_id;
+            send->server_if = sJobs[job].server_if;
+            send->attr_handle = sJobs[job].attr_handle;
+            send->value = sJobs[job].value;
+            send->len = sJobs[job].len;
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&sFanoutLock);
+    return found;
+}
+
+void notify_fanout_unsent(int conn_id) {
+    pthread_mutex_lock(&sFanoutLock);
+    fanout_conn_t *conn = find_conn(conn_id, false);
+    if (conn != NULL && conn->outstanding_count > 0) {
+        fanout_outstanding_t *tail = outstanding_at(conn, conn->outstanding_count - 1);
+        if (tail->job >= 0) {
+            account(tail->job, false);
+            conn->in_flight--;
+            tail->count = 0;
+        } else {
+            tail->count--;
+        }
+        if (tail->count == 0) conn->outstanding_count--;
+    }
+    pthread_mutex_unlock(&sFanoutLock);
+}
+
+void notify_fanout_single(int conn_id) {
+    pthread_mutex_lock(&sFanoutLock);
+    fanout_conn_t *conn = find_conn(conn_id, true);
+    if (conn != NULL && !push_outstanding(conn, NO_JOB)) {
+        ALOGW("%s: conn_id %d has too much outstanding", __FUNCTION__, conn_id);
+    }
+    pthread_mutex_unlock(&sFanoutLock);
+}
+
+bool notify_fanout_stream(int conn_id) {
+    pthread_mutex_lock(&sFanoutLock);
+    fanout_conn_t *conn = find_conn(conn_id, true);
+    bool recorded = conn != NULL && push_outstanding(conn, STREAM_JOB);
+    pthread_mutex_unlock(&sFanoutLock);
+    return recorded;
+}
+
+int notify_fanout_sent(int conn_id, int status) {
+    int kind = NOTIFY_FANOUT_SINGLE;
+
+    pthread_mutex_lock(&sFanoutLock);
+    fanout_conn_t *conn = find_conn(conn_id, false);
+    if (conn != NULL && conn->outstanding_count > 0) {
+        fanout_outstanding_t *head = outstanding_at(conn, 0);
+        if (head->job >= 0) {
+            account(head->job, status == 0 || status == NOTIFY_FANOUT_CONGESTED);
+            conn->in_flight--;
+            head->count = 0;
+            kind = NOTIFY_FANOUT_JOB;
+        } else {
+            if (head->job == STREAM_JOB) kind = NOTIFY_FANOUT_STREAM;
+            head->count--;
+        }
+        if (head->count == 0) {
+            conn->outstanding_head = (conn->outstanding_head + 1) % OUTSTANDING_SIZE;
+            conn->outstanding_count--;
+        }
+    }
+    pthread_mutex_unlock(&sFanoutLock);
+    return kind;
+}
+
+void notify_fanout_congested(int conn_id, bool congested) {
+    pthread_mutex_lock(&sFanoutLock);
+    fanout_conn_t *conn = find_conn(conn_id, false);
+    if (conn != NULL) conn->congested = congested;
+    pthread_mutex_unlock(&sFanoutLock);
+}
+
+void notify_fanout_close(int conn_id) {
+    pthread_mutex_lock(&sFanoutLock);
+    fanout_conn_t *conn = find_conn(conn_id, false);
+    if (conn != NULL) {
+        for (int i = 0; i < conn->pending_count; i++) {
+            account(conn->pending[(conn->pending_head + i) % NOTIFY_FANOUT_MAX_JOBS], false);
+        }
+        for (int i = 0; i < conn->outstanding_count; i++) {
+            fanout_outstanding_t *entry = outstanding_at(conn, i);
+            if (entry->job >= 0) account(entry->job, false);
+        }
+        memset(conn, 0, sizeof(*conn));
+    }
+    pthread_mutex_unlock(&sFanoutLock);
+}
+
+bool notify_fanout_take_done(notify_fanout_done_t *done) {
+    bool found = false;
+
+    pthread_mutex_lock(&sFanoutLock);
+    for (int i = 0; i < NOTIFY_FANOUT_MAX_JOBS && !found; i++) {
+        if (!sJobs[i].in_use || !sJobs[i].done) continue;
+        done->server_if = sJobs[i].server_if;
+        done->attr_handle = sJobs[i].attr_handle;
+        done->sent = sJobs[i].sent;
+        done->failed = sJobs[i].failed;
+        sJobs[i].in_use = false;
+        found = true;
+    }
+    pthread_mutex_unlock(&sFanoutLock);
+    return found;
+}
+
+void notify_fanout_reset() {
+    pthread_mutex_lock(&sFanoutLock);
+    memset(sJobs, 0, sizeof(sJobs));
+    memset(sConns, 0, sizeof(sConns));
+    pthread_mutex_unlock(&sFanoutLock);
+}
+
+}
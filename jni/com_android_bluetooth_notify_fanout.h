@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_NOTIFY_FANOUT_H
+#define COM_ANDROID_BLUETOOTH_NOTIFY_FANOUT_H
+
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Notifications of one GATT server value to many connections.
+ *
+ * A fan-out copies the value once and queues it on every connection it
+ * goes to. Each connection sends from its queue while it is not congested
+ * and has fewer than NOTIFY_FANOUT_WINDOW fan-out values in flight. Once
+ * the stack has reported every connection of a fan-out sent or failed, the
+ * fan-out is done and reported once.
+ *
+ * The stack reports sent notifications of a connection in the order they
+ * were sent, without saying which value it reports. Notifications sent on
+ * their own and chunks of streamed values are therefore recorded as well,
+ * so that their reports can be told apart from those of fan-outs.
+ */
+
+#define NOTIFY_FANOUT_MAX_CONNS     64
+#define NOTIFY_FANOUT_MAX_JOBS      8
+#define NOTIFY_FANOUT_MAX_LEN       600
+#define NOTIFY_FANOUT_WINDOW        4
+
+#define NOTIFY_FANOUT_SINGLE        0   // report of a notification sent on its own
+#define NOTIFY_FANOUT_JOB           1   // report of a fan-out value
+#define NOTIFY_FANOUT_STREAM        2   // report of a streamed chunk
+
+#define NOTIFY_FANOUT_NO_RESOURCES  0x80    // GATT_NO_RESOURCES
+#define NOTIFY_FANOUT_CONGESTED     0x8f    // GATT_CONGESTED, still queued by the stack
+
+typedef struct {
+    int conn_id;
+    int server_if;
+    int attr_handle;
+    const uint8_t *value;       // valid until the send is reported
+    int len;
+} notify_fanout_send_t;
+
+typedef struct {
+    int server_if;
+    int attr_handle;
+    int sent;
+    int failed;
+} notify_fanout_done_t;
+
+/*
+ * Queues value on each of the count connections, duplicates ignored.
+ * skipped connections the caller left out count as failed. Returns false
+ * if the value is too long or too many fan-outs are pending; nothing is
+ * queued then.
+ */
+bool notify_fanout_start(int server_if, int attr_handle, const int *conn_ids, int count,
+                         int skipped, const uint8_t *value, int len);
+
+/*
+ * Hands out the next value conn_id may send now. Returns false if there
+ * is none.
+ */
+bool notify_fanout_next(int conn_id, notify_fanout_send_t *send);
+
+/*
+ * Takes back what was last handed out or recorded for conn_id, which the
+ * stack did not accept. A fan-out value counts as failed.
+ */
+void notify_fanout_unsent(int conn_id);
+
+/*
+ * Records a notification sent on its own to conn_id.
+ */
+void notify_fanout_single(int conn_id);
+
+/*
+ * Records a chunk of a streamed value sent to conn_id. Returns false if
+ * there is no room to record it, in which case it must not be sent.
+ */
+bool notify_fanout_stream(int conn_id);
+
+/*
+ * Accounts a report of the stack for conn_id. Returns NOTIFY_FANOUT_JOB
+ * if it belonged to a fan-out value, NOTIFY_FANOUT_STREAM if it belonged
+ * to a streamed chunk, NOTIFY_FANOUT_SINGLE otherwise.
+ */
+int notify_fanout_sent(int conn_id, int status);
+
+/*
+ * Holds or resumes the queue of conn_id.
+ */
+void notify_fanout_congested(int conn_id, bool congested);
+
+/*
+ * Forgets conn_id; values still queued or in flight for it count as
+ * failed.
+ */
+void notify_fanout_close(int conn_id);
+
+/*
+ * Takes the next fan-out that is done. Returns false if there is none.
+ */
+bool notify_fanout_take_done(notify_fanout_done_t *done);
+
+/*
+ * Forgets all connections and fan-outs without reporting them.
+ */
+void notify_fanout_reset();
+
+}
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothNotifyStreamJni"
+
+#include "com_android_bluetooth_notify_stream.h"
+#include "utils/Log.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+#define NOTIFY_HEADER_LEN   3   // opcode and handle
+
+typedef struct {
+    bool in_use;
+    int conn_id;
+    int mtu;
+    bool congested;
+
+    bool streaming;
+    int server_if;
+    int attr_handle;
+    uint8_t *value;
+    size_t total;
+    size_t offset;              // handed out
+    size_t sent;                // reported sent
+    int status;
+    int step;                   // next progress step to report
+    int in_flight;
+    int chunk_lens[NOTIFY_STREAM_WINDOW];   // oldest first
+} notify_stream_conn_t;
+
+static pthread_mutex_t sStreamLock = PTHREAD_MUTEX_INITIALIZER;
+static notify_stream_conn_t sConns[NOTIFY_STREAM_MAX_CONNS];
+
+static notify_stream_conn_t* find_conn(int conn_id, bool create) {
+    notify_stream_conn_t *unused = NULL;
+    for (int i = 0; i < NOTIFY_STREAM_MAX_CONNS; i++) {
+        if (!sConns[i].in_use) {
+            if (unused == NULL) unused = &sConns[i];
+        } else if (sConns[i].conn_id == conn_id) {
+            return &sConns[i];
+        }
+    }
+    if (!create || unused == NULL) return NULL;
+
+    memset(unused, 0, sizeof(*unused));
+    unused->in_use = true;
+    unused->conn_id = conn_id;
+    unused->mtu = NOTIFY_STREAM_DEFAULT_MTU;
+    return unused;
+}
+
+static void fill_progress(const notify_stream_conn_t *conn, notify_stream_progress_t *progress) {
+    progress->attr_handle = conn->attr_handle;
+    progress->status = conn->status;
+    progress->sent = conn->sent;
+    progress->total = conn->total;
+}
+
+static void end_stream(notify_stream_conn_t *conn) {
+    free(conn->value);
+    conn->value = NULL;
+    conn->streaming = false;
+}
+
+// Reports the end once nothing is in flight, otherwise the steps passed
+static int account(notify_stream_conn_t *conn, notify_stream_progress_t *progress) {
+    if (conn->in_flight == 0 && (conn->status != 0 || conn->sent == conn->total)) {
+        fill_progress(conn, progress);
+        end_stream(conn);
+        return NOTIFY_STREAM_DONE;
+    }
+
+    int step = conn->step;
+    while (conn->step < NOTIFY_STREAM_STEPS
+            && conn->sent >= conn->total * conn->step / NOTIFY_STREAM_STEPS) {
+        conn->step++;
+    }
+    if (conn->status != 0 || conn->step == step) return NOTIFY_STREAM_NONE;
+
+    fill_progress(conn, progress);
+    return NOTIFY_STREAM_PROGRESS;
+}
+
+void notify_stream_set_mtu(int conn_id, int mtu) {
+    pthread_mutex_lock(&sStreamLock);
+    notify_stream_conn_t *conn = find_conn(conn_id, true);
+    if (conn != NULL && mtu > NOTIFY_HEADER_LEN) conn->mtu = mtu;
+    pthread_mutex_unlock(&sStreamLock);
+}
+
+bool notify_stream_start(int conn_id, int server_if, int attr_handle, const uint8_t *value,
+                         size_t len) {
+    if (len == 0) return false;
+
+    uint8_t *copy = (uint8_t *) malloc(len);
+    if (copy == NULL) return false;
+    memcpy(copy, value, len);
+
+    pthread_mutex_lock(&sStreamLock);
+    notify_stream_conn_t *conn = find_conn(conn_id, true);
+    bool started = conn != NULL && !conn->streaming;
+    if (started) {
+        conn->streaming = true;
+        conn->server_if = server_if;
+        conn->attr_handle = attr_handle;
+        conn->value = copy;
+        conn->total = len;
+        conn->offset = 0;
+        conn->sent = 0;
+        conn->status = 0;
+        conn->step = 1;
+        conn->in_flight = 0;
+    }
+    pthread_mutex_unlock(&sStreamLock);
+
+    if (!started) free(copy);
+    return started;
+}
+
+bool notify_stream_next(int conn_id, notify_stream_chunk_t *chunk) {
+    bool found = false;
+
+    pthread_mutex_lock(&sStreamLock);
+    notify_stream_conn_t *conn = find_conn(conn_id, false);
+    if (conn != NULL && conn->streaming && !conn->congested && conn->status == 0
+            && conn->offset < conn->total && conn->in_flight < NOTIFY_STREAM_WINDOW) {
+        size_t len = conn->mtu - NOTIFY_HEADER_LEN;
+        if (len > conn->total - conn->offset) len = conn->total - conn->offset;
+
+        chunk->server_if = conn->server_if;
+        chunk->attr_handle = conn->attr_handle;
+        chunk->value = conn->value + conn->offset;
+        chunk->len = (int) len;
+        conn->chunk_lens[conn->in_flight++] = (int) len;
+        conn->offset += len;
+        found = true;
+    }
+    pthread_mutex_unlock(&sStreamLock);
+    return found;
+}
+
+int notify_stream_sent(int conn_id, int status, notify_stream_progress_t *progress) {
+    int result = NOTIFY_STREAM_NONE;
+
+    pthread_mutex_lock(&sStreamLock);
+    notify_stream_conn_t *conn = find_conn(conn_id, false);
+    if (conn != NULL && conn->streaming && conn->in_flight > 0) {
+        int len = conn->chunk_lens[0];
+        memmove(conn->chunk_lens, conn->chunk_lens + 1,
+                --conn->in_flight * sizeof(conn->chunk_lens[0]));
+
+        if (status == 0 || status == NOTIFY_STREAM_CONGESTED) {
+            conn->sent += len;
+        } else if (conn->status == 0) {
+            conn->status = status;
+        }
+        result = account(conn, progress);
+    }
+    pthread_mutex_unlock(&sStreamLock);
+    return result;
+}
+
+int notify_stream_unsent(int conn_id, notify_stream_progress_t *progress) {
+    int result = NOTIFY_STREAM_NONE;
+
+    pthread_mutex_lock(&sStreamLock);
+    notify_stream_conn_t *conn = find_conn(conn_id, false);
+    if (conn != NULL && conn->streaming && conn->in_flight > 0) {
+        conn->offset -= conn->chunk_lens[--conn->in_flight];
+        if (conn->status == 0) conn->status = NOTIFY_STREAM_ERROR;
+        result = account(conn, progress);
+    }
+    pthread_mutex_unlock(&sStreamLock);
+    return result;
+}
+
+void notify_stream_congested(int conn_id, bool congested) {
+    pthread_mutex_lock(&sStreamLock);
+    notify_stream_conn_t *conn = find_conn(conn_id, false);
+    if (conn != NULL) conn->congested = congested;
+    pthread_mutex_unlock(&sStreamLock);
+}
+
+bool notify_stream_close(int conn_id, notify_stream_progress_t *progress) {
+    bool cut = false;
+
+    pthread_mutex_lock(&sStreamLock);
+    notify_stream_conn_t *conn = find_conn(conn_id, false);
+    if (conn != NULL) {
+        if (conn->streaming) {
+            if (conn->status == 0) conn->status = NOTIFY_STREAM_ERROR;
+            fill_progress(conn, progress);
+            cut = true;
+        }
+        end_stream(conn);
+        conn->in_use = false;
+    }
+    pthread_mutex_unlock(&sStreamLock);
+    return cut;
+}
+
+void notify_stream_reset() {
+    pthread_mutex_lock(&sStreamLock);
+    for (int i = 0; i < NOTIFY_STREAM_MAX_CONNS; i++) {
+        if (sConns[i].in_use) end_stream(&sConns[i]);
+    }
+    memset(sConns, 0, sizeof(sConns));
+    pthread_mutex_unlock(&sStreamLock);
+}
+
+}
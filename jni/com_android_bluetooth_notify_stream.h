@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_NOTIFY_STREAM_H
+#define COM_ANDROID_BLUETOOTH_NOTIFY_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Values of a GATT server streamed to one connection as notifications.
+ *
+ * The value is copied once and handed out in chunks that fill a
+ * notification at the MTU of the connection, as last reported by the
+ * stack. Up to NOTIFY_STREAM_WINDOW chunks are in flight; none are handed
+ * out while the connection is congested. Progress is reported each time
+ * another 1/NOTIFY_STREAM_STEPS of the value was sent, and once at the
+ * end. A chunk that fails ends the stream once the chunks in flight are
+ * reported.
+ */
+
+#define NOTIFY_STREAM_MAX_CONNS     16
+#define NOTIFY_STREAM_WINDOW        4
+#define NOTIFY_STREAM_STEPS         10
+#define NOTIFY_STREAM_DEFAULT_MTU   23
+
+#define NOTIFY_STREAM_NONE          0
+#define NOTIFY_STREAM_PROGRESS      1
+#define NOTIFY_STREAM_DONE          2
+
+#define NOTIFY_STREAM_CONGESTED     0x8f    // GATT_CONGESTED, still queued by the stack
+#define NOTIFY_STREAM_ERROR         0x85    // GATT_ERROR
+#define NOTIFY_STREAM_FAILURE       0x101   // BluetoothGatt.GATT_FAILURE
+
+typedef struct {
+    int server_if;
+    int attr_handle;
+    const uint8_t *value;       // valid until the chunk is reported
+    int len;
+} notify_stream_chunk_t;
+
+typedef struct {
+    int attr_handle;
+    int status;
+    size_t sent;
+    size_t total;
+} notify_stream_progress_t;
+
+/*
+ * Records the MTU of conn_id for the chunks handed out from now on.
+ */
+void notify_stream_set_mtu(int conn_id, int mtu);
+
+/*
+ * Starts streaming value to conn_id. Returns false if value is empty,
+ * conn_id streams already or there is no room.
+ */
+bool notify_stream_start(int conn_id, int server_if, int attr_handle, const uint8_t *value,
+                         size_t len);
+
+/*
+ * Hands out the next chunk conn_id may send now. Returns false if there
+ * is none.
+ */
+bool notify_stream_next(int conn_id, notify_stream_chunk_t *chunk);
+
+/*
+ * Accounts the report of a chunk of conn_id. Returns
+ * NOTIFY_STREAM_PROGRESS or NOTIFY_STREAM_DONE with progress filled in if
+ * there is something to report, NOTIFY_STREAM_NONE otherwise.
+ */
+int notify_stream_sent(int conn_id, int status, notify_stream_progress_t *progress);
+
+/*
+ * Takes back the chunk last handed out for conn_id, which the stack did
+ * not accept, and fails the stream. Returns like notify_stream_sent().
+ */
+int notify_stream_unsent(int conn_id, notify_stream_progress_t *progress);
+
+/*
+ * Holds or resumes the stream of conn_id.
+ */
+void notify_stream_congested(int conn_id, bool congested);
+
+/*
+ * Forgets conn_id. Returns true with progress filled in if a stream was
+ * cut short.
+ */
+bool notify_stream_close(int conn_id, notify_stream_progress_t *progress);
+
+/*
+ * Forgets all connections and streams without reporting them.
+ */
+void notify_stream_reset();
+
+}
+
+#endif
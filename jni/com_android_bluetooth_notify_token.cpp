@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothNotifyTokenJni"
+
+#include "com_android_bluetooth_notify_token.h"
+#include "utils/Log.h"
+
+#include <string.h>
+#include <pthread.h>
+
+namespace android {
+
+#define TABLE_MASK  (NOTIFY_TOKEN_TABLE_SIZE - 1)
+
+typedef struct {
+    int conn_id;
+    uint8_t srvc_uuid[16];
+    uint8_t char_uuid[16];
+    uint8_t srvc_inst_id;
+    uint8_t is_primary;
+    uint8_t char_inst_id;
+    uint8_t unused;
+} notify_key_t;
+
+typedef struct {
+    bool in_use;
+    notify_key_t key;
+    int token;
+} notify_entry_t;
+
+static pthread_mutex_t sNotifyTokenLock = PTHREAD_MUTEX_INITIALIZER;
+static notify_entry_t sEntries[NOTIFY_TOKEN_TABLE_SIZE];
+static int sCount = 0;
+
+static void make_key(int conn_id, const btgatt_srvc_id_t *srvc_id,
+                     const btgatt_gatt_id_t *char_id, notify_key_t *key) {
+    memset(key, 0, sizeof(*key));
+    key->conn_id = conn_id;
+    memcpy(key->srvc_uuid, srvc_id->id.uuid.uu, sizeof(key->srvc_uuid));
+    memcpy(key->char_uuid, char_id->uuid.uu, sizeof(key->char_uuid));
+    key->srvc_inst_id = srvc_id->id.inst_id;
+    key->is_primary = srvc_id->is_primary ? 1 : 0;
+    key->char_inst_id = char_id->inst_id;
+}
+
+static uint32_t hash_key(const notify_key_t *key) {
+    const uint8_t *p = (const uint8_t *) key;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(*key); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Linear probing; returns the entry holding key, or the free entry ending its probe
+static notify_entry_t* find(const notify_key_t *key) {
+    uint32_t i = hash_key(key);
+    for (int n = 0; n < NOTIFY_TOKEN_TABLE_SIZE; n++, i++) {
+        notify_entry_t *e = &sEntries[i & TABLE_MASK];
+        if (!e->in_use || !memcmp(&e->key, key, sizeof(*key))) return e;
+    }
+    return NULL;
+}
+
+// Frees e and moves later entries of its probe sequence up, so no tombstones are needed
+static void erase(notify_entry_t *e) {
+    uint32_t hole = e - sEntries;
+    e->in_use = false;
+    sCount--;
+    for (uint32_t i = (hole + 1) & TABLE_MASK; sEntries[i].in_use; i = (i + 1) & TABLE_MASK) {
+        uint32_t home = hash_key(&sEntries[i].key) & TABLE_MASK;
+        // Move the entry if its home is not in (hole, i]
+        if (((i - home) & TABLE_MASK) >= ((i - hole) & TABLE_MASK)) {
+            sEntries[hole] = sEntries[i];
+            sEntries[i].in_use = false;
+            hole = i;
+        }
+    }
+}
+
+bool notify_token_add(int conn_id, const btgatt_srvc_id_t *srvc_id,
+                      const btgatt_gatt_id_t *char_id, int token) {
+    notify_key_t key;
+    make_key(conn_id, srvc_id, char_id, &key);
+
+    pthread_mutex_lock(&sNotifyTokenLock);
+    notify_entry_t *e = find(&key);
+    // Keep one entry free so every probe ends
+    if (e == NULL || (!e->in_use && sCount == NOTIFY_TOKEN_TABLE_SIZE - 1)) {
+        pthread_mutex_unlock(&sNotifyTokenLock);
+        ALOGW("%s: table full, conn_id %d keeps full notifications", __FUNCTION__, conn_id);
+        return false;
+    }
+    if (!e->in_use) {
+        e->in_use = true;
+        e->key = key;
+        sCount++;
+    }
+    e->token = token;
+    pthread_mutex_unlock(&sNotifyTokenLock);
+    return true;
+}
+
+void notify_token_remove(int conn_id, const btgatt_srvc_id_t *srvc_id,
+                         const btgatt_gatt_id_t *char_id) {
+    notify_key_t key;
+    make_key(conn_id, srvc_id, char_id, &key);
+
+    pthread_mutex_lock(&sNotifyTokenLock);
+    notify_entry_t *e = find(&key);
+    if (e != NULL && e->in_use) erase(e);
+    pthread_mutex_unlock(&sNotifyTokenLock);
+}
+
+void notify_token_remove_conn(int conn_id) {
+    pthread_mutex_lock(&sNotifyTokenLock);
+    if (conn_id == -1) {
+        memset(sEntries, 0, sizeof(sEntries));
+        sCount = 0;
+    } else {
+        // Erasing moves entries up, so look at the same index again
+        for (int i = 0; i < NOTIFY_TOKEN_TABLE_SIZE;) {
+            if (sEntries[i].in_use && sEntries[i].key.conn_id == conn_id) {
+                erase(&sEntries[i]);
+            } else {
+                i++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&sNotifyTokenLock);
+}
+
+int notify_token_lookup(int conn_id, const btgatt_srvc_id_t *srvc_id,
+                        const btgatt_gatt_id_t *char_id) {
+    // Read without the lock: most connections never register a token
+    if (sCount == 0) return NOTIFY_TOKEN_NONE;
+
+    notify_key_t key;
+    make_key(conn_id, srvc_id, char_id, &key);
+
+    pthread_mutex_lock(&sNotifyTokenLock);
+    notify_entry_t *e = find(&key);
+    int token = (e != NULL && e->in_use) ? e->token : NOTIFY_TOKEN_NONE;
+    pthread_mutex_unlock(&sNotifyTokenLock);
+    return token;
+}
+
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_NOTIFY_TOKEN_H
+#define COM_ANDROID_BLUETOOTH_NOTIFY_TOKEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hardware/bt_gatt.h"
+
+namespace android {
+
+/*
+ * Small integer tokens for notified characteristics.
+ *
+ * GattService hands out a token when a client registers for notifications
+ * and tells native code which (conn_id, service, characteristic) it stands
+ * for. Notifications of a registered characteristic are then delivered as
+ * the token and the value only, without the address string and the two
+ * expanded IDs; GattService keeps everything else behind the token.
+ */
+
+#define NOTIFY_TOKEN_TABLE_SIZE     256     // must be a power of two
+#define NOTIFY_TOKEN_NONE           (-1)
+
+/*
+ * Maps the characteristic to token, replacing an earlier mapping. Returns
+ * false if the table is full.
+ */
+bool notify_token_add(int conn_id, const btgatt_srvc_id_t *srvc_id,
+                      const btgatt_gatt_id_t *char_id, int token);
+
+/*
+ * Forgets the token of the characteristic.
+ */
+void notify_token_remove(int conn_id, const btgatt_srvc_id_t *srvc_id,
+                         const btgatt_gatt_id_t *char_id);
+
+/*
+ * Forgets every token of conn_id, or of every connection if conn_id is -1.
+ */
+void notify_token_remove_conn(int conn_id);
+
+/*
+ * Returns the token of the characteristic, or NOTIFY_TOKEN_NONE.
+ */
+int notify_token_lookup(int conn_id, const btgatt_srvc_id_t *srvc_id,
+                        const btgatt_gatt_id_t *char_id);
+
+}
+
+#endif
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothPrepWriteJni"
+
+#include "com_android_bluetooth_prep_write.h"
+#include "utils/Log.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+typedef struct {
+    int attr_handle;
+    int offset;
+    size_t start;               // in the queue's buffer
+    int len;
+} prep_write_run_t;
+
+typedef struct {
+    bool in_use;
+    int conn_id;
+    uint8_t *buf;               // sLimit bytes
+    size_t used;
+    int run_count;
+    prep_write_run_t runs[PREP_WRITE_MAX_RUNS];
+} prep_write_queue_t;
+
+static pthread_mutex_t sPrepWriteLock = PTHREAD_MUTEX_INITIALIZER;
+static size_t sLimit = 0;
+static prep_write_queue_t sQueues[PREP_WRITE_MAX_CONNS];
+
+static prep_write_queue_t* find_queue(int conn_id, bool create) {
+    prep_write_queue_t *unused = NULL;
+    for (int i = 0; i < PREP_WRITE_MAX_CONNS; i++) {
+        if (!sQueues[i].in_use) {
+            if (unused == NULL) unused = &sQueues[i];
+        } else if (sQueues[i].conn_id == conn_id) {
+            return &sQueues[i];
+        }
+    }
+    if (!create || unused == NULL) return NULL;
+
+    unused->buf = (uint8_t *) malloc(sLimit);
+    if (unused->buf == NULL) return NULL;
+    unused->in_use = true;
+    unused->conn_id = conn_id;
+    unused->used = 0;
+    unused->run_count = 0;
+    return unused;
+}
+
+static void free_queue(prep_write_queue_t *q) {
+    free(q->buf);
+    memset(q, 0, sizeof(*q));
+}
+
+void prep_write_set_limit(size_t max_bytes) {
+    pthread_mutex_lock(&sPrepWriteLock);
+    for (int i = 0; i < PREP_WRITE_MAX_CONNS; i++) {
+        if (sQueues[i].in_use) free_queue(&sQueues[i]);
+    }
+    sLimit = max_bytes;
+    pthread_mutex_unlock(&sPrepWriteLock);
+}
+
+int prep_write_add(int conn_id, int attr_handle, int offset, const uint8_t *value, int len) {
+    pthread_mutex_lock(&sPrepWriteLock);
+    if (sLimit == 0) {
+        pthread_mutex_unlock(&sPrepWriteLock);
+        return PREP_WRITE_DISABLED;
+    }
+
+    prep_write_queue_t *q = find_queue(conn_id, true);
+    if (q == NULL || len < 0 || (size_t) len > sLimit - q->used) {
+        pthread_mutex_unlock(&sPrepWriteLock);
+        return PREP_WRITE_QUEUE_FULL;
+    }
+
+    prep_write_run_t *run = q->run_count > 0 ? &q->runs[q->run_count - 1] : NULL;
+    if (run == NULL || run->attr_handle != attr_handle || run->offset + run->len != offset) {
+        if (q->run_count == PREP_WRITE_MAX_RUNS) {
+            pthread_mutex_unlock(&sPrepWriteLock);
+            return PREP_WRITE_QUEUE_FULL;
+        }
+        run = &q->runs[q->run_count++];
+        run->attr_handle = attr_handle;
+        run->offset = offset;
+        run->start = q->used;
+        run->len = 0;
+    }
+
+    memcpy(q->buf + q->used, value, len);
+    q->used += len;
+    run->len += len;
+    pthread_mutex_unlock(&sPrepWriteLock);
+    return PREP_WRITE_OK;
+}
+
+bool prep_write_execute(int conn_id, bool execute, prep_write_handler_t handler,
+                        void *context) {
+    pthread_mutex_lock(&sPrepWriteLock);
+    prep_write_queue_t *q = find_queue(conn_id, false);
+    if (q == NULL) {
+        pthread_mutex_unlock(&sPrepWriteLock);
+        return false;
+    }
+
+    // Deliver without the lock, from a copy the next fragment cannot touch
+    prep_write_queue_t taken = *q;
+    memset(q, 0, sizeof(*q));
+    pthread_mutex_unlock(&sPrepWriteLock);
+
+    for (int i = 0; execute && i < taken.run_count; i++) {
+        const prep_write_run_t *run = &taken.runs[i];
+        handler(context, run->attr_handle, run->offset, taken.buf + run->start, run->len);
+    }
+    free(taken.buf);
+    return true;
+}
+
+void prep_write_clear(int conn_id) {
+    pthread_mutex_lock(&sPrepWriteLock);
+    prep_write_queue_t *q = find_queue(conn_id, false);
+    if (q != NULL) free_queue(q);
+    pthread_mutex_unlock(&sPrepWriteLock);
+}
+
+}
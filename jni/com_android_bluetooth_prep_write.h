@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_PREP_WRITE_H
+#define COM_ANDROID_BLUETOOTH_PREP_WRITE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Prepared write queues of the GATT server, kept in native code.
+ *
+ * Each connection queues the fragments of its prepared writes. A
+ * fragment that continues the previous one of the same attribute is
+ * appended to it, anything else starts a new run. On execute the runs
+ * are handed over in the order they were started, one call per run; on
+ * cancel they are dropped. Every connection may queue up to a limit of
+ * bytes, after which fragments are refused with Prepare Queue Full.
+ */
+
+#define PREP_WRITE_MAX_CONNS        16
+#define PREP_WRITE_MAX_RUNS         64
+
+#define PREP_WRITE_OK               0
+#define PREP_WRITE_DISABLED         (-1)
+#define PREP_WRITE_QUEUE_FULL       0x09    // ATT error code
+
+typedef void (*prep_write_handler_t)(void *context, int attr_handle, int offset,
+                                     const uint8_t *value, int len);
+
+/*
+ * Sets the number of bytes a connection may queue, or turns the queues
+ * off if max_bytes is 0. Queued fragments are dropped.
+ */
+void prep_write_set_limit(size_t max_bytes);
+
+/*
+ * Queues a fragment. Returns PREP_WRITE_DISABLED if queues are off, in
+ * which case the caller handles the fragment itself, or the status to
+ * answer the fragment with.
+ */
+int prep_write_add(int conn_id, int attr_handle, int offset, const uint8_t *value, int len);
+
+/*
+ * Hands the runs of conn_id to handler if execute is set and empties the
+ * queue. Returns false if conn_id had nothing queued.
+ */
+bool prep_write_execute(int conn_id, bool execute, prep_write_handler_t handler,
+                        void *context);
+
+/*
+ * Drops the queue of conn_id.
+ */
+void prep_write_clear(int conn_id);
+
+}
+
+#endif
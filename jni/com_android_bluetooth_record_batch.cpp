@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothRecordBatchJni"
+
+#include "com_android_bluetooth.h"
+#include "com_android_bluetooth_record_batch.h"
+#include "android_runtime/AndroidRuntime.h"
+#include "utils/Log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+namespace android {
+
+typedef struct {
+    uint8_t *records;
+    int count;
+} batch_buffer_t;
+
+struct record_batch {
+    size_t record_len;
+    record_batch_handler_t handler;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // filling is appended to by the producer; delivering is owned by the
+    // delivery thread while the lock is not held
+    batch_buffer_t buffers[2];
+    batch_buffer_t *filling;
+    batch_buffer_t *delivering;
+
+    int window_ms;
+    int max_records;
+    struct timespec deadline;
+    bool flush_now;
+    bool stopping;
+
+    pthread_t thread;
+    char thread_name[32];
+};
+
+static void deadline_after(struct timespec *ts, int ms) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long) (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static bool batch_due(const record_batch_t *batch) {
+    return batch->flush_now || batch->stopping || batch->window_ms == 0 ||
+           batch->filling->count >= batch->max_records;
+}
+
+static void *record_batch_thread_main(void *arg) {
+    record_batch_t *batch = (record_batch_t *) arg;
+    JavaVM *vm = AndroidRuntime::getJavaVM();
+    JNIEnv *env = NULL;
+
+    JavaVMAttachArgs args;
+    args.version = JNI_VERSION_1_6;
+    args.name = batch->thread_name;
+    args.group = NULL;
+    if (vm->AttachCurrentThread(&env, &args) != JNI_OK) {
+        ALOGE("%s: unable to attach %s to VM", __FUNCTION__, batch->thread_name);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    for (;;) {
+        while (batch->filling->count == 0 && !batch->stopping) {
+            batch->flush_now = false;
+            pthread_cond_wait(&batch->cond, &batch->lock);
+        }
+        if (batch->filling->count == 0) break;
+
+        while (!batch_due(batch)) {
+            if (pthread_cond_timedwait(&batch->cond, &batch->lock, &batch->deadline) != 0) break;
+        }
+
+        batch_buffer_t *ready = batch->filling;
+        batch->filling = batch->delivering;
+        batch->delivering = ready;
+        batch->flush_now = false;
+        pthread_cond_broadcast(&batch->cond);
+        pthread_mutex_unlock(&batch->lock);
+
+        batch->handler(env, ready->records, ready->count);
+        checkAndClearExceptionFromCallback(env, __FUNCTION__);
+
+        pthread_mutex_lock(&batch->lock);
+        ready->count = 0;
+        pthread_cond_broadcast(&batch->cond);
+    }
+    pthread_mutex_unlock(&batch->lock);
+
+    vm->DetachCurrentThread();
+    return NULL;
+}
+
+record_batch_t* record_batch_create(const char *thread_name, size_t record_len,
+                                    record_batch_handler_t handler) {
+    record_batch_t *batch = (record_batch_t *) calloc(1, sizeof(record_batch_t));
+    if (batch == NULL) return NULL;
+
+    for (int i = 0; i < 2; i++) {
+        batch->buffers[i].records = (uint8_t *) malloc(record_len * RECORD_BATCH_MAX_RECORDS);
+        if (batch->buffers[i].records == NULL) {
+            free(batch->buffers[0].records);
+            free(batch);
+            return NULL;
+        }
+    }
+    batch->record_len = record_len;
+    batch->handler = handler;
+    batch->filling = &batch->buffers[0];
+    batch->delivering = &batch->buffers[1];
+    snprintf(batch->thread_name, sizeof(batch->thread_name), "%s", thread_name);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&batch->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&batch->lock, NULL);
+
+    if (pthread_create(&batch->thread, NULL, record_batch_thread_main, batch) != 0) {
+        ALOGE("%s: unable to start %s", __FUNCTION__, thread_name);
+        pthread_cond_destroy(&batch->cond);
+        pthread_mutex_destroy(&batch->lock);
+        free(batch->buffers[0].records);
+        free(batch->buffers[1].records);
+        free(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+void record_batch_destroy(record_batch_t *batch) {
+    if (batch == NULL) return;
+
+    pthread_mutex_lock(&batch->lock);
+    batch->stopping = true;
+    pthread_cond_broadcast(&batch->cond);
+    pthread_mutex_unlock(&batch->lock);
+    pthread_join(batch->thread, NULL);
+
+    pthread_cond_destroy(&batch->cond);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch->buffers[0].records);
+    free(batch->buffers[1].records);
+    free(batch);
+}
+
+void record_batch_configure(record_batch_t *batch, int window_ms, int max_records) {
+    if (window_ms < 0) window_ms = 0;
+    if (max_records < 0) max_records = 0;
+    if (max_records > RECORD_BATCH_MAX_RECORDS) max_records = RECORD_BATCH_MAX_RECORDS;
+    if (max_records == 0) window_ms = 0;
+
+    pthread_mutex_lock(&batch->lock);
+    batch->window_ms = window_ms;
+    batch->max_records = window_ms ? max_records : 0;
+    pthread_cond_broadcast(&batch->cond);
+    pthread_mutex_unlock(&batch->lock);
+}
+
+bool record_batch_add(record_batch_t *batch, const void *record) {
+    pthread_mutex_lock(&batch->lock);
+    if (batch->max_records == 0) {
+        pthread_mutex_unlock(&batch->lock);
+        return false;
+    }
+
+    // Both buffers are full: wait for the delivery thread to catch up
+    while (batch->filling->count >= batch->max_records && !batch->stopping) {
+        pthread_cond_wait(&batch->cond, &batch->lock);
+    }
+    if (batch->stopping) {
+        pthread_mutex_unlock(&batch->lock);
+        return false;
+    }
+
+    batch_buffer_t *buffer = batch->filling;
+    memcpy(buffer->records + buffer->count * batch->record_len, record, batch->record_len);
+    if (buffer->count++ == 0) {
+        deadline_after(&batch->deadline, batch->window_ms);
+        pthread_cond_broadcast(&batch->cond);
+    } else if (buffer->count >= batch->max_records) {
+        pthread_cond_broadcast(&batch->cond);
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return true;
+}
+
+void record_batch_flush(record_batch_t *batch) {
+    pthread_mutex_lock(&batch->lock);
+    batch->flush_now = true;
+    pthread_cond_broadcast(&batch->cond);
+    pthread_mutex_unlock(&batch->lock);
+}
+
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_RECORD_BATCH_H
+#define COM_ANDROID_BLUETOOTH_RECORD_BATCH_H
+
+#include "jni.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Accumulates fixed size records produced on the stack callback thread and
+ * hands them to Java in one upcall per batch.
+ *
+ * A batch is delivered from a dedicated thread attached to the VM once it
+ * holds max_records records, or window_ms after its first record arrived,
+ * whichever comes first. Two buffers are used so the producer keeps
+ * filling one while the other is being delivered; it only waits when both
+ * are full.
+ */
+
+#define RECORD_BATCH_MAX_RECORDS    256
+
+typedef void (*record_batch_handler_t)(JNIEnv *env, const uint8_t *records, int count);
+
+typedef struct record_batch record_batch_t;
+
+/*
+ * Creates a disabled batch for records of record_len bytes and starts its
+ * delivery thread. Returns NULL on failure.
+ */
+record_batch_t* record_batch_create(const char *thread_name, size_t record_len,
+                                    record_batch_handler_t handler);
+
+/*
+ * Delivers pending records, stops the delivery thread and frees the batch.
+ */
+void record_batch_destroy(record_batch_t *batch);
+
+/*
+ * Sets the flush window and record limit. A window or limit of 0 disables
+ * batching; records already accumulated are delivered right away. The
+ * limit is capped at RECORD_BATCH_MAX_RECORDS.
+ */
+void record_batch_configure(record_batch_t *batch, int window_ms, int max_records);
+
+/*
+ * Copies one record into the batch. Returns false if batching is disabled,
+ * in which case the caller delivers the record itself.
+ */
+bool record_batch_add(record_batch_t *batch, const void *record);
+
+/*
+ * Asks the delivery thread to deliver pending records now, without
+ * waiting for it to do so.
+ */
+void record_batch_flush(record_batch_t *batch);
+
+}
+
+#endif
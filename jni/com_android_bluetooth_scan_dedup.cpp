@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothScanDedupJni"
+
+#include "com_android_bluetooth_scan_dedup.h"
+#include "com_android_bluetooth_scan_filter.h"
+#include "utils/Log.h"
+#include "utils/SystemClock.h"
+
+#include <string.h>
+#include <pthread.h>
+
+namespace android {
+
+#define NS_PER_MS   1000000LL
+
+typedef struct {
+    bool in_use;
+    bt_bdaddr_t bda;
+    uint32_t hash;
+    int rssi;
+    int64_t last_seen;      // elapsedRealtimeNano() of the last result let through
+    uint64_t reported;      // slots the result went to since last_seen
+} scan_dedup_entry_t;
+
+static pthread_mutex_t sScanDedupLock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t sWindowNanos = 0;
+static int sRssiDelta = 0;
+static uint64_t sExemptClients = 0;
+static int sExemptUnslotted = 0;
+static scan_dedup_entry_t sEntries[SCAN_DEDUP_TABLE_SIZE];
+
+// FNV-1a, seeded with the address so the table index mixes in both keys
+static uint32_t hash_adv(const bt_bdaddr_t *bda, const uint8_t *adv_data, size_t len,
+                         uint32_t *bucket) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ adv_data[i]) * 16777619u;
+    }
+    uint32_t b = h;
+    for (size_t i = 0; i < sizeof(bda->address); i++) {
+        b = (b ^ bda->address[i]) * 16777619u;
+    }
+    *bucket = b;
+    return h;
+}
+
+void scan_dedup_configure(int window_ms, int rssi_delta) {
+    pthread_mutex_lock(&sScanDedupLock);
+    sWindowNanos = window_ms > 0 ? window_ms * NS_PER_MS : 0;
+    sRssiDelta = rssi_delta > 0 ? rssi_delta : 0;
+    sExemptClients = 0;
+    sExemptUnslotted = 0;
+    memset(sEntries, 0, sizeof(sEntries));
+    pthread_mutex_unlock(&sScanDedupLock);
+}
+
+void scan_dedup_reset() {
+    scan_dedup_configure(0, 0);
+}
+
+void scan_dedup_forget_slot(int slot) {
+    if (slot < 0 || slot >= SCAN_FILTER_MAX_CLIENTS) return;
+
+    pthread_mutex_lock(&sScanDedupLock);
+    sExemptClients &= ~(1ULL << slot);
+    for (int i = 0; i < SCAN_DEDUP_TABLE_SIZE; i++) {
+        sEntries[i].reported &= ~(1ULL << slot);
+    }
+    pthread_mutex_unlock(&sScanDedupLock);
+}
+
+void scan_dedup_set_exempt(int slot, bool exempt) {
+    if (slot >= SCAN_FILTER_MAX_CLIENTS) return;
+
+    pthread_mutex_lock(&sScanDedupLock);
+    if (slot < 0) {
+        sExemptUnslotted += exempt ? 1 : -1;
+        if (sExemptUnslotted < 0) sExemptUnslotted = 0;
+    } else if (exempt) {
+        sExemptClients |= 1ULL << slot;
+    } else {
+        sExemptClients &= ~(1ULL << slot);
+    }
+    pthread_mutex_unlock(&sScanDedupLock);
+}
+
+uint64_t scan_dedup_filter(const bt_bdaddr_t *bda, int rssi, const uint8_t *adv_data,
+                           size_t len, uint64_t clients) {
+    // Read without the lock: a stale value only delays turning suppression on
+    if (sWindowNanos == 0) return clients;
+
+    uint32_t bucket;
+    uint32_t hash = hash_adv(bda, adv_data, len, &bucket);
+    int64_t now = elapsedRealtimeNano();
+
+    pthread_mutex_lock(&sScanDedupLock);
+    if (sWindowNanos == 0 || sExemptUnslotted > 0) {
+        pthread_mutex_unlock(&sScanDedupLock);
+        return clients;
+    }
+
+    // Probe a few neighbouring entries, replacing the oldest if none matches
+    scan_dedup_entry_t *victim = NULL;
+    uint64_t result = clients;
+    for (int i = 0; i < SCAN_DEDUP_MAX_PROBES; i++) {
+        scan_dedup_entry_t *e = &sEntries[(bucket + i) & (SCAN_DEDUP_TABLE_SIZE - 1)];
+        if (e->in_use && e->hash == hash && !memcmp(&e->bda, bda, sizeof(*bda))) {
+            int delta = rssi > e->rssi ? rssi - e->rssi : e->rssi - rssi;
+            bool fresh = now - e->last_seen < sWindowNanos;
+            if (fresh && (sRssiDelta == 0 || delta < sRssiDelta)) {
+                // Only clients that have not had it yet, or want every repeat
+                result = clients & (sExemptClients | ~e->reported);
+                e->reported |= result;
+            } else {
+                e->rssi = rssi;
+                e->last_seen = now;
+                e->reported = clients;
+            }
+            pthread_mutex_unlock(&sScanDedupLock);
+            return result;
+        }
+        if (victim == NULL || !e->in_use ||
+                (victim->in_use && e->last_seen < victim->last_seen)) {
+            victim = e;
+        }
+    }
+
+    victim->in_use = true;
+    victim->bda = *bda;
+    victim->hash = hash;
+    victim->rssi = rssi;
+    victim->last_seen = now;
+    victim->reported = clients;
+    pthread_mutex_unlock(&sScanDedupLock);
+    return result;
+}
+
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_SCAN_DEDUP_H
+#define COM_ANDROID_BLUETOOTH_SCAN_DEDUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hardware/bluetooth.h"
+
+namespace android {
+
+/*
+ * Suppression of repeated scan results.
+ *
+ * A result is remembered by its address and a hash of its advertising
+ * data. The same advertisement seen again within the window is dropped
+ * for the clients it was already reported to, unless its RSSI moved by at
+ * least the configured delta. The table is shared, but each entry records
+ * the slots it went to, so a client that starts scanning mid-window still
+ * gets its first sighting. Clients marked as exempt keep receiving every
+ * result, so they retain all matches semantics. Slots are the ones handed
+ * out by scan_filter_register().
+ */
+
+#define SCAN_DEDUP_TABLE_SIZE       512     // must be a power of two
+#define SCAN_DEDUP_MAX_PROBES       8
+
+/*
+ * Sets the suppression window and the RSSI change that lets a repeat
+ * through anyway. A window of 0 turns suppression off. Forgets all
+ * remembered results and exemptions.
+ */
+void scan_dedup_configure(int window_ms, int rssi_delta);
+
+/*
+ * Turns suppression off and forgets all remembered results and exemptions.
+ */
+void scan_dedup_reset();
+
+/*
+ * Forgets the exemption of slot and which results were reported to it,
+ * for a slot handed to a new client.
+ */
+void scan_dedup_forget_slot(int slot);
+
+/*
+ * Marks the client in slot as exempt from suppression, or clears it. Slot
+ * -1 stands for clients without a filter slot; while any of them is
+ * exempt nothing is suppressed.
+ */
+void scan_dedup_set_exempt(int slot, bool exempt);
+
+/*
+ * Returns the subset of clients that should still receive the result.
+ */
+uint64_t scan_dedup_filter(const bt_bdaddr_t *bda, int rssi, const uint8_t *adv_data,
+                           size_t len, uint64_t clients);
+
+}
+
+#endif
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothScanFilterJni"
+
+#include "com_android_bluetooth_scan_filter.h"
+#include "com_android_bluetooth_adv_parser.h"
+#include "utils/Log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+namespace android {
+
+typedef struct {
+    bool in_use;
+    int client_if;
+    scan_filter_cond_t *conds;
+    int num_conds;
+} scan_filter_client_t;
+
+static pthread_mutex_t sScanFilterLock = PTHREAD_MUTEX_INITIALIZER;
+static scan_filter_client_t sScanFilterClients[SCAN_FILTER_MAX_CLIENTS];
+static int sScanFilterNextSlot = 0;
+static int sScanFilterOverflow = 0;
+
+static bool match_masked(const uint8_t *want, const uint8_t *mask, int len,
+                         const uint8_t *data, int data_len) {
+    if (data_len < len) return false;
+    for (int i = 0; i < len; i++) {
+        if ((want[i] ^ data[i]) & mask[i]) return false;
+    }
+    return true;
+}
+
+static bool match_cond(const scan_filter_cond_t *cond, const bt_bdaddr_t *bda,
+                       const uint8_t *adv, const adv_record_t *rec) {
+    switch (cond->type) {
+        case SCAN_FILTER_TYPE_DEVICE_ADDRESS:
+            return !memcmp(cond->address.address, bda->address, sizeof(bda->address));
+
+        case SCAN_FILTER_TYPE_SERVICE_UUID:
+            return adv_find_uuid(rec, &cond->uuid, &cond->uuid_mask) >= 0;
+
+        case SCAN_FILTER_TYPE_LOCAL_NAME:
+            return (rec->present & ADV_HAS_NAME) && rec->name.len == cond->data_len &&
+                   !memcmp(adv_span_data(adv, rec->name), cond->data, cond->data_len);
+
+        case SCAN_FILTER_TYPE_MANUFACTURER_DATA: {
+            const adv_manufacturer_data_t *field =
+                    adv_find_manufacturer_data(rec, (uint16_t) cond->company);
+            return field != NULL &&
+                   match_masked(cond->data, cond->mask, cond->data_len,
+                                adv_span_data(adv, field->data), field->data.len);
+        }
+
+        case SCAN_FILTER_TYPE_SERVICE_DATA: {
+            // ScanRecord only reports service data carried with a 16 bit UUID
+            const adv_service_data_t *field = adv_find_service_data(rec, &cond->uuid);
+            return field != NULL && field->uuid_len == 2 &&
+                   match_masked(cond->data, cond->mask, cond->data_len,
+                                adv_span_data(adv, field->data), field->data.len);
+        }
+
+        default:
+            return false;
+    }
+}
+
+static bool match_client(const scan_filter_client_t *client, const bt_bdaddr_t *bda,
+                         const uint8_t *adv, const adv_record_t *rec) {
+    if (client->num_conds == 0) return true;
+
+    int i = 0;
+    while (i < client->num_conds) {
+        int filter_index = client->conds[i].filter_index;
+        bool matched = true;
+        for (; i < client->num_conds && client->conds[i].filter_index == filter_index; i++) {
+            if (matched && !match_cond(&client->conds[i], bda, adv, rec)) matched = false;
+        }
+        if (matched) return true;
+    }
+    return false;
+}
+
+int scan_filter_register(int client_if) {
+    pthread_mutex_lock(&sScanFilterLock);
+
+    // Hand out slots round robin so a result still in flight for a client
+    // that just stopped is unlikely to carry the bit of its successor.
+    int slot = -1;
+    for (int i = 0; i < SCAN_FILTER_MAX_CLIENTS; i++) {
+        int candidate = (sScanFilterNextSlot + i) % SCAN_FILTER_MAX_CLIENTS;
+        if (!sScanFilterClients[candidate].in_use) {
+            slot = candidate;
+            break;
+        }
+    }
+
+    if (slot < 0) {
+        ALOGW("%s: no free slot for client %d, disabling native filtering", __FUNCTION__,
+              client_if);
+        sScanFilterOverflow++;
+    } else {
+        scan_filter_client_t *client = &sScanFilterClients[slot];
+        client->in_use = true;
+        client->client_if = client_if;
+        client->conds = NULL;
+        client->num_conds = 0;
+        sScanFilterNextSlot = (slot + 1) % SCAN_FILTER_MAX_CLIENTS;
+    }
+
+    pthread_mutex_unlock(&sScanFilterLock);
+    return slot;
+}
+
+void scan_filter_unregister(int slot) {
+    pthread_mutex_lock(&sScanFilterLock);
+    if (slot < 0) {
+        if (sScanFilterOverflow > 0) sScanFilterOverflow--;
+    } else if (slot < SCAN_FILTER_MAX_CLIENTS && sScanFilterClients[slot].in_use) {
+        scan_filter_client_t *client = &sScanFilterClients[slot];
+        free(client->conds);
+        memset(client, 0, sizeof(*client));
+    }
+    pthread_mutex_unlock(&sScanFilterLock);
+}
+
+bool scan_filter_add(int slot, const scan_filter_cond_t *cond) {
+    if (slot < 0 || slot >= SCAN_FILTER_MAX_CLIENTS) return false;
+
+    pthread_mutex_lock(&sScanFilterLock);
+    scan_filter_client_t *client = &sScanFilterClients[slot];
+    if (!client->in_use) {
+        pthread_mutex_unlock(&sScanFilterLock);
+        return false;
+    }
+
+    scan_filter_cond_t *conds = (scan_filter_cond_t *)
+            realloc(client->conds, (client->num_conds + 1) * sizeof(scan_filter_cond_t));
+    if (conds == NULL) {
+        pthread_mutex_unlock(&sScanFilterLock);
+        return false;
+    }
+    conds[client->num_conds++] = *cond;
+    client->conds = conds;
+
+    pthread_mutex_unlock(&sScanFilterLock);
+    return true;
+}
+
+uint64_t scan_filter_match(const bt_bdaddr_t *bda, const uint8_t *adv_data, size_t len) {
+    adv_record_t rec;
+    adv_parse(adv_data, len, &rec);
+
+    uint64_t matched = 0;
+    pthread_mutex_lock(&sScanFilterLock);
+    if (sScanFilterOverflow) {
+        matched = ~0ULL;
+    } else {
+        for (int i = 0; i < SCAN_FILTER_MAX_CLIENTS; i++) {
+            const scan_filter_client_t *client = &sScanFilterClients[i];
+            if (client->in_use && match_client(client, bda, adv_data, &rec)) matched |= 1ULL << i;
+        }
+    }
+    pthread_mutex_unlock(&sScanFilterLock);
+    return matched;
+}
+
+void scan_filter_reset() {
+    pthread_mutex_lock(&sScanFilterLock);
+    for (int i = 0; i < SCAN_FILTER_MAX_CLIENTS; i++) {
+        free(sScanFilterClients[i].conds);
+    }
+    memset(sScanFilterClients, 0, sizeof(sScanFilterClients));
+    sScanFilterNextSlot = 0;
+    sScanFilterOverflow = 0;
+    pthread_mutex_unlock(&sScanFilterLock);
+}
+
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_SCAN_FILTER_H
+#define COM_ANDROID_BLUETOOTH_SCAN_FILTER_H
+
+#include "hardware/bluetooth.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Software evaluation of the ScanFilters of regular scan clients.
+ *
+ * Each client registered here gets a slot, and scan_filter_match() returns
+ * a bitmask of the slots whose filters accept an advertisement. A client
+ * matches if any of its filters matches, and a filter matches if all of
+ * its conditions do, following ScanFilter.matches(). A client without
+ * conditions matches everything. Results that match no client never need
+ * to reach Java.
+ */
+
+#define SCAN_FILTER_MAX_CLIENTS     64
+#define SCAN_FILTER_MAX_DATA_LEN    62
+
+// Condition types, as in ScanFilterQueue
+#define SCAN_FILTER_TYPE_DEVICE_ADDRESS     0
+#define SCAN_FILTER_TYPE_SERVICE_UUID       2
+#define SCAN_FILTER_TYPE_LOCAL_NAME         4
+#define SCAN_FILTER_TYPE_MANUFACTURER_DATA  5
+#define SCAN_FILTER_TYPE_SERVICE_DATA       6
+
+typedef struct {
+    int type;
+    int filter_index;       // conditions with the same index form one filter
+    bt_bdaddr_t address;
+    bt_uuid_t uuid;         // service UUID, or service data UUID
+    bt_uuid_t uuid_mask;
+    int company;
+    uint8_t data[SCAN_FILTER_MAX_DATA_LEN];     // name, manufacturer or service data
+    uint8_t mask[SCAN_FILTER_MAX_DATA_LEN];
+    int data_len;
+} scan_filter_cond_t;
+
+/*
+ * Registers a client that matches everything until conditions are added.
+ * Returns its slot, or -1 if all slots are taken; every advertisement is
+ * then reported as matching all slots until the client is unregistered
+ * with slot -1.
+ */
+int scan_filter_register(int client_if);
+
+void scan_filter_unregister(int slot);
+
+/*
+ * Adds a condition to the client in slot. Conditions of a filter must be
+ * added one after another.
+ */
+bool scan_filter_add(int slot, const scan_filter_cond_t *cond);
+
+/*
+ * Returns the slots whose filters accept the advertisement.
+ */
+uint64_t scan_filter_match(const bt_bdaddr_t *bda, const uint8_t *adv_data, size_t len);
+
+/*
+ * Unregisters every client, including those that did not get a slot.
+ */
+void scan_filter_reset();
+
+}
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothScanRingJni"
+
+#include "com_android_bluetooth_scan_ring.h"
+#include "utils/Log.h"
+#include "utils/SystemClock.h"
+#include "cutils/atomic.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+namespace android {
+
+#define SCAN_RING_CAPACITY_OFFSET       0
+#define SCAN_RING_RECORD_SIZE_OFFSET    4
+#define SCAN_RING_DROPPED_OFFSET        8
+#define SCAN_RING_HEAD_OFFSET           64
+#define SCAN_RING_TAIL_OFFSET           128
+
+struct scan_ring {
+    uint8_t *buffer;
+    size_t size;
+    uint32_t mask;
+
+    // Views into the shared header
+    volatile int32_t *head;
+    volatile int32_t *tail;
+    volatile int32_t *dropped;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    volatile int32_t waiting;
+    bool stopping;
+};
+
+scan_ring_t* scan_ring_create(int capacity) {
+    uint32_t records = 1;
+    while (records < (uint32_t) capacity) records <<= 1;
+
+    scan_ring_t *ring = (scan_ring_t *) calloc(1, sizeof(scan_ring_t));
+    if (ring == NULL) return NULL;
+
+    ring->size = SCAN_RING_HEADER_SIZE + records * SCAN_RING_RECORD_SIZE;
+    ring->buffer = (uint8_t *) calloc(1, ring->size);
+    if (ring->buffer == NULL) {
+        free(ring);
+        return NULL;
+    }
+    ring->mask = records - 1;
+    ring->head = (volatile int32_t *) (ring->buffer + SCAN_RING_HEAD_OFFSET);
+    ring->tail = (volatile int32_t *) (ring->buffer + SCAN_RING_TAIL_OFFSET);
+    ring->dropped = (volatile int32_t *) (ring->buffer + SCAN_RING_DROPPED_OFFSET);
+    *(int32_t *) (ring->buffer + SCAN_RING_CAPACITY_OFFSET) = (int32_t) records;
+    *(int32_t *) (ring->buffer + SCAN_RING_RECORD_SIZE_OFFSET) = SCAN_RING_RECORD_SIZE;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ring->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&ring->lock, NULL);
+    return ring;
+}
+
+void scan_ring_destroy(scan_ring_t *ring) {
+    if (ring == NULL) return;
+
+    pthread_cond_destroy(&ring->cond);
+    pthread_mutex_destroy(&ring->lock);
+    free(ring->buffer);
+    free(ring);
+}
+
+void* scan_ring_get_buffer(scan_ring_t *ring, size_t *size) {
+    *size = ring->size;
+    return ring->buffer;
+}
+
+bool scan_ring_put(scan_ring_t *ring, const bt_bdaddr_t *bda, int rssi,
+                   const uint8_t *adv_data, uint64_t clients) {
+    uint32_t head = (uint32_t) *ring->head;
+    if (head - (uint32_t) android_atomic_acquire_load(ring->tail) > ring->mask) {
+        android_atomic_inc(ring->dropped);
+        return false;
+    }
+
+    uint8_t *record = ring->buffer + SCAN_RING_HEADER_SIZE +
+                      (head & ring->mask) * SCAN_RING_RECORD_SIZE;
+    int64_t timestamp = elapsedRealtimeNano();
+    memcpy(record, bda->address, sizeof(bda->address));
+    record[6] = (uint8_t) rssi;
+    memcpy(record + 8, &timestamp, sizeof(timestamp));
+    memcpy(record + 16, adv_data, SCAN_RING_ADV_DATA_LEN);
+    memcpy(record + 80, &clients, sizeof(clients));
+
+    android_atomic_release_store((int32_t) (head + 1), ring->head);
+
+    // Pairs with the barrier in scan_ring_wait(): either the reader sees the
+    // new head or we see that it is waiting.
+    android_memory_barrier();
+    if (android_atomic_acquire_load(&ring->waiting)) {
+        pthread_mutex_lock(&ring->lock);
+        pthread_cond_signal(&ring->cond);
+        pthread_mutex_unlock(&ring->lock);
+    }
+    return true;
+}
+
+int64_t scan_ring_wait(scan_ring_t *ring, int consumed, int timeout_ms) {
+    android_atomic_release_store(consumed, ring->tail);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    android_atomic_release_store(1, &ring->waiting);
+    android_memory_barrier();
+
+    int32_t head = android_atomic_acquire_load(ring->head);
+    while (head == consumed && !ring->stopping) {
+        if (pthread_cond_timedwait(&ring->cond, &ring->lock, &deadline) == ETIMEDOUT) break;
+        head = android_atomic_acquire_load(ring->head);
+    }
+
+    android_atomic_release_store(0, &ring->waiting);
+    bool stopping = ring->stopping;
+    pthread_mutex_unlock(&ring->lock);
+    return stopping ? -1 : (int64_t) (uint32_t) head;
+}
+
+void scan_ring_stop(scan_ring_t *ring) {
+    pthread_mutex_lock(&ring->lock);
+    ring->stopping = true;
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+}
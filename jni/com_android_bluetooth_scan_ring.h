@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_SCAN_RING_H
+#define COM_ANDROID_BLUETOOTH_SCAN_RING_H
+
+#include "hardware/bluetooth.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Scan result ring shared with GattService through a direct ByteBuffer.
+ *
+ * The stack callback thread writes fixed size records and publishes them by
+ * advancing the producer index; a Java thread reads them in place and hands
+ * back its consumer index through scan_ring_wait(). No Java objects are
+ * created on the native side. When the ring is full new results are dropped
+ * and counted rather than stalling the stack.
+ *
+ * Layout (native byte order), mirrored by GattService:
+ *
+ *   header   0  capacity in records
+ *            4  record size
+ *            8  results dropped because the ring was full
+ *           64  producer index
+ *          128  consumer index
+ *   records at SCAN_RING_HEADER_SIZE, each SCAN_RING_RECORD_SIZE bytes:
+ *            0  remote address (6 bytes)
+ *            6  RSSI, signed
+ *            8  elapsed realtime of reception in nanoseconds (8 bytes)
+ *           16  advertising data (SCAN_RING_ADV_DATA_LEN bytes)
+ *           80  scan_filter_match() slots the result matched (8 bytes)
+ */
+
+#define SCAN_RING_HEADER_SIZE       192
+#define SCAN_RING_RECORD_SIZE       88
+#define SCAN_RING_ADV_DATA_LEN      62
+
+typedef struct scan_ring scan_ring_t;
+
+/*
+ * Allocates a ring of capacity records, rounded up to a power of two.
+ * Returns NULL on failure.
+ */
+scan_ring_t* scan_ring_create(int capacity);
+
+/*
+ * Frees the ring. The Java reader must have stopped touching the buffer.
+ */
+void scan_ring_destroy(scan_ring_t *ring);
+
+/*
+ * Returns the shared memory backing the ring and its size in bytes.
+ */
+void* scan_ring_get_buffer(scan_ring_t *ring, size_t *size);
+
+/*
+ * Appends one result. Returns false if the ring was full and the result
+ * was dropped.
+ */
+bool scan_ring_put(scan_ring_t *ring, const bt_bdaddr_t *bda, int rssi,
+                   const uint8_t *adv_data, uint64_t clients);
+
+/*
+ * Publishes consumed as the consumer index, then waits up to timeout_ms for
+ * records past it. Returns the producer index as an unsigned 32 bit value,
+ * or -1 once the ring has been stopped.
+ */
+int64_t scan_ring_wait(scan_ring_t *ring, int consumed, int timeout_ms);
+
+/*
+ * Wakes the reader and makes every later scan_ring_wait() return -1.
+ */
+void scan_ring_stop(scan_ring_t *ring);
+
+}
+
+#endif
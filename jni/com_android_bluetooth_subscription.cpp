@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothSubscriptionJni"
+
+#include "com_android_bluetooth_subscription.h"
+#include "utils/Log.h"
+
+#include <pthread.h>
+#include <string.h>
+
+namespace android {
+
+#define CCCD_NOTIFY         0x0001
+#define CCCD_INDICATE       0x0002
+#define BITMAP_WORDS        ((SUBSCRIPTION_MAX_CCCDS + 31) / 32)
+#define CCCD_LEN            2
+
+typedef struct {
+    bool in_use;
+    int srvc_handle;
+    int char_handle;
+    int cccd_handle;
+} subscription_cccd_t;
+
+typedef struct {
+    int cccd_handle;
+    uint8_t value[CCCD_LEN];
+    uint8_t written;                    // bit i set once value[i] was prepared
+} subscription_prepared_t;
+
+typedef struct {
+    int trans_id;
+    int cccd_handle;
+    uint16_t config;
+} subscription_pending_t;
+
+typedef struct {
+    bool in_use;
+    int conn_id;
+    uint32_t notify[BITMAP_WORDS];      // bit i stands for sCccds[i]
+    uint32_t indicate[BITMAP_WORDS];
+    subscription_prepared_t prepared[SUBSCRIPTION_MAX_PREPARED];
+    int num_prepared;
+    subscription_pending_t pending[SUBSCRIPTION_MAX_PENDING];
+    int num_pending;
+} subscription_conn_t;
+
+static pthread_mutex_t sSubscriptionLock = PTHREAD_MUTEX_INITIALIZER;
+static bool sFilter = false;
+static int sLastSrvcHandle = 0;
+static int sLastCharHandle = 0;
+static subscription_cccd_t sCccds[SUBSCRIPTION_MAX_CCCDS];
+static subscription_conn_t sConns[SUBSCRIPTION_MAX_CONNS];
+
+static subscription_conn_t* find_conn(int conn_id, bool create) {
+    subscription_conn_t *unused = NULL;
+    for (int i = 0; i < SUBSCRIPTION_MAX_CONNS; i++) {
+        if (!sConns[i].in_use) {
+            if (unused == NULL) unused = &sConns[i];
+        } else if (sConns[i].conn_id == conn_id) {
+            return &sConns[i];
+        }
+    }
+    if (!create || unused == NULL) return NULL;
+
+    memset(unused, 0, sizeof(*unused));
+    unused->in_use = true;
+    unused->conn_id = conn_id;
+    return unused;
+}
+
+static void set_bit(uint32_t *bitmap, int i, bool set) {
+    if (set) {
+        bitmap[i / 32] |= 1u << (i % 32);
+    } else {
+        bitmap[i / 32] &= ~(1u << (i % 32));
+    }
+}
+
+static bool get_bit(const uint32_t *bitmap, int i) {
+    return (bitmap[i / 32] & (1u << (i % 32))) != 0;
+}
+
+void subscription_set_filter(bool filter) {
+    pthread_mutex_lock(&sSubscriptionLock);
+    sFilter = filter;
+    pthread_mutex_unlock(&sSubscriptionLock);
+}
+
+void subscription_characteristic_added(int srvc_handle, int char_handle) {
+    pthread_mutex_lock(&sSubscriptionLock);
+    sLastSrvcHandle = srvc_handle;
+    sLastCharHandle = char_handle;
+    pthread_mutex_unlock(&sSubscriptionLock);
+}
+
+void subscription_descriptor_added(int srvc_handle, int descr_handle, bool is_cccd) {
+    if (!is_cccd) return;
+
+    pthread_mutex_lock(&sSubscriptionLock);
+    if (srvc_handle == sLastSrvcHandle && sLastCharHandle != 0) {
+        int i = 0;
+        while (i < SUBSCRIPTION_MAX_CCCDS && sCccds[i].in_use) i++;
+        if (i < SUBSCRIPTION_MAX_CCCDS) {
+            sCccds[i].in_use = true;
+            sCccds[i].srvc_handle = srvc_handle;
+            sCccds[i].char_handle = sLastCharHandle;
+            sCccds[i].cccd_handle = descr_handle;
+        } else {
+            ALOGW("%s: too many descriptors, handle %d not filtered", __FUNCTION__,
+                  sLastCharHandle);
+        }
+    }
+    pthread_mutex_unlock(&sSubscriptionLock);
+}
+
+void subscription_service_deleted(int srvc_handle) {
+    pthread_mutex_lock(&sSubscriptionLock);
+    for (int i = 0; i < SUBSCRIPTION_MAX_CCCDS; i++) {
+        if (!sCccds[i].in_use || sCccds[i].srvc_handle != srvc_handle) continue;
+        memset(&sCccds[i], 0, sizeof(sCccds[i]));
+        for (int c = 0; c < SUBSCRIPTION_MAX_CONNS; c++) {
+            set_bit(sConns[c].notify, i, false);
+            set_bit(sConns[c].indicate, i, false);
+        }
+    }
+    if (srvc_handle == sLastSrvcHandle) sLastCharHandle = 0;
+    pthread_mutex_unlock(&sSubscriptionLock);
+}
+
+static int find_cccd(int attr_handle) {
+    for (int i = 0; i < SUBSCRIPTION_MAX_CCCDS; i++) {
+        if (sCccds[i].in_use && sCccds[i].cccd_handle == attr_handle) return i;
+    }
+    return -1;
+}
+
+static void write_locked(int conn_id, int attr_handle, uint16_t config) {
+    int i = find_cccd(attr_handle);
+    if (i < 0) return;
+
+    subscription_conn_t *conn = find_conn(conn_id, config != 0);
+    if (conn != NULL) {
+        set_bit(conn->notify, i, (config & CCCD_NOTIFY) != 0);
+        set_bit(conn->indicate, i, (config & CCCD_INDICATE) != 0);
+    } else if (config != 0) {
+        ALOGW("%s: too many connections, conn_id %d not recorded", __FUNCTION__, conn_id);
+    }
+}
+
+// An unanswered write makes way for a newer one
+static void add_pending_locked(int conn_id, int trans_id, int attr_handle, uint16_t config) {
+    subscription_conn_t *conn = find_conn(conn_id, true);
+    if (conn == NULL) {
+        ALOGW("%s: too many connections, conn_id %d not recorded", __FUNCTION__, conn_id);
+        return;
+    }
+    if (conn->num_pending == SUBSCRIPTION_MAX_PENDING) {
+        memmove(&conn->pending[0], &conn->pending[1],
+                (SUBSCRIPTION_MAX_PENDING - 1) * sizeof(conn->pending[0]));
+        conn->num_pending--;
+    }
+    subscription_pending_t *p = &conn->pending[conn->num_pending++];
+    p->trans_id = trans_id;
+    p->cccd_handle = attr_handle;
+    p->config = config;
+}
+
+void subscription_write(int conn_id, int trans_id, int attr_handle, const uint8_t *value,
+                        int len, bool need_rsp) {
+    if (len < CCCD_LEN) return;
+
+    uint16_t config = value[0] | (value[1] << 8);
+    pthread_mutex_lock(&sSubscriptionLock);
+    if (!need_rsp) {
+        write_locked(conn_id, attr_handle, config);
+    } else if (find_cccd(attr_handle) >= 0) {
+        add_pending_locked(conn_id, trans_id, attr_handle, config);
+    }
+    pthread_mutex_unlock(&sSubscriptionLock);
+}
+
+void subscription_prepare_write(int conn_id, int attr_handle, int offset,
+                                const uint8_t *value, int len) {
+    if (offset < 0 || offset >= CCCD_LEN || len <= 0) return;
+
+    pthread_mutex_lock(&sSubscriptionLock);
+    subscription_conn_t *conn = find_cccd(attr_handle) >= 0 ? find_conn(conn_id, true) : NULL;
+    if (conn != NULL) {
+        subscription_prepared_t *p = NULL;
+        for (int i = 0; i < conn->num_prepared; i++) {
+            if (conn->prepared[i].cccd_handle == attr_handle) p = &conn->prepared[i];
+        }
+        if (p == NULL && conn->num_prepared < SUBSCRIPTION_MAX_PREPARED) {
+            p = &conn->prepared[conn->num_prepared++];
+            memset(p, 0, sizeof(*p));
+            p->cccd_handle = attr_handle;
+        }
+        if (p != NULL) {
+            for (int i = offset; i < CCCD_LEN && i - offset < len; i++) {
+                p->value[i] = value[i - offset];
+                p->written |= 1 << i;
+            }
+        } else {
+            ALOGW("%s: too many prepared descriptors, handle %d not recorded", __FUNCTION__,
+                  attr_handle);
+        }
+    }
+    pthread_mutex_unlock(&sSubscriptionLock);
+}
+
+void subscription_execute_write(int conn_id, int trans_id, bool execute) {
+    pthread_mutex_lock(&sSubscriptionLock);
+    subscription_conn_t *conn = find_conn(conn_id, false);
+    if (conn != NULL) {
+        int num_prepared = conn->num_prepared;
+        conn->num_prepared = 0;
+        for (int i = 0; execute && i < num_prepared; i++) {
+            const subscription_prepared_t *p = &conn->prepared[i];
+            if (p->written != (1 << CCCD_LEN) - 1) continue;
+            add_pending_locked(conn_id, trans_id, p->cccd_handle,
+                               p->value[0] | (p->value[1] << 8));
+        }
+    }
+    pthread_mutex_unlock(&sSubscriptionLock);
+}
+
+void subscription_respond(int conn_id, int trans_id, bool success) {
+    pthread_mutex_lock(&sSubscriptionLock);
+    subscription_conn_t *conn = find_conn(conn_id, false);
+    if (conn != NULL) {
+        int kept = 0;
+        for (int i = 0; i < conn->num_pending; i++) {
+            subscription_pending_t p = conn->pending[i];
+            if (p.trans_id != trans_id) {
+                conn->pending[kept++] = p;
+            } else if (success) {
+                write_locked(conn_id, p.cccd_handle, p.config);
+            }
+        }
+        conn->num_pending = kept;
+    }
+    pthread_mutex_unlock(&sSubscriptionLock);
+}
+
+void subscription_clear(int conn_id) {
+    pthread_mutex_lock(&sSubscriptionLock);
+    subscription_conn_t *conn = find_conn(conn_id, false);
+    if (conn != NULL) memset(conn, 0, sizeof(*conn));
+    pthread_mutex_unlock(&sSubscriptionLock);
+}
+
+bool subscription_allowed(int conn_id, int char_handle, bool indicate) {
+    bool allowed = true;
+
+    pthread_mutex_lock(&sSubscriptionLock);
+    if (sFilter) {
+        for (int i = 0; i < SUBSCRIPTION_MAX_CCCDS; i++) {
+            if (!sCccds[i].in_use || sCccds[i].char_handle != char_handle) continue;
+
+            subscription_conn_t *conn = find_conn(conn_id, false);
+            allowed = conn != NULL && get_bit(indicate ? conn->indicate : conn->notify, i);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sSubscriptionLock);
+    return allowed;
+}
+
+void subscription_reset() {
+    pthread_mutex_lock(&sSubscriptionLock);
+    sFilter = false;
+    sLastSrvcHandle = 0;
+    sLastCharHandle = 0;
+    memset(sCccds, 0, sizeof(sCccds));
+    memset(sConns, 0, sizeof(sConns));
+    pthread_mutex_unlock(&sSubscriptionLock);
+}
+
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_SUBSCRIPTION_H
+#define COM_ANDROID_BLUETOOTH_SUBSCRIPTION_H
+
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Notification and indication subscriptions of the clients of the GATT
+ * servers.
+ *
+ * Client Characteristic Configuration descriptors are recorded as the
+ * servers add them, each belonging to the characteristic added before it
+ * in the same service. Writes of clients to such a descriptor set or
+ * clear the characteristic in the notify and indicate bitmaps of the
+ * connection, whether written directly or prepared and executed;
+ * disconnecting clears them. A write that needs a response only takes
+ * effect once the server accepted it, by responding with success to its
+ * transaction, or to the execute write it was prepared for. Once filtering is on, values of
+ * a characteristic with a recorded descriptor only go to connections that
+ * subscribed to them. Characteristics without one are never filtered.
+ */
+
+#define SUBSCRIPTION_MAX_CCCDS      128
+#define SUBSCRIPTION_MAX_CONNS      64
+#define SUBSCRIPTION_MAX_PREPARED   4       // descriptors a connection may prepare
+#define SUBSCRIPTION_MAX_PENDING    4       // writes of a connection awaiting a response
+
+/*
+ * Turns filtering on or off. Subscriptions are recorded either way.
+ */
+void subscription_set_filter(bool filter);
+
+/*
+ * Records a characteristic added to srvc_handle.
+ */
+void subscription_characteristic_added(int srvc_handle, int char_handle);
+
+/*
+ * Records a descriptor added to srvc_handle. Only Client Characteristic
+ * Configuration descriptors are kept.
+ */
+void subscription_descriptor_added(int srvc_handle, int descr_handle, bool is_cccd);
+
+/*
+ * Forgets the descriptors of srvc_handle and every subscription to them.
+ */
+void subscription_service_deleted(int srvc_handle);
+
+/*
+ * Records a write of conn_id to attr_handle if it is a recorded
+ * descriptor. It is applied right away unless need_rsp is set, in which
+ * case it waits for the response to trans_id.
+ */
+void subscription_write(int conn_id, int trans_id, int attr_handle, const uint8_t *value,
+                        int len, bool need_rsp);
+
+/*
+ * Records a prepared write of conn_id to attr_handle if it is a recorded
+ * descriptor. The execute write trans_id of conn_id hands its prepared
+ * writes on like subscription_write() if execute is set, or drops them.
+ */
+void subscription_prepare_write(int conn_id, int attr_handle, int offset,
+                                const uint8_t *value, int len);
+void subscription_execute_write(int conn_id, int trans_id, bool execute);
+
+/*
+ * Applies the writes of conn_id waiting for the response to trans_id if
+ * success is set, or drops them.
+ */
+void subscription_respond(int conn_id, int trans_id, bool success);
+
+/*
+ * Forgets the subscriptions of conn_id.
+ */
+void subscription_clear(int conn_id);
+
+/*
+ * Returns whether a notification, or an indication if indicate is set,
+ * of char_handle may go to conn_id.
+ */
+bool subscription_allowed(int conn_id, int char_handle, bool indicate);
+
+/*
+ * Forgets all descriptors and subscriptions and turns filtering off.
+ */
+void subscription_reset();
+
+}
+
+#endif
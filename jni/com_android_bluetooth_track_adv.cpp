@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothTrackAdvJni"
+
+#include "com_android_bluetooth.h"
+#include "com_android_bluetooth_track_adv.h"
+#include "android_runtime/AndroidRuntime.h"
+#include "utils/Log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+namespace android {
+
+#define WHEEL_MASK      (TRACK_ADV_WHEEL_SLOTS - 1)
+#define NO_ENTRY        (-1)
+#define TICK_NEVER      ((int64_t) 0x7fffffffffffffffLL)
+
+enum {
+    ENTRY_FREE = 0,
+    ENTRY_PENDING,      // seen, but not often enough yet to be found
+    ENTRY_FOUND,
+};
+
+typedef struct {
+    bool active;
+    int client_if;
+    int found_timeout_ms;
+    int lost_timeout_ms;
+    int found_count;
+} track_filter_t;
+
+typedef struct {
+    bt_bdaddr_t bda;
+    int filt_index;
+    int state;
+    int sightings;
+    int64_t first_seen_ms;
+    int64_t deadline_ms;
+    int64_t filed_tick;     // wheel tick the entry is filed under
+    int hash_next;          // also links the free list
+    int wheel_prev;
+    int wheel_next;
+} track_entry_t;
+
+struct track_adv {
+    track_adv_handler_t handler;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    track_filter_t filters[TRACK_ADV_MAX_FILTERS];
+    track_entry_t entries[TRACK_ADV_MAX_ENTRIES];
+    int buckets[TRACK_ADV_MAX_ENTRIES];
+    int wheel[TRACK_ADV_WHEEL_SLOTS];
+    int free_head;
+    int num_tracked;
+
+    // Ticks up to last_tick have been processed; the thread sleeps until
+    // wakeup_tick, or indefinitely if it is TICK_NEVER
+    int64_t last_tick;
+    int64_t wakeup_tick;
+
+    track_adv_event_t events[TRACK_ADV_MAX_EVENTS];
+    int num_events;
+    int dropped_events;
+    bool stopping;
+
+    pthread_t thread;
+    char thread_name[32];
+};
+
+static int64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Entries expire on the first tick at or after their deadline
+static int64_t deadline_tick(int64_t deadline_ms) {
+    return (deadline_ms + TRACK_ADV_TICK_MS - 1) / TRACK_ADV_TICK_MS;
+}
+
+static int hash_key(const bt_bdaddr_t *bda, int filt_index) {
+    uint32_t h = 2166136261u ^ (uint32_t) filt_index;
+    for (size_t i = 0; i < sizeof(bda->address); i++) {
+        h = (h ^ bda->address[i]) * 16777619u;
+    }
+    return (int) (h & (TRACK_ADV_MAX_ENTRIES - 1));
+}
+
+static void wheel_unlink(track_adv_t *t, int i) {
+    track_entry_t *e = &t->entries[i];
+    if (e->wheel_prev != NO_ENTRY) {
+        t->entries[e->wheel_prev].wheel_next = e->wheel_next;
+    } else {
+        t->wheel[e->filed_tick & WHEEL_MASK] = e->wheel_next;
+    }
+    if (e->wheel_next != NO_ENTRY) t->entries[e->wheel_next].wheel_prev = e->wheel_prev;
+}
+
+static void wheel_file(track_adv_t *t, int i) {
+    track_entry_t *e = &t->entries[i];
+    int64_t tick = deadline_tick(e->deadline_ms);
+    if (tick <= t->last_tick) tick = t->last_tick + 1;
+
+    int slot = (int) (tick & WHEEL_MASK);
+    e->filed_tick = tick;
+    e->wheel_prev = NO_ENTRY;
+    e->wheel_next = t->wheel[slot];
+    if (e->wheel_next != NO_ENTRY) t->entries[e->wheel_next].wheel_prev = i;
+    t->wheel[slot] = i;
+
+    if (tick < t->wakeup_tick) {
+        t->wakeup_tick = tick;
+        pthread_cond_signal(&t->cond);
+    }
+}
+
+static int entry_find(const track_adv_t *t, const bt_bdaddr_t *bda, int filt_index) {
+    for (int i = t->buckets[hash_key(bda, filt_index)]; i != NO_ENTRY;
+            i = t->entries[i].hash_next) {
+        const track_entry_t *e = &t->entries[i];
+        if (e->filt_index == filt_index && !memcmp(&e->bda, bda, sizeof(*bda))) return i;
+    }
+    return NO_ENTRY;
+}
+
+static int entry_alloc(track_adv_t *t, const bt_bdaddr_t *bda, int filt_index) {
+    int i = t->free_head;
+    if (i == NO_ENTRY) return NO_ENTRY;
+
+    track_entry_t *e = &t->entries[i];
+    t->free_head = e->hash_next;
+    int bucket = hash_key(bda, filt_index);
+    e->bda = *bda;
+    e->filt_index = filt_index;
+    e->state = ENTRY_PENDING;
+    e->sightings = 0;
+    e->hash_next = t->buckets[bucket];
+    t->buckets[bucket] = i;
+    t->num_tracked++;
+    return i;
+}
+
+static void entry_free(track_adv_t *t, int i) {
+    track_entry_t *e = &t->entries[i];
+    int *link = &t->buckets[hash_key(&e->bda, e->filt_index)];
+    while (*link != i) link = &t->entries[*link].hash_next;
+    *link = e->hash_next;
+
+    wheel_unlink(t, i);
+    e->state = ENTRY_FREE;
+    e->hash_next = t->free_head;
+    t->free_head = i;
+    t->num_tracked--;
+}
+
+static bool add_event(track_adv_t *t, const track_entry_t *e, int adv_state) {
+    if (t->num_events == TRACK_ADV_MAX_EVENTS) return false;
+
+    track_adv_event_t *ev = &t->events[t->num_events++];
+    ev->client_if = t->filters[e->filt_index].client_if;
+    ev->filt_index = e->filt_index;
+    ev->bda = e->bda;
+    ev->adv_state = adv_state;
+    return true;
+}
+
+/*
+ * Expires or re-files the entries of one wheel slot. Returns false if the
+ * event buffer filled up first; the slot is then walked again once the
+ * events have been delivered.
+ */
+static bool process_tick(track_adv_t *t, int64_t tick) {
+    int i = t->wheel[tick & WHEEL_MASK];
+    while (i != NO_ENTRY) {
+        track_entry_t *e = &t->entries[i];
+        int next = e->wheel_next;
+        if (deadline_tick(e->deadline_ms) > tick) {
+            // Seen again since it was filed, or due in a later round
+            if (e->filed_tick != deadline_tick(e->deadline_ms)) {
+                wheel_unlink(t, i);
+                wheel_file(t, i);
+            }
+        } else {
+            if (e->state == ENTRY_FOUND && !add_event(t, e, TRACK_ADV_STATE_LOST)) return false;
+            entry_free(t, i);
+        }
+        i = next;
+    }
+    return true;
+}
+
+static int64_t next_wakeup_tick(const track_adv_t *t) {
+    if (t->num_tracked == 0) return TICK_NEVER;
+    for (int64_t tick = t->last_tick + 1; tick <= t->last_tick + TRACK_ADV_WHEEL_SLOTS; tick++) {
+        if (t->wheel[tick & WHEEL_MASK] != NO_ENTRY) return tick;
+    }
+    return TICK_NEVER;
+}
+
+static void *track_adv_thread_main(void *arg) {
+    track_adv_t *t = (track_adv_t *) arg;
+    JavaVM *vm = AndroidRuntime::getJavaVM();
+    JNIEnv *env = NULL;
+
+    JavaVMAttachArgs args;
+    args.version = JNI_VERSION_1_6;
+    args.name = t->thread_name;
+    args.group = NULL;
+    if (vm->AttachCurrentThread(&env, &args) != JNI_OK) {
+        ALOGE("%s: unable to attach %s to VM", __FUNCTION__, t->thread_name);
+        return NULL;
+    }
+
+    track_adv_event_t events[TRACK_ADV_MAX_EVENTS];
+    pthread_mutex_lock(&t->lock);
+    while (!t->stopping) {
+        int64_t now_tick = now_ms() / TRACK_ADV_TICK_MS;
+        if (now_tick - t->last_tick > TRACK_ADV_WHEEL_SLOTS) {
+            t->last_tick = now_tick - TRACK_ADV_WHEEL_SLOTS;
+        }
+        while (t->last_tick < now_tick && process_tick(t, t->last_tick + 1)) {
+            t->last_tick++;
+        }
+
+        if (t->num_events > 0) {
+            int count = t->num_events;
+            int dropped = t->dropped_events;
+            memcpy(events, t->events, count * sizeof(events[0]));
+            t->num_events = 0;
+            t->dropped_events = 0;
+            pthread_mutex_unlock(&t->lock);
+
+            if (dropped > 0) ALOGW("%s: %d found events dropped", __FUNCTION__, dropped);
+            t->handler(env, events, count);
+            checkAndClearExceptionFromCallback(env, __FUNCTION__);
+
+            pthread_mutex_lock(&t->lock);
+            continue;
+        }
+
+        t->wakeup_tick = next_wakeup_tick(t);
+        if (t->wakeup_tick == TICK_NEVER) {
+            pthread_cond_wait(&t->cond, &t->lock);
+        } else {
+            int64_t wakeup_ms = t->wakeup_tick * TRACK_ADV_TICK_MS;
+            struct timespec ts;
+            ts.tv_sec = wakeup_ms / 1000;
+            ts.tv_nsec = (long) (wakeup_ms % 1000) * 1000000L;
+            pthread_cond_timedwait(&t->cond, &t->lock, &ts);
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+
+    vm->DetachCurrentThread();
+    return NULL;
+}
+
+static void reset_entries(track_adv_t *t) {
+    for (int i = 0; i < TRACK_ADV_MAX_ENTRIES; i++) {
+        t->entries[i].state = ENTRY_FREE;
+        t->entries[i].hash_next = i + 1 < TRACK_ADV_MAX_ENTRIES ? i + 1 : NO_ENTRY;
+        t->buckets[i] = NO_ENTRY;
+    }
+    for (int i = 0; i < TRACK_ADV_WHEEL_SLOTS; i++) t->wheel[i] = NO_ENTRY;
+    t->free_head = 0;
+    t->num_tracked = 0;
+}
+
+track_adv_t* track_adv_create(const char *thread_name, track_adv_handler_t handler) {
+    track_adv_t *t = (track_adv_t *) calloc(1, sizeof(track_adv_t));
+    if (t == NULL) return NULL;
+
+    t->handler = handler;
+    reset_entries(t);
+    t->last_tick = now_ms() / TRACK_ADV_TICK_MS;
+    t->wakeup_tick = TICK_NEVER;
+    snprintf(t->thread_name, sizeof(t->thread_name), "%s", thread_name);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&t->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&t->lock, NULL);
+
+    if (pthread_create(&t->thread, NULL, track_adv_thread_main, t) != 0) {
+        ALOGE("%s: unable to start %s", __FUNCTION__, thread_name);
+        pthread_cond_destroy(&t->cond);
+        pthread_mutex_destroy(&t->lock);
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void track_adv_destroy(track_adv_t *tracker) {
+    if (tracker == NULL) return;
+
+    pthread_mutex_lock(&tracker->lock);
+    tracker->stopping = true;
+    pthread_cond_broadcast(&tracker->cond);
+    pthread_mutex_unlock(&tracker->lock);
+    pthread_join(tracker->thread, NULL);
+
+    pthread_cond_destroy(&tracker->cond);
+    pthread_mutex_destroy(&tracker->lock);
+    free(tracker);
+}
+
+void track_adv_set_filter(track_adv_t *tracker, int filt_index, int client_if,
+                          int found_timeout_ms, int lost_timeout_ms, int found_count) {
+    if (filt_index < 0 || filt_index >= TRACK_ADV_MAX_FILTERS) return;
+
+    pthread_mutex_lock(&tracker->lock);
+    track_filter_t *f = &tracker->filters[filt_index];
+    f->active = true;
+    f->client_if = client_if;
+    f->found_timeout_ms = found_timeout_ms > TRACK_ADV_TICK_MS ? found_timeout_ms
+                                                               : TRACK_ADV_TICK_MS;
+    f->lost_timeout_ms = lost_timeout_ms > TRACK_ADV_TICK_MS ? lost_timeout_ms
+                                                             : TRACK_ADV_TICK_MS;
+    f->found_count = found_count > 1 ? found_count : 1;
+    pthread_mutex_unlock(&tracker->lock);
+}
+
+void track_adv_clear_filter(track_adv_t *tracker, int filt_index) {
+    if (filt_index < -1 || filt_index >= TRACK_ADV_MAX_FILTERS) return;
+
+    pthread_mutex_lock(&tracker->lock);
+    if (filt_index == -1) {
+        memset(tracker->filters, 0, sizeof(tracker->filters));
+        reset_entries(tracker);
+        tracker->num_events = 0;
+        pthread_mutex_unlock(&tracker->lock);
+        return;
+    }
+
+    tracker->filters[filt_index].active = false;
+    for (int i = 0; i < TRACK_ADV_MAX_ENTRIES; i++) {
+        const track_entry_t *e = &tracker->entries[i];
+        if (e->state != ENTRY_FREE && e->filt_index == filt_index) entry_free(tracker, i);
+    }
+    int kept = 0;
+    for (int i = 0; i < tracker->num_events; i++) {
+        if (tracker->events[i].filt_index == filt_index) continue;
+        tracker->events[kept++] = tracker->events[i];
+    }
+    tracker->num_events = kept;
+    pthread_mutex_unlock(&tracker->lock);
+}
+
+bool track_adv_sighting(track_adv_t *tracker, const bt_bdaddr_t *bda, uint32_t filters) {
+    bool deliver = false;
+    int64_t now = now_ms();
+
+    pthread_mutex_lock(&tracker->lock);
+    for (int filt_index = 0; filters != 0; filt_index++, filters >>= 1) {
+        const track_filter_t *f = &tracker->filters[filt_index];
+        if (!(filters & 1) || !f->active) continue;
+
+        int i = entry_find(tracker, bda, filt_index);
+        if (i == NO_ENTRY) {
+            i = entry_alloc(tracker, bda, filt_index);
+            if (i == NO_ENTRY) {
+                // Out of entries: let Java see the result rather than lose the device
+                deliver = true;
+                continue;
+            }
+            tracker->entries[i].first_seen_ms = now;
+            tracker->entries[i].filed_tick = TICK_NEVER;
+        }
+
+        track_entry_t *e = &tracker->entries[i];
+        if (e->state == ENTRY_PENDING) {
+            if (now - e->first_seen_ms > f->found_timeout_ms) {
+                e->first_seen_ms = now;
+                e->sightings = 0;
+            }
+            if (++e->sightings >= f->found_count) {
+                // Only a FOUND that reaches Java may later be followed by a LOST;
+                // if the buffer is full the entry stays pending for the next sighting
+                if (add_event(tracker, e, TRACK_ADV_STATE_FOUND)) {
+                    e->state = ENTRY_FOUND;
+                    e->deadline_ms = now + f->lost_timeout_ms;
+                } else {
+                    tracker->dropped_events++;
+                    e->deadline_ms = e->first_seen_ms + f->found_timeout_ms;
+                }
+                pthread_cond_signal(&tracker->cond);
+                deliver = true;
+            } else {
+                e->deadline_ms = e->first_seen_ms + f->found_timeout_ms;
+            }
+        } else {
+            e->deadline_ms = now + f->lost_timeout_ms;
+        }
+
+        // Later deadlines are picked up lazily when the filed slot comes due
+        if (e->filed_tick == TICK_NEVER) {
+            wheel_file(tracker, i);
+        } else if (deadline_tick(e->deadline_ms) < e->filed_tick) {
+            wheel_unlink(tracker, i);
+            wheel_file(tracker, i);
+        }
+    }
+    pthread_mutex_unlock(&tracker->lock);
+    return deliver;
+}
+
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_TRACK_ADV_H
+#define COM_ANDROID_BLUETOOTH_TRACK_ADV_H
+
+#include "jni.h"
+
+#include <stdint.h>
+#include "hardware/bluetooth.h"
+
+namespace android {
+
+/*
+ * Software on-found/on-lost advertiser tracking, for controllers whose
+ * filters cannot do it.
+ *
+ * Devices are tracked per filter index with the filter's found timeout,
+ * lost timeout and found sighting count. A device is found once it has
+ * been seen found_count times within found_timeout_ms of its first
+ * sighting, and lost once it has not been seen for lost_timeout_ms. Only
+ * the transitions are reported, so a device that keeps advertising costs
+ * a hash table lookup per advertisement and nothing else.
+ *
+ * Entries live in a fixed size hash table and are timed out by a timer
+ * wheel. A sighting only moves an entry's deadline; the wheel re-files the
+ * entry when its old slot comes due. The wheel thread sleeps until the
+ * next occupied slot, and indefinitely while nothing is tracked. It is
+ * attached to the VM and delivers the events in batches.
+ */
+
+#define TRACK_ADV_MAX_FILTERS       32
+#define TRACK_ADV_MAX_ENTRIES       1024
+#define TRACK_ADV_TICK_MS           50
+#define TRACK_ADV_WHEEL_SLOTS       256     // must be a power of two
+#define TRACK_ADV_MAX_EVENTS        64
+
+// Advertiser states, as the controller reports them
+#define TRACK_ADV_STATE_FOUND       0
+#define TRACK_ADV_STATE_LOST        1
+
+typedef struct {
+    int client_if;
+    int filt_index;
+    bt_bdaddr_t bda;
+    int adv_state;
+} track_adv_event_t;
+
+typedef void (*track_adv_handler_t)(JNIEnv *env, const track_adv_event_t *events, int count);
+
+typedef struct track_adv track_adv_t;
+
+/*
+ * Creates a tracker without filters and starts its wheel thread. Returns
+ * NULL on failure.
+ */
+track_adv_t* track_adv_create(const char *thread_name, track_adv_handler_t handler);
+
+/*
+ * Stops the wheel thread and frees the tracker. Pending events are
+ * dropped.
+ */
+void track_adv_destroy(track_adv_t *tracker);
+
+/*
+ * Starts tracking devices for filter filt_index, or changes its timeouts.
+ */
+void track_adv_set_filter(track_adv_t *tracker, int filt_index, int client_if,
+                          int found_timeout_ms, int lost_timeout_ms, int found_count);
+
+/*
+ * Stops tracking for filter filt_index, or for every filter if filt_index
+ * is -1. Tracked devices are forgotten without a lost event, as the
+ * controller does when a filter is deleted.
+ */
+void track_adv_clear_filter(track_adv_t *tracker, int filt_index);
+
+/*
+ * Records a sighting of bda by every filter in the filters bit mask.
+ * Returns true if the device was found by one of them just now, or could
+ * not be tracked, in which case the result should be delivered.
+ */
+bool track_adv_sighting(track_adv_t *tracker, const bt_bdaddr_t *bda, uint32_t filters);
+
+}
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothUpcallQueueJni"
+
+#include "com_android_bluetooth.h"
+#include "com_android_bluetooth_upcall_queue.h"
+#include "android_runtime/AndroidRuntime.h"
+#include "utils/Log.h"
+#include "cutils/atomic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+namespace android {
+
+typedef struct {
+    // The position the slot is free for, plus one once committed
+    volatile int32_t seq;
+    uint32_t pos;
+    upcall_handler_t handler;
+    uint8_t payload[UPCALL_QUEUE_MAX_PAYLOAD];
+} upcall_slot_t;
+
+struct upcall_queue {
+    upcall_slot_t *slots;
+    uint32_t mask;
+
+    // head is claimed by producers with a compare and swap, tail is
+    // written by the drain thread only
+    volatile int32_t head;
+    volatile int32_t tail;
+
+    volatile int32_t high_water;
+    volatile int32_t dropped;
+
+    sem_t items;
+    volatile int32_t stopping;
+    pthread_t thread;
+    char thread_name[32];
+};
+
+static inline uint32_t queue_depth(const upcall_queue_t *queue, uint32_t head) {
+    return head - (uint32_t) android_atomic_acquire_load(&queue->tail);
+}
+
+static void *upcall_thread_main(void *arg) {
+    upcall_queue_t *queue = (upcall_queue_t *) arg;
+    JavaVM *vm = AndroidRuntime::getJavaVM();
+    JNIEnv *env = NULL;
+
+    JavaVMAttachArgs args;
+    args.version = JNI_VERSION_1_6;
+    args.name = queue->thread_name;
+    args.group = NULL;
+    if (vm->AttachCurrentThread(&env, &args) != JNI_OK) {
+        ALOGE("%s: unable to attach %s to VM", __FUNCTION__, queue->thread_name);
+        return NULL;
+    }
+
+    for (;;) {
+        uint32_t tail = (uint32_t) queue->tail;
+        upcall_slot_t *slot = &queue->slots[tail & queue->mask];
+
+        // Slots are committed out of order by concurrent producers; only
+        // the one at tail may be delivered, whatever else is ready
+        if ((uint32_t) android_atomic_acquire_load(&slot->seq) != tail + 1) {
+            if (android_atomic_acquire_load(&queue->stopping)
+                    && (uint32_t) android_atomic_acquire_load(&queue->head) == tail) {
+                break;
+            }
+            while (sem_wait(&queue->items) != 0) {}
+            continue;
+        }
+
+        slot->handler(env, slot->payload);
+        checkAndClearExceptionFromCallback(env, __FUNCTION__);
+
+        // tail moves only once the handler returned, so an idle queue has
+        // nothing left in Java either
+        android_atomic_release_store((int32_t) (tail + queue->mask + 1), &slot->seq);
+        android_atomic_release_store((int32_t) (tail + 1), &queue->tail);
+    }
+
+    vm->DetachCurrentThread();
+    return NULL;
+}
+
+upcall_queue_t* upcall_queue_create(const char *thread_name, int capacity) {
+    uint32_t size = 1;
+    while (size < (uint32_t) capacity) size <<= 1;
+
+    upcall_queue_t *queue = (upcall_queue_t *) calloc(1, sizeof(upcall_queue_t));
+    if (queue == NULL) return NULL;
+
+    queue->slots = (upcall_slot_t *) calloc(size, sizeof(upcall_slot_t));
+    if (queue->slots == NULL) {
+        free(queue);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < size; i++) queue->slots[i].seq = (int32_t) i;
+    queue->mask = size - 1;
+    snprintf(queue->thread_name, sizeof(queue->thread_name), "%s", thread_name);
+
+    if (sem_init(&queue->items, 0, 0) != 0) {
+        free(queue->slots);
+        free(queue);
+        return NULL;
+    }
+
+    if (pthread_create(&queue->thread, NULL, upcall_thread_main, queue) != 0) {
+        ALOGE("%s: unable to start %s", __FUNCTION__, thread_name);
+        sem_destroy(&queue->items);
+        free(queue->slots);
+        free(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+void upcall_queue_destroy(upcall_queue_t *queue) {
+    if (queue == NULL) return;
+
+    android_atomic_release_store(1, &queue->stopping);
+    sem_post(&queue->items);
+    pthread_join(queue->thread, NULL);
+
+    sem_destroy(&queue->items);
+    free(queue->slots);
+    free(queue);
+}
+
+void* upcall_queue_reserve(upcall_queue_t *queue, upcall_handler_t handler, size_t len,
+                           bool lossy) {
+    if (len > UPCALL_QUEUE_MAX_PAYLOAD) {
+        android_atomic_inc(&queue->dropped);
+        return NULL;
+    }
+    uint32_t limit = lossy ? (queue->mask + 1) / 4 * 3 : queue->mask + 1;
+
+    for (;;) {
+        uint32_t pos = (uint32_t) android_atomic_acquire_load(&queue->head);
+        upcall_slot_t *slot = &queue->slots[pos & queue->mask];
+        int32_t dif = (int32_t) ((uint32_t) android_atomic_acquire_load(&slot->seq) - pos);
+
+        // Full when the slot still holds the upcall one lap behind
+        if (dif < 0 || (dif == 0 && queue_depth(queue, pos) >= limit)) {
+            android_atomic_inc(&queue->dropped);
+            return NULL;
+        }
+        if (dif == 0 && android_atomic_release_cas((int32_t) pos, (int32_t) (pos + 1),
+                                                   &queue->head) == 0) {
+            slot->pos = pos;
+            slot->handler = handler;
+            return slot->payload;
+        }
+    }
+}
+
+void upcall_queue_commit(upcall_queue_t *queue, void *payload) {
+    upcall_slot_t *slot = (upcall_slot_t *) ((uint8_t *) payload
+                                             - offsetof(upcall_slot_t, payload));
+    android_atomic_release_store((int32_t) (slot->pos + 1), &slot->seq);
+    sem_post(&queue->items);
+
+    int32_t depth = (int32_t) queue_depth(queue, slot->pos + 1);
+    if (depth > queue->high_water) queue->high_water = depth;
+}
+
+bool upcall_queue_idle(upcall_queue_t *queue) {
+    return queue_depth(queue, (uint32_t) android_atomic_acquire_load(&queue->head)) == 0;
+}
+
+void upcall_queue_get_stats(upcall_queue_t *queue, upcall_queue_stats_t *stats) {
+    stats->capacity = (int) queue->mask + 1;
+    stats->depth = (int) queue_depth(queue, (uint32_t) android_atomic_acquire_load(&queue->head));
+    stats->high_water = queue->high_water;
+    stats->dropped = queue->dropped;
+}
+
+}
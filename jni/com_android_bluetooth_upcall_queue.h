@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_UPCALL_QUEUE_H
+#define COM_ANDROID_BLUETOOTH_UPCALL_QUEUE_H
+
+#include "jni.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * Multiple producer, single consumer queue of upcalls into Java.
+ *
+ * A producer, the stack callback thread or a thread calling into native
+ * code, reserves a slot, marshals the callback arguments into it and
+ * commits it; a dedicated thread attached to the VM runs the handler
+ * stored with each slot, in the order the slots were reserved. Slots are
+ * preallocated and claimed with a compare and swap, so producers never
+ * take a lock and never wait for Java: an upcall that finds the ring full
+ * is dropped and counted. Upcalls that may be missed, such as scan
+ * results and notifications, are reserved as lossy and dropped once the
+ * ring is three quarters full, which leaves room for the others.
+ */
+
+#define UPCALL_QUEUE_MAX_PAYLOAD    768
+
+typedef void (*upcall_handler_t)(JNIEnv *env, const void *payload);
+
+typedef struct {
+    int capacity;
+    int depth;
+    int high_water;
+    int dropped;    // upcalls refused for lack of room
+} upcall_queue_stats_t;
+
+typedef struct upcall_queue upcall_queue_t;
+
+/*
+ * Creates the queue and starts its drain thread. capacity is rounded up
+ * to a power of two. Returns NULL on failure.
+ */
+upcall_queue_t* upcall_queue_create(const char *thread_name, int capacity);
+
+/*
+ * Delivers everything still queued, stops the drain thread and frees the
+ * queue. Must not race with the producer.
+ */
+void upcall_queue_destroy(upcall_queue_t *queue);
+
+/*
+ * Returns payload space for one upcall, or NULL if len exceeds
+ * UPCALL_QUEUE_MAX_PAYLOAD or there is no room, in which case the upcall
+ * counts as dropped. Never waits. The slot is handed to the drain thread
+ * by upcall_queue_commit().
+ */
+void* upcall_queue_reserve(upcall_queue_t *queue, upcall_handler_t handler, size_t len,
+                           bool lossy);
+
+void upcall_queue_commit(upcall_queue_t *queue, void *payload);
+
+/*
+ * Returns true if every upcall reserved so far has been delivered. A
+ * producer that finds the queue idle may call into Java itself without
+ * overtaking anything it queued before.
+ */
+bool upcall_queue_idle(upcall_queue_t *queue);
+
+void upcall_queue_get_stats(upcall_queue_t *queue, upcall_queue_stats_t *stats);
+
+}
+
+#endif /* COM_ANDROID_BLUETOOTH_UPCALL_QUEUE_H */
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "BluetoothWritePipeJni"
+
+#include "com_android_bluetooth_write_pipe.h"
+#include "utils/Log.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+#define ATT_WRITE_HEADER_LEN    3
+
+typedef struct {
+    bool in_use;
+    int conn_id;
+    int mtu;
+    bool congested;
+
+    uint8_t *value;             // NULL unless a value is being written
+    size_t len;
+    size_t offset;              // of the next chunk
+    int window;
+    int in_flight;
+    int status;
+    btgatt_srvc_id_t srvc_id;
+    btgatt_gatt_id_t char_id;
+    int write_type;
+    int auth_req;
+} write_pipe_conn_t;
+
+static pthread_mutex_t sWritePipeLock = PTHREAD_MUTEX_INITIALIZER;
+static write_pipe_conn_t sConns[WRITE_PIPE_MAX_CONNS];
+
+static write_pipe_conn_t* find_conn(int conn_id, bool create) {
+    write_pipe_conn_t *free_conn = NULL;
+    for (int i = 0; i < WRITE_PIPE_MAX_CONNS; i++) {
+        if (!sConns[i].in_use) {
+            if (free_conn == NULL) free_conn = &sConns[i];
+        } else if (sConns[i].conn_id == conn_id) {
+            return &sConns[i];
+        }
+    }
+    if (!create || free_conn == NULL) return NULL;
+
+    memset(free_conn, 0, sizeof(*free_conn));
+    free_conn->in_use = true;
+    free_conn->conn_id = conn_id;
+    free_conn->mtu = WRITE_PIPE_DEFAULT_MTU;
+    return free_conn;
+}
+
+bool write_pipe_start(int conn_id, const btgatt_srvc_id_t *srvc_id,
+                      const btgatt_gatt_id_t *char_id, int write_type, int auth_req,
+                      const uint8_t *value, size_t len, int window) {
+    if (len == 0) return false;
+
+    pthread_mutex_lock(&sWritePipeLock);
+    write_pipe_conn_t *c = find_conn(conn_id, true);
+    if (c == NULL || c->value != NULL) {
+        pthread_mutex_unlock(&sWritePipeLock);
+        return false;
+    }
+
+    c->value = (uint8_t *) malloc(len);
+    if (c->value != NULL) {
+        memcpy(c->value, value, len);
+        c->len = len;
+        c->offset = 0;
+        c->window = window < 1 ? 1 : (window > WRITE_PIPE_MAX_WINDOW
+                                      ? WRITE_PIPE_MAX_WINDOW : window);
+        c->in_flight = 0;
+        c->status = 0;
+        c->srvc_id = *srvc_id;
+        c->char_id = *char_id;
+        c->write_type = write_type;
+        c->auth_req = auth_req;
+    }
+    bool started = c->value != NULL;
+    pthread_mutex_unlock(&sWritePipeLock);
+    return started;
+}
+
+bool write_pipe_next(int conn_id, write_pipe_chunk_t *chunk) {
+    pthread_mutex_lock(&sWritePipeLock);
+    write_pipe_conn_t *c = find_conn(conn_id, false);
+    if (c == NULL || c->value == NULL || c->congested || c->status != 0
+            || c->in_flight >= c->window || c->offset >= c->len) {
+        pthread_mutex_unlock(&sWritePipeLock);
+        return false;
+    }
+
+    size_t n = c->mtu - ATT_WRITE_HEADER_LEN;
+    if (n > WRITE_PIPE_MAX_CHUNK) n = WRITE_PIPE_MAX_CHUNK;
+    if (n > c->len - c->offset) n = c->len - c->offset;
+
+    chunk->srvc_id = c->srvc_id;
+    chunk->char_id = c->char_id;
+    chunk->write_type = c->write_type;
+    chunk->auth_req = c->auth_req;
+    chunk->status = 0;
+    chunk->len = (int) n;
+    memcpy(chunk->value, c->value + c->offset, n);
+    c->offset += n;
+    c->in_flight++;
+    pthread_mutex_unlock(&sWritePipeLock);
+    return true;
+}
+
+static bool same_gatt_id(const btgatt_gatt_id_t *a, const btgatt_gatt_id_t *b) {
+    return a->inst_id == b->inst_id && !memcmp(a->uuid.uu, b->uuid.uu, sizeof(a->uuid.uu));
+}
+
+int write_pipe_written(int conn_id, const btgatt_srvc_id_t *srvc_id,
+                       const btgatt_gatt_id_t *char_id, int status, write_pipe_chunk_t *done) {
+    int action = WRITE_PIPE_NONE;
+    pthread_mutex_lock(&sWritePipeLock);
+    write_pipe_conn_t *c = find_conn(conn_id, false);
+    if (c != NULL && c->value != NULL && c->in_flight > 0
+            && srvc_id->is_primary == c->srvc_id.is_primary
+            && same_gatt_id(&srvc_id->id, &c->srvc_id.id) && same_gatt_id(char_id, &c->char_id)) {
+        c->in_flight--;
+        if (c->status == 0) c->status = status;
+
+        if (c->in_flight == 0 && (c->status != 0 || c->offset >= c->len)) {
+            memset(done, 0, sizeof(*done));
+            done->srvc_id = c->srvc_id;
+            done->char_id = c->char_id;
+            done->write_type = c->write_type;
+            done->auth_req = c->auth_req;
+            done->status = c->status;
+            free(c->value);
+            c->value = NULL;
+            action = WRITE_PIPE_DONE;
+        } else {
+            action = WRITE_PIPE_MORE;
+        }
+    }
+    pthread_mutex_unlock(&sWritePipeLock);
+    return action;
+}
+
+void write_pipe_set_mtu(int conn_id, int mtu) {
+    if (mtu <= ATT_WRITE_HEADER_LEN) return;
+
+    pthread_mutex_lock(&sWritePipeLock);
+    write_pipe_conn_t *c = find_conn(conn_id, true);
+    if (c != NULL) c->mtu = mtu;
+    pthread_mutex_unlock(&sWritePipeLock);
+}
+
+void write_pipe_congested(int conn_id, bool congested) {
+    pthread_mutex_lock(&sWritePipeLock);
+    write_pipe_conn_t *c = find_conn(conn_id, congested);
+    if (c != NULL) c->congested = congested;
+    pthread_mutex_unlock(&sWritePipeLock);
+}
+
+void write_pipe_close(int conn_id) {
+    pthread_mutex_lock(&sWritePipeLock);
+    write_pipe_conn_t *c = find_conn(conn_id, false);
+    if (c != NULL) {
+        free(c->value);
+        memset(c, 0, sizeof(*c));
+    }
+    pthread_mutex_unlock(&sWritePipeLock);
+}
+
+}
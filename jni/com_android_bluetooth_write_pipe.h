@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COM_ANDROID_BLUETOOTH_WRITE_PIPE_H
+#define COM_ANDROID_BLUETOOTH_WRITE_PIPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hardware/bt_gatt.h"
+
+namespace android {
+
+/*
+ * Windowed writes of long values without response.
+ *
+ * A value is copied once and written in chunks of the connection's ATT
+ * MTU minus the 3 byte write command header. Up to window chunks are
+ * outstanding at a time, counted from the call until its
+ * write_characteristic_cb, and no chunk is started while the connection
+ * is congested. The caller reports the value's completion once, with
+ * the first failing status if any chunk failed; no chunk is started
+ * after a failure.
+ *
+ * The driver only keeps state. The caller makes the writes the driver
+ * hands out and feeds it their results and the connection's MTU and
+ * congestion changes.
+ */
+
+#define WRITE_PIPE_MAX_CONNS        16
+#define WRITE_PIPE_MAX_WINDOW       32
+#define WRITE_PIPE_MAX_CHUNK        600     // longest attribute value
+#define WRITE_PIPE_DEFAULT_MTU      23
+
+#define WRITE_PIPE_NONE             0   // not a pipelined write
+#define WRITE_PIPE_MORE             1   // call write_pipe_next
+#define WRITE_PIPE_DONE             2   // report completion
+
+typedef struct {
+    btgatt_srvc_id_t srvc_id;
+    btgatt_gatt_id_t char_id;
+    int write_type;
+    int auth_req;
+    int status;                         // of a finished value
+    int len;
+    uint8_t value[WRITE_PIPE_MAX_CHUNK];
+} write_pipe_chunk_t;
+
+/*
+ * Starts writing value to the characteristic with up to window chunks
+ * outstanding. Returns false if conn_id is still writing a value or
+ * nothing could be allocated.
+ */
+bool write_pipe_start(int conn_id, const btgatt_srvc_id_t *srvc_id,
+                      const btgatt_gatt_id_t *char_id, int write_type, int auth_req,
+                      const uint8_t *value, size_t len, int window);
+
+/*
+ * Hands out the next chunk to write. Returns false if the window is
+ * full, the connection is congested or every chunk was handed out.
+ */
+bool write_pipe_next(int conn_id, write_pipe_chunk_t *chunk);
+
+/*
+ * Takes the result of a write to srvc_id and char_id. Returns
+ * WRITE_PIPE_NONE if it is not a chunk of the value conn_id is writing,
+ * i.e. that characteristic has no chunk outstanding, and WRITE_PIPE_DONE
+ * with the IDs and status of the value in done once the last one is back.
+ */
+int write_pipe_written(int conn_id, const btgatt_srvc_id_t *srvc_id,
+                       const btgatt_gatt_id_t *char_id, int status, write_pipe_chunk_t *done);
+
+/*
+ * Track the state of a connection. write_pipe_close() drops a value
+ * being written.
+ */
+void write_pipe_set_mtu(int conn_id, int mtu);
+void write_pipe_congested(int conn_id, bool congested);
+void write_pipe_close(int conn_id);
+
+}
+
+#endif
@@ -26,6 +26,7 @@ import android.os.Looper;
 import android.os.Message;
 import android.os.ParcelUuid;
 import android.os.RemoteException;
+import android.os.SystemProperties;
 import android.util.Log;
 
 import com.android.bluetooth.Utils;
@@ -55,6 +56,13 @@ class AdvertiseManager {
     private static final int MSG_START_ADVERTISING = 0;
     private static final int MSG_STOP_ADVERTISING = 1;
 
+    // Length of the slices advertisers share the controller's instances in, 0 to give each
+    // advertiser an instance of its own.
+    private static final String ADVERTISE_SLICE_PROPERTY = "persist.bt.gatt.adv_slice_ms";
+
+    // Keep in sync with ADV_SCHED_MAX_SETS in com_android_bluetooth_adv_sched.h.
+    private static final int MAX_VIRTUAL_ADVERTISERS = 32;
+
     private final GattService mService;
     private final AdapterService mAdapterService;
     private final Set<AdvertiseClient> mAdvertiseClients;
@@ -66,6 +74,9 @@ class AdvertiseManager {
     // CountDownLatch for blocking advertise operations.
     private CountDownLatch mLatch;
 
+    // Whether advertisers are time sliced onto the instances by native code.
+    private boolean mVirtualAdvertising;
+
     /**
      * Constructor of {@link AdvertiseManager}.
      */
@@ -84,12 +95,25 @@ class AdvertiseManager {
         HandlerThread thread = new HandlerThread("BluetoothAdvertiseManager");
         thread.start();
         mHandler = new ClientHandler(thread.getLooper());
+
+        int sliceMillis = SystemProperties.getInt(ADVERTISE_SLICE_PROPERTY, 0);
+        int instances = mHandler.maxAdvertiseInstances();
+        if (sliceMillis > 0 && instances > 0 && mAdapterService.isMultiAdvertisementSupported()) {
+            logd("time slicing advertisers onto " + instances + " instances");
+            mAdvertiseNative.gattClientSetAdvSchedulerNative(instances, sliceMillis);
+            mVirtualAdvertising = true;
+        }
     }
 
     void cleanup() {
         logd("advertise clients cleared");
         mAdvertiseClients.clear();
 
+        if (mVirtualAdvertising) {
+            mAdvertiseNative.gattClientSetAdvSchedulerNative(0, 0);
+            mVirtualAdvertising = false;
+        }
+
         if (mHandler != null) {
             // Shut down the thread
             mHandler.removeCallbacksAndMessages(null);
@@ -129,6 +153,22 @@ class AdvertiseManager {
         mHandler.sendMessage(message);
     }
 
+    /**
+     * Update the advertising data, or the scan response, of a started advertiser. Only fields
+     * whose bytes changed are sent to the controller, and updates arriving faster than the
+     * advertising interval are coalesced. Whether the device name and tx power level are
+     * included stays as started.
+     *
+     * @return false if the client is not advertising or the data could not be taken.
+     */
+    boolean updateAdvertisingData(int clientIf, AdvertiseData data, boolean isScanResponse) {
+        AdvertiseClient client = getAdvertiseClient(clientIf);
+        if (client == null || data == null) {
+            return false;
+        }
+        return mAdvertiseNative.updateAdvertisingData(client, data, isScanResponse);
+    }
+
     /**
      * Signals the callback is received.
      *
@@ -199,7 +239,9 @@ class AdvertiseManager {
                 return;
             }
 
-            if (mAdvertiseClients.size() >= maxAdvertiseInstances()) {
+            int maxAdvertisers = mVirtualAdvertising ? MAX_VIRTUAL_ADVERTISERS
+                    : maxAdvertiseInstances();
+            if (mAdvertiseClients.size() >= maxAdvertisers) {
                 postCallback(clientIf,
                         AdvertiseCallback.ADVERTISE_FAILED_TOO_MANY_ADVERTISERS);
                 return;
@@ -230,7 +272,7 @@ class AdvertiseManager {
         }
 
         // Returns maximum advertise instances supported by controller.
-        private int maxAdvertiseInstances() {
+        int maxAdvertiseInstances() {
             AdapterService adapter;
             int numOfAdvtInstances = 0;
             if (null != (adapter = AdapterService.getAdapterService())){
@@ -280,12 +322,38 @@ class AdvertiseManager {
                     !mAdapterService.isPeripheralModeSupported()) {
                 return false;
             }
+            if (mVirtualAdvertising) {
+                return startVirtualAdvertising(client);
+            }
             if (mAdapterService.isMultiAdvertisementSupported()) {
                 return startMultiAdvertising(client);
             }
             return startSingleAdvertising(client);
         }
 
+        boolean startVirtualAdvertising(AdvertiseClient client) {
+            logd("starting virtual advertising");
+            int clientIf = client.clientIf;
+            int minAdvertiseUnit = (int) getAdvertisingIntervalUnit(client.settings);
+            int maxAdvertiseUnit = minAdvertiseUnit + ADVERTISING_INTERVAL_DELTA_UNIT;
+            int advertiseTimeoutSeconds = (int) TimeUnit.MILLISECONDS.toSeconds(
+                    client.settings.getTimeout());
+            // Data goes first so the advertiser is complete once it is scheduled.
+            if (setAdvertisingData(client, client.advertiseData, false)
+                    && setAdvertisingData(client, client.scanResponse, true)
+                    && gattClientStartVirtualAdvNative(clientIf,
+                            getAdvertisingWeight(client.settings),
+                            minAdvertiseUnit, maxAdvertiseUnit,
+                            getAdvertisingEventType(client),
+                            ADVERTISING_CHANNEL_ALL,
+                            getTxPowerLevel(client.settings),
+                            advertiseTimeoutSeconds)) {
+                return true;
+            }
+            gattClientStopVirtualAdvNative(clientIf);
+            return false;
+        }
+
         boolean startMultiAdvertising(AdvertiseClient client) {
             logd("starting multi advertising");
             resetCountDownLatch();
@@ -320,7 +388,11 @@ class AdvertiseManager {
         }
 
         void stopAdvertising(AdvertiseClient client) {
-            if (mAdapterService.isMultiAdvertisementSupported()) {
+            if (mVirtualAdvertising) {
+                if (!gattClientStopVirtualAdvNative(client.clientIf)) {
+                    logd("no virtual advertiser for client " + client.clientIf);
+                }
+            } else if (mAdapterService.isMultiAdvertisementSupported()) {
                 gattClientDisableAdvNative(client.clientIf);
             } else {
                 gattAdvertiseNative(client.clientIf, false);
@@ -367,10 +439,20 @@ class AdvertiseManager {
             }
         }
 
-        private void setAdvertisingData(AdvertiseClient client, AdvertiseData data,
+        boolean updateAdvertisingData(AdvertiseClient client, AdvertiseData data,
+                boolean isScanResponse) {
+            if (!mVirtualAdvertising && !mAdapterService.isMultiAdvertisementSupported()) {
+                return false;
+            }
+            return gattClientUpdateAdvDataNative(client.clientIf, isScanResponse,
+                    getManufacturerData(data), getServiceData(data), getServiceUuids(data));
+        }
+
+        // Returns false if the data was refused right away.
+        private boolean setAdvertisingData(AdvertiseClient client, AdvertiseData data,
                 boolean isScanResponse) {
             if (data == null) {
-                return;
+                return true;
             }
             boolean includeName = data.getIncludeDeviceName();
             boolean includeTxPower = data.getIncludeTxPowerLevel();
@@ -378,23 +460,12 @@ class AdvertiseManager {
             byte[] manufacturerData = getManufacturerData(data);
 
             byte[] serviceData = getServiceData(data);
-            byte[] serviceUuids;
-            if (data.getServiceUuids() == null) {
-                serviceUuids = new byte[0];
-            } else {
-                ByteBuffer advertisingUuidBytes = ByteBuffer.allocate(
-                        data.getServiceUuids().size() * 16)
-                        .order(ByteOrder.LITTLE_ENDIAN);
-                for (ParcelUuid parcelUuid : data.getServiceUuids()) {
-                    UUID uuid = parcelUuid.getUuid();
-                    // Least significant bits first as the advertising UUID should be in
-                    // little-endian.
-                    advertisingUuidBytes.putLong(uuid.getLeastSignificantBits())
-                            .putLong(uuid.getMostSignificantBits());
-                }
-                serviceUuids = advertisingUuidBytes.array();
-            }
-            if (mAdapterService.isMultiAdvertisementSupported()) {
+            byte[] serviceUuids = getServiceUuids(data);
+            if (mVirtualAdvertising) {
+                return gattClientSetVirtualAdvDataNative(client.clientIf, isScanResponse,
+                        includeName, includeTxPower, appearance,
+                        manufacturerData, serviceData, serviceUuids);
+            } else if (mAdapterService.isMultiAdvertisementSupported()) {
                 gattClientSetAdvDataNative(client.clientIf, isScanResponse, includeName,
                         includeTxPower, appearance,
                         manufacturerData, serviceData, serviceUuids);
@@ -403,6 +474,7 @@ class AdvertiseManager {
                         includeTxPower, 0, 0, appearance,
                         manufacturerData, serviceData, serviceUuids);
             }
+            return true;
         }
 
         // Combine manufacturer id and manufacturer data.
@@ -445,6 +517,24 @@ class AdvertiseManager {
             return concated;
         }
 
+        // Concatenate service UUIDs.
+        private byte[] getServiceUuids(AdvertiseData advertiseData) {
+            if (advertiseData.getServiceUuids() == null) {
+                return new byte[0];
+            }
+            ByteBuffer advertisingUuidBytes = ByteBuffer.allocate(
+                    advertiseData.getServiceUuids().size() * 16)
+                    .order(ByteOrder.LITTLE_ENDIAN);
+            for (ParcelUuid parcelUuid : advertiseData.getServiceUuids()) {
+                UUID uuid = parcelUuid.getUuid();
+                // Least significant bits first as the advertising UUID should be in
+                // little-endian.
+                advertisingUuidBytes.putLong(uuid.getLeastSignificantBits())
+                        .putLong(uuid.getMostSignificantBits());
+            }
+            return advertisingUuidBytes.array();
+        }
+
         // Convert settings tx power level to stack tx power level.
         private int getTxPowerLevel(AdvertiseSettings settings) {
             switch (settings.getTxPowerLevel()) {
@@ -472,6 +562,18 @@ class AdvertiseManager {
                     : ADVERTISING_EVENT_TYPE_SCANNABLE;
         }
 
+        // Share of the air time an advertiser gets when advertisers are time sliced.
+        private int getAdvertisingWeight(AdvertiseSettings settings) {
+            switch (settings.getMode()) {
+                case AdvertiseSettings.ADVERTISE_MODE_LOW_LATENCY:
+                    return 4;
+                case AdvertiseSettings.ADVERTISE_MODE_BALANCED:
+                    return 2;
+                default:
+                    return 1;
+            }
+        }
+
         // Convert advertising milliseconds to advertising units(one unit is 0.625 millisecond).
         private long getAdvertisingIntervalUnit(AdvertiseSettings settings) {
             switch (settings.getMode()) {
@@ -502,11 +604,27 @@ class AdvertiseManager {
                 boolean set_scan_rsp, boolean incl_name, boolean incl_txpower, int appearance,
                 byte[] manufacturer_data, byte[] service_data, byte[] service_uuid);
 
+        private native boolean gattClientUpdateAdvDataNative(int client_if,
+                boolean set_scan_rsp, byte[] manufacturer_data, byte[] service_data,
+                byte[] service_uuid);
+
         private native void gattSetAdvDataNative(int serverIf, boolean setScanRsp, boolean inclName,
                 boolean inclTxPower, int minSlaveConnectionInterval, int maxSlaveConnectionInterval,
                 int appearance, byte[] manufacturerData, byte[] serviceData, byte[] serviceUuid);
 
         private native void gattAdvertiseNative(int client_if, boolean start);
+
+        private native void gattClientSetAdvSchedulerNative(int instances, int slice_ms);
+
+        private native boolean gattClientSetVirtualAdvDataNative(int client_if,
+                boolean set_scan_rsp, boolean incl_name, boolean incl_txpower, int appearance,
+                byte[] manufacturer_data, byte[] service_data, byte[] service_uuid);
+
+        private native boolean gattClientStartVirtualAdvNative(int client_if, int weight,
+                int min_interval, int max_interval, int adv_type, int chnl_map,
+                int tx_power, int timeout_s);
+
+        private native boolean gattClientStopVirtualAdvNative(int client_if);
     }
 
     private void logd(String s) {
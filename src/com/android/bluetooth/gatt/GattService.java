@@ -20,6 +20,7 @@ import android.app.Service;
 import android.bluetooth.BluetoothAdapter;
 import android.bluetooth.BluetoothDevice;
 import android.bluetooth.BluetoothGatt;
+import android.bluetooth.BluetoothGattCharacteristic;
 import android.bluetooth.BluetoothProfile;
 import android.bluetooth.IBluetoothGatt;
 import android.bluetooth.IBluetoothGattCallback;
@@ -37,6 +38,7 @@ import android.os.IBinder;
 import android.os.ParcelUuid;
 import android.os.RemoteException;
 import android.os.SystemClock;
+import android.os.SystemProperties;
 import android.util.Log;
 
 import com.android.bluetooth.Utils;
@@ -45,6 +47,9 @@ import com.android.bluetooth.btservice.ProfileService;
 import com.android.bluetooth.util.NumberUtils;
 import com.android.internal.annotations.VisibleForTesting;
 
+import java.io.File;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.Collections;
@@ -71,13 +76,62 @@ public class GattService extends ProfileService {
 
     private static final int MAC_ADDRESS_LENGTH = 6;
     // Batch scan related constants.
-    private static final int TRUNCATED_RESULT_SIZE = 11;
     private static final int TIME_STAMP_LENGTH = 2;
 
     // onFoundLost related constants
     private static final int ADVT_STATE_ONFOUND = 0;
     private static final int ADVT_STATE_ONLOST = 1;
 
+    // Batched scan result record: address (6), rssi (1), advertising data (62),
+    // matched scan filter slots (8)
+    private static final int SCAN_RESULT_RECORD_SIZE = 6 + 1 + 62 + 8;
+    private static final int SCAN_RESULT_ADV_DATA_LENGTH = 62;
+
+    // Deliver native callbacks through a queue drained by a dedicated thread
+    private static final String UPCALL_QUEUE_PROPERTY = "persist.bt.gatt.upcall_queue";
+
+    // Records in the shared scan result ring, 0 to deliver scan results by upcall
+    private static final String SCAN_RESULT_RING_PROPERTY = "persist.bt.gatt.scan_ring";
+
+    // Window to batch notifications of a connection in, 0 to deliver them one by one.
+    // Only connections to the listed devices, comma separated addresses, are batched.
+    private static final String NOTIFY_BATCH_WINDOW_PROPERTY = "persist.bt.gatt.notify_batch_ms";
+    private static final String NOTIFY_BATCH_DEVICES_PROPERTY =
+            "persist.bt.gatt.notify_batch_devices";
+    private static final String NOTIFY_BATCH_BYTES_PROPERTY = "persist.bt.gatt.notify_batch_bytes";
+    private static final int DEFAULT_NOTIFY_BATCH_BYTES = 4096;
+
+    // Replay service discovery of known devices from a native attribute cache
+    private static final String ATTRIBUTE_CACHE_PROPERTY = "persist.bt.gatt.attr_cache";
+    private static final String ATTRIBUTE_CACHE_DIR = "gatt_attributes";
+
+    // Walk the attribute database in native code and deliver it as one table
+    private static final String BULK_DISCOVERY_PROPERTY = "persist.bt.gatt.bulk_discovery";
+
+    // Writes without response kept in flight by native code, 0 to write values in one call
+    private static final String WRITE_WINDOW_PROPERTY = "persist.bt.gatt.write_window";
+
+    // Bytes of prepared writes a server connection queues natively, 0 to queue them in apps
+    private static final String PREP_WRITE_BYTES_PROPERTY = "persist.bt.gatt.prep_write_bytes";
+
+    // Drop server notifications to clients that did not subscribe through the CCCD
+    private static final String CCCD_FILTER_PROPERTY = "persist.bt.gatt.cccd_filter";
+
+    // Discovery table layout, see com_android_bluetooth_discovery.h
+    private static final int DISCOVERY_RECORD_SIZE = 56;
+    private static final int DISCOVERY_TYPE_SERVICE = 0;
+    private static final int DISCOVERY_TYPE_CHARACTERISTIC = 1;
+    private static final int DISCOVERY_TYPE_DESCRIPTOR = 2;
+    private static final int DISCOVERY_TYPE_INCLUDED_SERVICE = 3;
+
+    // Shared scan result ring layout, see com_android_bluetooth_scan_ring.h
+    private static final int SCAN_RING_CAPACITY_OFFSET = 0;
+    private static final int SCAN_RING_DROPPED_OFFSET = 8;
+    private static final int SCAN_RING_HEADER_SIZE = 192;
+    private static final int SCAN_RING_RECORD_SIZE = 88;
+    private static final int SCAN_RING_ADV_DATA_LENGTH = 62;
+    private static final int SCAN_RING_WAIT_MILLIS = 1000;
+
     private static final UUID[] HID_UUIDS = {
         UUID.fromString("00002A4A-0000-1000-8000-00805F9B34FB"),
         UUID.fromString("00002A4B-0000-1000-8000-00805F9B34FB"),
@@ -90,6 +144,11 @@ public class GattService extends ProfileService {
      */
     SearchQueue mSearchQueue = new SearchQueue();
 
+    /**
+     * Tokens of characteristics clients registered for notifications of.
+     */
+    NotifyTokenMap mNotifyTokens = new NotifyTokenMap();
+
     /**
      * List of our registered clients.
      */
@@ -110,6 +169,7 @@ public class GattService extends ProfileService {
     private List<UUID> mAdvertisingServiceUuids = new ArrayList<UUID>();
 
     private int mMaxScanFilters;
+    private ScanResultRingReader mScanResultRingReader;
     private Map<ScanClient, ScanResult> mOnFoundResults = new HashMap<ScanClient, ScanResult>();
 
     /**
@@ -189,7 +249,26 @@ public class GattService extends ProfileService {
 
     protected boolean start() {
         if (DBG) Log.d(TAG, "start()");
-        initializeNative();
+        initializeNative(SystemProperties.getBoolean(UPCALL_QUEUE_PROPERTY, false),
+                SystemProperties.getInt(SCAN_RESULT_RING_PROPERTY, 0));
+        ByteBuffer scanResultRing = gattGetScanResultRingNative();
+        if (scanResultRing != null) {
+            mScanResultRingReader = new ScanResultRingReader(scanResultRing);
+            mScanResultRingReader.start();
+        }
+        if (SystemProperties.getBoolean(ATTRIBUTE_CACHE_PROPERTY, false)) {
+            File cacheDir = new File(getCacheDir(), ATTRIBUTE_CACHE_DIR);
+            if (cacheDir.isDirectory() || cacheDir.mkdirs()) {
+                gattClientSetAttributeCacheDirNative(cacheDir.getPath());
+            } else {
+                Log.e(TAG, "Unable to create " + cacheDir);
+            }
+        }
+        int prepWriteBytes = SystemProperties.getInt(PREP_WRITE_BYTES_PROPERTY, 0);
+        if (prepWriteBytes > 0) gattServerSetPrepWriteLimitNative(prepWriteBytes);
+        if (SystemProperties.getBoolean(CCCD_FILTER_PROPERTY, false)) {
+            gattServerSetSubscriptionFilterNative(true);
+        }
         mAdvertiseManager = new AdvertiseManager(this, AdapterService.getAdapterService());
         mAdvertiseManager.start();
 
@@ -204,6 +283,7 @@ public class GattService extends ProfileService {
         mClientMap.clear();
         mServerMap.clear();
         mSearchQueue.clear();
+        mNotifyTokens.clear();
         mHandleMap.clear();
         mServiceDeclarations.clear();
         mActiveServiceDeclarations.clear();
@@ -221,6 +301,10 @@ public class GattService extends ProfileService {
 
     protected boolean cleanup() {
         if (DBG) Log.d(TAG, "cleanup()");
+        if (mScanResultRingReader != null) {
+            mScanResultRingReader.quit();
+            mScanResultRingReader = null;
+        }
         cleanupNative();
         if (mAdvertiseManager != null) {
             mAdvertiseManager.cleanup();
@@ -246,6 +330,61 @@ public class GattService extends ProfileService {
      * disconnect ungracefully (ie. crash or forced close).
      */
 
+    /**
+     * Reads scan results the native layer writes into the shared ring and
+     * dispatches them like onScanResult() upcalls.
+     */
+    private class ScanResultRingReader extends Thread {
+        private final ByteBuffer mRing;
+        private final int mMask;
+
+        ScanResultRingReader(ByteBuffer ring) {
+            super("BluetoothScanResultRing");
+            mRing = ring.order(ByteOrder.nativeOrder());
+            mMask = mRing.getInt(SCAN_RING_CAPACITY_OFFSET) - 1;
+        }
+
+        int getDropped() {
+            return mRing.getInt(SCAN_RING_DROPPED_OFFSET);
+        }
+
+        void quit() {
+            gattStopScanResultRingNative();
+            try {
+                join();
+            } catch (InterruptedException e) {
+                Log.e(TAG, "Interrupted while stopping scan result ring reader");
+            }
+        }
+
+        @Override
+        public void run() {
+            byte[] address = new byte[MAC_ADDRESS_LENGTH];
+            int consumed = 0;
+            while (true) {
+                // Hands back the records read so far and waits for new ones.
+                long head = gattWaitScanResultRingNative(consumed, SCAN_RING_WAIT_MILLIS);
+                if (head < 0) break;
+
+                while (consumed != (int) head) {
+                    int offset = SCAN_RING_HEADER_SIZE + (consumed & mMask) * SCAN_RING_RECORD_SIZE;
+                    mRing.position(offset);
+                    mRing.get(address);
+                    int rssi = mRing.get(offset + 6);
+                    long timestampNanos = mRing.getLong(offset + 8);
+                    byte[] advData = new byte[SCAN_RING_ADV_DATA_LENGTH];
+                    mRing.position(offset + 16);
+                    mRing.get(advData);
+                    long clientMask = mRing.getLong(offset + 80);
+                    consumed++;
+
+                    onScanResult(Utils.getAddressStringFromByte(address), rssi, advData,
+                            timestampNanos, clientMask);
+                }
+            }
+        }
+    }
+
     class ClientDeathRecipient implements IBinder.DeathRecipient {
         int mAppIf;
 
@@ -586,12 +725,24 @@ public class GattService extends ProfileService {
      * Callback functions - CLIENT
      *************************************************************************/
 
-    void onScanResult(String address, int rssi, byte[] adv_data) {
+    void onScanResult(String address, int rssi, byte[] adv_data, long clientMask) {
+        onScanResult(address, rssi, adv_data, SystemClock.elapsedRealtimeNanos(), clientMask);
+    }
+
+    // clientMask holds the native scan filter slots the result matched.
+    void onScanResult(String address, int rssi, byte[] adv_data, long timestampNanos,
+            long clientMask) {
         if (VDBG) Log.d(TAG, "onScanResult() - address=" + address
                     + ", rssi=" + rssi);
-        List<UUID> remoteUuids = parseUuids(adv_data);
+        List<UUID> remoteUuids = null;
         for (ScanClient client : mScanManager.getRegularScanQueue()) {
-            if (client.uuids.length > 0) {
+            if (client.scanFilterSlot >= 0
+                    && (clientMask & (1L << client.scanFilterSlot)) == 0) {
+                continue;
+            }
+
+            if (!client.filteredNatively && client.uuids.length > 0) {
+                if (remoteUuids == null) remoteUuids = parseUuids(adv_data);
                 int matches = 0;
                 for (UUID search : client.uuids) {
                     for (UUID remote: remoteUuids) {
@@ -611,8 +762,8 @@ public class GattService extends ProfileService {
                     BluetoothDevice device = BluetoothAdapter.getDefaultAdapter()
                             .getRemoteDevice(address);
                     ScanResult result = new ScanResult(device, ScanRecord.parseFromBytes(adv_data),
-                            rssi, SystemClock.elapsedRealtimeNanos());
-                    if (matchesFilters(client, result)) {
+                            rssi, timestampNanos);
+                    if (client.filteredNatively || matchesFilters(client, result)) {
                         try {
                             ScanSettings settings = client.settings;
                             // framework detects the first match, hw signal is
@@ -652,6 +803,22 @@ public class GattService extends ProfileService {
         }
     }
 
+    // Batched scan results, see SCAN_RESULT_RECORD_SIZE for the record layout.
+    void onScanResults(byte[] packed, int count) {
+        if (VDBG) Log.d(TAG, "onScanResults() - count=" + count);
+        ByteBuffer records = ByteBuffer.wrap(packed).order(ByteOrder.nativeOrder());
+        byte[] address = new byte[6];
+        for (int i = 0; i < count; i++) {
+            int offset = i * SCAN_RESULT_RECORD_SIZE;
+            System.arraycopy(packed, offset, address, 0, address.length);
+            int rssi = packed[offset + 6];
+            byte[] advData = Arrays.copyOfRange(packed, offset + 7,
+                    offset + 7 + SCAN_RESULT_ADV_DATA_LENGTH);
+            long clientMask = records.getLong(offset + 7 + SCAN_RESULT_ADV_DATA_LENGTH);
+            onScanResult(Utils.getAddressStringFromByte(address), rssi, advData, clientMask);
+        }
+    }
+
     // Check if a scan record matches a specific filters.
     private boolean matchesFilters(ScanClient client, ScanResult scanResult) {
         if (client.filters == null || client.filters.isEmpty()) {
@@ -686,7 +853,10 @@ public class GattService extends ProfileService {
         if (DBG) Log.d(TAG, "onConnected() - clientIf=" + clientIf
             + ", connId=" + connId + ", address=" + address);
 
-        if (status == 0) mClientMap.addConnection(clientIf, connId, address);
+        if (status == 0) {
+            mClientMap.addConnection(clientIf, connId, address);
+            configureNotifyBatching(connId, address);
+        }
         ClientMap.App app = mClientMap.getById(clientIf);
         if (app != null) {
             app.callback.onClientConnectionState(status, clientIf,
@@ -701,6 +871,7 @@ public class GattService extends ProfileService {
 
         mClientMap.removeConnection(clientIf, connId);
         mSearchQueue.removeConnId(connId);
+        mNotifyTokens.removeConnId(connId);
         ClientMap.App app = mClientMap.getById(clientIf);
         if (app != null) {
             app.callback.onClientConnectionState(status, clientIf, false, address);
@@ -829,6 +1000,48 @@ public class GattService extends ProfileService {
         }
     }
 
+    void onDiscoveryTable(int connId, int status, byte[] table) throws RemoteException {
+        String address = mClientMap.addressByConnId(connId);
+        if (DBG) Log.d(TAG, "onDiscoveryTable() - address=" + address + ", status=" + status
+            + ", attributes=" + table.length / DISCOVERY_RECORD_SIZE);
+
+        ClientMap.App app = mClientMap.getByConnId(connId);
+        if (app == null) return;
+
+        ByteBuffer buf = ByteBuffer.wrap(table).order(ByteOrder.LITTLE_ENDIAN);
+        for (int offset = 0; offset + DISCOVERY_RECORD_SIZE <= table.length;
+                offset += DISCOVERY_RECORD_SIZE) {
+            int type = buf.get(offset);
+            int srvcType = buf.get(offset + 1);
+            int srvcInstId = buf.get(offset + 2) & 0xFF;
+            int instId = buf.get(offset + 3) & 0xFF;
+            ParcelUuid srvcUuid = new ParcelUuid(
+                new UUID(buf.getLong(offset + 16), buf.getLong(offset + 8)));
+            ParcelUuid uuid = new ParcelUuid(
+                new UUID(buf.getLong(offset + 32), buf.getLong(offset + 24)));
+
+            switch (type) {
+                case DISCOVERY_TYPE_SERVICE:
+                    app.callback.onGetService(address, srvcType, srvcInstId, srvcUuid);
+                    break;
+                case DISCOVERY_TYPE_CHARACTERISTIC:
+                    app.callback.onGetCharacteristic(address, srvcType, srvcInstId, srvcUuid,
+                        instId, uuid, buf.get(offset + 6) & 0xFF);
+                    break;
+                case DISCOVERY_TYPE_DESCRIPTOR:
+                    app.callback.onGetDescriptor(address, srvcType, srvcInstId, srvcUuid,
+                        instId, uuid, buf.get(offset + 5) & 0xFF, new ParcelUuid(
+                            new UUID(buf.getLong(offset + 48), buf.getLong(offset + 40))));
+                    break;
+                case DISCOVERY_TYPE_INCLUDED_SERVICE:
+                    app.callback.onGetIncludedService(address, srvcType, srvcInstId, srvcUuid,
+                        buf.get(offset + 4), instId, uuid);
+                    break;
+            }
+        }
+        app.callback.onSearchComplete(address, status);
+    }
+
     void onRegisterForNotifications(int connId, int status, int registered, int srvcType,
             int srvcInstId, long srvcUuidLsb, long srvcUuidMsb,
             int charInstId, long charUuidLsb, long charUuidMsb) {
@@ -866,6 +1079,72 @@ public class GattService extends ProfileService {
         }
     }
 
+    private void configureNotifyBatching(int connId, String address) {
+        int windowMillis = SystemProperties.getInt(NOTIFY_BATCH_WINDOW_PROPERTY, 0);
+        if (windowMillis <= 0 || !isNotifyBatchDevice(address)) return;
+        int maxBytes = SystemProperties.getInt(NOTIFY_BATCH_BYTES_PROPERTY,
+                DEFAULT_NOTIFY_BATCH_BYTES);
+        if (DBG) Log.d(TAG, "configureNotifyBatching() - connId=" + connId
+            + ", window=" + windowMillis + "ms, bytes=" + maxBytes);
+        gattClientSetNotifyBatchingNative(connId, windowMillis, maxBytes);
+    }
+
+    private static boolean isNotifyBatchDevice(String address) {
+        String devices = SystemProperties.get(NOTIFY_BATCH_DEVICES_PROPERTY, "");
+        for (String device : devices.split(",")) {
+            if (device.trim().equalsIgnoreCase(address)) return true;
+        }
+        return false;
+    }
+
+    // Notifications of characteristics in mNotifyTokens, batched per connection.
+    // Values are packed with a 2 byte little endian length in front of each.
+    void onNotifyBatch(int connId, int[] tokens, long[] timestampsNanos, byte[] values)
+            throws RemoteException {
+        if (VDBG) Log.d(TAG, "onNotifyBatch() - connId=" + connId
+            + ", count=" + tokens.length + ", span="
+            + (timestampsNanos[tokens.length - 1] - timestampsNanos[0]) + "ns");
+
+        ClientMap.App app = mClientMap.getByConnId(connId);
+        if (app == null) return;
+
+        int offset = 0;
+        for (int i = 0; i < tokens.length; i++) {
+            int len = (values[offset] & 0xFF) | ((values[offset + 1] & 0xFF) << 8);
+            offset += 2;
+            NotifyTokenMap.Entry entry = mNotifyTokens.get(tokens[i]);
+            if (entry != null && (!entry.isHid
+                    || 0 == checkCallingOrSelfPermission(BLUETOOTH_PRIVILEGED))) {
+                app.callback.onNotify(entry.address, entry.srvcType,
+                            entry.srvcInstId, entry.srvcUuid,
+                            entry.charInstId, entry.charUuid,
+                            Arrays.copyOfRange(values, offset, offset + len));
+            }
+            offset += len;
+        }
+    }
+
+    // Notification of a characteristic registered in mNotifyTokens.
+    void onNotifyCompact(int token, byte[] data) throws RemoteException {
+        NotifyTokenMap.Entry entry = mNotifyTokens.get(token);
+        if (entry == null) return;
+
+        if (VDBG) Log.d(TAG, "onNotifyCompact() - address=" + entry.address
+            + ", charUuid=" + entry.charUuid + ", length=" + data.length);
+
+        if (entry.isHid && (0 != checkCallingOrSelfPermission(BLUETOOTH_PRIVILEGED))) {
+            return;
+        }
+
+        ClientMap.App app = mClientMap.getByConnId(entry.connId);
+        if (app != null) {
+            app.callback.onNotify(entry.address, entry.srvcType,
+                        entry.srvcInstId, entry.srvcUuid,
+                        entry.charInstId, entry.charUuid,
+                        data);
+        }
+    }
+
     void onReadCharacteristic(int connId, int status, int srvcType,
             int srvcInstId, long srvcUuidLsb, long srvcUuidMsb,
             int charInstId, long charUuidLsb, long charUuidMsb,
@@ -1007,6 +1286,10 @@ public class GattService extends ProfileService {
                     + ", availableSpace=" + availableSpace);
         }
 
+        // Action 0 is add; the space left lets the filter slot allocator stop early.
+        if (action == 0 && status == 0) {
+            mScanManager.scanFilterSpaceReported(filterType, availableSpace);
+        }
         mScanManager.callbackDone(clientIf, status);
     }
 
@@ -1026,14 +1309,16 @@ public class GattService extends ProfileService {
         mScanManager.callbackDone(clientIf, status);
     }
 
-    void onBatchScanReports(int status, int clientIf, int reportType, int numRecords,
-            byte[] recordData) throws RemoteException {
+    void onBatchScanReports(int status, int clientIf, int reportType, long[] addresses,
+            byte[] txPower, byte[] rssi, int[] timestampDeltaMillis, int[] payloadOffsets,
+            byte[] payloads) throws RemoteException {
         if (DBG) {
             Log.d(TAG, "onBatchScanReports() - clientIf=" + clientIf + ", status=" + status
-                    + ", reportType=" + reportType + ", numRecords=" + numRecords);
+                    + ", reportType=" + reportType + ", numRecords=" + addresses.length);
         }
         mScanManager.callbackDone(clientIf, status);
-        Set<ScanResult> results = parseBatchScanResults(numRecords, reportType, recordData);
+        Set<ScanResult> results = parseBatchScanResults(addresses, rssi, timestampDeltaMillis,
+                payloadOffsets, payloads);
         if (reportType == ScanManager.SCAN_RESULT_TYPE_TRUNCATED) {
             // We only support single client for truncated mode.
             ClientMap.App app = mClientMap.getById(clientIf);
@@ -1065,33 +1350,29 @@ public class GattService extends ProfileService {
         app.callback.onBatchScanResults(results);
     }
 
-    private Set<ScanResult> parseBatchScanResults(int numRecords, int reportType,
-            byte[] batchRecord) {
+    // The records arrive already decoded, one array entry per record. Truncated reports carry
+    // no payloads; full reports carry the advertising data and scan response back to back.
+    private Set<ScanResult> parseBatchScanResults(long[] addresses, byte[] rssi,
+            int[] timestampDeltaMillis, int[] payloadOffsets, byte[] payloads) {
+        int numRecords = addresses.length;
         if (numRecords == 0) {
             return Collections.emptySet();
         }
         if (DBG) Log.d(TAG, "current time is " + SystemClock.elapsedRealtimeNanos());
-        if (reportType == ScanManager.SCAN_RESULT_TYPE_TRUNCATED) {
-            return parseTruncatedResults(numRecords, batchRecord);
-        } else {
-            return parseFullResults(numRecords, batchRecord);
-        }
-    }
-
-    private Set<ScanResult> parseTruncatedResults(int numRecords, byte[] batchRecord) {
-        if (DBG) Log.d(TAG, "batch record " + Arrays.toString(batchRecord));
         Set<ScanResult> results = new HashSet<ScanResult>(numRecords);
         long now = SystemClock.elapsedRealtimeNanos();
         for (int i = 0; i < numRecords; ++i) {
-            byte[] record = extractBytes(batchRecord, i * TRUNCATED_RESULT_SIZE,
-                    TRUNCATED_RESULT_SIZE);
-            byte[] address = extractBytes(record, 0, 6);
-            reverse(address);
-            BluetoothDevice device = mAdapter.getRemoteDevice(address);
-            int rssi = record[8];
-            long timestampNanos = now - parseTimestampNanos(extractBytes(record, 9, 2));
-            results.add(new ScanResult(device, ScanRecord.parseFromBytes(new byte[0]),
-                    rssi, timestampNanos));
+            BluetoothDevice device = mAdapter.getRemoteDevice(toAddressBytes(addresses[i]));
+            byte[] scanRecord;
+            if (payloads == null) {
+                scanRecord = new byte[0];
+            } else {
+                scanRecord = Arrays.copyOfRange(payloads, payloadOffsets[i],
+                        payloadOffsets[i + 1]);
+            }
+            long timestampNanos = now - TimeUnit.MILLISECONDS.toNanos(timestampDeltaMillis[i]);
+            results.add(new ScanResult(device, ScanRecord.parseFromBytes(scanRecord),
+                    rssi[i], timestampNanos));
         }
         return results;
     }
@@ -1103,57 +1384,13 @@ public class GattService extends ProfileService {
         return TimeUnit.MILLISECONDS.toNanos(timestampUnit * 50);
     }
 
-    private Set<ScanResult> parseFullResults(int numRecords, byte[] batchRecord) {
-        Log.d(TAG, "Batch record : " + Arrays.toString(batchRecord));
-        Set<ScanResult> results = new HashSet<ScanResult>(numRecords);
-        int position = 0;
-        long now = SystemClock.elapsedRealtimeNanos();
-        while (position < batchRecord.length) {
-            byte[] address = extractBytes(batchRecord, position, 6);
-            // TODO: remove temp hack.
-            reverse(address);
-            BluetoothDevice device = mAdapter.getRemoteDevice(address);
-            position += 6;
-            // Skip address type.
-            position++;
-            // Skip tx power level.
-            position++;
-            int rssi = batchRecord[position++];
-            long timestampNanos = now - parseTimestampNanos(extractBytes(batchRecord, position, 2));
-            position += 2;
-
-            // Combine advertise packet and scan response packet.
-            int advertisePacketLen = batchRecord[position++];
-            byte[] advertiseBytes = extractBytes(batchRecord, position, advertisePacketLen);
-            position += advertisePacketLen;
-            int scanResponsePacketLen = batchRecord[position++];
-            byte[] scanResponseBytes = extractBytes(batchRecord, position, scanResponsePacketLen);
-            position += scanResponsePacketLen;
-            byte[] scanRecord = new byte[advertisePacketLen + scanResponsePacketLen];
-            System.arraycopy(advertiseBytes, 0, scanRecord, 0, advertisePacketLen);
-            System.arraycopy(scanResponseBytes, 0, scanRecord,
-                    advertisePacketLen, scanResponsePacketLen);
-            Log.d(TAG, "ScanRecord : " + Arrays.toString(scanRecord));
-            results.add(new ScanResult(device, ScanRecord.parseFromBytes(scanRecord),
-                    rssi, timestampNanos));
-        }
-        return results;
-    }
-
-    // Reverse byte array.
-    private void reverse(byte[] address) {
-        int len = address.length;
-        for (int i = 0; i < len / 2; ++i) {
-            byte b = address[i];
-            address[i] = address[len - 1 - i];
-            address[len - 1 - i] = b;
+    // Addresses are packed with the first printed octet in the most significant byte.
+    private static byte[] toAddressBytes(long address) {
+        byte[] bytes = new byte[MAC_ADDRESS_LENGTH];
+        for (int i = MAC_ADDRESS_LENGTH - 1; i >= 0; --i) {
+            bytes[i] = (byte) address;
+            address >>>= 8;
         }
-    }
-
-    // Helper method to extract bytes from byte array.
-    private static byte[] extractBytes(byte[] scanRecord, int start, int length) {
-        byte[] bytes = new byte[length];
-        System.arraycopy(scanRecord, start, bytes, 0, length);
         return bytes;
     }
 
@@ -1412,6 +1649,18 @@ public class GattService extends ProfileService {
         mAdvertiseManager.stopAdvertising(client);
     }
 
+    /**
+     * Updates the data of a started advertiser, see
+     * AdvertiseManager.updateAdvertisingData. Nothing calls this yet:
+     * IBluetoothGatt, which is defined in the framework, has no matching
+     * method.
+     */
+    boolean updateMultiAdvertisingData(int clientIf, AdvertiseData data,
+            boolean isScanResponse) {
+        enforceAdminPermission();
+        return mAdvertiseManager.updateAdvertisingData(clientIf, data, isScanResponse);
+    }
+
 
     synchronized List<ParcelUuid> getRegisteredServiceUuids() {
         Utils.enforceAdminPermission(this);
@@ -1445,7 +1694,9 @@ public class GattService extends ProfileService {
         Integer connId = mClientMap.connIdByAddress(clientIf, address);
         if (DBG) Log.d(TAG, "discoverServices() - address=" + address + ", connId=" + connId);
 
-        if (connId != null)
+        if (connId != null && SystemProperties.getBoolean(BULK_DISCOVERY_PROPERTY, false))
+            gattClientDiscoverServicesNative(connId);
+        else if (connId != null)
             gattClientSearchServiceNative(connId, true, 0, 0);
         else
             Log.e(TAG, "discoverServices() - No connection for " + address + "...");
@@ -1482,6 +1733,18 @@ public class GattService extends ProfileService {
         if (mReliableQueue.contains(address)) writeType = 3; // Prepared write
 
         Integer connId = mClientMap.connIdByAddress(clientIf, address);
+        if (connId != null && writeType == BluetoothGattCharacteristic.WRITE_TYPE_NO_RESPONSE) {
+            // Values longer than the MTU allows are written in chunks, reported once
+            int window = SystemProperties.getInt(WRITE_WINDOW_PROPERTY, 0);
+            if (window > 0 && gattClientWriteCharacteristicWindowedNative(connId, srvcType,
+                    srvcInstanceId, srvcUuid.getLeastSignificantBits(),
+                    srvcUuid.getMostSignificantBits(), charInstanceId,
+                    charUuid.getLeastSignificantBits(), charUuid.getMostSignificantBits(),
+                    writeType, authReq, value, window)) {
+                return;
+            }
+        }
+
         if (connId != null)
             gattClientWriteCharacteristicNative(connId, srvcType,
                 srvcInstanceId, srvcUuid.getLeastSignificantBits(),
@@ -1569,6 +1832,8 @@ public class GattService extends ProfileService {
 
         Integer connId = mClientMap.connIdByAddress(clientIf, address);
         if (connId != null) {
+            setNotifyToken(connId, address, srvcType, srvcInstanceId, srvcUuid,
+                    charInstanceId, charUuid, enable);
             gattClientRegisterForNotificationsNative(clientIf, address,
                 srvcType, srvcInstanceId, srvcUuid.getLeastSignificantBits(),
                 srvcUuid.getMostSignificantBits(), charInstanceId,
@@ -1579,6 +1844,26 @@ public class GattService extends ProfileService {
         }
     }
 
+    // Let native code deliver notifications of the characteristic as a token.
+    private void setNotifyToken(int connId, String address, int srvcType,
+                int srvcInstanceId, UUID srvcUuid,
+                int charInstanceId, UUID charUuid,
+                boolean enable) {
+        NotifyTokenMap.Entry entry;
+        if (enable) {
+            entry = mNotifyTokens.add(connId, address, srvcType, srvcInstanceId, srvcUuid,
+                    charInstanceId, charUuid, isHidUuid(charUuid));
+        } else {
+            entry = mNotifyTokens.remove(connId, srvcType, srvcInstanceId, srvcUuid,
+                    charInstanceId, charUuid);
+            if (entry == null) return;
+        }
+        gattClientSetNotifyTokenNative(connId, srvcType, srvcInstanceId,
+                srvcUuid.getLeastSignificantBits(), srvcUuid.getMostSignificantBits(),
+                charInstanceId, charUuid.getLeastSignificantBits(),
+                charUuid.getMostSignificantBits(), enable ? entry.token : -1);
+    }
+
     void readRemoteRssi(int clientIf, String address) {
         enforceCallingOrSelfPermission(BLUETOOTH_PERM, "Need BLUETOOTH permission");
 
@@ -1713,6 +1998,11 @@ public class GattService extends ProfileService {
     void onServiceDeleted(int status, int serverIf, int srvcHandle) {
         if (DBG) Log.d(TAG, "onServiceDeleted() srvcHandle=" + srvcHandle
             + ", status=" + status);
+        for (HandleMap.Entry entry : mHandleMap.getEntries()) {
+            if (entry.serverIf == serverIf && entry.serviceHandle == srvcHandle) {
+                gattServerSetAttributeValueNative(entry.handle, null);
+            }
+        }
         mHandleMap.deleteService(serverIf, srvcHandle);
     }
 
@@ -1891,6 +2181,25 @@ public class GattService extends ProfileService {
         }
     }
 
+    // IBluetoothGattServerCallback has no way to report one value sent to several
+    // clients, and sendNotificationMulti() has no callers yet, so this only logs.
+    void onNotificationFanoutDone(int serverIf, int attrHandle, int sent, int failed) {
+        if (DBG) Log.d(TAG, "onNotificationFanoutDone() - serverIf=" + serverIf
+            + ", attrHandle=" + attrHandle + ", sent=" + sent + ", failed=" + failed);
+    }
+
+    void onNotificationStreamProgress(int connId, int attrHandle, int status, int sent,
+            int total) throws RemoteException {
+        if (VDBG) Log.d(TAG, "onNotificationStreamProgress() - connId=" + connId
+            + ", attrHandle=" + attrHandle + ", status=" + status + ", sent=" + sent
+            + "/" + total);
+
+        // The application sent one value and learns once that it went out
+        if (status != BluetoothGatt.GATT_SUCCESS || sent == total) {
+            onNotificationSent(connId, status);
+        }
+    }
+
     void onMtuChanged(int connId, int mtu) throws RemoteException {
         if (DBG) Log.d(TAG, "onMtuChanged() - connId=" + connId + ", mtu=" + mtu);
 
@@ -2072,6 +2381,116 @@ public class GattService extends ProfileService {
         }
     }
 
+    /**
+     * Notifies every listed client of a new characteristic value. The value
+     * crosses into native code once and completion is reported once for
+     * all clients, to onNotificationFanoutDone.
+     *
+     * Nothing calls this yet: IBluetoothGatt, which is defined in the
+     * framework, has no matching method, so applications cannot reach it
+     * and the completion is only logged.
+     */
+    void sendNotificationMulti(int serverIf, List<String> addresses, int srvcType,
+                               int srvcInstanceId, UUID srvcUuid,
+                               int charInstanceId, UUID charUuid, byte[] value) {
+        enforceCallingOrSelfPermission(BLUETOOTH_PERM, "Need BLUETOOTH permission");
+
+        if (VDBG) Log.d(TAG, "sendNotificationMulti() - clients=" + addresses.size());
+
+        int srvcHandle = mHandleMap.getServiceHandle(srvcUuid, srvcType, srvcInstanceId);
+        if (srvcHandle == 0) return;
+
+        int charHandle = mHandleMap.getCharacteristicHandle(srvcHandle, charUuid, charInstanceId);
+        if (charHandle == 0) return;
+
+        List<Integer> connIds = new ArrayList<Integer>();
+        for (String address : addresses) {
+            Integer connId = mServerMap.connIdByAddress(serverIf, address);
+            if (connId != null) connIds.add(connId);
+        }
+        if (connIds.isEmpty()) return;
+
+        int[] ids = new int[connIds.size()];
+        for (int i = 0; i < ids.length; i++) ids[i] = connIds.get(i);
+
+        if (!gattServerSendNotificationMultiNative(serverIf, charHandle, ids, value)) {
+            for (int connId : ids) {
+                gattServerSendNotificationNative(serverIf, charHandle, connId, value);
+            }
+        }
+    }
+
+    /**
+     * Streams a value too long for one notification to a client, in
+     * notifications that fill the MTU of the connection. Completion is
+     * reported once, with onNotificationSent.
+     *
+     * Returns false, and reports nothing, if the client is still being sent
+     * a value or the stream cannot be started; the caller retries after the
+     * previous value was reported. Nothing calls this yet: IBluetoothGatt,
+     * which is defined in the framework, has no matching method.
+     */
+    boolean sendNotificationStream(int serverIf, String address, int srvcType,
+                                   int srvcInstanceId, UUID srvcUuid,
+                                   int charInstanceId, UUID charUuid, byte[] value) {
+        enforceCallingOrSelfPermission(BLUETOOTH_PERM, "Need BLUETOOTH permission");
+
+        if (VDBG) Log.d(TAG, "sendNotificationStream() - address=" + address
+            + ", length=" + value.length);
+
+        int srvcHandle = mHandleMap.getServiceHandle(srvcUuid, srvcType, srvcInstanceId);
+        if (srvcHandle == 0) return false;
+
+        int charHandle = mHandleMap.getCharacteristicHandle(srvcHandle, charUuid, charInstanceId);
+        if (charHandle == 0) return false;
+
+        Integer connId = mServerMap.connIdByAddress(serverIf, address);
+        if (connId == null) return false;
+
+        // Sliced notifications would interleave with a value still streaming
+        if (!gattServerSendNotificationStreamNative(serverIf, charHandle, connId, value)) {
+            Log.w(TAG, "sendNotificationStream() - stream to " + address + " not started");
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Stores the value of a characteristic so that reads of it are answered
+     * without a round trip to the server application. A null value hands
+     * the reads back to the application.
+     */
+    void setCharacteristicValue(int serverIf, int srvcType, int srvcInstanceId,
+                                UUID srvcUuid, int charInstanceId, UUID charUuid,
+                                byte[] value) {
+        enforceCallingOrSelfPermission(BLUETOOTH_PERM, "Need BLUETOOTH permission");
+
+        if (VDBG) Log.d(TAG, "setCharacteristicValue() - uuid=" + charUuid);
+
+        int charHandle = getServerCharacteristicHandle(serverIf, srvcType, srvcInstanceId,
+                                                       srvcUuid, charInstanceId, charUuid);
+        if (charHandle == 0) return;
+
+        gattServerSetAttributeValueNative(charHandle, value);
+    }
+
+    /**
+     * Returns the handle of a characteristic of one of serverIf's services,
+     * or 0 if there is none.
+     */
+    int getServerCharacteristicHandle(int serverIf, int srvcType, int srvcInstanceId,
+                                      UUID srvcUuid, int charInstanceId, UUID charUuid) {
+        int srvcHandle = mHandleMap.getServiceHandle(srvcUuid, srvcType, srvcInstanceId);
+        if (srvcHandle == 0) return 0;
+
+        int charHandle = mHandleMap.getCharacteristicHandle(srvcHandle, charUuid, charInstanceId);
+        if (charHandle == 0) return 0;
+
+        HandleMap.Entry entry = mHandleMap.getByHandle(charHandle);
+        if (entry == null || entry.serverIf != serverIf) return 0;
+        return charHandle;
+    }
+
 
     /**************************************************************************
      * Private functions
@@ -2311,6 +2730,17 @@ public class GattService extends ProfileService {
         }
         println(sb, "mMaxScanFilters: " + mMaxScanFilters);
 
+        int[] upcallQueueStats = gattGetUpcallQueueStatsNative();
+        if (upcallQueueStats != null) {
+            println(sb, "Upcall queue: capacity=" + upcallQueueStats[0]
+                    + " depth=" + upcallQueueStats[1]
+                    + " highWater=" + upcallQueueStats[2]
+                    + " dropped=" + upcallQueueStats[3]);
+        }
+        if (mScanResultRingReader != null) {
+            println(sb, "Scan result ring: dropped=" + mScanResultRingReader.getDropped());
+        }
+
         sb.append("\nGATT Client Map\n");
         mClientMap.dump(sb);
 
@@ -2335,6 +2765,12 @@ public class GattService extends ProfileService {
             gattTestNative(command, 0,0, bda1, p1, p2, p3, p4, p5);
     }
 
+    private native void gattServerSetPrepWriteLimitNative(int maxBytes);
+
+    private native void gattServerSetSubscriptionFilterNative(boolean filter);
+
+    private native void gattServerSetAttributeValueNative(int handle, byte[] value);
+
     private native void gattTestNative(int command,
                                     long uuid1_lsb, long uuid1_msb, String bda1,
                                     int p1, int p2, int p3, int p4, int p5);
@@ -2344,9 +2780,17 @@ public class GattService extends ProfileService {
      *************************************************************************/
 
     private native static void classInitNative();
-    private native void initializeNative();
+    private native void initializeNative(boolean useUpcallQueue, int scanResultRingSize);
     private native void cleanupNative();
 
+    private native int[] gattGetUpcallQueueStatsNative();
+
+    private native ByteBuffer gattGetScanResultRingNative();
+
+    private native long gattWaitScanResultRingNative(int consumed, int timeoutMillis);
+
+    private native void gattStopScanResultRingNative();
+
     private native int gattClientGetDeviceTypeNative(String address);
 
     private native void gattClientRegisterAppNative(long app_uuid_lsb,
@@ -2365,6 +2809,8 @@ public class GattService extends ProfileService {
     private native void gattClientSearchServiceNative(int conn_id,
             boolean search_all, long service_uuid_lsb, long service_uuid_msb);
 
+    private native void gattClientDiscoverServicesNative(int conn_id);
+
     private native void gattClientGetCharacteristicNative(int conn_id,
             int service_type, int service_id_inst_id, long service_id_uuid_lsb,
             long service_id_uuid_msb, int char_id_inst_id, long char_id_uuid_lsb,
@@ -2403,6 +2849,11 @@ public class GattService extends ProfileService {
             int descr_id_inst_id, long descr_id_uuid_lsb, long descr_id_uuid_msb,
             int write_type, int auth_req, byte[] value);
 
+    private native boolean gattClientWriteCharacteristicWindowedNative(int conn_id,
+            int service_type, int service_id_inst_id, long service_id_uuid_lsb,
+            long service_id_uuid_msb, int char_id_inst_id, long char_id_uuid_lsb,
+            long char_id_uuid_msb, int write_type, int auth_req, byte[] value, int window);
+
     private native void gattClientExecuteWriteNative(int conn_id, boolean execute);
 
     private native void gattClientRegisterForNotificationsNative(int clientIf,
@@ -2414,6 +2865,15 @@ public class GattService extends ProfileService {
     private native void gattClientReadRemoteRssiNative(int clientIf,
             String address);
 
+    private native void gattClientSetNotifyTokenNative(int connId,
+            int srvcType, int srvcInstId, long srvcUuidLsb, long srvcUuidMsb,
+            int charInstId, long charUuidLsb, long charUuidMsb, int token);
+
+    private native void gattClientSetNotifyBatchingNative(int connId, int windowMillis,
+            int maxBytes);
+
+    private native void gattClientSetAttributeCacheDirNative(String dir);
+
     private native void gattClientConfigureMTUNative(int conn_id, int mtu);
 
     private native void gattConnectionParameterUpdateNative(int client_if, String address,
@@ -2461,6 +2921,12 @@ public class GattService extends ProfileService {
     private native void gattServerSendNotificationNative (int server_if,
             int attr_handle, int conn_id, byte[] val);
 
+    private native boolean gattServerSendNotificationMultiNative(int server_if,
+            int attr_handle, int[] conn_ids, byte[] val);
+
+    private native boolean gattServerSendNotificationStreamNative(int server_if,
+            int attr_handle, int conn_id, byte[] val);
+
     private native void gattServerSendResponseNative (int server_if,
             int conn_id, int trans_id, int status, int handle, int offset,
             byte[] val, int auth_req);
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+package com.android.bluetooth.gatt;
+
+import android.os.ParcelUuid;
+
+import java.util.HashMap;
+import java.util.Iterator;
+import java.util.Map;
+import java.util.UUID;
+
+/**
+ * Tokens standing for notified characteristics of a connection.
+ *
+ * Native code delivers notifications of a characteristic with a token as
+ * the token and the value only; the address and IDs are kept here, ready
+ * to be passed to the client.
+ * @hide
+ */
+/*package*/ class NotifyTokenMap {
+    class Entry {
+        public int token;
+        public int connId;
+        public String address;
+        public int srvcType;
+        public int srvcInstId;
+        public ParcelUuid srvcUuid;
+        public int charInstId;
+        public ParcelUuid charUuid;
+        public boolean isHid;
+    }
+
+    private final Map<Integer, Entry> mEntries = new HashMap<Integer, Entry>();
+    private int mNextToken = 0;
+
+    synchronized Entry add(int connId, String address, int srvcType,
+            int srvcInstId, UUID srvcUuid, int charInstId, UUID charUuid, boolean isHid) {
+        Entry entry = find(connId, srvcType, srvcInstId, srvcUuid, charInstId, charUuid);
+        if (entry != null) return entry;
+
+        entry = new Entry();
+        // Tokens are never negative; native code uses -1 for none
+        entry.token = mNextToken;
+        mNextToken = (mNextToken + 1) & Integer.MAX_VALUE;
+        entry.connId = connId;
+        entry.address = address;
+        entry.srvcType = srvcType;
+        entry.srvcInstId = srvcInstId;
+        entry.srvcUuid = new ParcelUuid(srvcUuid);
+        entry.charInstId = charInstId;
+        entry.charUuid = new ParcelUuid(charUuid);
+        entry.isHid = isHid;
+        mEntries.put(entry.token, entry);
+        return entry;
+    }
+
+    synchronized Entry get(int token) {
+        return mEntries.get(token);
+    }
+
+    synchronized Entry remove(int connId, int srvcType,
+            int srvcInstId, UUID srvcUuid, int charInstId, UUID charUuid) {
+        Entry entry = find(connId, srvcType, srvcInstId, srvcUuid, charInstId, charUuid);
+        if (entry != null) mEntries.remove(entry.token);
+        return entry;
+    }
+
+    synchronized void removeConnId(int connId) {
+        for (Iterator<Entry> it = mEntries.values().iterator(); it.hasNext();) {
+            if (it.next().connId == connId) it.remove();
+        }
+    }
+
+    synchronized void clear() {
+        mEntries.clear();
+    }
+
+    // Registrations are rare next to notifications, so a scan is fine here
+    private Entry find(int connId, int srvcType,
+            int srvcInstId, UUID srvcUuid, int charInstId, UUID charUuid) {
+        for (Entry entry : mEntries.values()) {
+            if (entry.connId == connId && entry.srvcType == srvcType
+                    && entry.srvcInstId == srvcInstId && entry.charInstId == charInstId
+                    && entry.srvcUuid.getUuid().equals(srvcUuid)
+                    && entry.charUuid.getUuid().equals(charUuid)) {
+                return entry;
+            }
+        }
+        return null;
+    }
+}
@@ -38,6 +38,10 @@ import java.util.UUID;
     List<List<ResultStorageDescriptor>> storages;
     // App associated with the scan client died.
     boolean appDied;
+    // Native software scan filter slot of a regular scan client, -1 if none.
+    int scanFilterSlot = -1;
+    // Whether the native scan filters cover all of uuids and filters.
+    boolean filteredNatively;
 
     private static final ScanSettings DEFAULT_SCAN_SETTINGS = new ScanSettings.Builder()
             .setScanMode(ScanSettings.SCAN_MODE_LOW_LATENCY).build();
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+package com.android.bluetooth.gatt;
+
+import java.util.ArrayDeque;
+import java.util.ArrayList;
+import java.util.Deque;
+import java.util.HashMap;
+import java.util.Iterator;
+import java.util.List;
+import java.util.Map;
+
+/**
+ * Hands out controller scan filter indices to client scan filters.
+ *
+ * Filters that test a single feature are merged: every such filter with the same feature and
+ * delivery shares one filter index, with the entries of that feature ORed, for example the
+ * addresses of many asset tags. Other filters get an index of their own with every feature
+ * ANDed. A merged index lets through results that only match another client's filter;
+ * GattService checks each result against the client's own filters before delivering it.
+ *
+ * @hide
+ */
+/* package */class ScanFilterSlotAllocator {
+    // The logic is AND for each filter field.
+    static final int LIST_LOGIC_AND = 0x1111111;
+    // Entries of a merged index are ORed.
+    static final int LIST_LOGIC_OR = 0;
+
+    /**
+     * A filter index and the entries programmed into it.
+     */
+    static class Slot {
+        final int filterIndex;
+        // Client the index was configured for; merged indices keep their first client.
+        final int clientIf;
+        final int featureSelection;
+        final int listLogicType;
+        final String mergeKey;
+        // Number of client filters using each entry.
+        private final Map<ScanFilterQueue.Entry, Integer> mEntryRefs =
+                new HashMap<ScanFilterQueue.Entry, Integer>();
+        private final Map<Integer, List<ScanFilterQueue.Entry>> mClientEntries =
+                new HashMap<Integer, List<ScanFilterQueue.Entry>>();
+
+        Slot(int filterIndex, int clientIf, int featureSelection, String mergeKey) {
+            this.filterIndex = filterIndex;
+            this.clientIf = clientIf;
+            this.featureSelection = featureSelection;
+            this.listLogicType = mergeKey == null ? LIST_LOGIC_AND : LIST_LOGIC_OR;
+            this.mergeKey = mergeKey;
+        }
+
+        // Returns the entries that are new to the slot.
+        private List<ScanFilterQueue.Entry> add(int clientIf, List<ScanFilterQueue.Entry> entries) {
+            List<ScanFilterQueue.Entry> added = new ArrayList<ScanFilterQueue.Entry>();
+            List<ScanFilterQueue.Entry> clientEntries = mClientEntries.get(clientIf);
+            if (clientEntries == null) {
+                clientEntries = new ArrayList<ScanFilterQueue.Entry>();
+                mClientEntries.put(clientIf, clientEntries);
+            }
+            for (ScanFilterQueue.Entry entry : entries) {
+                Integer refs = mEntryRefs.get(entry);
+                if (refs == null) {
+                    refs = 0;
+                    added.add(entry);
+                }
+                mEntryRefs.put(entry, refs + 1);
+                clientEntries.add(entry);
+            }
+            return added;
+        }
+
+        // Takes back the entries of one add(), leaving the client's earlier entries alone.
+        private void undo(int clientIf, List<ScanFilterQueue.Entry> entries) {
+            List<ScanFilterQueue.Entry> clientEntries = mClientEntries.get(clientIf);
+            for (ScanFilterQueue.Entry entry : entries) {
+                clientEntries.remove(clientEntries.lastIndexOf(entry));
+                int refs = mEntryRefs.get(entry) - 1;
+                if (refs == 0) {
+                    mEntryRefs.remove(entry);
+                } else {
+                    mEntryRefs.put(entry, refs);
+                }
+            }
+            if (clientEntries.isEmpty()) {
+                mClientEntries.remove(clientIf);
+            }
+        }
+
+        // Returns the entries no other client uses.
+        private List<ScanFilterQueue.Entry> remove(int clientIf) {
+            List<ScanFilterQueue.Entry> removed = new ArrayList<ScanFilterQueue.Entry>();
+            List<ScanFilterQueue.Entry> clientEntries = mClientEntries.remove(clientIf);
+            if (clientEntries == null) {
+                return removed;
+            }
+            for (ScanFilterQueue.Entry entry : clientEntries) {
+                int refs = mEntryRefs.get(entry) - 1;
+                if (refs == 0) {
+                    mEntryRefs.remove(entry);
+                    removed.add(entry);
+                } else {
+                    mEntryRefs.put(entry, refs);
+                }
+            }
+            return removed;
+        }
+
+        boolean hasClient(int clientIf) {
+            return mClientEntries.containsKey(clientIf);
+        }
+
+        boolean isEmpty() {
+            return mClientEntries.isEmpty();
+        }
+
+        int size() {
+            return mEntryRefs.size();
+        }
+    }
+
+    /**
+     * What to program into the controller for one client filter.
+     */
+    static class Allocation {
+        final Slot slot;
+        // True if the filter parameters of the index still need to be set.
+        final boolean newSlot;
+        final List<ScanFilterQueue.Entry> addedEntries;
+
+        Allocation(Slot slot, boolean newSlot, List<ScanFilterQueue.Entry> addedEntries) {
+            this.slot = slot;
+            this.newSlot = newSlot;
+            this.addedEntries = addedEntries;
+        }
+    }
+
+    /**
+     * What to remove from the controller when a client leaves a slot.
+     */
+    static class Release {
+        final Slot slot;
+        // True if the whole index is free again.
+        final boolean freed;
+        final List<ScanFilterQueue.Entry> removedEntries;
+
+        Release(Slot slot, boolean freed, List<ScanFilterQueue.Entry> removedEntries) {
+            this.slot = slot;
+            this.freed = freed;
+            this.removedEntries = removedEntries;
+        }
+    }
+
+    private final Deque<Integer> mFreeIndices = new ArrayDeque<Integer>();
+    private final Map<Integer, Slot> mSlots = new HashMap<Integer, Slot>();
+    private final Map<String, Slot> mMergedSlots = new HashMap<String, Slot>();
+    // Entries the controller still has room for, per filter type, as last reported.
+    private final Map<Integer, Integer> mAvailableSpace = new HashMap<Integer, Integer>();
+    private boolean mInitialized;
+
+    /**
+     * Makes filter indices [firstIndex, endIndex) available.
+     */
+    void init(int firstIndex, int endIndex) {
+        mFreeIndices.clear();
+        mSlots.clear();
+        mMergedSlots.clear();
+        for (int i = firstIndex; i < endIndex; ++i) {
+            mFreeIndices.add(i);
+        }
+        mInitialized = true;
+    }
+
+    boolean isInitialized() {
+        return mInitialized;
+    }
+
+    int getFreeIndexCount() {
+        return mFreeIndices.size();
+    }
+
+    int getSlotCount() {
+        return mSlots.size();
+    }
+
+    Slot getSlot(int filterIndex) {
+        return mSlots.get(filterIndex);
+    }
+
+    /**
+     * Records the space the controller reported after adding an entry of filterType.
+     */
+    synchronized void setAvailableSpace(int filterType, int availableSpace) {
+        mAvailableSpace.put(filterType, availableSpace);
+    }
+
+    private synchronized boolean hasSpace(List<ScanFilterQueue.Entry> entries) {
+        Map<Integer, Integer> needed = new HashMap<Integer, Integer>();
+        for (ScanFilterQueue.Entry entry : entries) {
+            Integer count = needed.get((int) entry.type);
+            needed.put((int) entry.type, count == null ? 1 : count + 1);
+        }
+        for (Map.Entry<Integer, Integer> need : needed.entrySet()) {
+            Integer space = mAvailableSpace.get(need.getKey());
+            if (space != null && space < need.getValue()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Finds a filter index for the filter in queue, which is drained. Filters are only merged
+     * with others of the same delivery key; a null key keeps the filter on its own index.
+     * Returns null if the controller has no index or entry space left.
+     */
+    Allocation allocate(int clientIf, ScanFilterQueue queue, String deliveryKey) {
+        int featureSelection = queue.getFeatureSelection();
+        List<ScanFilterQueue.Entry> entries = new ArrayList<ScanFilterQueue.Entry>();
+        while (!queue.isEmpty()) {
+            entries.add(queue.pop());
+        }
+
+        String mergeKey = getMergeKey(featureSelection, entries.size(), deliveryKey);
+        Slot slot = mergeKey == null ? null : mMergedSlots.get(mergeKey);
+        if (slot != null) {
+            List<ScanFilterQueue.Entry> added = slot.add(clientIf, entries);
+            if (!hasSpace(added)) {
+                // Nothing of this call was programmed yet; what is, stays with its users.
+                slot.undo(clientIf, entries);
+                if (slot.isEmpty()) {
+                    freeSlot(slot);
+                }
+                return null;
+            }
+            return new Allocation(slot, false, added);
+        }
+
+        if (mFreeIndices.isEmpty() || !hasSpace(entries)) {
+            return null;
+        }
+        slot = new Slot(mFreeIndices.pop(), clientIf, featureSelection, mergeKey);
+        slot.add(clientIf, entries);
+        mSlots.put(slot.filterIndex, slot);
+        if (mergeKey != null) {
+            mMergedSlots.put(mergeKey, slot);
+        }
+        return new Allocation(slot, true, entries);
+    }
+
+    /**
+     * Takes the client out of every slot it uses. Freed indices become available again.
+     */
+    List<Release> release(int clientIf) {
+        List<Release> releases = new ArrayList<Release>();
+        for (Iterator<Slot> it = mSlots.values().iterator(); it.hasNext();) {
+            Slot slot = it.next();
+            if (!slot.hasClient(clientIf)) {
+                continue;
+            }
+            List<ScanFilterQueue.Entry> removed = slot.remove(clientIf);
+            boolean freed = slot.isEmpty();
+            if (freed) {
+                it.remove();
+                freeSlot(slot);
+            }
+            releases.add(new Release(slot, freed, removed));
+        }
+        return releases;
+    }
+
+    private void freeSlot(Slot slot) {
+        mSlots.remove(slot.filterIndex);
+        if (slot.mergeKey != null) {
+            mMergedSlots.remove(slot.mergeKey);
+        }
+        mFreeIndices.push(slot.filterIndex);
+    }
+
+    // Filters testing one feature with one entry can be ORed with others like them.
+    private static String getMergeKey(int featureSelection, int numEntries, String deliveryKey) {
+        if (deliveryKey == null || numEntries != 1 || Integer.bitCount(featureSelection) != 1) {
+            return null;
+        }
+        return featureSelection + "/" + deliveryKey;
+    }
+}
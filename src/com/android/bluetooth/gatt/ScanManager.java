@@ -30,17 +30,18 @@ import android.os.HandlerThread;
 import android.os.Looper;
 import android.os.Message;
 import android.os.SystemClock;
+import android.os.ParcelUuid;
+import android.os.SystemProperties;
 import android.util.Log;
 
 import com.android.bluetooth.Utils;
 import com.android.bluetooth.btservice.AdapterService;
 
-import java.util.ArrayDeque;
-import java.util.Deque;
-import java.util.HashMap;
+import java.util.ArrayList;
 import java.util.HashSet;
-import java.util.Map;
+import java.util.List;
 import java.util.Set;
+import java.util.UUID;
 import java.util.concurrent.CountDownLatch;
 import java.util.concurrent.TimeUnit;
 
@@ -58,6 +59,11 @@ public class ScanManager {
     static final int SCAN_RESULT_TYPE_FULL = 2;
     static final int SCAN_RESULT_TYPE_BOTH = 3;
 
+    // Delivery mode defined in bt stack.
+    static final int DELIVERY_MODE_IMMEDIATE = 0;
+    static final int DELIVERY_MODE_ON_FOUND_LOST = 1;
+    static final int DELIVERY_MODE_BATCH = 2;
+
     // Internal messages for handling BLE scan operations.
     private static final int MSG_START_BLE_SCAN = 0;
     private static final int MSG_STOP_BLE_SCAN = 1;
@@ -69,6 +75,11 @@ public class ScanManager {
     // Timeout for each controller operation.
     private static final int OPERATION_TIME_OUT_MILLIS = 500;
 
+    // Emulate controller scan filters in native code when the controller has none.
+    private static final String SCAN_FILTER_EMULATION_PROPERTY = "persist.bt.gatt.soft_apcf";
+    // Filter indices the native emulation provides, matching APCF_MAX_FILTERS.
+    private static final int EMULATED_SCAN_FILTER_COUNT = 32;
+
     private int mLastConfiguredScanSetting = Integer.MIN_VALUE;
     // Scan parameters for batch scan.
     private BatchScanParams mBatchScanParms;
@@ -162,6 +173,10 @@ public class ScanManager {
         // TODO: add a callback for scan failure.
     }
 
+    void scanFilterSpaceReported(int filterType, int availableSpace) {
+        mScanNative.setScanFilterSpace(filterType, availableSpace);
+    }
+
     private void sendMessage(int what, ScanClient client) {
         Message message = new Message();
         message.what = what;
@@ -174,6 +189,39 @@ public class ScanManager {
         return adapter.isOffloadedFilteringSupported();
     }
 
+    // Controllers without scan filters can have them emulated in native code. The emulation
+    // covers immediate and found/lost delivery; batch delivery still needs the controller.
+    private boolean isScanFilterEmulated() {
+        return !isFilteringSupported()
+                && SystemProperties.getBoolean(SCAN_FILTER_EMULATION_PROPERTY, false);
+    }
+
+    // Whether a scan with the settings can run on the controller.
+    static boolean isScanSupported(ScanSettings settings, boolean filteringSupported,
+            boolean filterEmulated) {
+        if (settings == null || filteringSupported) {
+            return true;
+        }
+        if (settings.getReportDelayMillis() != 0) {
+            return false;
+        }
+        return filterEmulated
+                || settings.getCallbackType() == ScanSettings.CALLBACK_TYPE_ALL_MATCHES;
+    }
+
+    // Get delivery mode based on scan settings.
+    static int getDeliveryMode(ScanSettings settings) {
+        if (settings == null) {
+            return DELIVERY_MODE_IMMEDIATE;
+        }
+        if ((settings.getCallbackType() & ScanSettings.CALLBACK_TYPE_FIRST_MATCH) != 0
+                || (settings.getCallbackType() & ScanSettings.CALLBACK_TYPE_MATCH_LOST) != 0) {
+            return DELIVERY_MODE_ON_FOUND_LOST;
+        }
+        return settings.getReportDelayMillis() == 0 ? DELIVERY_MODE_IMMEDIATE
+                : DELIVERY_MODE_BATCH;
+    }
+
     // Handler class that handles BLE scan operations.
     private class ClientHandler extends Handler {
 
@@ -257,15 +305,11 @@ public class ScanManager {
         }
 
         private boolean isScanSupported(ScanClient client) {
-            if (client == null || client.settings == null) {
-                return true;
-            }
-            ScanSettings settings = client.settings;
-            if (isFilteringSupported()) {
+            if (client == null) {
                 return true;
             }
-            return settings.getCallbackType() == ScanSettings.CALLBACK_TYPE_ALL_MATCHES &&
-                    settings.getReportDelayMillis() == 0;
+            return ScanManager.isScanSupported(client.settings, isFilteringSupported(),
+                    isScanFilterEmulated());
         }
     }
 
@@ -298,12 +342,54 @@ public class ScanManager {
         }
     }
 
-    private class ScanNative {
+    /**
+     * Clients whose results come through an ALL_PASS filter, one filter for regular and one
+     * for batch delivery. A filter is set for the first client of its delivery and deleted
+     * after the last. Overflow clients have filters of their own that did not fit in the
+     * controller.
+     */
+    static class AllPassClients {
+        private final Set<Integer> mRegularClients = new HashSet<Integer>();
+        private final Set<Integer> mBatchClients = new HashSet<Integer>();
+        private final Set<Integer> mOverflowClients = new HashSet<Integer>();
+
+        // Returns true if the ALL_PASS filter of the delivery has to be set.
+        boolean add(int clientIf, boolean batch) {
+            Set<Integer> clients = batch ? mBatchClients : mRegularClients;
+            clients.add(clientIf);
+            return clients.size() == 1;
+        }
+
+        // Returns true if the client was the last and the ALL_PASS filter has to be deleted.
+        boolean remove(int clientIf, boolean batch) {
+            Set<Integer> clients = batch ? mBatchClients : mRegularClients;
+            return clients.remove(clientIf) && clients.isEmpty();
+        }
+
+        boolean contains(int clientIf, boolean batch) {
+            return (batch ? mBatchClients : mRegularClients).contains(clientIf);
+        }
+
+        // Same as add(), for a client whose own filters did not fit.
+        boolean addOverflow(int clientIf, boolean batch) {
+            mOverflowClients.add(clientIf);
+            return add(clientIf, batch);
+        }
+
+        void removeOverflow(int clientIf) {
+            mOverflowClients.remove(clientIf);
+        }
 
-        // Delivery mode defined in bt stack.
-        private static final int DELIVERY_MODE_IMMEDIATE = 0;
-        private static final int DELIVERY_MODE_ON_FOUND_LOST = 1;
-        private static final int DELIVERY_MODE_BATCH = 2;
+        boolean isOverflow(int clientIf) {
+            return mOverflowClients.contains(clientIf);
+        }
+
+        List<Integer> getOverflowClients() {
+            return new ArrayList<Integer>(mOverflowClients);
+        }
+    }
+
+    private class ScanNative {
 
         private static final int DEFAULT_ONLOST_ONFOUND_TIMEOUT_MILLIS = 1000;
         private static final int ONFOUND_SIGHTINGS = 2;
@@ -324,6 +410,28 @@ public class ScanManager {
         private static final int SCAN_MODE_LOW_LATENCY_WINDOW_MS = 5000;
         private static final int SCAN_MODE_LOW_LATENCY_INTERVAL_MS = 5000;
 
+        /**
+         * Native batching of regular scan results. Results are delivered every
+         * flush window or once the record limit is reached; a window of 0
+         * turns batching off. Low latency scans are never batched.
+         */
+        private static final String SCAN_RESULT_BATCH_WINDOW_PROPERTY =
+                "persist.bt.gatt.scan_batch_ms";
+        private static final String SCAN_RESULT_BATCH_RECORDS_PROPERTY =
+                "persist.bt.gatt.scan_batch_records";
+        private static final int DEFAULT_SCAN_RESULT_BATCH_RECORDS = 32;
+
+        /**
+         * Native suppression of repeated advertisements. The same payload from the same device
+         * is reported once per window unless its RSSI changes by the given delta; a window of 0
+         * turns suppression off. Low latency clients keep receiving every result.
+         */
+        private static final String SCAN_DEDUP_WINDOW_PROPERTY =
+                "persist.bt.gatt.scan_dedup_ms";
+        private static final String SCAN_DEDUP_RSSI_DELTA_PROPERTY =
+                "persist.bt.gatt.scan_dedup_rssi";
+        private static final int DEFAULT_SCAN_DEDUP_RSSI_DELTA = 10;
+
         /**
          * Scan params corresponding to batch scan setting
          */
@@ -334,24 +442,19 @@ public class ScanManager {
         private static final int SCAN_MODE_BATCH_LOW_LATENCY_WINDOW_MS = 1500;
         private static final int SCAN_MODE_BATCH_LOW_LATENCY_INTERVAL_MS = 5000;
 
-        // The logic is AND for each filter field.
-        private static final int LIST_LOGIC_TYPE = 0x1111111;
+        // Longest manufacturer or service data native software filters compare.
+        private static final int MAX_SOFT_FILTER_DATA_LENGTH = 62;
+
         private static final int FILTER_LOGIC_TYPE = 1;
-        // Filter indices that are available to user. It's sad we need to maintain filter index.
-        private final Deque<Integer> mFilterIndexStack;
-        // Map of clientIf and Filter indices used by client.
-        private final Map<Integer, Deque<Integer>> mClientFilterIndexMap;
+        // Filter indices that are available to user, shared by clients where possible.
+        private final ScanFilterSlotAllocator mSlotAllocator = new ScanFilterSlotAllocator();
         // Keep track of the clients that uses ALL_PASS filters.
-        private final Set<Integer> mAllPassRegularClients = new HashSet<>();
-        private final Set<Integer> mAllPassBatchClients = new HashSet<>();
+        private final AllPassClients mAllPassClients = new AllPassClients();
 
         private AlarmManager mAlarmManager;
         private PendingIntent mBatchScanIntervalIntent;
 
         ScanNative() {
-            mFilterIndexStack = new ArrayDeque<Integer>();
-            mClientFilterIndexMap = new HashMap<Integer, Deque<Integer>>();
-
             mAlarmManager = (AlarmManager) mService.getSystemService(Context.ALARM_SERVICE);
             Intent batchIntent = new Intent(ACTION_REFRESH_BATCHED_SCAN, null);
             mBatchScanIntervalIntent = PendingIntent.getBroadcast(mService, 0, batchIntent, 0);
@@ -428,6 +531,7 @@ public class ScanManager {
                     scanInterval = Utils.millsToUnit(scanInterval);
                     gattClientScanNative(false);
                     gattSetScanParametersNative(scanInterval, scanWindow);
+                    configureScanResultBatching(curScanSetting);
                     gattClientScanNative(true);
                     mLastConfiguredScanSetting = curScanSetting;
                 }
@@ -437,6 +541,19 @@ public class ScanManager {
             }
         }
 
+        private void configureScanResultBatching(int scanSetting) {
+            int windowMillis = 0;
+            int maxRecords = 0;
+            if (scanSetting != ScanSettings.SCAN_MODE_LOW_LATENCY) {
+                windowMillis = SystemProperties.getInt(SCAN_RESULT_BATCH_WINDOW_PROPERTY, 0);
+                maxRecords = SystemProperties.getInt(SCAN_RESULT_BATCH_RECORDS_PROPERTY,
+                        DEFAULT_SCAN_RESULT_BATCH_RECORDS);
+            }
+            logd("configureScanResultBatching() - window=" + windowMillis
+                    + "ms records=" + maxRecords);
+            gattSetScanResultBatchingNative(windowMillis, maxRecords);
+        }
+
         ScanClient getAggressiveClient(Set<ScanClient> cList) {
             ScanClient result = null;
             int curScanSetting = Integer.MIN_VALUE;
@@ -452,11 +569,19 @@ public class ScanManager {
         }
 
         void startRegularScan(ScanClient client) {
-            if (isFilteringSupported() && mFilterIndexStack.isEmpty() &&
-                    mClientFilterIndexMap.isEmpty()) {
+            configureSoftScanFilters(client);
+            // Configuring suppression forgets all exemptions, so it comes first.
+            if (mRegularScanClients.size() == 1) {
+                configureScanDedup();
+            }
+            if (isScanDedupExempt(client)) {
+                gattSetScanDedupExemptNative(client.scanFilterSlot, true);
+            }
+            boolean filteringAvailable = isFilteringSupported() || isScanFilterEmulated();
+            if (filteringAvailable && !mSlotAllocator.isInitialized()) {
                 initFilterIndexStack();
             }
-            if (isFilteringSupported()) {
+            if (filteringAvailable) {
                 configureScanFilters(client);
             }
             // Start scan native only for the first client.
@@ -465,8 +590,22 @@ public class ScanManager {
             }
         }
 
+        private void configureScanDedup() {
+            int windowMillis = SystemProperties.getInt(SCAN_DEDUP_WINDOW_PROPERTY, 0);
+            int rssiDelta = SystemProperties.getInt(SCAN_DEDUP_RSSI_DELTA_PROPERTY,
+                    DEFAULT_SCAN_DEDUP_RSSI_DELTA);
+            logd("configureScanDedup() - window=" + windowMillis + "ms rssi=" + rssiDelta);
+            gattSetScanDedupNative(windowMillis, rssiDelta);
+        }
+
+        // ScanSettings has no way to ask for repeats, so clients that want every advertisement
+        // are recognized by their scan mode, as for result batching.
+        private boolean isScanDedupExempt(ScanClient client) {
+            return client.settings.getScanMode() == ScanSettings.SCAN_MODE_LOW_LATENCY;
+        }
+
         void startBatchScan(ScanClient client) {
-            if (mFilterIndexStack.isEmpty() && isFilteringSupported()) {
+            if (!mSlotAllocator.isInitialized() && isFilteringSupported()) {
                 initFilterIndexStack();
             }
             configureScanFilters(client);
@@ -589,6 +728,13 @@ public class ScanManager {
         void stopRegularScan(ScanClient client) {
             // Remove scan filters and recycle filter indices.
             removeScanFilters(client.clientIf);
+            ScanClient regularClient = getRegularScanClient(client.clientIf);
+            if (regularClient != null) {
+                if (isScanDedupExempt(regularClient)) {
+                    gattSetScanDedupExemptNative(regularClient.scanFilterSlot, false);
+                }
+                gattSoftScanFilterUnregisterNative(regularClient.scanFilterSlot);
+            }
             mRegularScanClients.remove(client);
             if (mRegularScanClients.isEmpty()) {
                 logd("stop scan");
@@ -654,36 +800,117 @@ public class ScanManager {
             waitForCallback();
 
             if (shouldUseAllPassFilter(client)) {
-                int filterIndex = (deliveryMode == DELIVERY_MODE_BATCH) ?
-                        ALL_PASS_FILTER_INDEX_BATCH_SCAN : ALL_PASS_FILTER_INDEX_REGULAR_SCAN;
-                resetCountDownLatch();
-                configureFilterParamter(clientIf, client, ALL_PASS_FILTER_SELECTION, filterIndex);
-                waitForCallback();
-            } else {
-                Deque<Integer> clientFilterIndices = new ArrayDeque<Integer>();
-                int featureSelection;
-                int filterIndex;
-                for (ScanFilter filter : client.filters) {
-                    ScanFilterQueue queue = new ScanFilterQueue();
-                    if (null != queue) {
-                        queue.addScanFilter(filter);
-                        featureSelection = queue.getFeatureSelection();
-                        filterIndex = mFilterIndexStack.pop();
-                        while (!queue.isEmpty()) {
-                            resetCountDownLatch();
-                            addFilterToController(clientIf, queue.pop(), filterIndex);
-                            waitForCallback();
-                        }
-                        resetCountDownLatch();
-                        configureFilterParamter(clientIf, client, featureSelection, filterIndex);
-                        waitForCallback();
-                        clientFilterIndices.add(filterIndex);
-                    }
+                configureAllPassFilter(client, deliveryMode);
+            } else if (!addClientFilters(client, deliveryMode)) {
+                // Out of filter indices or entry space: rely on the filtering done in
+                // GattService until a slot frees up.
+                Log.w(TAG, "No room for scan filters of client " + clientIf + ", using ALL_PASS");
+                releaseSlots(clientIf);
+                if (deliveryMode == DELIVERY_MODE_ON_FOUND_LOST) {
+                    Log.e(TAG, "Cannot offload found/lost filters of client " + clientIf);
+                    return;
+                }
+                if (mAllPassClients.addOverflow(clientIf, deliveryMode == DELIVERY_MODE_BATCH)) {
+                    configureAllPassFilter(client, deliveryMode);
+                }
+            }
+        }
+
+        private void configureAllPassFilter(ScanClient client, int deliveryMode) {
+            int filterIndex = (deliveryMode == DELIVERY_MODE_BATCH) ?
+                    ALL_PASS_FILTER_INDEX_BATCH_SCAN : ALL_PASS_FILTER_INDEX_REGULAR_SCAN;
+            resetCountDownLatch();
+            configureFilterParamter(client.clientIf, client, ALL_PASS_FILTER_SELECTION,
+                    filterIndex, ScanFilterSlotAllocator.LIST_LOGIC_AND);
+            waitForCallback();
+        }
+
+        // Programs the client's filters, sharing filter indices with other clients where
+        // the filters allow it. Returns false if the controller ran out of room.
+        private boolean addClientFilters(ScanClient client, int deliveryMode) {
+            int clientIf = client.clientIf;
+            // Found/lost tracking is per filter index, so those filters are never merged.
+            String deliveryKey = (deliveryMode == DELIVERY_MODE_ON_FOUND_LOST) ? null
+                    : deliveryMode + "/" + getOnfoundLostTimeout(client);
+            for (ScanFilter filter : client.filters) {
+                ScanFilterQueue queue = new ScanFilterQueue();
+                queue.addScanFilter(filter);
+                ScanFilterSlotAllocator.Allocation allocation =
+                        mSlotAllocator.allocate(clientIf, queue, deliveryKey);
+                if (allocation == null) {
+                    return false;
+                }
+                ScanFilterSlotAllocator.Slot slot = allocation.slot;
+                for (ScanFilterQueue.Entry entry : allocation.addedEntries) {
+                    resetCountDownLatch();
+                    addFilterToController(slot.clientIf, entry, slot.filterIndex, true);
+                    waitForCallback();
+                }
+                if (allocation.newSlot) {
+                    resetCountDownLatch();
+                    configureFilterParamter(slot.clientIf, client, slot.featureSelection,
+                            slot.filterIndex, slot.listLogicType);
+                    waitForCallback();
+                }
+            }
+            return true;
+        }
+
+        // Removes the client from its filter indices, deleting what no other client uses.
+        private void releaseSlots(int clientIf) {
+            for (ScanFilterSlotAllocator.Release release : mSlotAllocator.release(clientIf)) {
+                ScanFilterSlotAllocator.Slot slot = release.slot;
+                if (release.freed) {
+                    resetCountDownLatch();
+                    gattClientScanFilterParamDeleteNative(slot.clientIf, slot.filterIndex);
+                    waitForCallback();
+                    // Clear the entries too, so they do not leak into the next user.
+                    resetCountDownLatch();
+                    gattClientScanFilterClearNative(slot.clientIf, slot.filterIndex);
+                    waitForCallback();
+                    continue;
+                }
+                for (ScanFilterQueue.Entry entry : release.removedEntries) {
+                    resetCountDownLatch();
+                    addFilterToController(slot.clientIf, entry, slot.filterIndex, false);
+                    waitForCallback();
+                }
+            }
+        }
+
+        // Gives clients that fell back to ALL_PASS another try at their own filters.
+        private void repackOverflowClients() {
+            List<Integer> overflowClients = mAllPassClients.getOverflowClients();
+            if (overflowClients.isEmpty() || mSlotAllocator.getFreeIndexCount() == 0) {
+                return;
+            }
+            for (Integer clientIf : overflowClients) {
+                ScanClient client = getRegularScanClient(clientIf);
+                if (client == null) {
+                    client = getBatchScanClient(clientIf);
+                }
+                if (client == null) {
+                    mAllPassClients.removeOverflow(clientIf);
+                    continue;
+                }
+                int deliveryMode = getDeliveryMode(client);
+                if (!addClientFilters(client, deliveryMode)) {
+                    releaseSlots(clientIf);
+                    return;
+                }
+                mAllPassClients.removeOverflow(clientIf);
+                if (deliveryMode == DELIVERY_MODE_BATCH) {
+                    removeFilterIfExisits(true, clientIf, ALL_PASS_FILTER_INDEX_BATCH_SCAN);
+                } else {
+                    removeFilterIfExisits(false, clientIf, ALL_PASS_FILTER_INDEX_REGULAR_SCAN);
                 }
-                mClientFilterIndexMap.put(clientIf, clientFilterIndices);
             }
         }
 
+        void setScanFilterSpace(int filterType, int availableSpace) {
+            mSlotAllocator.setAvailableSpace(filterType, availableSpace);
+        }
+
         // Check whether the filter should be added to controller.
         // Note only on ALL_PASS filter should be added.
         private boolean shouldAddAllPassFilterToController(ScanClient client, int deliveryMode) {
@@ -692,45 +919,141 @@ public class ScanManager {
                 return true;
             }
 
-            if (deliveryMode == DELIVERY_MODE_BATCH) {
-                mAllPassBatchClients.add(client.clientIf);
-                return mAllPassBatchClients.size() == 1;
-            } else {
-                mAllPassRegularClients.add(client.clientIf);
-                return mAllPassRegularClients.size() == 1;
-            }
+            return mAllPassClients.add(client.clientIf, deliveryMode == DELIVERY_MODE_BATCH);
         }
 
         private void removeScanFilters(int clientIf) {
-            Deque<Integer> filterIndices = mClientFilterIndexMap.remove(clientIf);
-            if (filterIndices != null) {
-                mFilterIndexStack.addAll(filterIndices);
-                for (Integer filterIndex : filterIndices) {
-                    resetCountDownLatch();
-                    gattClientScanFilterParamDeleteNative(clientIf, filterIndex);
-                    waitForCallback();
-                }
-            }
+            releaseSlots(clientIf);
+            mAllPassClients.removeOverflow(clientIf);
             // Remove if ALL_PASS filters are used.
-            removeFilterIfExisits(mAllPassRegularClients, clientIf,
-                    ALL_PASS_FILTER_INDEX_REGULAR_SCAN);
-            removeFilterIfExisits(mAllPassBatchClients, clientIf,
-                    ALL_PASS_FILTER_INDEX_BATCH_SCAN);
+            removeFilterIfExisits(false, clientIf, ALL_PASS_FILTER_INDEX_REGULAR_SCAN);
+            removeFilterIfExisits(true, clientIf, ALL_PASS_FILTER_INDEX_BATCH_SCAN);
+            repackOverflowClients();
         }
 
-        private void removeFilterIfExisits(Set<Integer> clients, int clientIf, int filterIndex) {
-            if (!clients.contains(clientIf)) {
-                return;
-            }
-            clients.remove(clientIf);
+        private void removeFilterIfExisits(boolean batch, int clientIf, int filterIndex) {
             // Remove ALL_PASS filter iff no app is using it.
-            if (clients.isEmpty()) {
+            if (mAllPassClients.remove(clientIf, batch)) {
                 resetCountDownLatch();
                 gattClientScanFilterParamDeleteNative(clientIf, filterIndex);
                 waitForCallback();
             }
         }
 
+        private ScanClient getRegularScanClient(int clientIf) {
+            for (ScanClient client : mRegularScanClients) {
+                if (client.clientIf == clientIf) {
+                    return client;
+                }
+            }
+            return null;
+        }
+
+        // Mirror the client's filters in native code, so results that match no client are
+        // dropped before reaching GattService. Clients whose filters cannot be expressed
+        // natively match everything there and keep being filtered in Java.
+        private void configureSoftScanFilters(ScanClient client) {
+            client.scanFilterSlot = gattSoftScanFilterRegisterNative(client.clientIf);
+            client.filteredNatively = false;
+            if (client.scanFilterSlot < 0) {
+                return;
+            }
+
+            boolean hasUuids = client.uuids != null && client.uuids.length > 0;
+            boolean hasFilters = client.filters != null && !client.filters.isEmpty();
+            if (hasUuids && hasFilters) {
+                return;
+            }
+            if (hasFilters) {
+                for (ScanFilter filter : client.filters) {
+                    if (!isSoftFilterSupported(filter)) {
+                        return;
+                    }
+                    // A filter without criteria accepts everything, and so does the client.
+                    if (isSoftFilterEmpty(filter)) {
+                        client.filteredNatively = true;
+                        return;
+                    }
+                }
+                int filterIndex = 0;
+                for (ScanFilter filter : client.filters) {
+                    addSoftScanFilter(client.scanFilterSlot, filterIndex++, filter);
+                }
+            } else if (hasUuids) {
+                // Legacy scans need every UUID to be present: one filter with all of them.
+                for (UUID uuid : client.uuids) {
+                    addSoftScanFilterUuid(client.scanFilterSlot, 0,
+                            ScanFilterQueue.TYPE_SERVICE_UUID, uuid, null);
+                }
+            }
+            client.filteredNatively = true;
+        }
+
+        private boolean isSoftFilterSupported(ScanFilter filter) {
+            if (filter.getManufacturerId() >= 0 && !isSoftFilterDataSupported(
+                    filter.getManufacturerData(), filter.getManufacturerDataMask())) {
+                return false;
+            }
+            if (filter.getServiceDataUuid() != null && !isSoftFilterDataSupported(
+                    filter.getServiceData(), filter.getServiceDataMask())) {
+                return false;
+            }
+            return true;
+        }
+
+        private boolean isSoftFilterDataSupported(byte[] data, byte[] mask) {
+            if (data == null || data.length > MAX_SOFT_FILTER_DATA_LENGTH) {
+                return false;
+            }
+            return mask == null || mask.length == data.length;
+        }
+
+        private boolean isSoftFilterEmpty(ScanFilter filter) {
+            return filter.getDeviceName() == null && filter.getDeviceAddress() == null
+                    && filter.getServiceUuid() == null && filter.getManufacturerId() < 0
+                    && filter.getServiceDataUuid() == null;
+        }
+
+        private void addSoftScanFilter(int slot, int filterIndex, ScanFilter filter) {
+            if (filter.getDeviceName() != null) {
+                gattSoftScanFilterAddNative(slot, filterIndex, ScanFilterQueue.TYPE_LOCAL_NAME, 0,
+                        0, 0, 0, 0, filter.getDeviceName(), null, null, null);
+            }
+            if (filter.getDeviceAddress() != null) {
+                gattSoftScanFilterAddNative(slot, filterIndex,
+                        ScanFilterQueue.TYPE_DEVICE_ADDRESS, 0, 0, 0, 0, 0, null,
+                        filter.getDeviceAddress(), null, null);
+            }
+            if (filter.getServiceUuid() != null) {
+                ParcelUuid mask = filter.getServiceUuidMask();
+                addSoftScanFilterUuid(slot, filterIndex, ScanFilterQueue.TYPE_SERVICE_UUID,
+                        filter.getServiceUuid().getUuid(), mask == null ? null : mask.getUuid());
+            }
+            if (filter.getManufacturerId() >= 0) {
+                gattSoftScanFilterAddNative(slot, filterIndex,
+                        ScanFilterQueue.TYPE_MANUFACTURER_DATA, filter.getManufacturerId(), 0, 0,
+                        0, 0, null, null, filter.getManufacturerData(),
+                        filter.getManufacturerDataMask());
+            }
+            if (filter.getServiceDataUuid() != null) {
+                UUID uuid = filter.getServiceDataUuid().getUuid();
+                gattSoftScanFilterAddNative(slot, filterIndex, ScanFilterQueue.TYPE_SERVICE_DATA,
+                        0, uuid.getLeastSignificantBits(), uuid.getMostSignificantBits(), 0, 0,
+                        null, null, filter.getServiceData(), filter.getServiceDataMask());
+            }
+        }
+
+        private void addSoftScanFilterUuid(int slot, int filterIndex, int type, UUID uuid,
+                UUID mask) {
+            if (mask == null) {
+                mask = new UUID(-1L, -1L);
+            }
+            gattSoftScanFilterAddNative(slot, filterIndex, type, 0,
+                    uuid.getLeastSignificantBits(), uuid.getMostSignificantBits(),
+                    mask.getLeastSignificantBits(), mask.getMostSignificantBits(), null, null,
+                    null, null);
+        }
+
         private ScanClient getBatchScanClient(int clientIf) {
             for (ScanClient client : mBatchClients) {
                 if (client.clientIf == clientIf) {
@@ -768,25 +1091,25 @@ public class ScanManager {
         }
 
         private void addFilterToController(int clientIf, ScanFilterQueue.Entry entry,
-                int filterIndex) {
-            logd("addFilterToController: " + entry.type);
+                int filterIndex, boolean add) {
+            logd("addFilterToController: " + entry.type + " add=" + add);
             switch (entry.type) {
                 case ScanFilterQueue.TYPE_DEVICE_ADDRESS:
                     logd("add address " + entry.address);
-                    gattClientScanFilterAddNative(clientIf, entry.type, filterIndex, 0, 0, 0, 0, 0,
+                    scanFilterAddRemove(add, clientIf, entry.type, filterIndex, 0, 0, 0, 0, 0,
                             0,
                             "", entry.address, (byte) 0, new byte[0], new byte[0]);
                     break;
 
                 case ScanFilterQueue.TYPE_SERVICE_DATA:
-                    gattClientScanFilterAddNative(clientIf, entry.type, filterIndex, 0, 0, 0, 0, 0,
+                    scanFilterAddRemove(add, clientIf, entry.type, filterIndex, 0, 0, 0, 0, 0,
                             0,
                             "", "", (byte) 0, entry.data, entry.data_mask);
                     break;
 
                 case ScanFilterQueue.TYPE_SERVICE_UUID:
                 case ScanFilterQueue.TYPE_SOLICIT_UUID:
-                    gattClientScanFilterAddNative(clientIf, entry.type, filterIndex, 0, 0,
+                    scanFilterAddRemove(add, clientIf, entry.type, filterIndex, 0, 0,
                             entry.uuid.getLeastSignificantBits(),
                             entry.uuid.getMostSignificantBits(),
                             entry.uuid_mask.getLeastSignificantBits(),
@@ -796,7 +1119,7 @@ public class ScanManager {
 
                 case ScanFilterQueue.TYPE_LOCAL_NAME:
                     logd("adding filters: " + entry.name);
-                    gattClientScanFilterAddNative(clientIf, entry.type, filterIndex, 0, 0, 0, 0, 0,
+                    scanFilterAddRemove(add, clientIf, entry.type, filterIndex, 0, 0, 0, 0, 0,
                             0,
                             entry.name, "", (byte) 0, new byte[0], new byte[0]);
                     break;
@@ -805,54 +1128,58 @@ public class ScanManager {
                     int len = entry.data.length;
                     if (entry.data_mask.length != len)
                         return;
-                    gattClientScanFilterAddNative(clientIf, entry.type, filterIndex, entry.company,
+                    scanFilterAddRemove(add, clientIf, entry.type, filterIndex, entry.company,
                             entry.company_mask, 0, 0, 0, 0, "", "", (byte) 0,
                             entry.data, entry.data_mask);
                     break;
             }
         }
 
+        // Adds the filter entry, or removes it when add is false.
+        private void scanFilterAddRemove(boolean add, int clientIf, int filterType,
+                int filterIndex, int companyId, int companyIdMask, long uuidLsb, long uuidMsb,
+                long uuidMaskLsb, long uuidMaskMsb, String name, String address, byte addrType,
+                byte[] data, byte[] mask) {
+            if (add) {
+                gattClientScanFilterAddNative(clientIf, filterType, filterIndex, companyId,
+                        companyIdMask, uuidLsb, uuidMsb, uuidMaskLsb, uuidMaskMsb, name, address,
+                        addrType, data, mask);
+            } else {
+                gattClientScanFilterDeleteNative(clientIf, filterType, filterIndex, companyId,
+                        companyIdMask, uuidLsb, uuidMsb, uuidMaskLsb, uuidMaskMsb, name, address,
+                        addrType, data, mask);
+            }
+        }
+
         private void initFilterIndexStack() {
             AdapterService adapterService;
             if (null != (adapterService = AdapterService.getAdapterService())) {
-                int maxFiltersSupported = adapterService.getNumOfOffloadedScanFilterSupported();
+                boolean emulated = isScanFilterEmulated();
+                gattSetScanFilterEmulationNative(emulated);
+                int maxFiltersSupported = emulated ? EMULATED_SCAN_FILTER_COUNT
+                        : adapterService.getNumOfOffloadedScanFilterSupported();
                 // Start from index 3 as:
                 // index 0 is reserved for ALL_PASS filter in Settings app.
                 // index 1 is reserved for ALL_PASS filter for regular scan apps.
                 // index 2 is reserved for ALL_PASS filter for batch scan apps.
-                for (int i = 3; i < maxFiltersSupported; ++i) {
-                    mFilterIndexStack.add(i);
-                }
+                mSlotAllocator.init(3, maxFiltersSupported);
             }
         }
 
         // Configure filter parameters.
         private void configureFilterParamter(int clientIf, ScanClient client, int featureSelection,
-                int filterIndex) {
+                int filterIndex, int listLogicType) {
             int deliveryMode = getDeliveryMode(client);
             int rssiThreshold = Byte.MIN_VALUE;
             int timeout = getOnfoundLostTimeout(client);
             gattClientScanFilterParamAddNative(
-                    clientIf, filterIndex, featureSelection, LIST_LOGIC_TYPE,
+                    clientIf, filterIndex, featureSelection, listLogicType,
                     FILTER_LOGIC_TYPE, rssiThreshold, rssiThreshold, deliveryMode,
                     timeout, timeout, ONFOUND_SIGHTINGS);
         }
 
-        // Get delivery mode based on scan settings.
         private int getDeliveryMode(ScanClient client) {
-            if (client == null) {
-                return DELIVERY_MODE_IMMEDIATE;
-            }
-            ScanSettings settings = client.settings;
-            if (settings == null) {
-                return DELIVERY_MODE_IMMEDIATE;
-            }
-            if ((settings.getCallbackType() & ScanSettings.CALLBACK_TYPE_FIRST_MATCH) != 0
-                    || (settings.getCallbackType() & ScanSettings.CALLBACK_TYPE_MATCH_LOST) != 0) {
-                return DELIVERY_MODE_ON_FOUND_LOST;
-            }
-            return settings.getReportDelayMillis() == 0 ? DELIVERY_MODE_IMMEDIATE
-                    : DELIVERY_MODE_BATCH;
+            return ScanManager.getDeliveryMode(client == null ? null : client.settings);
         }
 
         // Get onfound and onlost timeouts in ms
@@ -870,6 +1197,25 @@ public class ScanManager {
         /************************** Regular scan related native methods **************************/
         private native void gattClientScanNative(boolean start);
 
+        private native void gattSetScanResultBatchingNative(int flush_window_ms,
+                int max_records);
+
+        private native void gattSetScanDedupNative(int window_ms, int rssi_delta);
+
+        private native void gattSetScanDedupExemptNative(int slot, boolean exempt);
+
+        private native void gattSetScanFilterEmulationNative(boolean enable);
+
+        /************************** Software filter related native methods ***********************/
+        private native int gattSoftScanFilterRegisterNative(int client_if);
+
+        private native void gattSoftScanFilterUnregisterNative(int slot);
+
+        private native void gattSoftScanFilterAddNative(int slot, int filter_index,
+                int filter_type, int company_id, long uuid_lsb, long uuid_msb,
+                long uuid_mask_lsb, long uuid_mask_msb, String name, String address,
+                byte[] data, byte[] mask);
+
         private native void gattSetScanParametersNative(int scan_interval,
                 int scan_window);
 
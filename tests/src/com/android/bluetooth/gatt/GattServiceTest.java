@@ -6,6 +6,8 @@ import android.test.suitebuilder.annotation.SmallTest;
 
 import com.android.bluetooth.gatt.GattService;
 
+import java.util.UUID;
+
 /**
  * Test cases for {@link GattService}.
  */
@@ -19,4 +21,19 @@ public class GattServiceTest extends AndroidTestCase {
         assertEquals(99700000000L, timestampNanos);
     }
 
+    @SmallTest
+    public void testServerCharacteristicHandle() {
+        GattService service = new GattService();
+        UUID srvcUuid = UUID.fromString("0000180d-0000-1000-8000-00805f9b34fb");
+        UUID charUuid = UUID.fromString("00002a37-0000-1000-8000-00805f9b34fb");
+        service.mHandleMap.addService(1, 40, srvcUuid, 0, 0, false);
+        service.mHandleMap.addCharacteristic(1, 42, charUuid, 40);
+
+        // Values may only be stored for characteristics of the caller's services.
+        assertEquals(42, service.getServerCharacteristicHandle(1, 0, 0, srvcUuid, 0, charUuid));
+        assertEquals(0, service.getServerCharacteristicHandle(2, 0, 0, srvcUuid, 0, charUuid));
+        assertEquals(0, service.getServerCharacteristicHandle(1, 0, 0, srvcUuid, 1, charUuid));
+        assertEquals(0, service.getServerCharacteristicHandle(1, 0, 0, charUuid, 0, charUuid));
+    }
+
 }
@@ -0,0 +1,138 @@
+package com.android.bluetooth.gatt;
+
+import android.test.AndroidTestCase;
+import android.test.suitebuilder.annotation.SmallTest;
+
+import java.util.List;
+
+/**
+ * Test cases for {@link ScanFilterSlotAllocator}.
+ */
+public class ScanFilterSlotAllocatorTest extends AndroidTestCase {
+
+    private static ScanFilterQueue addressQueue(String address) {
+        ScanFilterQueue queue = new ScanFilterQueue();
+        queue.addDeviceAddress(address, (byte) 0);
+        return queue;
+    }
+
+    @SmallTest
+    public void testSingleFeatureFiltersShareIndex() {
+        ScanFilterSlotAllocator allocator = new ScanFilterSlotAllocator();
+        allocator.init(3, 5);
+        ScanFilterSlotAllocator.Allocation first =
+                allocator.allocate(1, addressQueue("00:11:22:33:44:55"), "0/0");
+        ScanFilterSlotAllocator.Allocation second =
+                allocator.allocate(2, addressQueue("00:11:22:33:44:66"), "0/0");
+        assertTrue(first.newSlot);
+        assertFalse(second.newSlot);
+        assertEquals(first.slot.filterIndex, second.slot.filterIndex);
+        assertEquals(ScanFilterSlotAllocator.LIST_LOGIC_OR, first.slot.listLogicType);
+        assertEquals(1, allocator.getFreeIndexCount());
+
+        List<ScanFilterSlotAllocator.Release> releases = allocator.release(1);
+        assertEquals(1, releases.size());
+        assertFalse(releases.get(0).freed);
+        releases = allocator.release(2);
+        assertTrue(releases.get(0).freed);
+        assertEquals(2, allocator.getFreeIndexCount());
+    }
+
+    @SmallTest
+    public void testUnmergeableFilterRunsOutOfIndices() {
+        ScanFilterSlotAllocator allocator = new ScanFilterSlotAllocator();
+        allocator.init(3, 4);
+        assertNotNull(allocator.allocate(1, addressQueue("00:11:22:33:44:55"), null));
+        assertNull(allocator.allocate(2, addressQueue("00:11:22:33:44:55"), null));
+    }
+
+    @SmallTest
+    public void testMergeWithoutSpaceKeepsEarlierEntries() {
+        ScanFilterSlotAllocator allocator = new ScanFilterSlotAllocator();
+        allocator.init(3, 5);
+        ScanFilterSlotAllocator.Allocation first =
+                allocator.allocate(1, addressQueue("00:11:22:33:44:55"), "0/0");
+        int filterIndex = first.slot.filterIndex;
+
+        // The controller is out of address entries: the next merge is rolled back.
+        allocator.setAvailableSpace(ScanFilterQueue.TYPE_DEVICE_ADDRESS, 0);
+        assertNull(allocator.allocate(1, addressQueue("00:11:22:33:44:66"), "0/0"));
+        assertNull(allocator.allocate(2, addressQueue("00:11:22:33:44:77"), "0/0"));
+
+        ScanFilterSlotAllocator.Slot slot = allocator.getSlot(filterIndex);
+        assertNotNull(slot);
+        assertTrue(slot.hasClient(1));
+        assertFalse(slot.hasClient(2));
+        assertEquals(1, slot.size());
+        assertEquals(1, allocator.getFreeIndexCount());
+
+        // Releasing the client deletes its first entry and frees the index.
+        List<ScanFilterSlotAllocator.Release> releases = allocator.release(1);
+        assertEquals(1, releases.size());
+        assertTrue(releases.get(0).freed);
+        assertEquals(1, releases.get(0).removedEntries.size());
+        assertEquals(2, allocator.getFreeIndexCount());
+        assertEquals(0, allocator.getSlotCount());
+    }
+
+    @SmallTest
+    public void testDuplicateEntryRollbackKeepsReference() {
+        ScanFilterSlotAllocator allocator = new ScanFilterSlotAllocator();
+        allocator.init(3, 4);
+        allocator.allocate(1, addressQueue("00:11:22:33:44:55"), "0/0");
+        allocator.allocate(2, addressQueue("00:11:22:33:44:55"), "0/0");
+        allocator.setAvailableSpace(ScanFilterQueue.TYPE_DEVICE_ADDRESS, 0);
+        assertNull(allocator.allocate(2, addressQueue("00:11:22:33:44:66"), "0/0"));
+
+        // Client 1 still shares the entry, so releasing client 2 deletes nothing.
+        List<ScanFilterSlotAllocator.Release> releases = allocator.release(2);
+        assertFalse(releases.get(0).freed);
+        assertTrue(releases.get(0).removedEntries.isEmpty());
+    }
+
+    @SmallTest
+    public void testOverflowClientUsesAllPassFilter() {
+        ScanFilterSlotAllocator allocator = new ScanFilterSlotAllocator();
+        ScanManager.AllPassClients allPass = new ScanManager.AllPassClients();
+        allocator.init(3, 4);
+
+        // The only filter index goes to the first client's own filter.
+        assertNotNull(allocator.allocate(1, addressQueue("00:11:22:33:44:55"), null));
+        assertNull(allocator.allocate(2, addressQueue("00:11:22:33:44:66"), null));
+
+        // The second client falls back to ALL_PASS, which has to be set for it.
+        assertTrue(allPass.addOverflow(2, false));
+        assertTrue(allPass.contains(2, false));
+        assertTrue(allPass.isOverflow(2));
+        assertFalse(allPass.contains(2, true));
+
+        // Another overflow client shares the filter already set.
+        assertNull(allocator.allocate(3, addressQueue("00:11:22:33:44:77"), null));
+        assertFalse(allPass.addOverflow(3, false));
+        assertEquals(2, allPass.getOverflowClients().size());
+
+        // Stopping the first client frees its index for the overflow clients.
+        assertTrue(allocator.release(1).get(0).freed);
+        assertEquals(1, allocator.getFreeIndexCount());
+        assertNotNull(allocator.allocate(2, addressQueue("00:11:22:33:44:66"), null));
+        allPass.removeOverflow(2);
+        assertFalse(allPass.remove(2, false));
+
+        // The filter is deleted with its last client only.
+        allPass.removeOverflow(3);
+        assertTrue(allPass.remove(3, false));
+        assertTrue(allPass.getOverflowClients().isEmpty());
+    }
+
+    @SmallTest
+    public void testAllPassFiltersPerDelivery() {
+        ScanManager.AllPassClients allPass = new ScanManager.AllPassClients();
+        assertTrue(allPass.add(1, false));
+        assertTrue(allPass.add(1, true));
+        assertFalse(allPass.add(2, true));
+        assertFalse(allPass.remove(3, true));
+        assertTrue(allPass.remove(1, false));
+        assertFalse(allPass.remove(1, true));
+        assertTrue(allPass.remove(2, true));
+    }
+}
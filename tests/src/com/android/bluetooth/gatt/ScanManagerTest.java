@@ -0,0 +1,45 @@
+package com.android.bluetooth.gatt;
+
+import android.bluetooth.le.ScanSettings;
+import android.test.AndroidTestCase;
+import android.test.suitebuilder.annotation.SmallTest;
+
+/**
+ * Test cases for {@link ScanManager}.
+ */
+public class ScanManagerTest extends AndroidTestCase {
+
+    private static ScanSettings settings(int callbackType, long reportDelayMillis) {
+        return new ScanSettings.Builder()
+                .setCallbackType(callbackType)
+                .setReportDelay(reportDelayMillis)
+                .build();
+    }
+
+    @SmallTest
+    public void testFoundLostScanWithEmulatedFilters() {
+        ScanSettings foundLost = settings(ScanSettings.CALLBACK_TYPE_FIRST_MATCH
+                | ScanSettings.CALLBACK_TYPE_MATCH_LOST, 0);
+
+        // Admitted with emulated filters and configured for found/lost delivery.
+        assertTrue(ScanManager.isScanSupported(foundLost, false, true));
+        assertEquals(ScanManager.DELIVERY_MODE_ON_FOUND_LOST,
+                ScanManager.getDeliveryMode(foundLost));
+
+        // Without controller or emulated filters there is nothing to track it with.
+        assertFalse(ScanManager.isScanSupported(foundLost, false, false));
+        assertTrue(ScanManager.isScanSupported(foundLost, true, false));
+    }
+
+    @SmallTest
+    public void testBatchScanNeedsControllerFilters() {
+        ScanSettings batch = settings(ScanSettings.CALLBACK_TYPE_ALL_MATCHES, 5000);
+        assertEquals(ScanManager.DELIVERY_MODE_BATCH, ScanManager.getDeliveryMode(batch));
+        assertFalse(ScanManager.isScanSupported(batch, false, true));
+        assertTrue(ScanManager.isScanSupported(batch, true, false));
+
+        ScanSettings regular = settings(ScanSettings.CALLBACK_TYPE_ALL_MATCHES, 0);
+        assertEquals(ScanManager.DELIVERY_MODE_IMMEDIATE, ScanManager.getDeliveryMode(regular));
+        assertTrue(ScanManager.isScanSupported(regular, false, false));
+    }
+}